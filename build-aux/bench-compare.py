@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+#
+# Compares two benchmark runs and reports the differences.
+#
+# Each run is either the output of the bench-* programs (one JSON object
+# per line), or a meson-logs/testlog.json from `meson test --benchmark`,
+# in which case the results are taken from the output of each benchmark.
+#
+#   meson test -C _build --benchmark
+#   cp _build/meson-logs/testlog.json baseline.json
+#   ... make changes, build ...
+#   meson test -C _build --benchmark
+#   build-aux/bench-compare.py baseline.json _build/meson-logs/testlog.json
+#
+# Exits with status 1 when a benchmark got slower by more than the
+# threshold.
+
+import argparse
+import json
+import sys
+
+
+def parse_results(lines, results):
+    for line in lines:
+        line = line.strip()
+        if not line.startswith('{'):
+            continue
+        try:
+            obj = json.loads(line)
+        except ValueError:
+            continue
+        if 'stdout' in obj:
+            parse_results(obj['stdout'].splitlines(), results)
+        elif 'name' in obj and 'ns_per_op' in obj:
+            results[obj['name']] = obj
+
+
+def load(path):
+    results = {}
+    with open(path) as f:
+        parse_results(f, results)
+    return results
+
+
+def format_ns(ns):
+    for unit, scale in (('s', 1e9), ('ms', 1e6), ('us', 1e3)):
+        if ns >= scale:
+            return '%.2f %s' % (ns / scale, unit)
+    return '%.1f ns' % ns
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compare two benchmark runs')
+    parser.add_argument('baseline', help='results of the baseline run')
+    parser.add_argument('current', help='results of the run to compare')
+    parser.add_argument('-t', '--threshold', type=float, default=10.0,
+                        help='percentage slowdown counted as a regression (default 10)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    if not baseline or not current:
+        sys.stderr.write('no benchmark results found\n')
+        return 2
+
+    names = sorted(set(baseline) | set(current))
+    width = max(len(name) for name in names)
+    regressions = 0
+
+    print('%-*s %12s %12s %9s' % (width, 'benchmark', 'baseline', 'current', 'change'))
+    for name in names:
+        if name not in baseline or name not in current:
+            which = baseline if name in baseline else current
+            print('%-*s %12s %12s %9s' % (width, name,
+                  format_ns(baseline[name]['ns_per_op']) if name in baseline else '-',
+                  format_ns(current[name]['ns_per_op']) if name in current else '-',
+                  'new' if which is current else 'gone'))
+            continue
+
+        before = baseline[name]['ns_per_op']
+        after = current[name]['ns_per_op']
+        change = (after - before) * 100.0 / before if before else 0.0
+        marker = ''
+        if change > args.threshold:
+            marker = ' !'
+            regressions += 1
+        print('%-*s %12s %12s %+8.1f%%%s' % (width, name, format_ns(before),
+              format_ns(after), change, marker))
+
+    if regressions:
+        print('\n%d benchmark(s) slower by more than %.0f%%' % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
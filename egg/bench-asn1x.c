@@ -0,0 +1,112 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "egg/egg-asn1-defs.h"
+#include "egg/egg-asn1x.h"
+#include "egg/egg-bench.h"
+
+#include <glib.h>
+
+static const gchar *CERTIFICATES[] = {
+	SRCDIR "/egg/fixtures/test-certificate-1.der",
+	SRCDIR "/gcr/fixtures/cacert.org.cer",
+	SRCDIR "/gcr/fixtures/startcom-intermediate.cer",
+};
+
+static void
+bench_decode (guint64 iterations,
+              gconstpointer data)
+{
+	GBytes *bytes = (GBytes *)data;
+	GNode *asn;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		asn = egg_asn1x_create_and_decode (pkix_asn1_tab, "Certificate", bytes);
+		g_assert (asn != NULL);
+		egg_asn1x_destroy (asn);
+	}
+}
+
+static void
+bench_decode_and_read (guint64 iterations,
+                       gconstpointer data)
+{
+	GBytes *bytes = (GBytes *)data;
+	GBytes *subject;
+	GNode *asn;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		asn = egg_asn1x_create_and_decode (pkix_asn1_tab, "Certificate", bytes);
+		g_assert (asn != NULL);
+		subject = egg_asn1x_get_element_raw (egg_asn1x_node (asn, "tbsCertificate", "subject", NULL));
+		g_assert (subject != NULL);
+		g_bytes_unref (subject);
+		egg_asn1x_destroy (asn);
+	}
+}
+
+static void
+bench_create (guint64 iterations,
+              gconstpointer data)
+{
+	GNode *asn;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		asn = egg_asn1x_create (pkix_asn1_tab, "Certificate");
+		egg_asn1x_destroy (asn);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	GPtrArray *fixtures;
+	GBytes *bytes;
+	gchar *contents;
+	gchar *basename;
+	gchar *name;
+	gsize length;
+	guint i;
+
+	egg_bench_init (&argc, &argv);
+
+	fixtures = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	for (i = 0; i < G_N_ELEMENTS (CERTIFICATES); i++) {
+		if (!g_file_get_contents (CERTIFICATES[i], &contents, &length, NULL))
+			g_assert_not_reached ();
+		bytes = g_bytes_new_take (contents, length);
+		g_ptr_array_add (fixtures, bytes);
+
+		basename = g_path_get_basename (CERTIFICATES[i]);
+		name = g_strdup_printf ("/egg/asn1x/decode/%s", basename);
+		egg_bench_add_sized (name, bytes, bench_decode, length);
+		g_free (name);
+		g_free (basename);
+	}
+
+	egg_bench_add ("/egg/asn1x/decode-and-read-subject", fixtures->pdata[0], bench_decode_and_read);
+	egg_bench_add ("/egg/asn1x/create", NULL, bench_create);
+
+	i = egg_bench_run ();
+	g_ptr_array_unref (fixtures);
+	return i;
+}
@@ -0,0 +1,130 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "egg/egg-armor.h"
+#include "egg/egg-bench.h"
+#include "egg/egg-hex.h"
+#include "egg/egg-secure-memory.h"
+
+#include <glib.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+#define DATA_SIZE 4096
+
+typedef struct {
+	guchar *data;
+	gchar *hex;
+	GBytes *armored;
+	GQuark type;
+} Fixture;
+
+static void
+bench_hex_encode (guint64 iterations,
+                  gconstpointer data)
+{
+	const Fixture *fixture = data;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++)
+		g_free (egg_hex_encode (fixture->data, DATA_SIZE));
+}
+
+static void
+bench_hex_decode (guint64 iterations,
+                  gconstpointer data)
+{
+	const Fixture *fixture = data;
+	gpointer decoded;
+	gsize n_decoded;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		decoded = egg_hex_decode (fixture->hex, -1, &n_decoded);
+		g_assert (n_decoded == DATA_SIZE);
+		g_free (decoded);
+	}
+}
+
+static void
+bench_armor_write (guint64 iterations,
+                   gconstpointer data)
+{
+	const Fixture *fixture = data;
+	gsize n_result;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++)
+		g_free (egg_armor_write (fixture->data, DATA_SIZE, fixture->type, NULL, &n_result));
+}
+
+static void
+on_armor_parsed (GQuark type,
+                 GBytes *data,
+                 GBytes *outer,
+                 GHashTable *headers,
+                 gpointer user_data)
+{
+	g_assert (g_bytes_get_size (data) == DATA_SIZE);
+}
+
+static void
+bench_armor_parse (guint64 iterations,
+                   gconstpointer data)
+{
+	const Fixture *fixture = data;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++)
+		egg_armor_parse (fixture->armored, on_armor_parsed, NULL);
+}
+
+int
+main (int argc, char **argv)
+{
+	Fixture fixture;
+	gsize n_armored;
+	guchar *armored;
+	GRand *rand;
+	guint i;
+
+	egg_bench_init (&argc, &argv);
+
+	rand = g_rand_new_with_seed (0);
+	fixture.data = g_malloc (DATA_SIZE);
+	for (i = 0; i < DATA_SIZE; i++)
+		fixture.data[i] = g_rand_int_range (rand, 0, 256);
+	g_rand_free (rand);
+
+	fixture.type = g_quark_from_static_string ("CERTIFICATE");
+	fixture.hex = egg_hex_encode (fixture.data, DATA_SIZE);
+	armored = egg_armor_write (fixture.data, DATA_SIZE, fixture.type, NULL, &n_armored);
+	fixture.armored = g_bytes_new_take (armored, n_armored);
+
+	egg_bench_add_sized ("/egg/hex/encode", &fixture, bench_hex_encode, DATA_SIZE);
+	egg_bench_add_sized ("/egg/hex/decode", &fixture, bench_hex_decode, DATA_SIZE);
+	egg_bench_add_sized ("/egg/armor/write", &fixture, bench_armor_write, DATA_SIZE);
+	egg_bench_add_sized ("/egg/armor/parse", &fixture, bench_armor_parse, DATA_SIZE);
+
+	i = egg_bench_run ();
+
+	g_bytes_unref (fixture.armored);
+	g_free (fixture.hex);
+	g_free (fixture.data);
+	return i;
+}
@@ -0,0 +1,119 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "egg/egg-bench.h"
+#include "egg/egg-secure-memory.h"
+
+#include <glib.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+EGG_SECURE_DECLARE (bench);
+
+#define N_SLOTS 64
+#define N_THREADS 4
+
+static void
+bench_alloc_free (guint64 iterations,
+                  gconstpointer data)
+{
+	gsize size = GPOINTER_TO_SIZE (data);
+	gpointer memory;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		memory = egg_secure_alloc (size);
+		egg_secure_free (memory);
+	}
+}
+
+/* Keeps a working set of blocks, replacing a random one each iteration */
+static void
+churn (guint64 iterations,
+       guint32 seed)
+{
+	gpointer slots[N_SLOTS] = { NULL, };
+	GRand *rand;
+	guint64 i;
+	guint slot;
+
+	rand = g_rand_new_with_seed (seed);
+
+	for (i = 0; i < iterations; i++) {
+		slot = g_rand_int_range (rand, 0, N_SLOTS);
+		egg_secure_free (slots[slot]);
+		slots[slot] = egg_secure_alloc (g_rand_int_range (rand, 16, 1024));
+	}
+
+	for (slot = 0; slot < N_SLOTS; slot++)
+		egg_secure_free (slots[slot]);
+
+	g_rand_free (rand);
+}
+
+static void
+bench_churn (guint64 iterations,
+             gconstpointer data)
+{
+	churn (iterations, 0);
+}
+
+typedef struct {
+	guint64 iterations;
+	guint32 seed;
+} Churn;
+
+static gpointer
+churn_thread (gpointer data)
+{
+	Churn *args = data;
+	churn (args->iterations, args->seed);
+	return NULL;
+}
+
+static void
+bench_churn_threads (guint64 iterations,
+                     gconstpointer data)
+{
+	GThread *threads[N_THREADS];
+	Churn args[N_THREADS];
+	guint i;
+
+	/* Each iteration is one allocation, split over the threads */
+	for (i = 0; i < N_THREADS; i++) {
+		args[i].iterations = iterations / N_THREADS + 1;
+		args[i].seed = i;
+		threads[i] = g_thread_new ("churn", churn_thread, &args[i]);
+	}
+
+	for (i = 0; i < N_THREADS; i++)
+		g_thread_join (threads[i]);
+}
+
+int
+main (int argc, char **argv)
+{
+	egg_bench_init (&argc, &argv);
+
+	egg_bench_add ("/egg/secmem/alloc-free/32", GSIZE_TO_POINTER (32), bench_alloc_free);
+	egg_bench_add ("/egg/secmem/alloc-free/4096", GSIZE_TO_POINTER (4096), bench_alloc_free);
+	egg_bench_add ("/egg/secmem/churn", NULL, bench_churn);
+	egg_bench_add ("/egg/secmem/churn-threads", NULL, bench_churn_threads);
+
+	return egg_bench_run ();
+}
@@ -2647,6 +2647,47 @@ egg_asn1x_count (GNode *node)
 	return result;
 }
 
+static gboolean
+anode_is_list (GNode *node,
+               const gchar *caller)
+{
+	gint type = anode_def_type (node);
+	if (type != EGG_ASN1X_SEQUENCE_OF && type != EGG_ASN1X_SET_OF) {
+		g_warning ("node passed to %s was not a sequence of or set of", caller);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static GNode *
+anode_next_with_data (GNode *node)
+{
+	while (node != NULL && !egg_asn1x_have (node))
+		node = node->next;
+	return node;
+}
+
+GNode*
+egg_asn1x_first (GNode *node)
+{
+	g_return_val_if_fail (node, NULL);
+
+	if (!anode_is_list (node, "egg_asn1x_first"))
+		return NULL;
+
+	return anode_next_with_data (node->children);
+}
+
+GNode*
+egg_asn1x_next (GNode *node)
+{
+	g_return_val_if_fail (node, NULL);
+	g_return_val_if_fail (node->parent != NULL, NULL);
+
+	/* Only consider nodes that have data, like egg_asn1x_node() */
+	return anode_next_with_data (node->next);
+}
+
 GNode*
 egg_asn1x_append (GNode *node)
 {
@@ -3720,12 +3761,59 @@ egg_asn1x_set_oid_as_string (GNode *node,
 	return TRUE;
 }
 
+static gboolean
+anode_format_object_id (GBytes *data,
+                        gchar *buf,
+                        gsize n_buf)
+{
+	const guchar *p;
+	gsize len, at;
+	guint val;
+	gsize k;
+	gint n;
+
+	p = g_bytes_get_data (data, &len);
+	if (len == 0)
+		return FALSE;
+
+	n = g_snprintf (buf, n_buf, "%u.%u", p[0] / 40, p[0] % 40);
+	if (n < 0 || n >= n_buf)
+		return FALSE;
+	at = n;
+
+	for (k = 1, val = 0; k < len; ++k) {
+		val = (val << 7) | (p[k] & 0x7F);
+		if (!(p[k] & 0x80)) {
+			n = g_snprintf (buf + at, n_buf - at, ".%u", val);
+			if (n < 0 || n >= n_buf - at)
+				return FALSE;
+			at += n;
+			val = 0;
+		}
+	}
+
+	return TRUE;
+}
+
 GQuark
 egg_asn1x_get_oid_as_quark (GNode *node)
 {
 	GQuark quark;
+	GBytes *data;
+	gchar buf[128];
 	gchar *oid;
 
+	g_return_val_if_fail (node, 0);
+	g_return_val_if_fail (anode_def_type (node) == EGG_ASN1X_OBJECT_ID, 0);
+
+	data = anode_get_value (node);
+	if (data == NULL)
+		return 0;
+
+	/* The value was validated when decoded or set, avoid allocating */
+	if (anode_format_object_id (data, buf, sizeof (buf)))
+		return g_quark_from_string (buf);
+
 	oid = egg_asn1x_get_oid_as_string (node);
 	if (!oid)
 		return 0;
@@ -148,6 +148,10 @@ guint               egg_asn1x_count                  (GNode *node);
 
 GNode*              egg_asn1x_append                 (GNode *node);
 
+GNode*              egg_asn1x_first                  (GNode *node);
+
+GNode*              egg_asn1x_next                   (GNode *node);
+
 gboolean            egg_asn1x_have                   (GNode *node);
 
 GNode*              egg_asn1x_get_choice             (GNode *node);
@@ -0,0 +1,219 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "egg-bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	gchar *name;
+	gconstpointer data;
+	EggBenchFunc func;
+	guint64 size;
+} Bench;
+
+static GPtrArray *benches = NULL;
+
+static gint min_time_ms = 200;
+static gint repeat = 5;
+static gchar *output_path = NULL;
+static gchar *filter = NULL;
+
+static const GOptionEntry entries[] = {
+	{ "min-time", 't', 0, G_OPTION_ARG_INT, &min_time_ms,
+	  "Minimum time for each timed run in milliseconds", "MS" },
+	{ "repeat", 'r', 0, G_OPTION_ARG_INT, &repeat,
+	  "Number of timed runs, the median is reported", "N" },
+	{ "output", 'o', 0, G_OPTION_ARG_FILENAME, &output_path,
+	  "Append results to this file instead of stdout", "FILE" },
+	{ "filter", 'p', 0, G_OPTION_ARG_STRING, &filter,
+	  "Only run benchmarks whose name contains this", "TEXT" },
+	{ NULL }
+};
+
+static void
+bench_free (gpointer data)
+{
+	Bench *bench = data;
+	g_free (bench->name);
+	g_free (bench);
+}
+
+void
+egg_bench_init (int *argc,
+                char ***argv)
+{
+	GOptionContext *context;
+	GError *error = NULL;
+	const gchar *env;
+
+	/* Handy for a quick check that all the benchmarks still run */
+	env = g_getenv ("EGG_BENCH_MIN_TIME");
+	if (env != NULL)
+		min_time_ms = atoi (env);
+
+	context = g_option_context_new ("- run benchmarks");
+	g_option_context_add_main_entries (context, entries, NULL);
+	if (!g_option_context_parse (context, argc, argv, &error)) {
+		g_printerr ("%s\n", error->message);
+		exit (2);
+	}
+	g_option_context_free (context);
+
+	min_time_ms = MAX (min_time_ms, 1);
+	repeat = MAX (repeat, 1);
+
+	benches = g_ptr_array_new_with_free_func (bench_free);
+}
+
+void
+egg_bench_add_sized (const gchar *name,
+                     gconstpointer data,
+                     EggBenchFunc func,
+                     guint64 size)
+{
+	Bench *bench;
+
+	g_return_if_fail (benches != NULL);
+	g_return_if_fail (name != NULL);
+	g_return_if_fail (func != NULL);
+
+	bench = g_new0 (Bench, 1);
+	bench->name = g_strdup (name);
+	bench->data = data;
+	bench->func = func;
+	bench->size = size;
+	g_ptr_array_add (benches, bench);
+}
+
+void
+egg_bench_add (const gchar *name,
+               gconstpointer data,
+               EggBenchFunc func)
+{
+	egg_bench_add_sized (name, data, func, 0);
+}
+
+static gint64
+time_run (Bench *bench,
+          guint64 iterations)
+{
+	gint64 start;
+
+	start = g_get_monotonic_time ();
+	(bench->func) (iterations, bench->data);
+	return MAX (g_get_monotonic_time () - start, 1);
+}
+
+static gint
+compare_doubles (gconstpointer a,
+                 gconstpointer b)
+{
+	gdouble one = *(const gdouble *)a;
+	gdouble two = *(const gdouble *)b;
+	return (one > two) - (one < two);
+}
+
+static void
+run_bench (Bench *bench,
+           GString *output)
+{
+	gdouble *ns_per_op;
+	guint64 iterations = 1;
+	gint64 min_time;
+	gint64 elapsed;
+	gdouble median;
+	gint i;
+
+	min_time = (gint64)min_time_ms * 1000;
+
+	/* Scale up the iterations until a run takes long enough */
+	for (;;) {
+		elapsed = time_run (bench, iterations);
+		if (elapsed >= min_time)
+			break;
+		if (elapsed * 10 < min_time)
+			iterations *= 10;
+		else
+			iterations = (iterations * min_time * 12) / (elapsed * 10) + 1;
+	}
+
+	ns_per_op = g_new (gdouble, repeat);
+	for (i = 0; i < repeat; i++) {
+		elapsed = time_run (bench, iterations);
+		ns_per_op[i] = (elapsed * 1000.0) / iterations;
+	}
+
+	qsort (ns_per_op, repeat, sizeof (gdouble), compare_doubles);
+	median = ns_per_op[repeat / 2];
+
+	g_string_append_printf (output, "{\"name\": \"%s\", \"iterations\": %" G_GUINT64_FORMAT ", "
+	                        "\"runs\": %d, \"ns_per_op\": %.1f, \"min_ns_per_op\": %.1f, "
+	                        "\"max_ns_per_op\": %.1f",
+	                        bench->name, iterations, repeat, median,
+	                        ns_per_op[0], ns_per_op[repeat - 1]);
+	if (bench->size > 0) {
+		g_string_append_printf (output, ", \"size\": %" G_GUINT64_FORMAT ", \"per_second\": %.1f",
+		                        bench->size, bench->size * (1000000000.0 / median));
+	}
+	g_string_append (output, "}\n");
+
+	g_free (ns_per_op);
+}
+
+gint
+egg_bench_run (void)
+{
+	GString *output;
+	FILE *file = stdout;
+	Bench *bench;
+	guint i;
+
+	g_return_val_if_fail (benches != NULL, 1);
+
+	if (output_path) {
+		file = fopen (output_path, "a");
+		if (file == NULL) {
+			g_printerr ("couldn't open output file: %s\n", output_path);
+			return 1;
+		}
+	}
+
+	output = g_string_new ("");
+	for (i = 0; i < benches->len; i++) {
+		bench = benches->pdata[i];
+		if (filter && !strstr (bench->name, filter))
+			continue;
+
+		g_string_truncate (output, 0);
+		run_bench (bench, output);
+		fputs (output->str, file);
+		fflush (file);
+	}
+
+	g_string_free (output, TRUE);
+	if (file != stdout)
+		fclose (file);
+
+	g_ptr_array_unref (benches);
+	benches = NULL;
+	return 0;
+}
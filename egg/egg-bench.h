@@ -0,0 +1,49 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EGG_BENCH_H_
+#define EGG_BENCH_H_
+
+#include <glib.h>
+
+/*
+ * Runs the operation being measured @iterations times. The harness picks
+ * the number of iterations so that each run takes long enough to time.
+ */
+typedef void (* EggBenchFunc)      (guint64 iterations,
+                                    gconstpointer data);
+
+void       egg_bench_init          (int *argc,
+                                    char ***argv);
+
+void       egg_bench_add           (const gchar *name,
+                                    gconstpointer data,
+                                    EggBenchFunc func);
+
+/* For throughput, the number of bytes or items handled by one iteration */
+void       egg_bench_add_sized     (const gchar *name,
+                                    gconstpointer data,
+                                    EggBenchFunc func,
+                                    guint64 size);
+
+/*
+ * Prints one JSON object per line for each benchmark, see
+ * build-aux/bench-compare.py to compare two runs.
+ */
+gint       egg_bench_run           (void);
+
+#endif /* EGG_BENCH_H_ */
@@ -31,12 +31,12 @@
 
 static const char HEXC[] = "0123456789ABCDEF";
 
-static gchar*
-dn_print_hex_value (GBytes *val)
+static void
+dn_append_hex_value (GString *result,
+                     GBytes *val)
 {
-	const gchar *data = g_bytes_get_data (val, NULL);
+	const guchar *data = g_bytes_get_data (val, NULL);
 	gsize size = g_bytes_get_size (val);
-	GString *result = g_string_sized_new (size * 2 + 1);
 	gsize i;
 
 	g_string_append_c (result, '#');
@@ -44,31 +44,30 @@ dn_print_hex_value (GBytes *val)
 		g_string_append_c (result, HEXC[data[i] >> 4 & 0xf]);
 		g_string_append_c (result, HEXC[data[i] & 0xf]);
 	}
-
-	return g_string_free (result, FALSE);
 }
 
-static gchar*
-dn_print_oid_value_parsed (GQuark oid,
-                           guint flags,
-                           GNode *val)
+static gboolean
+dn_append_oid_value_parsed (GString *result,
+                            GQuark oid,
+                            guint flags,
+                            GNode *val)
 {
 	GNode *asn1, *node;
 	GBytes *value;
 	const gchar *data;
 	gsize size;
-	gchar *result;
+	gchar *string;
 
 	g_assert (val != NULL);
 
 	asn1 = egg_asn1x_create_quark (pkix_asn1_tab, oid);
-	g_return_val_if_fail (asn1, NULL);
+	g_return_val_if_fail (asn1, FALSE);
 
 	if (!egg_asn1x_get_any_into (val, asn1)) {
 		g_message ("couldn't decode value for OID: %s: %s",
 		           g_quark_to_string (oid), egg_asn1x_message (asn1));
 		egg_asn1x_destroy (asn1);
-		return NULL;
+		return FALSE;
 	}
 
 	/*
@@ -81,128 +80,142 @@ dn_print_oid_value_parsed (GQuark oid,
 		node = asn1;
 
 	if (egg_asn1x_type (node) == EGG_ASN1X_BMP_STRING) {
-		result = egg_asn1x_get_bmpstring_as_utf8 (node);
-		if (result) {
+		string = egg_asn1x_get_bmpstring_as_utf8 (node);
+		if (string) {
+			g_string_append (result, string);
 			egg_asn1x_destroy (asn1);
-
-			return result;
+			g_free (string);
+			return TRUE;
 		}
 	}
 
 	value = egg_asn1x_get_value_raw (node);
-	data = g_bytes_get_data (value, &size);
-
-	/*
-	 * Now we make sure it's UTF-8.
-	 */
+	egg_asn1x_destroy (asn1);
 
 	if (!value) {
 		g_message ("couldn't read value for OID: %s", g_quark_to_string (oid));
-		result = NULL;
+		return FALSE;
+	}
 
-	} else if (!g_utf8_validate (data, size, NULL)) {
-		result = dn_print_hex_value (value);
+	/*
+	 * Now we make sure it's UTF-8.
+	 */
 
-	} else {
-		result = g_strndup (data, size);
-	}
+	data = g_bytes_get_data (value, &size);
+	if (!g_utf8_validate (data, size, NULL))
+		dn_append_hex_value (result, value);
+	else
+		g_string_append_len (result, data, size);
 
 	g_bytes_unref (value);
-	egg_asn1x_destroy (asn1);
-
-	return result;
+	return TRUE;
 }
 
-static gchar*
-dn_print_oid_value (GQuark oid,
-                    guint flags,
-                    GNode *val)
+static void
+dn_append_oid_value (GString *result,
+                     GQuark oid,
+                     guint flags,
+                     GNode *val)
 {
 	GBytes *der;
-	gchar *value;
 
 	g_assert (val != NULL);
 
 	if (flags & EGG_OID_PRINTABLE) {
-		value = dn_print_oid_value_parsed (oid, flags, val);
-		if (value != NULL)
-			return value;
+		if (dn_append_oid_value_parsed (result, oid, flags, val))
+			return;
 	}
 
 	der = egg_asn1x_get_element_raw (val);
-	value = dn_print_hex_value (der);
+	dn_append_hex_value (result, der);
 	g_bytes_unref (der);
-
-	return value;
 }
 
 static gchar*
-dn_parse_rdn (GNode *asn)
+dn_print_oid_value (GQuark oid,
+                    guint flags,
+                    GNode *val)
+{
+	GString *result = g_string_sized_new (32);
+	dn_append_oid_value (result, oid, flags, val);
+	return g_string_free (result, FALSE);
+}
+
+static gboolean
+dn_append_rdn (GString *result,
+               GNode *asn)
 {
-	const gchar *name;
 	guint flags;
 	GQuark oid;
 	GNode *value;
-	gchar *display;
-	gchar *result;
 
 	g_assert (asn);
 
 	oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (asn, "type", NULL));
-	g_return_val_if_fail (oid, NULL);
-
-	flags = egg_oid_get_flags (oid);
-	name = egg_oid_get_name (oid);
+	g_return_val_if_fail (oid, FALSE);
 
 	value = egg_asn1x_node (asn, "value", NULL);
-	g_return_val_if_fail (value, NULL);
+	g_return_val_if_fail (value, FALSE);
 
-	display = dn_print_oid_value (oid, flags, value);
-	result = g_strconcat ((flags & EGG_OID_PRINTABLE) ? name : g_quark_to_string (oid),
-	                      "=", display, NULL);
-	g_free (display);
+	flags = egg_oid_get_flags (oid);
+	g_string_append (result, (flags & EGG_OID_PRINTABLE) ? egg_oid_get_name (oid) : g_quark_to_string (oid));
+	g_string_append_c (result, '=');
+	dn_append_oid_value (result, oid, flags, value);
 
-	return result;
+	return TRUE;
 }
 
-gchar*
-egg_dn_read (GNode* asn)
+gboolean
+egg_dn_append (GString *result,
+               GNode *asn)
 {
-	gboolean done = FALSE;
-	GString *result;
-	GNode *node;
-	gchar *rdn;
-	gint i, j;
+	gboolean first;
+	GNode *rdn, *node;
+	gsize len;
 
-	g_return_val_if_fail (asn, NULL);
+	g_return_val_if_fail (result, FALSE);
+	g_return_val_if_fail (asn, FALSE);
 
-	result = g_string_sized_new (64);
+	len = result->len;
 
 	/* Each (possibly multi valued) RDN */
-	for (i = 1; !done; ++i) {
+	for (rdn = egg_asn1x_first (asn); rdn; rdn = egg_asn1x_next (rdn)) {
 
 		/* Each type=value pair of an RDN */
-		for (j = 1; TRUE; ++j) {
-			node = egg_asn1x_node (asn, i, j, NULL);
-			if (!node) {
-				done = j == 1;
-				break;
-			}
-
-			rdn = dn_parse_rdn (node);
-			g_return_val_if_fail (rdn, NULL);
+		first = TRUE;
+		for (node = egg_asn1x_first (rdn); node; node = egg_asn1x_next (node)) {
 
 			/* Account for multi valued RDNs */
-			if (j > 1)
-				g_string_append (result, "+");
-			else if (i > 1)
+			if (!first)
+				g_string_append_c (result, '+');
+			else if (result->len > len)
 				g_string_append (result, ", ");
 
-			g_string_append (result, rdn);
-			g_free (rdn);
+			if (!dn_append_rdn (result, node)) {
+				g_string_truncate (result, len);
+				return FALSE;
+			}
+
+			first = FALSE;
 		}
 	}
 
+	return TRUE;
+}
+
+gchar*
+egg_dn_read (GNode* asn)
+{
+	GString *result;
+
+	g_return_val_if_fail (asn, NULL);
+
+	result = g_string_sized_new (64);
+	if (!egg_dn_append (result, asn)) {
+		g_string_free (result, TRUE);
+		return NULL;
+	}
+
 	/* Returns null when string is empty */
 	return g_string_free (result, (result->len == 0));
 }
@@ -210,27 +223,19 @@ egg_dn_read (GNode* asn)
 gchar*
 egg_dn_read_part (GNode *asn, const gchar *match)
 {
-	gboolean done = FALSE;
 	const gchar *name;
-	GNode *node;
+	GNode *rdn, *node, *value;
 	GQuark oid;
-	gint i, j;
 
 	g_return_val_if_fail (asn, NULL);
 	g_return_val_if_fail (match, NULL);
 
 	/* Each (possibly multi valued) RDN */
-	for (i = 1; !done; ++i) {
+	for (rdn = egg_asn1x_first (asn); rdn; rdn = egg_asn1x_next (rdn)) {
 
 		/* Each type=value pair of an RDN */
-		for (j = 1; TRUE; ++j) {
-			node = egg_asn1x_node (asn, i, j, "type", NULL);
-			if (!node) {
-				done = j == 1;
-				break;
-			}
-
-			oid = egg_asn1x_get_oid_as_quark (node);
+		for (node = egg_asn1x_first (rdn); node; node = egg_asn1x_next (node)) {
+			oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (node, "type", NULL));
 			g_return_val_if_fail (oid, NULL);
 
 			/* Does it match either the OID or the displayable? */
@@ -240,10 +245,10 @@ egg_dn_read_part (GNode *asn, const gchar *match)
 					continue;
 			}
 
-			node = egg_asn1x_node (asn, i, j, "value", NULL);
-			g_return_val_if_fail (node, NULL);
+			value = egg_asn1x_node (node, "value", NULL);
+			g_return_val_if_fail (value, NULL);
 
-			return dn_print_oid_value (oid, egg_oid_get_flags (oid), node);
+			return dn_print_oid_value (oid, egg_oid_get_flags (oid), value);
 		}
 	}
 
@@ -253,38 +258,28 @@ egg_dn_read_part (GNode *asn, const gchar *match)
 gboolean
 egg_dn_parse (GNode *asn, EggDnCallback callback, gpointer user_data)
 {
-	gboolean done = FALSE;
-	GNode *node;
+	GNode *rdn, *node, *value;
 	GQuark oid;
-	guint i, j;
+	guint i = 1;
 
 	g_return_val_if_fail (asn, FALSE);
 
 	/* Each (possibly multi valued) RDN */
-	for (i = 1; !done; ++i) {
+	for (rdn = egg_asn1x_first (asn); rdn; rdn = egg_asn1x_next (rdn), ++i) {
 
 		/* Each type=value pair of an RDN */
-		for (j = 1; TRUE; ++j) {
+		for (node = egg_asn1x_first (rdn); node; node = egg_asn1x_next (node)) {
 
 			/* Dig out the type */
-			node = egg_asn1x_node (asn, i, j, "type", NULL);
-			if (!node) {
-				done = j == 1;
-				break;
-			}
-
-			oid = egg_asn1x_get_oid_as_quark (node);
+			oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (node, "type", NULL));
 			g_return_val_if_fail (oid, FALSE);
 
 			/* Dig out the value */
-			node = egg_asn1x_node (asn, i, j, "value", NULL);
-			if (!node) {
-				done = j == 1;
-				break;
-			}
+			value = egg_asn1x_node (node, "value", NULL);
+			g_return_val_if_fail (value, FALSE);
 
 			if (callback)
-				(callback) (i, oid, node, user_data);
+				(callback) (i, oid, value, user_data);
 		}
 	}
 
@@ -301,6 +296,153 @@ egg_dn_print_value (GQuark oid,
 	return dn_print_oid_value (oid, egg_oid_get_flags (oid), value);
 }
 
+static gchar *
+dn_canonical_string (const gchar *string)
+{
+	gchar *normal, *folded;
+	GString *result;
+	gboolean space = FALSE;
+	gunichar ch;
+	const gchar *p;
+
+	/* RFC 4518 string preparation: normalize, fold case, squash spaces */
+	normal = g_utf8_normalize (string, -1, G_NORMALIZE_NFKC);
+	if (normal == NULL)
+		return NULL;
+	folded = g_utf8_casefold (normal, -1);
+	g_free (normal);
+
+	result = g_string_sized_new (strlen (folded));
+	for (p = folded; *p != '\0'; p = g_utf8_next_char (p)) {
+		ch = g_utf8_get_char (p);
+		if (g_unichar_isspace (ch)) {
+			space = TRUE;
+			continue;
+		}
+		if (space && result->len > 0)
+			g_string_append_c (result, ' ');
+		space = FALSE;
+		g_string_append_unichar (result, ch);
+	}
+
+	g_free (folded);
+	return g_string_free (result, FALSE);
+}
+
+static GBytes *
+dn_canonical_attribute (GNode *node)
+{
+	GByteArray *result;
+	const gchar *name;
+	GString *value;
+	GBytes *der;
+	gchar *canon;
+	guint flags;
+	guint8 kind;
+	GQuark oid;
+
+	oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (node, "type", NULL));
+	if (oid == 0)
+		return NULL;
+
+	node = egg_asn1x_node (node, "value", NULL);
+	g_return_val_if_fail (node != NULL, NULL);
+
+	result = g_byte_array_new ();
+	name = g_quark_to_string (oid);
+	g_byte_array_append (result, (const guint8 *)name, strlen (name) + 1);
+
+	/* Strings compare as prepared text, whatever their encoding */
+	flags = egg_oid_get_flags (oid);
+	canon = NULL;
+	if (flags & EGG_OID_PRINTABLE) {
+		value = g_string_sized_new (32);
+		if (dn_append_oid_value_parsed (value, oid, flags, node) && value->str[0] != '#')
+			canon = dn_canonical_string (value->str);
+		g_string_free (value, TRUE);
+	}
+
+	if (canon) {
+		kind = 's';
+		g_byte_array_append (result, &kind, 1);
+		g_byte_array_append (result, (const guint8 *)canon, strlen (canon));
+		g_free (canon);
+
+	/* Anything else compares as its encoding */
+	} else {
+		der = egg_asn1x_get_element_raw (node);
+		if (der == NULL) {
+			g_byte_array_unref (result);
+			return NULL;
+		}
+		kind = 'r';
+		g_byte_array_append (result, &kind, 1);
+		g_byte_array_append (result, g_bytes_get_data (der, NULL), g_bytes_get_size (der));
+		g_bytes_unref (der);
+	}
+
+	return g_byte_array_free_to_bytes (result);
+}
+
+static gint
+dn_compare_attributes (gconstpointer a,
+                       gconstpointer b)
+{
+	return g_bytes_compare (*(GBytes **)a, *(GBytes **)b);
+}
+
+static void
+dn_append_length (GByteArray *array,
+                  gsize length)
+{
+	guint8 buf[4] = { length >> 24 & 0xff, length >> 16 & 0xff, length >> 8 & 0xff, length & 0xff };
+	g_byte_array_append (array, buf, sizeof (buf));
+}
+
+GBytes *
+egg_dn_canonicalize (GNode *asn)
+{
+	GByteArray *result;
+	GPtrArray *attributes;
+	GBytes *attribute;
+	GNode *rdn, *node;
+	guint i;
+
+	g_return_val_if_fail (asn, NULL);
+
+	result = g_byte_array_new ();
+	attributes = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+
+	/* Each (possibly multi valued) RDN */
+	for (rdn = egg_asn1x_first (asn); rdn; rdn = egg_asn1x_next (rdn)) {
+		for (node = egg_asn1x_first (rdn); node; node = egg_asn1x_next (node)) {
+			attribute = dn_canonical_attribute (node);
+			if (attribute == NULL) {
+				g_ptr_array_unref (attributes);
+				g_byte_array_unref (result);
+				return NULL;
+			}
+			g_ptr_array_add (attributes, attribute);
+		}
+
+		/* The values of an RDN are a set, so the order doesn't matter */
+		g_ptr_array_sort (attributes, dn_compare_attributes);
+
+		dn_append_length (result, attributes->len);
+		for (i = 0; i < attributes->len; i++) {
+			attribute = attributes->pdata[i];
+			dn_append_length (result, g_bytes_get_size (attribute));
+			g_byte_array_append (result, g_bytes_get_data (attribute, NULL),
+			                     g_bytes_get_size (attribute));
+		}
+
+		g_ptr_array_set_size (attributes, 0);
+	}
+
+	g_ptr_array_unref (attributes);
+	return g_byte_array_free_to_bytes (result);
+}
+
 static gboolean
 is_ascii_string (const gchar *string)
 {
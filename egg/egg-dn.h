@@ -27,6 +27,9 @@
 
 gchar*             egg_dn_read                            (GNode *node);
 
+gboolean           egg_dn_append                          (GString *result,
+                                                           GNode *node);
+
 gchar*             egg_dn_read_part                       (GNode *node,
                                                            const gchar *match);
 
@@ -42,6 +45,8 @@ gboolean           egg_dn_parse                           (GNode *node,
 gchar*             egg_dn_print_value                     (GQuark oid,
                                                            GNode *value);
 
+GBytes*            egg_dn_canonicalize                    (GNode *node);
+
 void               egg_dn_add_string_part                 (GNode *node,
                                                            GQuark oid,
                                                            const gchar *string);
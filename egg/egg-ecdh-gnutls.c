@@ -0,0 +1,157 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "egg-ecdh.h"
+
+#include "egg-secure-memory.h"
+
+#include <gnutls/gnutls.h>
+#include <gnutls/abstract.h>
+
+#include <string.h>
+
+EGG_SECURE_DECLARE (ecdh);
+
+struct egg_ecdh_privkey {
+	gnutls_privkey_t inner;
+};
+
+gboolean
+egg_ecdh_is_supported (const gchar *curve)
+{
+	g_return_val_if_fail (curve != NULL, FALSE);
+	return g_str_equal (curve, EGG_ECDH_X25519);
+}
+
+gboolean
+egg_ecdh_gen_pair (const gchar *curve,
+                   GBytes **pub,
+                   egg_ecdh_privkey **priv)
+{
+	gnutls_privkey_t priv_inner = NULL;
+	gnutls_pubkey_t pub_inner = NULL;
+	gnutls_ecc_curve_t ecc_curve;
+	gnutls_datum_t x = { NULL, 0 };
+	gboolean ok = FALSE;
+	int ret;
+
+	g_return_val_if_fail (curve != NULL, FALSE);
+	g_return_val_if_fail (pub != NULL, FALSE);
+	g_return_val_if_fail (priv != NULL, FALSE);
+
+	*pub = NULL;
+	*priv = NULL;
+
+	if (!egg_ecdh_is_supported (curve))
+		return FALSE;
+
+	ret = gnutls_privkey_init (&priv_inner);
+	if (ret < 0)
+		goto out;
+
+	ret = gnutls_privkey_generate2 (priv_inner, GNUTLS_PK_ECDH_X25519,
+	                                GNUTLS_CURVE_TO_BITS (GNUTLS_ECC_CURVE_X25519),
+	                                0, NULL, 0);
+	if (ret < 0)
+		goto out;
+
+	ret = gnutls_pubkey_init (&pub_inner);
+	if (ret < 0)
+		goto out;
+
+	ret = gnutls_pubkey_import_privkey (pub_inner, priv_inner, 0, 0);
+	if (ret < 0)
+		goto out;
+
+	ret = gnutls_pubkey_export_ecc_raw2 (pub_inner, &ecc_curve, &x, NULL, 0);
+	if (ret < 0)
+		goto out;
+
+	*pub = g_bytes_new (x.data, x.size);
+	*priv = g_new0 (egg_ecdh_privkey, 1);
+	(*priv)->inner = g_steal_pointer (&priv_inner);
+	ok = TRUE;
+
+ out:
+	gnutls_free (x.data);
+	if (priv_inner)
+		gnutls_privkey_deinit (priv_inner);
+	if (pub_inner)
+		gnutls_pubkey_deinit (pub_inner);
+
+	return ok;
+}
+
+GBytes *
+egg_ecdh_gen_secret (egg_ecdh_privkey *priv,
+                     GBytes *peer)
+{
+	gnutls_pubkey_t peer_inner = NULL;
+	gnutls_datum_t x, k = { NULL, 0 };
+	guchar *value = NULL;
+	gsize n_value = 0;
+	int ret;
+
+	g_return_val_if_fail (priv != NULL, NULL);
+	g_return_val_if_fail (peer != NULL, NULL);
+
+	ret = gnutls_pubkey_init (&peer_inner);
+	if (ret < 0)
+		return NULL;
+
+	x.data = (void *)g_bytes_get_data (peer, NULL);
+	x.size = g_bytes_get_size (peer);
+
+	ret = gnutls_pubkey_import_ecc_raw (peer_inner, GNUTLS_ECC_CURVE_X25519, &x, NULL);
+	if (ret < 0)
+		goto out;
+
+	/* This also rejects the all zero result of a low order point */
+	ret = gnutls_privkey_derive_secret (priv->inner, peer_inner, NULL, &k, 0);
+	if (ret < 0)
+		goto out;
+
+	n_value = k.size;
+	value = egg_secure_alloc (n_value);
+	memcpy (value, k.data, n_value);
+
+ out:
+	if (k.data) {
+		gnutls_memset (k.data, 0, k.size);
+		gnutls_free (k.data);
+	}
+	gnutls_pubkey_deinit (peer_inner);
+
+	if (value == NULL)
+		return NULL;
+
+	return g_bytes_new_with_free_func (value, n_value,
+	                                   (GDestroyNotify)egg_secure_free,
+	                                   value);
+}
+
+void
+egg_ecdh_privkey_free (egg_ecdh_privkey *privkey)
+{
+	if (!privkey)
+		return;
+	if (privkey->inner)
+		gnutls_privkey_deinit (privkey->inner);
+	g_free (privkey);
+}
@@ -0,0 +1,164 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "egg-ecdh.h"
+
+#include "egg-secure-memory.h"
+
+#include <gcrypt.h>
+#include <string.h>
+
+EGG_SECURE_DECLARE (ecdh);
+
+/* gcry_ecc_mul_point() appeared in libgcrypt 1.9 */
+#if GCRYPT_VERSION_NUMBER >= 0x010900
+#define WITH_X25519 1
+#endif
+
+#define X25519_LENGTH 32
+
+struct egg_ecdh_privkey {
+	guchar *scalar;
+};
+
+gboolean
+egg_ecdh_is_supported (const gchar *curve)
+{
+	g_return_val_if_fail (curve != NULL, FALSE);
+
+#ifdef WITH_X25519
+	return g_str_equal (curve, EGG_ECDH_X25519);
+#else
+	return FALSE;
+#endif
+}
+
+#ifdef WITH_X25519
+
+static gboolean
+x25519 (guchar *result,
+        const guchar *scalar,
+        const guchar *point)
+{
+	gcry_error_t gcry;
+
+	gcry = gcry_ecc_mul_point (GCRY_ECC_CURVE25519, result, scalar, point);
+	if (gcry != 0) {
+		g_message ("couldn't perform x25519: %s", gcry_strerror (gcry));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+#endif /* WITH_X25519 */
+
+gboolean
+egg_ecdh_gen_pair (const gchar *curve,
+                   GBytes **pub,
+                   egg_ecdh_privkey **priv)
+{
+#ifdef WITH_X25519
+	static const guchar base[X25519_LENGTH] = { 9, };
+	egg_ecdh_privkey *privkey;
+	guchar *point;
+#endif
+
+	g_return_val_if_fail (curve != NULL, FALSE);
+	g_return_val_if_fail (pub != NULL, FALSE);
+	g_return_val_if_fail (priv != NULL, FALSE);
+
+	*pub = NULL;
+	*priv = NULL;
+
+	if (!egg_ecdh_is_supported (curve))
+		return FALSE;
+
+#ifdef WITH_X25519
+	privkey = g_new0 (egg_ecdh_privkey, 1);
+	privkey->scalar = egg_secure_alloc (X25519_LENGTH);
+	gcry_randomize (privkey->scalar, X25519_LENGTH, GCRY_STRONG_RANDOM);
+
+	/* Clamp as described in RFC 7748 */
+	privkey->scalar[0] &= 248;
+	privkey->scalar[31] &= 127;
+	privkey->scalar[31] |= 64;
+
+	point = g_malloc (X25519_LENGTH);
+	if (!x25519 (point, privkey->scalar, base)) {
+		egg_ecdh_privkey_free (privkey);
+		g_free (point);
+		return FALSE;
+	}
+
+	*pub = g_bytes_new_take (point, X25519_LENGTH);
+	*priv = privkey;
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
+GBytes *
+egg_ecdh_gen_secret (egg_ecdh_privkey *priv,
+                     GBytes *peer)
+{
+#ifdef WITH_X25519
+	guchar *value;
+	guchar bits;
+	gsize i;
+#endif
+
+	g_return_val_if_fail (priv != NULL, NULL);
+	g_return_val_if_fail (peer != NULL, NULL);
+
+#ifdef WITH_X25519
+	if (g_bytes_get_size (peer) != X25519_LENGTH)
+		return NULL;
+
+	value = egg_secure_alloc (X25519_LENGTH);
+	if (!x25519 (value, priv->scalar, g_bytes_get_data (peer, NULL))) {
+		egg_secure_free (value);
+		return NULL;
+	}
+
+	/* A low order peer point results in all zeros, reject it */
+	for (i = 0, bits = 0; i < X25519_LENGTH; i++)
+		bits |= value[i];
+	if (bits == 0) {
+		egg_secure_free (value);
+		return NULL;
+	}
+
+	return g_bytes_new_with_free_func (value, X25519_LENGTH,
+	                                   (GDestroyNotify)egg_secure_free,
+	                                   value);
+#else
+	return NULL;
+#endif
+}
+
+void
+egg_ecdh_privkey_free (egg_ecdh_privkey *privkey)
+{
+	if (!privkey)
+		return;
+	egg_secure_free (privkey->scalar);
+	g_free (privkey);
+}
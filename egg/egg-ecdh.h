@@ -0,0 +1,39 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EGG_ECDH_H_
+#define EGG_ECDH_H_
+
+#include <glib.h>
+
+/* Only Montgomery curves for now, the public key is the raw u coordinate */
+#define EGG_ECDH_X25519 "x25519"
+
+typedef struct egg_ecdh_privkey egg_ecdh_privkey;
+
+gboolean       egg_ecdh_is_supported        (const gchar *curve);
+
+gboolean       egg_ecdh_gen_pair            (const gchar *curve,
+                                             GBytes **pub,
+                                             egg_ecdh_privkey **priv);
+
+GBytes        *egg_ecdh_gen_secret          (egg_ecdh_privkey *priv,
+                                             GBytes *peer);
+
+void           egg_ecdh_privkey_free        (egg_ecdh_privkey *privkey);
+
+#endif /* EGG_ECDH_H_ */
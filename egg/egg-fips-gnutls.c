@@ -30,7 +30,22 @@ egg_fips_get_mode (void)
 }
 
 void
-egg_fips_set_mode (EggFipsMode mode)
+egg_fips_scope_begin (EggFipsScope *scope,
+                      EggFipsMode mode)
 {
-	gnutls_fips140_set_mode (mode, GNUTLS_FIPS140_SET_MODE_THREAD);
+	/* This is the mode of the calling thread, if it has one */
+	scope->saved = gnutls_fips140_mode_enabled ();
+	scope->changed = (scope->saved != mode);
+
+	/* Only ever change the calling thread, never the global mode */
+	if (scope->changed)
+		gnutls_fips140_set_mode (mode, GNUTLS_FIPS140_SET_MODE_THREAD);
+}
+
+void
+egg_fips_scope_end (EggFipsScope *scope)
+{
+	if (scope->changed)
+		gnutls_fips140_set_mode (scope->saved, GNUTLS_FIPS140_SET_MODE_THREAD);
+	scope->changed = 0;
 }
@@ -26,8 +26,19 @@ egg_fips_get_mode (void)
 	return EGG_FIPS_MODE_DISABLED;
 }
 
+/* libgcrypt has no way to override the mode, so there's nothing to change */
+
 void
-egg_fips_set_mode (EggFipsMode mode)
+egg_fips_scope_begin (EggFipsScope *scope,
+                      EggFipsMode mode)
 {
 	(void)mode;
+	scope->saved = EGG_FIPS_MODE_DISABLED;
+	scope->changed = 0;
+}
+
+void
+egg_fips_scope_end (EggFipsScope *scope)
+{
+	(void)scope;
 }
@@ -25,7 +25,20 @@ typedef enum {
 	/* Other values are specific to each backend */
 } EggFipsMode;
 
+/*
+ * Temporarily use a different mode for operations on the calling thread.
+ * Scopes are kept on the stack, and must be ended in reverse order on the
+ * thread that began them. Other threads are not affected.
+ */
+typedef struct {
+	EggFipsMode saved;
+	int changed;
+} EggFipsScope;
+
 EggFipsMode egg_fips_get_mode (void);
-void egg_fips_set_mode (EggFipsMode mode);
+
+void egg_fips_scope_begin (EggFipsScope *scope,
+                           EggFipsMode mode);
+void egg_fips_scope_end (EggFipsScope *scope);
 
 #endif /* EGG_FIPS_H_ */
@@ -172,24 +172,22 @@ static OidInfo oid_info[] = {
 static OidInfo*
 find_oid_info (GQuark oid)
 {
-	static size_t inited_oids = 0;
+	static GHashTable *oids_by_quark = NULL;
 	int i;
 
 	g_return_val_if_fail (oid != 0, NULL);
 
-	/* Initialize first time around */
-	if (g_once_init_enter (&inited_oids)) {
-		for (i = 0; oid_info[i].oidstr != NULL; ++i)
+	/* Initialize first time around, the table is never freed */
+	if (g_once_init_enter (&oids_by_quark)) {
+		GHashTable *table = g_hash_table_new (g_direct_hash, g_direct_equal);
+		for (i = 0; oid_info[i].oidstr != NULL; ++i) {
 			oid_info[i].oid = g_quark_from_static_string (oid_info[i].oidstr);
-		g_once_init_leave (&inited_oids, 1);
+			g_hash_table_insert (table, GUINT_TO_POINTER (oid_info[i].oid), &oid_info[i]);
+		}
+		g_once_init_leave (&oids_by_quark, table);
 	}
 
-	for (i = 0; oid_info[i].oidstr != NULL; ++i) {
-		if (oid_info[i].oid == oid)
-			return &oid_info[i];
-	}
-
-	return NULL;
+	return g_hash_table_lookup (oids_by_quark, GUINT_TO_POINTER (oid));
 }
 
 const gchar*
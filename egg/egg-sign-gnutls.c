@@ -0,0 +1,361 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "egg-sign.h"
+#include "egg-secure-memory.h"
+
+#include <gnutls/gnutls.h>
+#include <gnutls/abstract.h>
+#include <gnutls/crypto.h>
+#include <string.h>
+
+EGG_SECURE_DECLARE (sign);
+
+/*
+ * GnuTLS keeps private keys in ordinary memory, so the private parts are
+ * held here in secure memory instead. A GnuTLS key is imported for each
+ * operation and freed right after, which costs an import per signature.
+ */
+
+typedef enum {
+	KEY_RSA,
+	KEY_ECDSA,
+	KEY_ED25519,
+} KeyType;
+
+struct egg_sign_key {
+	KeyType type;
+	gnutls_ecc_curve_t curve;
+	gsize n_part;
+	gnutls_sign_algorithm_t algo;
+
+	/* Public parts: the modulus and exponent, or the point */
+	GBytes *n;
+	GBytes *e;
+	GBytes *x;
+	GBytes *y;
+
+	/* Private parts, all in secure memory */
+	GBytes *d;
+	GBytes *p;
+	GBytes *q;
+	GBytes *iqmp;
+};
+
+static GBytes *
+secure_bytes_copy (GBytes *bytes)
+{
+	gconstpointer data;
+	gpointer copy;
+	gsize size;
+
+	data = g_bytes_get_data (bytes, &size);
+	copy = egg_secure_alloc (MAX (size, 1));
+	memcpy (copy, data, size);
+	return g_bytes_new_with_free_func (copy, size, egg_secure_free, copy);
+}
+
+static void
+datum_from_bytes (gnutls_datum_t *datum,
+                  GBytes *bytes)
+{
+	datum->data = (void *)g_bytes_get_data (bytes, NULL);
+	datum->size = g_bytes_get_size (bytes);
+}
+
+static gboolean
+key_import (egg_sign_key *key,
+            gnutls_privkey_t *inner)
+{
+	gnutls_datum_t dn, de, dd, dp, dq, du, dx, dy;
+	int ret;
+
+	ret = gnutls_privkey_init (inner);
+	if (ret < 0)
+		return FALSE;
+
+	datum_from_bytes (&dd, key->d);
+
+	switch (key->type) {
+	case KEY_RSA:
+		datum_from_bytes (&dn, key->n);
+		datum_from_bytes (&de, key->e);
+		datum_from_bytes (&dp, key->p);
+		datum_from_bytes (&dq, key->q);
+		datum_from_bytes (&du, key->iqmp);
+
+		/* The exponents modulo p-1 and q-1 are calculated for us */
+		ret = gnutls_privkey_import_rsa_raw (*inner, &dn, &de, &dd, &dp, &dq, &du, NULL, NULL);
+		break;
+	case KEY_ECDSA:
+		datum_from_bytes (&dx, key->x);
+		datum_from_bytes (&dy, key->y);
+		ret = gnutls_privkey_import_ecc_raw (*inner, key->curve, &dx, &dy, &dd);
+		break;
+	case KEY_ED25519:
+		datum_from_bytes (&dx, key->x);
+		ret = gnutls_privkey_import_ecc_raw (*inner, key->curve, &dx, NULL, &dd);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	if (ret < 0) {
+		gnutls_privkey_deinit (*inner);
+		*inner = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Checks the parts are usable, so that bad keys are refused up front */
+static egg_sign_key *
+key_check (egg_sign_key *key)
+{
+	gnutls_privkey_t inner;
+
+	if (!key_import (key, &inner)) {
+		egg_sign_key_free (key);
+		return NULL;
+	}
+
+	gnutls_privkey_deinit (inner);
+	return key;
+}
+
+egg_sign_key *
+egg_sign_key_new_rsa (GBytes *n,
+                      GBytes *e,
+                      GBytes *d,
+                      GBytes *p,
+                      GBytes *q,
+                      GBytes *iqmp)
+{
+	egg_sign_key *key;
+
+	g_return_val_if_fail (n && e && d && p && q && iqmp, NULL);
+
+	key = g_new0 (egg_sign_key, 1);
+	key->type = KEY_RSA;
+	key->n = g_bytes_ref (n);
+	key->e = g_bytes_ref (e);
+	key->d = secure_bytes_copy (d);
+	key->p = secure_bytes_copy (p);
+	key->q = secure_bytes_copy (q);
+	key->iqmp = secure_bytes_copy (iqmp);
+	return key_check (key);
+}
+
+egg_sign_key *
+egg_sign_key_new_ecdsa (EggSignCurve curve,
+                        GBytes *q,
+                        GBytes *d)
+{
+	gnutls_ecc_curve_t inner_curve;
+	gnutls_sign_algorithm_t algo;
+	egg_sign_key *key;
+	const guchar *point;
+	gsize n_point;
+	gsize n_part;
+
+	g_return_val_if_fail (q && d, NULL);
+
+	switch (curve) {
+	case EGG_SIGN_CURVE_NIST_P256:
+		inner_curve = GNUTLS_ECC_CURVE_SECP256R1;
+		algo = GNUTLS_SIGN_ECDSA_SHA256;
+		n_part = 32;
+		break;
+	case EGG_SIGN_CURVE_NIST_P384:
+		inner_curve = GNUTLS_ECC_CURVE_SECP384R1;
+		algo = GNUTLS_SIGN_ECDSA_SHA384;
+		n_part = 48;
+		break;
+	case EGG_SIGN_CURVE_NIST_P521:
+		inner_curve = GNUTLS_ECC_CURVE_SECP521R1;
+		algo = GNUTLS_SIGN_ECDSA_SHA512;
+		n_part = 66;
+		break;
+	default:
+		g_return_val_if_reached (NULL);
+	}
+
+	/* Only the uncompressed point form is supported */
+	point = g_bytes_get_data (q, &n_point);
+	if (n_point != 1 + n_part * 2 || point[0] != 0x04)
+		return NULL;
+
+	key = g_new0 (egg_sign_key, 1);
+	key->type = KEY_ECDSA;
+	key->curve = inner_curve;
+	key->n_part = n_part;
+	key->algo = algo;
+	key->x = g_bytes_new_from_bytes (q, 1, n_part);
+	key->y = g_bytes_new_from_bytes (q, 1 + n_part, n_part);
+	key->d = secure_bytes_copy (d);
+	return key_check (key);
+}
+
+egg_sign_key *
+egg_sign_key_new_ed25519 (GBytes *public_key,
+                          GBytes *seed)
+{
+	egg_sign_key *key;
+
+	g_return_val_if_fail (public_key && seed, NULL);
+	g_return_val_if_fail (g_bytes_get_size (public_key) == 32, NULL);
+	g_return_val_if_fail (g_bytes_get_size (seed) == 32, NULL);
+
+	key = g_new0 (egg_sign_key, 1);
+	key->type = KEY_ED25519;
+	key->curve = GNUTLS_ECC_CURVE_ED25519;
+	key->n_part = 32;
+	key->algo = GNUTLS_SIGN_EDDSA_ED25519;
+	key->x = g_bytes_ref (public_key);
+	key->d = secure_bytes_copy (seed);
+	return key_check (key);
+}
+
+static gnutls_sign_algorithm_t
+rsa_algo_for_hash (EggSignHash hash)
+{
+	switch (hash) {
+	case EGG_SIGN_HASH_SHA1:
+		return GNUTLS_SIGN_RSA_SHA1;
+	case EGG_SIGN_HASH_SHA256:
+		return GNUTLS_SIGN_RSA_SHA256;
+	case EGG_SIGN_HASH_SHA384:
+		return GNUTLS_SIGN_RSA_SHA384;
+	case EGG_SIGN_HASH_SHA512:
+		return GNUTLS_SIGN_RSA_SHA512;
+	default:
+		g_return_val_if_reached (GNUTLS_SIGN_UNKNOWN);
+	}
+}
+
+/* Copy a number into the output, left padded to the given size */
+static gboolean
+copy_part (const gnutls_datum_t *part,
+           guchar *output,
+           gsize n_output)
+{
+	const guchar *data = part->data;
+	gsize n_data = part->size;
+
+	/* Strip any sign bytes that would make it overflow */
+	while (n_data > n_output && data[0] == 0) {
+		data++;
+		n_data--;
+	}
+
+	if (n_data > n_output)
+		return FALSE;
+
+	memset (output, 0, n_output - n_data);
+	memcpy (output + (n_output - n_data), data, n_data);
+	return TRUE;
+}
+
+GBytes *
+egg_sign_key_sign (egg_sign_key *key,
+                   EggSignHash hash,
+                   gconstpointer data,
+                   gsize n_data)
+{
+	gnutls_datum_t input;
+	gnutls_datum_t sig = { NULL, 0 };
+	gnutls_datum_t r = { NULL, 0 };
+	gnutls_datum_t s = { NULL, 0 };
+	gnutls_sign_algorithm_t algo;
+	gnutls_privkey_t inner;
+	guchar *output = NULL;
+	gsize n_output = 0;
+	gboolean ok = FALSE;
+	int ret;
+
+	g_return_val_if_fail (key != NULL, NULL);
+	g_return_val_if_fail (data != NULL || n_data == 0, NULL);
+
+	input.data = (void *)data;
+	input.size = n_data;
+
+	if (key->type == KEY_RSA)
+		algo = rsa_algo_for_hash (hash);
+	else
+		algo = key->algo;
+
+	if (!key_import (key, &inner))
+		return NULL;
+
+	ret = gnutls_privkey_sign_data2 (inner, algo, 0, &input, &sig);
+	gnutls_privkey_deinit (inner);
+	if (ret < 0) {
+		g_message ("signing failed: %s", gnutls_strerror (ret));
+		return NULL;
+	}
+
+	switch (key->type) {
+	case KEY_RSA:
+	case KEY_ED25519:
+		n_output = sig.size;
+		output = g_memdup2 (sig.data, sig.size);
+		ok = TRUE;
+		break;
+	case KEY_ECDSA:
+		/* The signature is a DER encoded Ecdsa-Sig-Value */
+		ret = gnutls_decode_rs_value (&sig, &r, &s);
+		if (ret < 0)
+			break;
+		n_output = key->n_part * 2;
+		output = g_malloc (n_output);
+		ok = copy_part (&r, output, key->n_part) &&
+		     copy_part (&s, output + key->n_part, key->n_part);
+		break;
+	default:
+		g_assert_not_reached ();
+	}
+
+	gnutls_free (sig.data);
+	gnutls_free (r.data);
+	gnutls_free (s.data);
+
+	if (!ok) {
+		g_free (output);
+		return NULL;
+	}
+
+	return g_bytes_new_take (output, n_output);
+}
+
+void
+egg_sign_key_free (egg_sign_key *key)
+{
+	if (!key)
+		return;
+	g_clear_pointer (&key->n, g_bytes_unref);
+	g_clear_pointer (&key->e, g_bytes_unref);
+	g_clear_pointer (&key->x, g_bytes_unref);
+	g_clear_pointer (&key->y, g_bytes_unref);
+	g_clear_pointer (&key->d, g_bytes_unref);
+	g_clear_pointer (&key->p, g_bytes_unref);
+	g_clear_pointer (&key->q, g_bytes_unref);
+	g_clear_pointer (&key->iqmp, g_bytes_unref);
+	g_free (key);
+}
@@ -0,0 +1,288 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "egg-sign.h"
+
+#include "egg-libgcrypt.h"
+#include "egg-secure-memory.h"
+
+#include <gcrypt.h>
+#include <string.h>
+
+typedef enum {
+	KEY_RSA,
+	KEY_ECDSA,
+	KEY_ED25519,
+} KeyType;
+
+struct egg_sign_key {
+	KeyType type;
+	gcry_sexp_t sexp;
+	gsize n_part;
+	int hash_algo;
+};
+
+static int
+hash_to_gcry (EggSignHash hash)
+{
+	switch (hash) {
+	case EGG_SIGN_HASH_SHA1:
+		return GCRY_MD_SHA1;
+	case EGG_SIGN_HASH_SHA256:
+		return GCRY_MD_SHA256;
+	case EGG_SIGN_HASH_SHA384:
+		return GCRY_MD_SHA384;
+	case EGG_SIGN_HASH_SHA512:
+		return GCRY_MD_SHA512;
+	default:
+		g_return_val_if_reached (GCRY_MD_NONE);
+	}
+}
+
+#define BYTES_ARG(b) (int)g_bytes_get_size (b), g_bytes_get_data (b, NULL)
+
+egg_sign_key *
+egg_sign_key_new_rsa (GBytes *n,
+                      GBytes *e,
+                      GBytes *d,
+                      GBytes *p,
+                      GBytes *q,
+                      GBytes *iqmp)
+{
+	egg_sign_key *key;
+	gcry_sexp_t sexp;
+	gcry_error_t gcry;
+
+	g_return_val_if_fail (n && e && d && p && q && iqmp, NULL);
+
+	egg_libgcrypt_initialize ();
+
+	/*
+	 * libgcrypt expects u = p^-1 mod q, so swap the primes around
+	 * to make iqmp = q^-1 mod p usable as is.
+	 */
+	gcry = gcry_sexp_build (&sexp, NULL,
+	                        "(private-key (rsa (n %b) (e %b) (d %b) (p %b) (q %b) (u %b)))",
+	                        BYTES_ARG (n), BYTES_ARG (e), BYTES_ARG (d),
+	                        BYTES_ARG (q), BYTES_ARG (p), BYTES_ARG (iqmp));
+	if (gcry != 0)
+		return NULL;
+
+	key = g_new0 (egg_sign_key, 1);
+	key->type = KEY_RSA;
+	key->sexp = sexp;
+	key->n_part = (gcry_pk_get_nbits (sexp) + 7) / 8;
+	if (key->n_part == 0) {
+		egg_sign_key_free (key);
+		return NULL;
+	}
+
+	return key;
+}
+
+egg_sign_key *
+egg_sign_key_new_ecdsa (EggSignCurve curve,
+                        GBytes *q,
+                        GBytes *d)
+{
+	egg_sign_key *key;
+	const gchar *name;
+	gcry_sexp_t sexp;
+	gcry_error_t gcry;
+	gsize n_part;
+	int hash_algo;
+
+	g_return_val_if_fail (q && d, NULL);
+
+	switch (curve) {
+	case EGG_SIGN_CURVE_NIST_P256:
+		name = "NIST P-256";
+		n_part = 32;
+		hash_algo = GCRY_MD_SHA256;
+		break;
+	case EGG_SIGN_CURVE_NIST_P384:
+		name = "NIST P-384";
+		n_part = 48;
+		hash_algo = GCRY_MD_SHA384;
+		break;
+	case EGG_SIGN_CURVE_NIST_P521:
+		name = "NIST P-521";
+		n_part = 66;
+		hash_algo = GCRY_MD_SHA512;
+		break;
+	default:
+		g_return_val_if_reached (NULL);
+	}
+
+	egg_libgcrypt_initialize ();
+
+	gcry = gcry_sexp_build (&sexp, NULL,
+	                        "(private-key (ecc (curve %s) (q %b) (d %b)))",
+	                        name, BYTES_ARG (q), BYTES_ARG (d));
+	if (gcry != 0)
+		return NULL;
+
+	key = g_new0 (egg_sign_key, 1);
+	key->type = KEY_ECDSA;
+	key->sexp = sexp;
+	key->n_part = n_part;
+	key->hash_algo = hash_algo;
+	return key;
+}
+
+egg_sign_key *
+egg_sign_key_new_ed25519 (GBytes *public_key,
+                          GBytes *seed)
+{
+	egg_sign_key *key;
+	gcry_sexp_t sexp;
+	gcry_error_t gcry;
+
+	g_return_val_if_fail (public_key && seed, NULL);
+	g_return_val_if_fail (g_bytes_get_size (public_key) == 32, NULL);
+	g_return_val_if_fail (g_bytes_get_size (seed) == 32, NULL);
+
+	egg_libgcrypt_initialize ();
+
+	gcry = gcry_sexp_build (&sexp, NULL,
+	                        "(private-key (ecc (curve Ed25519) (flags eddsa) (q %b) (d %b)))",
+	                        BYTES_ARG (public_key), BYTES_ARG (seed));
+	if (gcry != 0)
+		return NULL;
+
+	key = g_new0 (egg_sign_key, 1);
+	key->type = KEY_ED25519;
+	key->sexp = sexp;
+	key->n_part = 32;
+	return key;
+}
+
+/* Copy a number out of the signature, left padded to the given size */
+static gboolean
+extract_part (gcry_sexp_t sig,
+              const gchar *token,
+              guchar *output,
+              gsize n_output)
+{
+	gcry_sexp_t part;
+	const gchar *data;
+	size_t n_data;
+	gboolean ret = FALSE;
+
+	part = gcry_sexp_find_token (sig, token, 0);
+	if (part == NULL)
+		return FALSE;
+
+	data = gcry_sexp_nth_data (part, 1, &n_data);
+
+	/* Strip any sign bytes that would make it overflow */
+	while (data && n_data > n_output && data[0] == 0) {
+		data++;
+		n_data--;
+	}
+
+	if (data && n_data <= n_output) {
+		memset (output, 0, n_output - n_data);
+		memcpy (output + (n_output - n_data), data, n_data);
+		ret = TRUE;
+	}
+
+	gcry_sexp_release (part);
+	return ret;
+}
+
+GBytes *
+egg_sign_key_sign (egg_sign_key *key,
+                   EggSignHash hash,
+                   gconstpointer data,
+                   gsize n_data)
+{
+	guchar digest[64];
+	gcry_sexp_t sdata = NULL;
+	gcry_sexp_t sig = NULL;
+	gcry_error_t gcry;
+	guchar *output = NULL;
+	gsize n_output = 0;
+	gboolean ret = FALSE;
+	int algo;
+
+	g_return_val_if_fail (key != NULL, NULL);
+	g_return_val_if_fail (data != NULL || n_data == 0, NULL);
+
+	switch (key->type) {
+	case KEY_RSA:
+		algo = hash_to_gcry (hash);
+		gcry_md_hash_buffer (algo, digest, data, n_data);
+		gcry = gcry_sexp_build (&sdata, NULL, "(data (flags pkcs1) (hash %s %b))",
+		                        gcry_md_algo_name (algo),
+		                        (int)gcry_md_get_algo_dlen (algo), digest);
+		n_output = key->n_part;
+		break;
+	case KEY_ECDSA:
+		gcry_md_hash_buffer (key->hash_algo, digest, data, n_data);
+		gcry = gcry_sexp_build (&sdata, NULL, "(data (flags raw) (value %b))",
+		                        (int)gcry_md_get_algo_dlen (key->hash_algo), digest);
+		n_output = key->n_part * 2;
+		break;
+	case KEY_ED25519:
+		gcry = gcry_sexp_build (&sdata, NULL, "(data (flags eddsa) (hash-algo sha512) (value %b))",
+		                        (int)n_data, data);
+		n_output = key->n_part * 2;
+		break;
+	default:
+		g_return_val_if_reached (NULL);
+	}
+
+	if (gcry != 0)
+		goto out;
+
+	gcry = gcry_pk_sign (&sig, sdata, key->sexp);
+	if (gcry != 0) {
+		g_message ("signing failed: %s", gcry_strerror (gcry));
+		goto out;
+	}
+
+	output = g_malloc (n_output);
+	if (key->type == KEY_RSA)
+		ret = extract_part (sig, "s", output, n_output);
+	else
+		ret = extract_part (sig, "r", output, key->n_part) &&
+		      extract_part (sig, "s", output + key->n_part, key->n_part);
+
+ out:
+	egg_secure_clear (digest, sizeof (digest));
+	gcry_sexp_release (sdata);
+	gcry_sexp_release (sig);
+
+	if (!ret) {
+		g_free (output);
+		return NULL;
+	}
+
+	return g_bytes_new_take (output, n_output);
+}
+
+void
+egg_sign_key_free (egg_sign_key *key)
+{
+	if (!key)
+		return;
+	gcry_sexp_release (key->sexp);
+	g_free (key);
+}
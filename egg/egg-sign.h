@@ -0,0 +1,71 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EGG_SIGN_H_
+#define EGG_SIGN_H_
+
+#include <glib.h>
+
+typedef enum {
+	EGG_SIGN_HASH_SHA1,
+	EGG_SIGN_HASH_SHA256,
+	EGG_SIGN_HASH_SHA384,
+	EGG_SIGN_HASH_SHA512,
+} EggSignHash;
+
+typedef enum {
+	EGG_SIGN_CURVE_NIST_P256,
+	EGG_SIGN_CURVE_NIST_P384,
+	EGG_SIGN_CURVE_NIST_P521,
+} EggSignCurve;
+
+typedef struct egg_sign_key egg_sign_key;
+
+/*
+ * All the numbers are unsigned big endian, leading zeros are allowed.
+ * The iqmp coefficient is q^-1 mod p as in PKCS#1 and the SSH agent
+ * protocol.
+ */
+egg_sign_key *egg_sign_key_new_rsa     (GBytes *n,
+                                        GBytes *e,
+                                        GBytes *d,
+                                        GBytes *p,
+                                        GBytes *q,
+                                        GBytes *iqmp);
+
+/* The public point q is in uncompressed form */
+egg_sign_key *egg_sign_key_new_ecdsa   (EggSignCurve curve,
+                                        GBytes *q,
+                                        GBytes *d);
+
+egg_sign_key *egg_sign_key_new_ed25519 (GBytes *public_key,
+                                        GBytes *seed);
+
+/*
+ * The hash is ignored for Ed25519 and for ECDSA where it is determined
+ * by the curve. The signature is returned in its raw form: the PKCS#1
+ * v1.5 signature for RSA, r || s with each half the size of the curve
+ * order for ECDSA, and the 64 byte signature for Ed25519.
+ */
+GBytes       *egg_sign_key_sign        (egg_sign_key *key,
+                                        EggSignHash hash,
+                                        gconstpointer data,
+                                        gsize n_data);
+
+void          egg_sign_key_free        (egg_sign_key *key);
+
+#endif /* EGG_SIGN_H_ */
@@ -649,13 +649,305 @@ egg_symkey_generate_pbkdf2 (int cipher_algo, int hash_algo,
 	return ret;
 }
 
+/* ----------------------------------------------------------------------------
+ * DERIVED KEY CACHE
+ */
+
+/*
+ * The same password, salt and iteration count are often used for every
+ * bag in a PKCS#12 file, and each bag is tried with every password we know
+ * of. Remember derived keys so that each distinct set of parameters is
+ * only run through the key derivation function once.
+ */
+
+#define CACHE_MAX_ENTRIES 32
+
+enum {
+	KDF_PBE = 1,
+	KDF_PKCS12,
+	KDF_PKCS12_MAC,
+	KDF_PBKDF2,
+};
+
+typedef struct {
+	guint kdf;
+	int cipher_algo;
+	int hash_algo;
+	gulong iterations;
+	gsize n_salt;
+	gsize n_password;
+	gboolean null_password;
+} CacheInput;
+
+typedef struct {
+	guchar *input;
+	gsize n_input;
+	guchar *output;
+	gsize n_output;
+} CacheEntry;
+
+struct _EggSymkeyCache {
+	GMutex mutex;
+	GQueue entries;
+
+	/* Modified atomically, see egg_symkey_cache_get_derivations() */
+	gint derivations;
+};
+
+static void
+cache_entry_free (gpointer data)
+{
+	CacheEntry *entry = data;
+	egg_secure_free (entry->input);
+	egg_secure_free (entry->output);
+	g_free (entry);
+}
+
+EggSymkeyCache *
+egg_symkey_cache_new (void)
+{
+	EggSymkeyCache *cache;
+
+	cache = g_new0 (EggSymkeyCache, 1);
+	g_mutex_init (&cache->mutex);
+	g_queue_init (&cache->entries);
+	return cache;
+}
+
+void
+egg_symkey_cache_clear (EggSymkeyCache *cache)
+{
+	g_return_if_fail (cache != NULL);
+
+	g_mutex_lock (&cache->mutex);
+	g_queue_clear_full (&cache->entries, cache_entry_free);
+	g_mutex_unlock (&cache->mutex);
+}
+
+/* The number of times a key was derived rather than found, for tests */
+guint
+egg_symkey_cache_get_derivations (EggSymkeyCache *cache)
+{
+	g_return_val_if_fail (cache != NULL, 0);
+	return g_atomic_int_get (&cache->derivations);
+}
+
+void
+egg_symkey_cache_free (gpointer cache)
+{
+	EggSymkeyCache *self = cache;
+
+	if (self == NULL)
+		return;
+
+	egg_symkey_cache_clear (self);
+	g_mutex_clear (&self->mutex);
+	g_free (self);
+}
+
+static guchar *
+cache_build_input (guint kdf,
+                   int cipher_algo,
+                   int hash_algo,
+                   const gchar *password,
+                   gsize n_password,
+                   GBytes *salt,
+                   gulong iterations,
+                   gsize *n_input)
+{
+	CacheInput header;
+	gconstpointer salt_data;
+	guchar *input;
+	gsize n_salt;
+
+	salt_data = g_bytes_get_data (salt, &n_salt);
+
+	memset (&header, 0, sizeof (header));
+	header.kdf = kdf;
+	header.cipher_algo = cipher_algo;
+	header.hash_algo = hash_algo;
+	header.iterations = iterations;
+	header.n_salt = n_salt;
+	header.n_password = n_password;
+	header.null_password = (password == NULL);
+
+	*n_input = sizeof (header) + n_salt + n_password;
+	input = egg_secure_alloc (*n_input);
+	memcpy (input, &header, sizeof (header));
+	if (n_salt)
+		memcpy (input + sizeof (header), salt_data, n_salt);
+	if (n_password)
+		memcpy (input + sizeof (header) + n_salt, password, n_password);
+
+	return input;
+}
+
+static gboolean
+cache_lookup (EggSymkeyCache *cache,
+              const guchar *input,
+              gsize n_input,
+              guchar *output,
+              gsize n_output)
+{
+	CacheEntry *entry;
+	GList *l;
+
+	g_mutex_lock (&cache->mutex);
+
+	for (l = cache->entries.head; l != NULL; l = g_list_next (l)) {
+		entry = l->data;
+		if (entry->n_input == n_input && entry->n_output == n_output &&
+		    memcmp (entry->input, input, n_input) == 0) {
+			memcpy (output, entry->output, n_output);
+			g_queue_unlink (&cache->entries, l);
+			g_queue_push_head_link (&cache->entries, l);
+			break;
+		}
+	}
+
+	g_mutex_unlock (&cache->mutex);
+	return l != NULL;
+}
+
+static void
+cache_store (EggSymkeyCache *cache,
+             guchar *input,
+             gsize n_input,
+             guchar *output,
+             gsize n_output)
+{
+	CacheEntry *entry;
+	GList *l;
+
+	g_mutex_lock (&cache->mutex);
+
+	/* Another thread may have derived the same key meanwhile */
+	for (l = cache->entries.head; l != NULL; l = g_list_next (l)) {
+		entry = l->data;
+		if (entry->n_input == n_input && memcmp (entry->input, input, n_input) == 0)
+			break;
+	}
+
+	if (l == NULL) {
+		entry = g_new0 (CacheEntry, 1);
+		entry->input = input;
+		entry->n_input = n_input;
+		entry->output = output;
+		entry->n_output = n_output;
+		g_queue_push_head (&cache->entries, entry);
+		input = output = NULL;
+
+		while (cache->entries.length > CACHE_MAX_ENTRIES)
+			cache_entry_free (g_queue_pop_tail (&cache->entries));
+	}
+
+	g_mutex_unlock (&cache->mutex);
+
+	egg_secure_free (input);
+	egg_secure_free (output);
+}
+
+static gboolean
+derive_key (EggSymkeyCache *cache,
+            guint kdf,
+            int cipher_algo,
+            int hash_algo,
+            const gchar *password,
+            gsize n_password,
+            GBytes *salt,
+            gulong iterations,
+            guchar **key,
+            gsize n_key,
+            guchar **iv,
+            gsize n_iv)
+{
+	const guchar *salt_data;
+	guchar *input = NULL;
+	guchar *output = NULL;
+	gsize n_salt, n_input;
+	gboolean ret;
+
+	g_assert (key != NULL);
+
+	if (password == NULL)
+		n_password = 0;
+	else if (n_password == (gsize)-1)
+		n_password = strlen (password);
+
+	if (iv == NULL)
+		n_iv = 0;
+
+	*key = NULL;
+	if (iv)
+		*iv = NULL;
+
+	if (cache != NULL) {
+		input = cache_build_input (kdf, cipher_algo, hash_algo, password, n_password,
+		                           salt, iterations, &n_input);
+		output = egg_secure_alloc (n_key + n_iv);
+		if (cache_lookup (cache, input, n_input, output, n_key + n_iv)) {
+			*key = egg_secure_alloc (n_key);
+			memcpy (*key, output, n_key);
+			if (n_iv)
+				*iv = g_memdup2 (output + n_key, n_iv);
+			egg_secure_free (input);
+			egg_secure_free (output);
+			return TRUE;
+		}
+	}
+
+	salt_data = g_bytes_get_data (salt, &n_salt);
+
+	switch (kdf) {
+	case KDF_PBE:
+		ret = egg_symkey_generate_pbe (cipher_algo, hash_algo, password, n_password,
+		                               salt_data, n_salt, iterations,
+		                               key, n_iv ? iv : NULL);
+		break;
+	case KDF_PKCS12:
+		ret = egg_symkey_generate_pkcs12 (cipher_algo, hash_algo, password, n_password,
+		                                  salt_data, n_salt, iterations,
+		                                  key, n_iv ? iv : NULL);
+		break;
+	case KDF_PKCS12_MAC:
+		ret = egg_symkey_generate_pkcs12_mac (hash_algo, password, n_password,
+		                                      salt_data, n_salt, iterations, key);
+		break;
+	case KDF_PBKDF2:
+		ret = egg_symkey_generate_pbkdf2 (cipher_algo, hash_algo, password, n_password,
+		                                  salt_data, n_salt, iterations, key, NULL);
+		break;
+	default:
+		g_assert_not_reached ();
+		ret = FALSE;
+		break;
+	}
+
+	if (cache == NULL)
+		return ret;
+
+	g_atomic_int_inc (&cache->derivations);
+	if (ret) {
+		memcpy (output, *key, n_key);
+		if (n_iv)
+			memcpy (output + n_key, *iv, n_iv);
+		cache_store (cache, input, n_input, output, n_key + n_iv);
+	} else {
+		egg_secure_free (input);
+		egg_secure_free (output);
+	}
+
+	return ret;
+}
+
 /* ----------------------------------------------------------------------------
  * DER encoded cipher params
  */
 
 
 static gboolean
-read_cipher_pkcs5_pbe (int cipher_algo,
+read_cipher_pkcs5_pbe (EggSymkeyCache *cache,
+                       int cipher_algo,
                        int cipher_mode,
                        int hash_algo,
                        const gchar *password,
@@ -699,9 +991,8 @@ read_cipher_pkcs5_pbe (int cipher_algo,
 	g_return_val_if_fail (n_key > 0, FALSE);
 	n_block = gcry_cipher_get_algo_blklen (cipher_algo);
 
-	if (!egg_symkey_generate_pbe (cipher_algo, hash_algo, password, n_password,
-	                              g_bytes_get_data (salt, NULL), g_bytes_get_size (salt),
-	                              iterations, &key, n_block > 1 ? &iv : NULL))
+	if (!derive_key (cache, KDF_PBE, cipher_algo, hash_algo, password, n_password,
+	                 salt, iterations, &key, n_key, n_block > 1 ? &iv : NULL, n_block))
 		goto done;
 
 	gcry = gcry_cipher_open (cih, cipher_algo, cipher_mode, 0);
@@ -802,7 +1093,8 @@ setup_pkcs5_des_params (GNode *any,
 }
 
 static gboolean
-setup_pkcs5_pbkdf2_params (const gchar *password,
+setup_pkcs5_pbkdf2_params (EggSymkeyCache *cache,
+                           const gchar *password,
                            gsize n_password,
                            GNode *any,
                            int cipher_algo,
@@ -831,14 +1123,13 @@ setup_pkcs5_pbkdf2_params (const gchar *password,
 	if (!salt)
 		goto done;
 
-	if (!egg_symkey_generate_pbkdf2 (cipher_algo, GCRY_MD_SHA1, password, n_password,
-	                                 g_bytes_get_data (salt, NULL), g_bytes_get_size (salt),
-	                                 iterations, &key, NULL))
-		goto done;
-
 	n_key = gcry_cipher_get_algo_keylen (cipher_algo);
 	g_return_val_if_fail (n_key > 0, FALSE);
 
+	if (!derive_key (cache, KDF_PBKDF2, cipher_algo, GCRY_MD_SHA1, password, n_password,
+	                 salt, iterations, &key, n_key, NULL, 0))
+		goto done;
+
 	gcry = gcry_cipher_setkey (cih, key, n_key);
 	if (gcry != 0) {
 		g_message ("couldn't set %lu byte key on cipher", (gulong)n_key);
@@ -856,7 +1147,8 @@ done:
 }
 
 static gboolean
-read_cipher_pkcs5_pbes2 (const gchar *password,
+read_cipher_pkcs5_pbes2 (EggSymkeyCache *cache,
+                         const gchar *password,
                          gsize n_password,
                          GNode *data,
                          gcry_cipher_hd_t *cih)
@@ -943,7 +1235,7 @@ read_cipher_pkcs5_pbes2 (const gchar *password,
 	params = egg_asn1x_node (asn, "keyDerivationFunc", "parameters", NULL);
 	g_return_val_if_fail (params != NULL, FALSE);
 
-	ret = setup_pkcs5_pbkdf2_params (password, n_password, params, algo, *cih);
+	ret = setup_pkcs5_pbkdf2_params (cache, password, n_password, params, algo, *cih);
 
 done:
 	if (ret != TRUE && *cih) {
@@ -956,7 +1248,8 @@ done:
 }
 
 static gboolean
-read_cipher_pkcs12_pbe (int cipher_algo,
+read_cipher_pkcs12_pbe (EggSymkeyCache *cache,
+                        int cipher_algo,
                         int cipher_mode,
                         const gchar *password,
                         gsize n_password,
@@ -996,9 +1289,8 @@ read_cipher_pkcs12_pbe (int cipher_algo,
 	n_key = gcry_cipher_get_algo_keylen (cipher_algo);
 
 	/* Generate IV and key using salt read above */
-	if (!egg_symkey_generate_pkcs12 (cipher_algo, GCRY_MD_SHA1, password, n_password,
-	                                 g_bytes_get_data (salt, NULL), g_bytes_get_size (salt),
-	                                 iterations, &key, n_block > 1 ? &iv : NULL))
+	if (!derive_key (cache, KDF_PKCS12, cipher_algo, GCRY_MD_SHA1, password, n_password,
+	                 salt, iterations, &key, n_key, n_block > 1 ? &iv : NULL, n_block))
 		goto done;
 
 	gcry = gcry_cipher_open (cih, cipher_algo, cipher_mode, 0);
@@ -1028,7 +1320,8 @@ done:
 }
 
 static gboolean
-read_mac_pkcs12_pbe (int hash_algo,
+read_mac_pkcs12_pbe (EggSymkeyCache *cache,
+                     int hash_algo,
                      const gchar *password,
                      gsize n_password,
                      GNode *data,
@@ -1070,9 +1363,8 @@ read_mac_pkcs12_pbe (int hash_algo,
 	n_key = gcry_md_get_algo_dlen (hash_algo);
 
 	/* Generate IV and key using salt read above */
-	if (!egg_symkey_generate_pkcs12_mac (hash_algo, password, n_password,
-	                                     g_bytes_get_data (salt, NULL), g_bytes_get_size (salt),
-	                                     iterations, &key))
+	if (!derive_key (cache, KDF_PKCS12_MAC, 0, hash_algo, password, n_password,
+	                 salt, iterations, &key, n_key, NULL, 0))
 		goto done;
 
 	gcry = gcry_md_open (mdh, hash_algo, GCRY_MD_FLAG_HMAC);
@@ -1100,37 +1392,34 @@ done:
 	return ret;
 }
 
-gboolean
-egg_symkey_read_cipher (GQuark oid_scheme,
-                        const gchar *password,
-                        gsize n_password,
-                        GNode *data,
-                        gcry_cipher_hd_t *cih)
+static gboolean
+read_cipher_full (EggSymkeyCache *cache,
+                  GQuark oid_scheme,
+                  const gchar *password,
+                  gsize n_password,
+                  GNode *data,
+                  gcry_cipher_hd_t *cih)
 {
 	gboolean ret = FALSE;
 
-	g_return_val_if_fail (oid_scheme != 0, FALSE);
-	g_return_val_if_fail (cih != NULL, FALSE);
-	g_return_val_if_fail (data != NULL, FALSE);
-
 	init_quarks ();
 
 	/* PKCS#5 PBE */
 	if (oid_scheme == OID_PBE_MD2_DES_CBC)
-		ret = read_cipher_pkcs5_pbe (GCRY_CIPHER_DES, GCRY_CIPHER_MODE_CBC,
+		ret = read_cipher_pkcs5_pbe (cache, GCRY_CIPHER_DES, GCRY_CIPHER_MODE_CBC,
 		                             GCRY_MD_MD2, password, n_password, data, cih);
 
 	else if (oid_scheme == OID_PBE_MD2_RC2_CBC)
 		/* RC2-64 has no implementation in libgcrypt */;
 
 	else if (oid_scheme == OID_PBE_MD5_DES_CBC)
-		ret = read_cipher_pkcs5_pbe (GCRY_CIPHER_DES, GCRY_CIPHER_MODE_CBC,
+		ret = read_cipher_pkcs5_pbe (cache, GCRY_CIPHER_DES, GCRY_CIPHER_MODE_CBC,
 		                             GCRY_MD_MD5, password, n_password, data, cih);
 	else if (oid_scheme == OID_PBE_MD5_RC2_CBC)
 		/* RC2-64 has no implementation in libgcrypt */;
 
 	else if (oid_scheme == OID_PBE_SHA1_DES_CBC)
-		ret = read_cipher_pkcs5_pbe (GCRY_CIPHER_DES, GCRY_CIPHER_MODE_CBC,
+		ret = read_cipher_pkcs5_pbe (cache, GCRY_CIPHER_DES, GCRY_CIPHER_MODE_CBC,
 		                             GCRY_MD_SHA1, password, n_password, data, cih);
 	else if (oid_scheme == OID_PBE_SHA1_RC2_CBC)
 		/* RC2-64 has no implementation in libgcrypt */;
@@ -1138,36 +1427,108 @@ egg_symkey_read_cipher (GQuark oid_scheme,
 
 	/* PKCS#5 PBES2 */
 	else if (oid_scheme == OID_PBES2)
-		ret = read_cipher_pkcs5_pbes2 (password, n_password, data, cih);
+		ret = read_cipher_pkcs5_pbes2 (cache, password, n_password, data, cih);
 
 
 	/* PKCS#12 PBE */
 	else if (oid_scheme == OID_PKCS12_PBE_ARCFOUR_SHA1)
-		ret = read_cipher_pkcs12_pbe (GCRY_CIPHER_ARCFOUR, GCRY_CIPHER_MODE_STREAM,
+		ret = read_cipher_pkcs12_pbe (cache, GCRY_CIPHER_ARCFOUR, GCRY_CIPHER_MODE_STREAM,
 		                              password, n_password, data, cih);
 	else if (oid_scheme == OID_PKCS12_PBE_RC4_40_SHA1)
 		/* RC4-40 has no implementation in libgcrypt */;
 
 	else if (oid_scheme == OID_PKCS12_PBE_3DES_SHA1)
-		ret = read_cipher_pkcs12_pbe (GCRY_CIPHER_3DES, GCRY_CIPHER_MODE_CBC,
+		ret = read_cipher_pkcs12_pbe (cache, GCRY_CIPHER_3DES, GCRY_CIPHER_MODE_CBC,
 		                              password, n_password, data, cih);
 	else if (oid_scheme == OID_PKCS12_PBE_2DES_SHA1)
 		/* 2DES has no implementation in libgcrypt */;
 
 	else if (oid_scheme == OID_PKCS12_PBE_RC2_128_SHA1)
-		ret = read_cipher_pkcs12_pbe (GCRY_CIPHER_RFC2268_128, GCRY_CIPHER_MODE_CBC,
+		ret = read_cipher_pkcs12_pbe (cache, GCRY_CIPHER_RFC2268_128, GCRY_CIPHER_MODE_CBC,
 		                              password, n_password, data, cih);
 
 	else if (oid_scheme == OID_PKCS12_PBE_RC2_40_SHA1)
-		ret = read_cipher_pkcs12_pbe (GCRY_CIPHER_RFC2268_40, GCRY_CIPHER_MODE_CBC,
+		ret = read_cipher_pkcs12_pbe (cache, GCRY_CIPHER_RFC2268_40, GCRY_CIPHER_MODE_CBC,
 		                              password, n_password, data, cih);
 
+	return ret;
+}
+
+static gboolean
+read_mac_full (EggSymkeyCache *cache,
+               GQuark oid_scheme,
+               const gchar *password,
+               gsize n_password,
+               GNode *data,
+               gcry_md_hd_t *mdh,
+               gsize *digest_len)
+{
+	gboolean ret = FALSE;
+
+	init_quarks ();
+
+	/* PKCS#12 MAC with SHA-1 */
+	if (oid_scheme == OID_SHA1)
+		ret = read_mac_pkcs12_pbe (cache, GCRY_MD_SHA1, password, n_password,
+		                           data, mdh, digest_len);
+
+	return ret;
+}
+
+gboolean
+egg_symkey_read_cipher_cached (EggSymkeyCache *cache,
+                               GQuark oid_scheme,
+                               const gchar *password,
+                               gsize n_password,
+                               GNode *data,
+                               gcry_cipher_hd_t *cih)
+{
+	gboolean ret;
+
+	g_return_val_if_fail (oid_scheme != 0, FALSE);
+	g_return_val_if_fail (cih != NULL, FALSE);
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	ret = read_cipher_full (cache, oid_scheme, password, n_password, data, cih);
 	if (ret == FALSE)
 		g_message ("unsupported or invalid cipher: %s", g_quark_to_string (oid_scheme));
 
 	return ret;
 }
 
+gboolean
+egg_symkey_read_cipher (GQuark oid_scheme,
+                        const gchar *password,
+                        gsize n_password,
+                        GNode *data,
+                        gcry_cipher_hd_t *cih)
+{
+	return egg_symkey_read_cipher_cached (NULL, oid_scheme, password,
+	                                      n_password, data, cih);
+}
+
+gboolean
+egg_symkey_read_mac_cached (EggSymkeyCache *cache,
+                            GQuark oid_scheme,
+                            const gchar *password,
+                            gsize n_password,
+                            GNode *data,
+                            gcry_md_hd_t *mdh,
+                            gsize *digest_len)
+{
+	gboolean ret;
+
+	g_return_val_if_fail (oid_scheme != 0, FALSE);
+	g_return_val_if_fail (mdh != NULL, FALSE);
+	g_return_val_if_fail (data != NULL, FALSE);
+
+	ret = read_mac_full (cache, oid_scheme, password, n_password, data, mdh, digest_len);
+	if (ret == FALSE)
+		g_message ("unsupported or invalid mac: %s", g_quark_to_string (oid_scheme));
+
+	return ret;
+}
+
 gboolean
 egg_symkey_read_mac (GQuark oid_scheme,
                      const gchar *password,
@@ -1176,21 +1537,117 @@ egg_symkey_read_mac (GQuark oid_scheme,
                      gcry_md_hd_t *mdh,
                      gsize *digest_len)
 {
-	gboolean ret = FALSE;
+	return egg_symkey_read_mac_cached (NULL, oid_scheme, password,
+	                                   n_password, data, mdh, digest_len);
+}
 
-	g_return_val_if_fail (oid_scheme != 0, FALSE);
-	g_return_val_if_fail (mdh != NULL, FALSE);
-	g_return_val_if_fail (data != NULL, FALSE);
+/* ----------------------------------------------------------------------------
+ * PARALLEL KEY DERIVATION
+ */
 
-	init_quarks ();
+typedef struct {
+	EggSymkeyCache *cache;
+	GQuark oid_scheme;
+	gboolean mac;
+	const gchar **passwords;
+	GNode *data;
+} PrepareClosure;
 
-	/* PKCS#12 MAC with SHA-1 */
-	if (oid_scheme == OID_SHA1)
-		ret = read_mac_pkcs12_pbe (GCRY_MD_SHA1, password, n_password,
-		                           data, mdh, digest_len);
+static void
+prepare_password (gpointer data,
+                  gpointer user_data)
+{
+	PrepareClosure *closure = user_data;
+	const gchar *password;
+	gcry_cipher_hd_t cih = NULL;
+	gcry_md_hd_t mdh = NULL;
+
+	/* Indexes are offset by one, as the pool doesn't accept NULL */
+	password = closure->passwords[GPOINTER_TO_UINT (data) - 1];
+
+	/* Only the side effect of filling the cache is interesting */
+	if (closure->mac) {
+		if (read_mac_full (closure->cache, closure->oid_scheme, password, -1,
+		                   closure->data, &mdh, NULL))
+			gcry_md_close (mdh);
+	} else {
+		if (read_cipher_full (closure->cache, closure->oid_scheme, password, -1,
+		                      closure->data, &cih))
+			gcry_cipher_close (cih);
+	}
+}
 
-	if (ret == FALSE)
-		g_message ("unsupported or invalid mac: %s", g_quark_to_string (oid_scheme));
+static void
+prepare_passwords (EggSymkeyCache *cache,
+                   GQuark oid_scheme,
+                   gboolean mac,
+                   const gchar **passwords,
+                   guint n_passwords,
+                   GNode *data)
+{
+	PrepareClosure closure = { cache, oid_scheme, mac, passwords, data };
+	GThreadPool *pool = NULL;
+	GArray *unique;
+	guint n_threads;
+	guint i, j;
+
+	/* The same password twice would be derived twice at the same time */
+	unique = g_array_new (FALSE, FALSE, sizeof (guint));
+	for (i = 0; i < n_passwords; i++) {
+		for (j = 0; j < i; j++) {
+			if (g_strcmp0 (passwords[i], passwords[j]) == 0)
+				break;
+		}
+		if (j == i)
+			g_array_append_val (unique, i);
+	}
 
-	return ret;
+	/* Not worth spinning up threads for a single derivation */
+	n_threads = MIN (unique->len, g_get_num_processors ());
+	if (n_threads >= 2)
+		pool = g_thread_pool_new (prepare_password, &closure, n_threads, FALSE, NULL);
+
+	if (pool == NULL) {
+		for (i = 0; i < unique->len; i++)
+			prepare_password (GUINT_TO_POINTER (g_array_index (unique, guint, i) + 1), &closure);
+		g_array_free (unique, TRUE);
+		return;
+	}
+
+	for (i = 0; i < unique->len; i++)
+		g_thread_pool_push (pool, GUINT_TO_POINTER (g_array_index (unique, guint, i) + 1), NULL);
+	g_array_free (unique, TRUE);
+
+	/* Waits for all the derivations to complete */
+	g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+void
+egg_symkey_cache_prepare_cipher (EggSymkeyCache *cache,
+                                 GQuark oid_scheme,
+                                 const gchar **passwords,
+                                 guint n_passwords,
+                                 GNode *data)
+{
+	g_return_if_fail (cache != NULL);
+	g_return_if_fail (oid_scheme != 0);
+	g_return_if_fail (passwords != NULL || n_passwords == 0);
+	g_return_if_fail (data != NULL);
+
+	prepare_passwords (cache, oid_scheme, FALSE, passwords, n_passwords, data);
+}
+
+void
+egg_symkey_cache_prepare_mac (EggSymkeyCache *cache,
+                              GQuark oid_scheme,
+                              const gchar **passwords,
+                              guint n_passwords,
+                              GNode *data)
+{
+	g_return_if_fail (cache != NULL);
+	g_return_if_fail (oid_scheme != 0);
+	g_return_if_fail (passwords != NULL || n_passwords == 0);
+	g_return_if_fail (data != NULL);
+
+	prepare_passwords (cache, oid_scheme, TRUE, passwords, n_passwords, data);
 }
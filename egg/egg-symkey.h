@@ -72,6 +72,28 @@ gboolean                 egg_symkey_generate_pbkdf2             (int cipher_algo
                                                                  guchar **key,
                                                                  guchar **iv);
 
+typedef struct _EggSymkeyCache EggSymkeyCache;
+
+EggSymkeyCache *         egg_symkey_cache_new                   (void);
+
+void                     egg_symkey_cache_clear                 (EggSymkeyCache *cache);
+
+void                     egg_symkey_cache_free                  (gpointer cache);
+
+guint                    egg_symkey_cache_get_derivations       (EggSymkeyCache *cache);
+
+void                     egg_symkey_cache_prepare_cipher        (EggSymkeyCache *cache,
+                                                                 GQuark oid_scheme,
+                                                                 const gchar **passwords,
+                                                                 guint n_passwords,
+                                                                 GNode *params);
+
+void                     egg_symkey_cache_prepare_mac           (EggSymkeyCache *cache,
+                                                                 GQuark oid_scheme,
+                                                                 const gchar **passwords,
+                                                                 guint n_passwords,
+                                                                 GNode *params);
+
 gboolean                 egg_symkey_read_cipher                 (GQuark oid_scheme,
                                                                  const gchar *password,
                                                                  gsize n_password,
@@ -85,4 +107,19 @@ gboolean                 egg_symkey_read_mac                    (GQuark oid_sche
                                                                  gcry_md_hd_t *mdh,
                                                                  gsize *digest_len);
 
+gboolean                 egg_symkey_read_cipher_cached          (EggSymkeyCache *cache,
+                                                                 GQuark oid_scheme,
+                                                                 const gchar *password,
+                                                                 gsize n_password,
+                                                                 GNode *params,
+                                                                 gcry_cipher_hd_t *cih);
+
+gboolean                 egg_symkey_read_mac_cached             (EggSymkeyCache *cache,
+                                                                 GQuark oid_scheme,
+                                                                 const gchar *password,
+                                                                 gsize n_password,
+                                                                 GNode *params,
+                                                                 gcry_md_hd_t *mdh,
+                                                                 gsize *digest_len);
+
 #endif /* EGG_SYMKEY_H_ */
@@ -2127,6 +2127,46 @@ test_count (Test* test, gconstpointer unused)
 	g_assert_cmpuint (egg_asn1x_count (node), ==, 7);
 }
 
+static void
+test_first_next (Test* test, gconstpointer unused)
+{
+	GNode *node;
+	GNode *child;
+	guint count = 0;
+
+	node = egg_asn1x_node (test->asn1, "tbsCertificate", "issuer", "rdnSequence", NULL);
+	g_assert (node);
+
+	for (child = egg_asn1x_first (node); child; child = egg_asn1x_next (child)) {
+		g_assert (child == egg_asn1x_node (node, ++count, NULL));
+		g_assert (egg_asn1x_first (child) == egg_asn1x_node (child, 1, NULL));
+	}
+
+	g_assert_cmpuint (count, ==, 7);
+}
+
+static void
+test_first_next_empty (void)
+{
+	GNode *asn;
+
+	asn = egg_asn1x_create (test_asn1_tab, "TestSeqOf");
+	g_assert (asn);
+
+	g_assert (egg_asn1x_first (asn) == NULL);
+
+	/* Appended but without any data */
+	egg_asn1x_append (asn);
+	g_assert (egg_asn1x_first (asn) == NULL);
+
+	egg_asn1x_set_integer_as_ulong (egg_asn1x_append (asn), 2);
+	g_assert (egg_asn1x_first (asn) != NULL);
+	g_assert (egg_asn1x_first (asn) == egg_asn1x_node (asn, 1, NULL));
+	g_assert (egg_asn1x_next (egg_asn1x_first (asn)) == NULL);
+
+	egg_asn1x_destroy (asn);
+}
+
 static void
 test_nested_fails_with_extra (void)
 {
@@ -2479,6 +2519,8 @@ main (int argc, char **argv)
 	g_test_add ("/asn1/create_by_oid_invalid", Test, NULL, setup, test_create_by_oid_invalid, teardown);
 	g_test_add ("/asn1/create_by_bad_order", Test, NULL, setup, test_create_by_bad_order, teardown);
 	g_test_add ("/asn1/count", Test, NULL, setup, test_count, teardown);
+	g_test_add ("/asn1/first_next", Test, NULL, setup, test_first_next, teardown);
+	g_test_add_func ("/asn1/first_next_empty", test_first_next_empty);
 
 	return g_test_run ();
 }
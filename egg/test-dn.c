@@ -77,6 +77,21 @@ test_read_dn (Test* test, gconstpointer unused)
 	g_free (dn);
 }
 
+static void
+test_append_dn (Test* test, gconstpointer unused)
+{
+	GString *result;
+	GNode *node;
+
+	node = egg_asn1x_node (test->asn1, "tbsCertificate", "subject", "rdnSequence", NULL);
+	result = g_string_new ("Subject: ");
+
+	g_assert (egg_dn_append (result, node));
+	g_assert_cmpstr (result->str, ==, "Subject: C=ZA, ST=Western Cape, L=Cape Town, O=Thawte Consulting, OU=Certification Services Division, CN=Thawte Personal Premium CA, EMAIL=personal-premium@thawte.com");
+
+	g_string_free (result, TRUE);
+}
+
 static void
 test_dn_value (Test* test, gconstpointer unused)
 {
@@ -217,16 +232,81 @@ test_add_dn_part (Test *test,
 	g_bytes_unref (check);
 }
 
+static void
+add_utf8_part (GNode *asn,
+               const gchar *oid,
+               const gchar *string)
+{
+	GNode *node;
+	GNode *value;
+
+	node = egg_asn1x_append (egg_asn1x_append (asn));
+	egg_asn1x_set_oid_as_quark (egg_asn1x_node (node, "type", NULL), g_quark_from_static_string (oid));
+
+	value = egg_asn1x_create_quark (pkix_asn1_tab, g_quark_from_static_string (oid));
+	if (egg_asn1x_type (value) == EGG_ASN1X_CHOICE) {
+		egg_asn1x_set_choice (value, egg_asn1x_node (value, "utf8String", NULL));
+		egg_asn1x_set_string_as_utf8 (egg_asn1x_get_choice (value), g_strdup (string), g_free);
+	} else {
+		egg_asn1x_set_string_as_utf8 (value, g_strdup (string), g_free);
+	}
+
+	egg_asn1x_set_any_from (egg_asn1x_node (node, "value", NULL), value);
+	egg_asn1x_destroy (value);
+}
+
+static void
+test_canonicalize (Test *test,
+                   gconstpointer unused)
+{
+	GBytes *canonical;
+	GBytes *check;
+	GNode *asn;
+	GNode *node;
+
+	check = egg_dn_canonicalize (egg_asn1x_node (test->asn1, "tbsCertificate", "issuer", "rdnSequence", NULL));
+	g_assert (check != NULL);
+
+	/* UTF8String instead of PrintableString, different case and spacing */
+	asn = egg_asn1x_create (pkix_asn1_tab, "Name");
+	node = egg_asn1x_node (asn, "rdnSequence", NULL);
+	egg_asn1x_set_choice (asn, node);
+	add_utf8_part (node, "2.5.4.6", "za");
+	add_utf8_part (node, "2.5.4.8", "  Western   CAPE ");
+	add_utf8_part (node, "2.5.4.7", "Cape Town");
+	add_utf8_part (node, "2.5.4.10", "thawte consulting");
+	add_utf8_part (node, "2.5.4.11", "Certification Services Division");
+	add_utf8_part (node, "2.5.4.3", "Thawte Personal Premium CA");
+	egg_dn_add_string_part (node, g_quark_from_static_string ("1.2.840.113549.1.9.1"), "personal-premium@thawte.com");
+
+	canonical = egg_dn_canonicalize (node);
+	g_assert (canonical != NULL);
+	g_assert (g_bytes_equal (canonical, check));
+	g_bytes_unref (canonical);
+
+	/* But a different value isn't the same */
+	add_utf8_part (node, "2.5.4.3", "Another");
+	canonical = egg_dn_canonicalize (node);
+	g_assert (canonical != NULL);
+	g_assert (!g_bytes_equal (canonical, check));
+	g_bytes_unref (canonical);
+
+	egg_asn1x_destroy (asn);
+	g_bytes_unref (check);
+}
+
 int
 main (int argc, char **argv)
 {
 	g_test_init (&argc, &argv, NULL);
 
 	g_test_add ("/dn/read_dn", Test, NULL, setup, test_read_dn, teardown);
+	g_test_add ("/dn/append_dn", Test, NULL, setup, test_append_dn, teardown);
 	g_test_add ("/dn/dn_value", Test, NULL, setup, test_dn_value, teardown);
 	g_test_add ("/dn/parse_dn", Test, NULL, setup, test_parse_dn, teardown);
 	g_test_add ("/dn/read_dn_part", Test, NULL, setup, test_read_dn_part, teardown);
 	g_test_add ("/dn/add_dn_part", Test, NULL, setup, test_add_dn_part, teardown);
+	g_test_add ("/dn/canonicalize", Test, NULL, setup, test_canonicalize, teardown);
 
 	return g_test_run ();
 }
@@ -0,0 +1,126 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#undef G_DISABLE_ASSERT
+
+#include "egg/egg-ecdh.h"
+#include "egg/egg-secure-memory.h"
+#include "egg/egg-testing.h"
+
+#include <glib.h>
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+static gboolean
+skip_without_x25519 (void)
+{
+	if (!egg_ecdh_is_supported (EGG_ECDH_X25519)) {
+		g_test_skip ("x25519 is not supported by the crypto backend");
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+test_perform (void)
+{
+	egg_ecdh_privkey *x1, *x2;
+	GBytes *y1, *y2;
+	GBytes *k1, *k2;
+	gboolean ret;
+
+	if (skip_without_x25519 ())
+		return;
+
+	ret = egg_ecdh_gen_pair (EGG_ECDH_X25519, &y1, &x1);
+	g_assert_true (ret);
+	ret = egg_ecdh_gen_pair (EGG_ECDH_X25519, &y2, &x2);
+	g_assert_true (ret);
+
+	g_assert_cmpuint (g_bytes_get_size (y1), ==, 32);
+	g_assert_false (g_bytes_equal (y1, y2));
+
+	k1 = egg_ecdh_gen_secret (x2, y1);
+	g_assert_nonnull (k1);
+	k2 = egg_ecdh_gen_secret (x1, y2);
+	g_assert_nonnull (k2);
+
+	/* Keys must be the same */
+	g_assert_cmpmem (g_bytes_get_data (k1, NULL), g_bytes_get_size (k1),
+			 g_bytes_get_data (k2, NULL), g_bytes_get_size (k2));
+
+	egg_ecdh_privkey_free (x1);
+	egg_ecdh_privkey_free (x2);
+	g_bytes_unref (y1);
+	g_bytes_unref (y2);
+	g_bytes_unref (k1);
+	g_bytes_unref (k2);
+}
+
+static void
+test_bad_peer (void)
+{
+	static const guchar zeros[32] = { 0, };
+	egg_ecdh_privkey *x1;
+	GBytes *y1, *peer;
+	gboolean ret;
+
+	if (skip_without_x25519 ())
+		return;
+
+	ret = egg_ecdh_gen_pair (EGG_ECDH_X25519, &y1, &x1);
+	g_assert_true (ret);
+
+	/* A low order point gives an all zero secret */
+	peer = g_bytes_new_static (zeros, sizeof (zeros));
+	g_assert_null (egg_ecdh_gen_secret (x1, peer));
+	g_bytes_unref (peer);
+
+	peer = g_bytes_new_static (zeros, 16);
+	g_assert_null (egg_ecdh_gen_secret (x1, peer));
+	g_bytes_unref (peer);
+
+	egg_ecdh_privkey_free (x1);
+	g_bytes_unref (y1);
+}
+
+static void
+test_bad_curve (void)
+{
+	egg_ecdh_privkey *priv;
+	GBytes *pub;
+
+	g_assert_false (egg_ecdh_is_supported ("bad-name"));
+	g_assert_false (egg_ecdh_gen_pair ("bad-name", &pub, &priv));
+	g_assert_null (pub);
+	g_assert_null (priv);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/ecdh/perform", test_perform);
+	g_test_add_func ("/ecdh/bad_peer", test_bad_peer);
+	g_test_add_func ("/ecdh/bad_curve", test_bad_curve);
+
+	return g_test_run ();
+}
@@ -0,0 +1,93 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#undef G_DISABLE_ASSERT
+
+#include "egg/egg-fips.h"
+
+#include <glib.h>
+
+#define N_THREADS 4
+
+static void
+test_scope (void)
+{
+	EggFipsMode mode;
+	EggFipsScope outer;
+	EggFipsScope inner;
+
+	mode = egg_fips_get_mode ();
+
+	egg_fips_scope_begin (&outer, EGG_FIPS_MODE_DISABLED);
+	g_assert_cmpint (egg_fips_get_mode (), ==, EGG_FIPS_MODE_DISABLED);
+
+	/* Nested scopes restore what the outer one set */
+	egg_fips_scope_begin (&inner, mode);
+	egg_fips_scope_end (&inner);
+	g_assert_cmpint (egg_fips_get_mode (), ==, EGG_FIPS_MODE_DISABLED);
+
+	egg_fips_scope_end (&outer);
+	g_assert_cmpint (egg_fips_get_mode (), ==, mode);
+}
+
+static gpointer
+scope_thread (gpointer data)
+{
+	EggFipsMode mode = GPOINTER_TO_INT (data);
+	EggFipsScope scope;
+	guint i;
+
+	for (i = 0; i < 1000; i++) {
+		g_assert_cmpint (egg_fips_get_mode (), ==, mode);
+		egg_fips_scope_begin (&scope, EGG_FIPS_MODE_DISABLED);
+		g_assert_cmpint (egg_fips_get_mode (), ==, EGG_FIPS_MODE_DISABLED);
+		egg_fips_scope_end (&scope);
+	}
+
+	return NULL;
+}
+
+static void
+test_scope_threads (void)
+{
+	GThread *threads[N_THREADS];
+	EggFipsMode mode;
+	guint i;
+
+	mode = egg_fips_get_mode ();
+
+	/* A scope on one thread never changes the mode another thread sees */
+	for (i = 0; i < N_THREADS; i++)
+		threads[i] = g_thread_new ("fips-scope", scope_thread, GINT_TO_POINTER (mode));
+	for (i = 0; i < N_THREADS; i++)
+		g_thread_join (threads[i]);
+
+	g_assert_cmpint (egg_fips_get_mode (), ==, mode);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/fips/scope", test_scope);
+	g_test_add_func ("/fips/scope_threads", test_scope_threads);
+
+	return g_test_run ();
+}
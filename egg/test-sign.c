@@ -0,0 +1,310 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#undef G_DISABLE_ASSERT
+
+#include <string.h>
+
+#include "egg/egg-secure-memory.h"
+#include "egg/egg-sign.h"
+#include "egg/egg-testing.h"
+
+#ifdef WITH_GNUTLS
+#include <gnutls/abstract.h>
+#include <gnutls/crypto.h>
+#else
+#include <gcrypt.h>
+#endif
+
+EGG_SECURE_DEFINE_GLIB_GLOBALS ();
+
+/* Generated with openssl, the signatures are over the string "data" */
+
+static const guchar RSA_N[] = {
+	0x00, 0xce, 0xe5, 0x0e, 0xaa, 0xd5, 0xe5, 0x99, 0x0f, 0x5c, 0xe4, 0x9c,
+	0x53, 0x06, 0x29, 0x8b, 0xca, 0x59, 0x21, 0x0d, 0xe0, 0x8b, 0x14, 0x07,
+	0xc1, 0xd3, 0x87, 0x03, 0x0f, 0x86, 0x3c, 0xae, 0x19, 0xdf, 0xb3, 0xc5,
+	0x8d, 0x20, 0xfa, 0x48, 0xd9, 0x45, 0x87, 0x56, 0xc9, 0x03, 0xcc, 0xfb,
+	0x79, 0x8c, 0x4f, 0xb4, 0x9e, 0xe1, 0x00, 0xb7, 0xa5, 0x3b, 0xd1, 0x22,
+	0xe8, 0x6a, 0x62, 0x73, 0xb7, 0xe5, 0x3b, 0xe1, 0x4f, 0x3d, 0xb3, 0x60,
+	0x7b, 0x88, 0xa4, 0x37, 0x5f, 0x70, 0x74, 0x3a, 0x3a, 0x84, 0x80, 0xf3,
+	0x63, 0x8d, 0x02, 0x19, 0x4c, 0xfc, 0x53, 0x09, 0xe4, 0xc6, 0x3e, 0xaa,
+	0x2d, 0xf6, 0x86, 0xff, 0x9d, 0x1a, 0x19, 0xa2, 0xf5, 0x97, 0xd2, 0xc0,
+	0x78, 0xb3, 0x21, 0xbb, 0x5e, 0xc7, 0x3d, 0x9d, 0xec, 0x1b, 0x0f, 0xc8,
+	0x42, 0xe6, 0x97, 0x37, 0x01, 0xf7, 0xe1, 0xbf, 0x23,
+};
+static const guchar RSA_E[] = {
+	0x01, 0x00, 0x01,
+};
+static const guchar RSA_D[] = {
+	0x00, 0x92, 0x43, 0x56, 0xa2, 0x29, 0x42, 0xfe, 0x78, 0xe0, 0xe7, 0xf1,
+	0x27, 0xb4, 0x94, 0x8c, 0x71, 0xc9, 0x9e, 0xd7, 0x8b, 0xa5, 0x66, 0xcc,
+	0xb1, 0x17, 0x14, 0x3c, 0x72, 0xae, 0x28, 0x99, 0xc0, 0x4a, 0xe8, 0x71,
+	0x41, 0x7b, 0x4d, 0xd5, 0x50, 0x5c, 0x99, 0xf8, 0x1d, 0x75, 0xa5, 0x65,
+	0x26, 0xa1, 0xad, 0xfb, 0x77, 0xd2, 0x83, 0x4a, 0x50, 0xf2, 0xbf, 0xbf,
+	0xd8, 0xe4, 0xd4, 0xa3, 0x0e, 0xd9, 0xee, 0x8f, 0xb4, 0x27, 0x63, 0xe2,
+	0xe2, 0xfe, 0xd0, 0xf5, 0xb1, 0x21, 0xb2, 0x4d, 0x1d, 0xa8, 0x27, 0x80,
+	0x7d, 0xb2, 0x67, 0xe9, 0xcf, 0xd4, 0x10, 0x39, 0xa1, 0x81, 0x5d, 0xa2,
+	0xb0, 0xa2, 0xd4, 0xd9, 0xfc, 0x7e, 0xe2, 0x58, 0xfd, 0xcb, 0x18, 0x7d,
+	0xc6, 0xa7, 0xa9, 0x13, 0xbd, 0xcf, 0x8d, 0x3c, 0xa0, 0x22, 0x66, 0xba,
+	0x11, 0x2e, 0xef, 0x51, 0x4b, 0x33, 0xba, 0x6a, 0xb9,
+};
+static const guchar RSA_P[] = {
+	0x00, 0xeb, 0xc3, 0x37, 0xb0, 0x24, 0x8e, 0x78, 0x56, 0xb5, 0xb4, 0x60,
+	0x2b, 0x55, 0x14, 0xaa, 0x95, 0x35, 0x79, 0x8b, 0x3a, 0x4e, 0x79, 0x98,
+	0xe7, 0x0b, 0xc9, 0x7b, 0x2d, 0x8c, 0xdb, 0x87, 0x28, 0xee, 0xd9, 0x02,
+	0xfe, 0x87, 0xbf, 0xb1, 0xd0, 0x90, 0x1f, 0x03, 0x2a, 0x49, 0xe1, 0xd7,
+	0x56, 0x00, 0x89, 0x54, 0x2c, 0xaa, 0x7a, 0xb7, 0x11, 0xe6, 0xdd, 0x13,
+	0xeb, 0xe2, 0xe3, 0x42, 0xcd,
+};
+static const guchar RSA_Q[] = {
+	0x00, 0xe0, 0xa7, 0x7b, 0x57, 0x81, 0x1c, 0x68, 0x39, 0x80, 0x7b, 0x10,
+	0x13, 0x9a, 0xa2, 0x1c, 0x5b, 0x77, 0x09, 0xb3, 0xaf, 0xff, 0xed, 0x28,
+	0x59, 0xf8, 0xde, 0x92, 0xe9, 0x39, 0x5b, 0xdd, 0x6f, 0xa1, 0x39, 0x51,
+	0x58, 0x49, 0xdf, 0xf0, 0xc7, 0x78, 0xf8, 0xf0, 0xe6, 0xf7, 0x74, 0x49,
+	0x55, 0x47, 0xb2, 0x20, 0x6b, 0xbd, 0x6f, 0xc8, 0xc7, 0xe0, 0x88, 0x7a,
+	0x7f, 0x02, 0xa5, 0x69, 0xaf,
+};
+static const guchar RSA_IQMP[] = {
+	0x00, 0x8a, 0x0b, 0xd6, 0xe6, 0x24, 0xfb, 0xae, 0xed, 0x97, 0x80, 0x04,
+	0xc4, 0x5a, 0x05, 0x22, 0x5a, 0xab, 0x7e, 0xfd, 0x3e, 0xc5, 0xb4, 0xd6,
+	0x75, 0xc8, 0x29, 0x12, 0xbd, 0xc7, 0xc2, 0x6c, 0x91, 0x54, 0x4f, 0x86,
+	0x1a, 0xb9, 0xb6, 0xb3, 0xc7, 0x9e, 0x86, 0x2a, 0x13, 0x78, 0x1f, 0x3b,
+	0xc5, 0x4b, 0x92, 0x35, 0x90, 0x70, 0xff, 0x83, 0xdd, 0xec, 0x61, 0xd7,
+	0xa6, 0x68, 0xcc, 0x9a, 0x64,
+};
+static const guchar RSA_SHA256_SIGNATURE[] = {
+	0xaf, 0x82, 0x61, 0x15, 0x2f, 0x6a, 0x6b, 0x3c, 0xaf, 0x24, 0x7b, 0x62,
+	0xef, 0xb5, 0x7e, 0xff, 0xc7, 0x9a, 0xff, 0x1a, 0x7d, 0xf5, 0x74, 0x9c,
+	0x07, 0x3f, 0x8e, 0x19, 0x02, 0xf3, 0xbf, 0x1f, 0xe9, 0xc6, 0x9f, 0x0a,
+	0x05, 0xd7, 0x12, 0x73, 0x0d, 0x0e, 0x40, 0x44, 0xd2, 0x47, 0x8b, 0x6f,
+	0xb5, 0x2a, 0x49, 0x20, 0xc1, 0x2c, 0x73, 0x4a, 0xa2, 0x3d, 0xe0, 0x32,
+	0x29, 0xea, 0x78, 0xc3, 0x40, 0xfe, 0xeb, 0x82, 0x1a, 0x6f, 0x84, 0x47,
+	0xa4, 0xee, 0x0e, 0x6b, 0xa7, 0xe2, 0xc0, 0x17, 0x19, 0xd1, 0x3b, 0xad,
+	0xac, 0x7b, 0x91, 0x1f, 0xf4, 0x80, 0x80, 0x9b, 0xa8, 0x91, 0x15, 0x1f,
+	0x66, 0xd1, 0xfc, 0x86, 0x35, 0x6a, 0xaf, 0x2c, 0x3b, 0x1a, 0xd9, 0x0b,
+	0x57, 0x8d, 0x4a, 0xba, 0x53, 0x34, 0xea, 0x5b, 0xd8, 0x0a, 0x3c, 0x21,
+	0x6d, 0x71, 0xe7, 0x0d, 0x17, 0xe5, 0xf9, 0xdb,
+};
+static const guchar ED25519_SEED[] = {
+	0xa6, 0x08, 0xc1, 0x20, 0x8b, 0xb4, 0x93, 0xfd, 0x0f, 0xb8, 0x1d, 0x8f,
+	0x99, 0x44, 0xcd, 0xea, 0xb3, 0x4e, 0x23, 0x49, 0x4e, 0xb1, 0x47, 0x63,
+	0x31, 0x73, 0xe6, 0x8f, 0xdf, 0x41, 0x88, 0x9f,
+};
+static const guchar ED25519_PUBLIC[] = {
+	0x84, 0x31, 0x84, 0xf9, 0x42, 0xa7, 0x0f, 0x87, 0xd9, 0xbc, 0xa6, 0x79,
+	0xc9, 0x75, 0x7a, 0xfc, 0xf9, 0xbd, 0x66, 0x27, 0x24, 0x05, 0xbc, 0xa5,
+	0x7c, 0x81, 0xc0, 0xb8, 0x75, 0xa5, 0xe3, 0x4e,
+};
+static const guchar ED25519_SIGNATURE[] = {
+	0x74, 0x1f, 0x67, 0x57, 0x94, 0x10, 0x28, 0x05, 0xe7, 0xa9, 0xd2, 0x94,
+	0x2f, 0x9d, 0xf6, 0x3f, 0xd2, 0xd6, 0x01, 0xfe, 0x1c, 0x6d, 0x1b, 0x2c,
+	0x89, 0xee, 0x16, 0x54, 0x51, 0x80, 0x48, 0xd7, 0x06, 0x6a, 0xc0, 0xd3,
+	0x17, 0x1e, 0x2b, 0xc5, 0x9a, 0x57, 0x50, 0x5a, 0x51, 0xde, 0xeb, 0x4c,
+	0xbb, 0xf4, 0xd1, 0x42, 0x4f, 0x37, 0x51, 0x1c, 0xb2, 0x35, 0x65, 0x86,
+	0xc8, 0xd6, 0xbf, 0x07,
+};
+static const guchar P256_D[] = {
+	0x16, 0xe2, 0xad, 0x92, 0xdf, 0xc0, 0x9b, 0xe0, 0x02, 0x9f, 0xcc, 0x8e,
+	0x90, 0x51, 0xeb, 0xd4, 0xd1, 0x81, 0x50, 0x7a, 0xeb, 0x4f, 0xbe, 0xdd,
+	0x4b, 0x3a, 0xee, 0x8c, 0xad, 0x52, 0x81, 0xe1,
+};
+static const guchar P256_Q[] = {
+	0x04, 0xc3, 0x8d, 0xf2, 0xc2, 0x89, 0x72, 0xda, 0x06, 0xc5, 0x60, 0x85,
+	0x17, 0x8a, 0xbc, 0x50, 0xb4, 0xbd, 0x8c, 0xbf, 0xa9, 0x25, 0xf3, 0x08,
+	0xfe, 0x12, 0x29, 0x89, 0x71, 0xd0, 0xcd, 0xa9, 0xa4, 0x18, 0xcb, 0xf1,
+	0x59, 0x95, 0x75, 0x1c, 0x03, 0xea, 0xd1, 0x20, 0x48, 0x8c, 0xf7, 0x9c,
+	0xf0, 0x50, 0x35, 0x83, 0xf8, 0xf3, 0xdb, 0x82, 0xcc, 0x3f, 0x8f, 0x9e,
+	0x68, 0x73, 0x24, 0x26, 0xdf,
+};
+
+#define BYTES(x) g_bytes_new_static (x, sizeof (x))
+
+/* Checks a raw r || s ECDSA P-256 signature against P256_Q */
+static gboolean
+verify_p256 (const guchar *signature,
+             gsize n_signature,
+             const void *data,
+             gsize n_data)
+{
+	gboolean ret;
+#ifdef WITH_GNUTLS
+	gnutls_pubkey_t pubkey;
+	gnutls_datum_t x, y, r, s, sig, msg;
+	int res;
+
+	g_assert_cmpuint (n_signature, ==, 64);
+
+	res = gnutls_pubkey_init (&pubkey);
+	g_assert_cmpint (res, ==, 0);
+	x.data = (guchar *)P256_Q + 1;
+	x.size = 32;
+	y.data = (guchar *)P256_Q + 33;
+	y.size = 32;
+	res = gnutls_pubkey_import_ecc_raw (pubkey, GNUTLS_ECC_CURVE_SECP256R1, &x, &y);
+	g_assert_cmpint (res, ==, 0);
+
+	r.data = (guchar *)signature;
+	r.size = 32;
+	s.data = (guchar *)signature + 32;
+	s.size = 32;
+	res = gnutls_encode_rs_value (&sig, &r, &s);
+	g_assert_cmpint (res, ==, 0);
+
+	msg.data = (guchar *)data;
+	msg.size = n_data;
+	ret = gnutls_pubkey_verify_data2 (pubkey, GNUTLS_SIGN_ECDSA_SHA256, 0, &msg, &sig) >= 0;
+
+	gnutls_free (sig.data);
+	gnutls_pubkey_deinit (pubkey);
+#else
+	gcry_sexp_t spub, sdata, ssig;
+	guchar digest[32];
+	gcry_error_t gcry;
+
+	g_assert_cmpuint (n_signature, ==, 64);
+
+	gcry = gcry_sexp_build (&spub, NULL, "(public-key (ecc (curve \"NIST P-256\") (q %b)))",
+	                        (int)sizeof (P256_Q), P256_Q);
+	g_assert_cmpint (gcry, ==, 0);
+
+	gcry_md_hash_buffer (GCRY_MD_SHA256, digest, data, n_data);
+	gcry = gcry_sexp_build (&sdata, NULL, "(data (flags raw) (value %b))",
+	                        (int)sizeof (digest), digest);
+	g_assert_cmpint (gcry, ==, 0);
+
+	gcry = gcry_sexp_build (&ssig, NULL, "(sig-val (ecdsa (r %b) (s %b)))",
+	                        32, signature, 32, signature + 32);
+	g_assert_cmpint (gcry, ==, 0);
+
+	ret = gcry_pk_verify (ssig, sdata, spub) == 0;
+
+	gcry_sexp_release (spub);
+	gcry_sexp_release (sdata);
+	gcry_sexp_release (ssig);
+#endif
+	return ret;
+}
+
+static void
+test_rsa (void)
+{
+	egg_sign_key *key;
+	GBytes *n, *e, *d, *p, *q, *iqmp;
+	GBytes *signature;
+
+	n = BYTES (RSA_N);
+	e = BYTES (RSA_E);
+	d = BYTES (RSA_D);
+	p = BYTES (RSA_P);
+	q = BYTES (RSA_Q);
+	iqmp = BYTES (RSA_IQMP);
+
+	key = egg_sign_key_new_rsa (n, e, d, p, q, iqmp);
+	g_assert_nonnull (key);
+
+	/* PKCS#1 v1.5 signatures are deterministic */
+	signature = egg_sign_key_sign (key, EGG_SIGN_HASH_SHA256, "data", 4);
+	g_assert_nonnull (signature);
+	egg_assert_cmpbytes (signature, ==, RSA_SHA256_SIGNATURE, sizeof (RSA_SHA256_SIGNATURE));
+	g_bytes_unref (signature);
+
+	signature = egg_sign_key_sign (key, EGG_SIGN_HASH_SHA512, "data", 4);
+	g_assert_nonnull (signature);
+	g_assert_cmpuint (g_bytes_get_size (signature), ==, 128);
+	g_bytes_unref (signature);
+
+	egg_sign_key_free (key);
+	g_bytes_unref (n);
+	g_bytes_unref (e);
+	g_bytes_unref (d);
+	g_bytes_unref (p);
+	g_bytes_unref (q);
+	g_bytes_unref (iqmp);
+}
+
+static void
+test_ecdsa (void)
+{
+	egg_sign_key *key;
+	GBytes *q, *d;
+	GBytes *signature;
+	guchar *corrupt;
+	gsize n_signature;
+
+	q = BYTES (P256_Q);
+	d = BYTES (P256_D);
+
+	key = egg_sign_key_new_ecdsa (EGG_SIGN_CURVE_NIST_P256, q, d);
+	g_assert_nonnull (key);
+
+	signature = egg_sign_key_sign (key, EGG_SIGN_HASH_SHA256, "data", 4);
+	g_assert_nonnull (signature);
+	g_assert_cmpuint (g_bytes_get_size (signature), ==, 64);
+	g_assert_true (verify_p256 (g_bytes_get_data (signature, NULL), 64, "data", 4));
+	g_assert_false (verify_p256 (g_bytes_get_data (signature, NULL), 64, "other", 5));
+
+	/* A damaged s, or s in place of r, must not verify */
+	corrupt = g_bytes_unref_to_data (signature, &n_signature);
+	corrupt[40] ^= 0x01;
+	g_assert_false (verify_p256 (corrupt, n_signature, "data", 4));
+	corrupt[40] ^= 0x01;
+	memmove (corrupt, corrupt + 32, 32);
+	g_assert_false (verify_p256 (corrupt, n_signature, "data", 4));
+	g_free (corrupt);
+
+	egg_sign_key_free (key);
+	g_bytes_unref (q);
+	g_bytes_unref (d);
+}
+
+static void
+test_ed25519 (void)
+{
+	egg_sign_key *key;
+	GBytes *public_key, *seed;
+	GBytes *signature;
+
+	public_key = BYTES (ED25519_PUBLIC);
+	seed = BYTES (ED25519_SEED);
+
+	key = egg_sign_key_new_ed25519 (public_key, seed);
+	g_assert_nonnull (key);
+
+	signature = egg_sign_key_sign (key, EGG_SIGN_HASH_SHA512, "data", 4);
+	g_assert_nonnull (signature);
+	egg_assert_cmpbytes (signature, ==, ED25519_SIGNATURE, sizeof (ED25519_SIGNATURE));
+	g_bytes_unref (signature);
+
+	egg_sign_key_free (key);
+	g_bytes_unref (public_key);
+	g_bytes_unref (seed);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_test_add_func ("/sign/rsa", test_rsa);
+	g_test_add_func ("/sign/ecdsa", test_ecdsa);
+	g_test_add_func ("/sign/ed25519", test_ed25519);
+
+	return g_test_run ();
+}
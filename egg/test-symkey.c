@@ -391,6 +391,57 @@ test_read_cipher (gconstpointer data)
 	g_free (block);
 }
 
+static void
+test_read_cipher_cached (gconstpointer data)
+{
+	const ReadCipher *test = data;
+	const gchar *passwords[] = { "wrong", NULL, test->password, "wrong" };
+	EggSymkeyCache *cache;
+	gcry_cipher_hd_t cih;
+	gcry_error_t gcry;
+	GNode *asn;
+	gboolean ret;
+	GBytes *bytes;
+	gpointer block;
+	gint i;
+
+	bytes = g_bytes_new_static (test->der, test->n_der);
+	asn = egg_asn1x_create_and_decode (test_asn1_tab, "TestAny", bytes);
+	g_assert (asn != NULL);
+	g_bytes_unref (bytes);
+
+	cache = egg_symkey_cache_new ();
+	egg_symkey_cache_prepare_cipher (cache, g_quark_from_static_string (test->scheme),
+	                                 passwords, G_N_ELEMENTS (passwords), asn);
+
+	/* Once for each distinct password, however many processors there are */
+	g_assert_cmpuint (egg_symkey_cache_get_derivations (cache), ==, 3);
+
+	/* Once derived, and then again from the cache */
+	for (i = 0; i < 2; i++) {
+		ret = egg_symkey_read_cipher_cached (cache, g_quark_from_static_string (test->scheme),
+		                                     test->password, strlen (test->password),
+		                                     asn, &cih);
+		g_assert (ret == TRUE);
+
+		block = g_memdup2 (test->plain_text, test->n_text_length);
+		gcry = gcry_cipher_encrypt (cih, block, test->n_text_length, NULL, 0);
+		g_assert_cmpint (gcry, ==, 0);
+
+		egg_assert_cmpmem (test->cipher_text, test->n_text_length, ==,
+		                   block, test->n_text_length);
+
+		gcry_cipher_close (cih);
+		g_free (block);
+	}
+
+	/* Both reads were answered from the cache */
+	g_assert_cmpuint (egg_symkey_cache_get_derivations (cache), ==, 3);
+
+	egg_asn1x_destroy (asn);
+	egg_symkey_cache_free (cache);
+}
+
 static const InvalidCipher cipher_invalid[] = {
 	{
 		"pbe-bad-der", "1.2.840.113549.1.12.1.3",
@@ -648,6 +699,12 @@ main (int argc, char **argv)
 		g_free (name);
 	}
 
+	for (i = 0; i < G_N_ELEMENTS (cipher_tests); i++) {
+		name = g_strdup_printf ("/symkey/read-cipher-cached/%s", cipher_tests[i].name);
+		g_test_add_data_func (name, cipher_tests + i, test_read_cipher_cached);
+		g_free (name);
+	}
+
 	for (i = 0; i < G_N_ELEMENTS (cipher_invalid); i++) {
 		name = g_strdup_printf ("/symkey/read-cipher-invalid/%s", cipher_invalid[i].name);
 		g_test_add_data_func (name, cipher_invalid + i, test_read_cipher_invalid);
@@ -0,0 +1,146 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "egg/egg-bench.h"
+
+#include "gck/gck.h"
+#include "gck/mock-bench-module.h"
+
+#include <glib.h>
+
+#define N_OBJECTS 10000
+
+typedef struct {
+	GList *modules;
+	GckSession *session;
+} Fixture;
+
+static GckEnumerator *
+enumerate_certificates (const Fixture *fixture)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GckAttributes *match;
+	GckEnumerator *en;
+
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_CERTIFICATE);
+	match = gck_attributes_ref_sink (gck_builder_end (&builder));
+	en = gck_modules_enumerate_objects (fixture->modules, match, GCK_SESSION_READ_ONLY);
+	gck_attributes_unref (match);
+
+	return en;
+}
+
+static void
+bench_enumerate_all (guint64 iterations,
+                     gconstpointer data)
+{
+	GError *error = NULL;
+	GckEnumerator *en;
+	GList *objects;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		en = enumerate_certificates (data);
+		objects = gck_enumerator_next_n (en, -1, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (g_list_length (objects) == N_OBJECTS);
+		g_list_free_full (objects, g_object_unref);
+		g_object_unref (en);
+	}
+}
+
+static void
+bench_enumerate_one_at_a_time (guint64 iterations,
+                               gconstpointer data)
+{
+	GError *error = NULL;
+	GckEnumerator *en;
+	GckObject *object;
+	guint64 i;
+	guint count;
+
+	for (i = 0; i < iterations; i++) {
+		en = enumerate_certificates (data);
+		count = 0;
+		while ((object = gck_enumerator_next (en, NULL, &error)) != NULL) {
+			g_object_unref (object);
+			count++;
+		}
+		g_assert_no_error (error);
+		g_assert (count == N_OBJECTS);
+		g_object_unref (en);
+	}
+}
+
+static void
+bench_find_by_id (guint64 iterations,
+                  gconstpointer data)
+{
+	const Fixture *fixture = data;
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GError *error = NULL;
+	GckAttributes *match;
+	gulong *handles;
+	gulong n_handles;
+	guint32 id;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		id = GUINT32_TO_BE ((i % N_OBJECTS) + 1);
+		gck_builder_add_data (&builder, CKA_ID, (const guchar *)&id, sizeof (id));
+		match = gck_attributes_ref_sink (gck_builder_end (&builder));
+		handles = gck_session_find_handles (fixture->session, match, NULL, &n_handles, &error);
+		g_assert_no_error (error);
+		g_assert (n_handles == 1);
+		g_free (handles);
+		gck_attributes_unref (match);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	GError *error = NULL;
+	GckModule *module;
+	Fixture fixture;
+	GList *slots;
+	gint ret;
+
+	egg_bench_init (&argc, &argv);
+
+	g_setenv ("GCK_MOCK_BENCH_OBJECTS", G_STRINGIFY (N_OBJECTS), TRUE);
+	module = gck_module_initialize (_GCK_BENCH_MODULE_PATH, NULL, &error);
+	g_assert_no_error (error);
+
+	fixture.modules = g_list_append (NULL, module);
+	slots = gck_module_get_slots (module, TRUE);
+	fixture.session = gck_slot_open_session (slots->data, GCK_SESSION_READ_ONLY,
+	                                         NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_clear_list (&slots, g_object_unref);
+
+	egg_bench_add_sized ("/gck/enumerator/all", &fixture, bench_enumerate_all, N_OBJECTS);
+	egg_bench_add_sized ("/gck/enumerator/one-at-a-time", &fixture, bench_enumerate_one_at_a_time, N_OBJECTS);
+	egg_bench_add ("/gck/session/find-by-id", &fixture, bench_find_by_id);
+
+	ret = egg_bench_run ();
+
+	g_object_unref (fixture.session);
+	g_clear_list (&fixture.modules, g_object_unref);
+	return ret;
+}
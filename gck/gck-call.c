@@ -25,6 +25,7 @@
 
 #include "gck-private.h"
 
+#include <stdlib.h>
 #include <string.h>
 
 struct _GckCall {
@@ -37,8 +38,40 @@ struct _GckCall {
 	GckCompleteFunc complete;
 	GckArguments *args;
 	GDestroyNotify destroy;
+
+	/* While waiting in a module's queue */
+	GckCallQueue *queue;
+	gint queue_state;
+	gint64 queued_at;
+	gsize sequence;
+	gulong cancelled_sig;
+};
+
+enum {
+	CALL_QUEUED = 1,
+	CALL_RUNNING,
+	CALL_CANCELLED,
 };
 
+struct _GckCallQueue {
+	GThreadPool *pool;
+	gchar *label;
+	guint max_calls;
+
+	/* Modified atomically */
+	gsize sequence;
+	gint depth;
+	gint started;
+	gint cancelled;
+	gsize wait_usec;
+};
+
+/* Used when the module doesn't say otherwise */
+#define DEFAULT_MAX_CALLS 4
+
+G_LOCK_DEFINE_STATIC (queues);
+static GList *all_queues = NULL;
+
 G_DEFINE_TYPE (GckCall, _gck_call, G_TYPE_OBJECT)
 
 /* ----------------------------------------------------------------------------
@@ -135,6 +168,238 @@ _gck_call_thread_func (GTask        *task,
 	_gck_task_return (task, rv);
 }
 
+/* ----------------------------------------------------------------------------
+ * QUEUE
+ */
+
+static void
+queue_thread_func (gpointer data,
+                   gpointer user_data)
+{
+	GTask *task = data;
+	GckCallQueue *queue = user_data;
+	GckCall *call = g_task_get_task_data (task);
+	GCancellable *cancellable = g_task_get_cancellable (task);
+	gboolean started;
+	CK_RV rv;
+
+	started = g_atomic_int_compare_and_exchange (&call->queue_state, CALL_QUEUED, CALL_RUNNING);
+
+	if (call->cancelled_sig)
+		g_cancellable_disconnect (cancellable, call->cancelled_sig);
+	call->cancelled_sig = 0;
+
+	/* Cancelled while waiting, and the task has already returned */
+	if (!started) {
+		g_object_unref (task);
+		return;
+	}
+
+	g_atomic_int_add (&queue->depth, -1);
+	g_atomic_int_inc (&queue->started);
+	g_atomic_pointer_add (&queue->wait_usec,
+	                      (gsize)MAX (g_get_monotonic_time () - call->queued_at, 0));
+
+	rv = perform_call_chain (call->perform, call->complete, cancellable,
+	                         call->args);
+	_gck_task_return (task, rv);
+
+	/* May release the module, and with it the queue */
+	g_object_unref (task);
+}
+
+static gint
+compare_queued_calls (gconstpointer a,
+                      gconstpointer b,
+                      gpointer user_data)
+{
+	GTask *task_a = (GTask *)a;
+	GTask *task_b = (GTask *)b;
+	GckCall *call_a = g_task_get_task_data (task_a);
+	GckCall *call_b = g_task_get_task_data (task_b);
+	gint priority_a = g_task_get_priority (task_a);
+	gint priority_b = g_task_get_priority (task_b);
+
+	if (priority_a != priority_b)
+		return priority_a < priority_b ? -1 : 1;
+
+	/* Otherwise first come first served */
+	return (call_a->sequence > call_b->sequence) - (call_a->sequence < call_b->sequence);
+}
+
+static void
+on_queued_call_cancelled (GCancellable *cancellable,
+                          gpointer user_data)
+{
+	GTask *task = user_data;
+	GckCall *call = g_task_get_task_data (task);
+
+	/*
+	 * Complete the call now rather than when it reaches the front of the
+	 * queue. It stays in the queue, but won't be run.
+	 */
+	if (g_atomic_int_compare_and_exchange (&call->queue_state, CALL_QUEUED, CALL_CANCELLED)) {
+		g_atomic_int_add (&call->queue->depth, -1);
+		g_atomic_int_inc (&call->queue->cancelled);
+		_gck_task_return (task, CKR_FUNCTION_CANCELED);
+	}
+}
+
+static void
+queue_push (GckCallQueue *queue,
+            GTask *task)
+{
+	GckCall *call = g_task_get_task_data (task);
+	GCancellable *cancellable = g_task_get_cancellable (task);
+
+	call->queue = queue;
+	call->queued_at = g_get_monotonic_time ();
+	call->sequence = g_atomic_pointer_add (&queue->sequence, 1);
+	g_atomic_int_set (&call->queue_state, CALL_QUEUED);
+	g_atomic_int_inc (&queue->depth);
+
+	/* Runs right away if already cancelled */
+	if (cancellable) {
+		call->cancelled_sig = g_cancellable_connect (cancellable,
+		                                             G_CALLBACK (on_queued_call_cancelled),
+		                                             task, NULL);
+		if (g_atomic_int_get (&call->queue_state) == CALL_CANCELLED) {
+			if (call->cancelled_sig)
+				g_cancellable_disconnect (cancellable, call->cancelled_sig);
+			call->cancelled_sig = 0;
+			return;
+		}
+	}
+
+	g_thread_pool_push (queue->pool, g_object_ref (task), NULL);
+}
+
+static guint
+default_max_calls (void)
+{
+	static gsize initialized = 0;
+	static guint max_calls = DEFAULT_MAX_CALLS;
+	const gchar *env;
+
+	if (g_once_init_enter (&initialized)) {
+		env = g_getenv ("GCK_MAX_CONCURRENT_CALLS");
+		if (env != NULL && atoi (env) > 0)
+			max_calls = atoi (env);
+		g_once_init_leave (&initialized, 1);
+	}
+
+	return max_calls;
+}
+
+static gboolean
+queue_label_in_use (const gchar *label)
+{
+	GList *l;
+
+	for (l = all_queues; l != NULL; l = g_list_next (l)) {
+		if (g_str_equal (((GckCallQueue *)l->data)->label, label))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+GckCallQueue *
+_gck_call_queue_new (const gchar *name,
+                     guint max_calls)
+{
+	GckCallQueue *queue;
+	gchar *escaped;
+	gint n = 1;
+
+	queue = g_new0 (GckCallQueue, 1);
+	queue->max_calls = max_calls ? max_calls : default_max_calls ();
+
+	/* Shares idle threads with other pools, but never runs more than this */
+	queue->pool = g_thread_pool_new (queue_thread_func, queue,
+	                                 queue->max_calls, FALSE, NULL);
+	g_thread_pool_set_sort_function (queue->pool, compare_queued_calls, NULL);
+
+	escaped = _gck_trace_escape_label (name);
+	queue->label = g_strdup (escaped);
+
+	G_LOCK (queues);
+
+	/* Modules can share a file name, but each needs its own series */
+	while (queue_label_in_use (queue->label)) {
+		g_free (queue->label);
+		queue->label = g_strdup_printf ("%s-%d", escaped, ++n);
+	}
+	all_queues = g_list_prepend (all_queues, queue);
+
+	G_UNLOCK (queues);
+
+	g_free (escaped);
+
+	return queue;
+}
+
+void
+_gck_call_queue_set_max_calls (GckCallQueue *queue,
+                               guint max_calls)
+{
+	g_assert (queue != NULL);
+
+	queue->max_calls = max_calls ? max_calls : default_max_calls ();
+	g_thread_pool_set_max_threads (queue->pool, queue->max_calls, NULL);
+}
+
+guint
+_gck_call_queue_get_max_calls (GckCallQueue *queue)
+{
+	if (queue == NULL)
+		return default_max_calls ();
+	return queue->max_calls;
+}
+
+void
+_gck_call_queue_free (GckCallQueue *queue)
+{
+	if (queue == NULL)
+		return;
+
+	G_LOCK (queues);
+	all_queues = g_list_remove (all_queues, queue);
+	G_UNLOCK (queues);
+
+	/*
+	 * Every queued call holds a reference to the module, so the queue is
+	 * empty by now. This may run in one of the pool's own threads, so
+	 * don't wait for them.
+	 */
+	g_thread_pool_free (queue->pool, FALSE, FALSE);
+	g_free (queue->label);
+	g_free (queue);
+}
+
+void
+_gck_call_queue_dump (GString *output)
+{
+	GckCallQueue *queue;
+	GList *l;
+
+	G_LOCK (queues);
+
+	for (l = all_queues; l != NULL; l = g_list_next (l)) {
+		queue = l->data;
+		g_string_append_printf (output, "gck_call_queue_depth{module=\"%s\"} %d\n",
+		                        queue->label, g_atomic_int_get (&queue->depth));
+		g_string_append_printf (output, "gck_call_queue_started_total{module=\"%s\"} %u\n",
+		                        queue->label, (guint)g_atomic_int_get (&queue->started));
+		g_string_append_printf (output, "gck_call_queue_cancelled_total{module=\"%s\"} %u\n",
+		                        queue->label, (guint)g_atomic_int_get (&queue->cancelled));
+		g_string_append_printf (output, "gck_call_queue_wait_usec_sum{module=\"%s\"} %" G_GSIZE_FORMAT "\n",
+		                        queue->label, (gsize)g_atomic_pointer_get (&queue->wait_usec));
+	}
+
+	G_UNLOCK (queues);
+}
+
 /* ----------------------------------------------------------------------------
  * OBJECT
  */
@@ -198,7 +463,7 @@ _gck_call_sync (gpointer object, gpointer perform, gpointer complete,
 		g_assert (GCK_IS_MODULE (module));
 
 		/* We now hold a reference to module until below */
-		args->pkcs11 = gck_module_get_functions (module);
+		args->pkcs11 = _gck_module_get_dispatch (module);
 		g_assert (args->pkcs11);
 	}
 
@@ -259,7 +524,7 @@ _gck_call_async_object (GckCall *call, gpointer object)
 
 	g_object_get (object, "module", &call->module, "handle", &call->args->handle, NULL);
 	g_assert (GCK_IS_MODULE (call->module));
-	call->args->pkcs11 = gck_module_get_functions (call->module);
+	call->args->pkcs11 = _gck_module_get_dispatch (call->module);
 
 	/* We now hold a reference on module until finalize */
 }
@@ -290,13 +555,32 @@ _gck_call_async_ready (GckCall *call, gpointer cb_object,
 void
 _gck_call_async_go (GckCall *call)
 {
+	GckCallQueue *queue = NULL;
+
 	g_assert (GCK_IS_CALL (call));
 	g_assert (G_IS_TASK (call->task));
 
-	g_task_run_in_thread (call->task, _gck_call_thread_func);
+	/* Calls into a module wait their turn, so as not to swamp it */
+	if (call->module)
+		queue = _gck_module_get_call_queue (call->module);
+
+	if (queue)
+		queue_push (queue, call->task);
+	else
+		g_task_run_in_thread (call->task, _gck_call_thread_func);
 	g_clear_object (&call->task);
 }
 
+void
+_gck_call_set_priority (GckCall *call,
+                        gint io_priority)
+{
+	g_assert (GCK_IS_CALL (call));
+	g_assert (G_IS_TASK (call->task));
+
+	g_task_set_priority (call->task, io_priority);
+}
+
 void
 _gck_call_async_ready_go (GckCall *call, gpointer cb_object,
                            GCancellable *cancellable,
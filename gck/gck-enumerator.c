@@ -293,7 +293,7 @@ state_slots (GckEnumeratorState *args, gboolean forward)
 		}
 
 		module = gck_slot_get_module (slot);
-		args->funcs = gck_module_get_functions (module);
+		args->funcs = _gck_module_get_dispatch (module);
 		g_assert (args->funcs);
 		g_object_unref (module);
 
@@ -746,7 +746,7 @@ _gck_enumerator_new_for_session (GckSession *session,
 	state->token_info = gck_slot_get_token_info (state->slot);
 
 	module = gck_session_get_module (session);
-	state->funcs = gck_module_get_functions (module);
+	state->funcs = _gck_module_get_dispatch (module);
 	g_object_unref (module);
 
 	created_enumerator (uri_data, "session");
@@ -85,8 +85,17 @@ typedef struct {
 
 	/* Modified atomically */
 	gint finalized;
+
+	/* Set on first use while tracing, modified atomically */
+	CK_FUNCTION_LIST_PTR traced_funcs;
+
+	/* Created on first use, see below */
+	GckCallQueue *call_queue;
+	guint max_calls;
 } GckModulePrivate;
 
+G_LOCK_DEFINE_STATIC (call_queue);
+
 G_DEFINE_TYPE_WITH_PRIVATE (GckModule, gck_module, G_TYPE_OBJECT);
 
 /* ----------------------------------------------------------------------------
@@ -103,13 +112,14 @@ gck_module_get_property (GObject *obj, guint prop_id, GValue *value,
                           GParamSpec *pspec)
 {
 	GckModule *self = GCK_MODULE (obj);
+	GckModulePrivate *priv = gck_module_get_instance_private (self);
 
 	switch (prop_id) {
 	case PROP_PATH:
 		g_value_set_string (value, gck_module_get_path (self));
 		break;
 	case PROP_FUNCTIONS:
-		g_value_set_pointer (value, gck_module_get_functions (self));
+		g_value_set_pointer (value, priv->funcs);
 		break;
 	}
 }
@@ -165,10 +175,13 @@ gck_module_finalize (GObject *obj)
 	GckModule *self = GCK_MODULE (obj);
 	GckModulePrivate *priv = gck_module_get_instance_private (self);
 
+	g_clear_pointer (&priv->traced_funcs, _gck_trace_unwrap);
+
 	if (priv->initialized && priv->funcs)
 		g_clear_pointer (&priv->funcs, p11_kit_module_release);
 
 	g_clear_pointer (&priv->path, g_free);
+	g_clear_pointer (&priv->call_queue, _gck_call_queue_free);
 
 	G_OBJECT_CLASS (gck_module_parent_class)->finalize (obj);
 }
@@ -185,6 +198,8 @@ gck_module_class_init (GckModuleClass *klass)
 	gobject_class->dispose = gck_module_dispose;
 	gobject_class->finalize = gck_module_finalize;
 
+	_gck_trace_init ();
+
 	/**
 	 * GckModule:path:
 	 *
@@ -532,7 +547,7 @@ gck_module_get_info (GckModule *self)
 	g_return_val_if_fail (priv->funcs, NULL);
 
 	memset (&info, 0, sizeof (info));
-	rv = (priv->funcs->C_GetInfo (&info));
+	rv = (_gck_module_get_dispatch (self)->C_GetInfo (&info));
 	if (rv != CKR_OK) {
 		g_warning ("couldn't get module info: %s", gck_message_from_rv (rv));
 		return NULL;
@@ -555,6 +570,7 @@ GList*
 gck_module_get_slots (GckModule *self, gboolean token_present)
 {
 	GckModulePrivate *priv = gck_module_get_instance_private (self);
+	CK_FUNCTION_LIST_PTR funcs;
 	CK_SLOT_ID_PTR slot_list;
 	CK_ULONG count, i;
 	GList *result;
@@ -563,7 +579,8 @@ gck_module_get_slots (GckModule *self, gboolean token_present)
 	g_return_val_if_fail (GCK_IS_MODULE (self), NULL);
 	g_return_val_if_fail (priv->funcs, NULL);
 
-	rv = (priv->funcs->C_GetSlotList) (token_present ? CK_TRUE : CK_FALSE, NULL, &count);
+	funcs = _gck_module_get_dispatch (self);
+	rv = (funcs->C_GetSlotList) (token_present ? CK_TRUE : CK_FALSE, NULL, &count);
 	if (rv != CKR_OK) {
 		g_warning ("couldn't get slot count: %s", gck_message_from_rv (rv));
 		return NULL;
@@ -573,7 +590,7 @@ gck_module_get_slots (GckModule *self, gboolean token_present)
 		return NULL;
 
 	slot_list = g_new (CK_SLOT_ID, count);
-	rv = (priv->funcs->C_GetSlotList) (token_present ? CK_TRUE : CK_FALSE, slot_list, &count);
+	rv = (funcs->C_GetSlotList) (token_present ? CK_TRUE : CK_FALSE, slot_list, &count);
 	if (rv != CKR_OK) {
 		g_warning ("couldn't get slot list: %s", gck_message_from_rv (rv));
 		g_free (slot_list);
@@ -624,10 +641,113 @@ gck_module_get_functions (GckModule *self)
 	GckModulePrivate *priv = gck_module_get_instance_private (self);
 
 	g_return_val_if_fail (GCK_IS_MODULE (self), NULL);
-
 	return priv->funcs;
 }
 
+/*
+ * The function list used for the calls Gck makes into the module, which
+ * counts and times them while tracing is on, see gck-trace.c
+ */
+CK_FUNCTION_LIST_PTR
+_gck_module_get_dispatch (GckModule *self)
+{
+	GckModulePrivate *priv = gck_module_get_instance_private (self);
+	CK_FUNCTION_LIST_PTR traced;
+
+	if (G_LIKELY (!g_atomic_int_get (&_gck_trace_enabled)))
+		return priv->funcs;
+
+	traced = g_atomic_pointer_get (&priv->traced_funcs);
+	if (traced == NULL) {
+		traced = _gck_trace_wrap (priv->funcs, priv->path);
+		if (!g_atomic_pointer_compare_and_exchange (&priv->traced_funcs, NULL, traced)) {
+			_gck_trace_unwrap (traced);
+			traced = g_atomic_pointer_get (&priv->traced_funcs);
+		}
+	}
+
+	return traced;
+}
+
+GckCallQueue *
+_gck_module_get_call_queue (GckModule *self)
+{
+	GckModulePrivate *priv = gck_module_get_instance_private (self);
+	GckCallQueue *queue;
+	gchar *name;
+
+	G_LOCK (call_queue);
+
+	if (priv->call_queue == NULL) {
+		name = priv->path ? g_path_get_basename (priv->path) : g_strdup ("module");
+		priv->call_queue = _gck_call_queue_new (name, priv->max_calls);
+		g_free (name);
+	}
+	queue = priv->call_queue;
+
+	G_UNLOCK (call_queue);
+
+	return queue;
+}
+
+/**
+ * gck_module_set_max_concurrent_calls:
+ * @self: the module
+ * @max_calls: the most calls to run at once, or zero for the default
+ *
+ * Set how many asynchronous calls into the module run at the same time.
+ *
+ * Further calls wait in a queue, in order of priority and then in the order
+ * they were made. A call that is cancelled while waiting completes straight
+ * away, without reaching the module. The state of the queue is included in
+ * [func@trace_dump].
+ *
+ * The default is 4, or the value of the `GCK_MAX_CONCURRENT_CALLS`
+ * environment variable. Synchronous calls run in the calling thread and are
+ * not limited.
+ */
+void
+gck_module_set_max_concurrent_calls (GckModule *self,
+                                     guint max_calls)
+{
+	GckModulePrivate *priv = gck_module_get_instance_private (self);
+
+	g_return_if_fail (GCK_IS_MODULE (self));
+
+	G_LOCK (call_queue);
+	priv->max_calls = max_calls;
+	if (priv->call_queue)
+		_gck_call_queue_set_max_calls (priv->call_queue, max_calls);
+	G_UNLOCK (call_queue);
+}
+
+/**
+ * gck_module_get_max_concurrent_calls:
+ * @self: the module
+ *
+ * Get how many asynchronous calls into the module run at the same time, see
+ * [method@Module.set_max_concurrent_calls].
+ *
+ * Returns: the most calls run at once
+ */
+guint
+gck_module_get_max_concurrent_calls (GckModule *self)
+{
+	GckModulePrivate *priv = gck_module_get_instance_private (self);
+	guint max_calls;
+
+	g_return_val_if_fail (GCK_IS_MODULE (self), 0);
+
+	G_LOCK (call_queue);
+	if (priv->call_queue)
+		max_calls = _gck_call_queue_get_max_calls (priv->call_queue);
+	else
+		max_calls = priv->max_calls ? priv->max_calls : _gck_call_queue_get_max_calls (NULL);
+	G_UNLOCK (call_queue);
+
+	return max_calls;
+}
+
 /**
  * gck_module_match:
  * @self: the module to match
@@ -75,6 +75,25 @@ void                _gck_module_info_to_pkcs11              (GckModuleInfo* modu
 gboolean            _gck_module_info_match                  (GckModuleInfo *match,
                                                              GckModuleInfo *module_info);
 
+struct _GckCallQueue * _gck_module_get_call_queue           (GckModule *self);
+
+CK_FUNCTION_LIST_PTR _gck_module_get_dispatch               (GckModule *self);
+
+/* ----------------------------------------------------------------------------
+ * TRACE
+ */
+
+extern gint         _gck_trace_enabled;
+
+void                _gck_trace_init                         (void);
+
+CK_FUNCTION_LIST_PTR _gck_trace_wrap                        (CK_FUNCTION_LIST_PTR funcs,
+                                                             const gchar *path);
+
+void                _gck_trace_unwrap                       (CK_FUNCTION_LIST_PTR list);
+
+gchar *             _gck_trace_escape_label                 (const gchar *value);
+
 /* -----------------------------------------------------------------------------
  * ENUMERATOR
  */
@@ -130,6 +149,8 @@ typedef gboolean (*GckCompleteFunc) (gpointer call_data, CK_RV result);
 
 typedef struct _GckCall GckCall;
 
+typedef struct _GckCallQueue GckCallQueue;
+
 typedef struct _GckArguments {
 	/* For the call function to use */
 	CK_FUNCTION_LIST_PTR pkcs11;
@@ -191,4 +212,19 @@ gboolean           _gck_call_basic_finish                (GAsyncResult *result,
 void               _gck_call_async_object                (GckCall *call,
                                                            gpointer object);
 
+void               _gck_call_set_priority                (GckCall *call,
+                                                           gint io_priority);
+
+GckCallQueue *     _gck_call_queue_new                   (const gchar *name,
+                                                           guint max_calls);
+
+void               _gck_call_queue_set_max_calls         (GckCallQueue *queue,
+                                                           guint max_calls);
+
+guint              _gck_call_queue_get_max_calls         (GckCallQueue *queue);
+
+void               _gck_call_queue_free                  (GckCallQueue *queue);
+
+void               _gck_call_queue_dump                  (GString *output);
+
 #endif /* GCK_PRIVATE_H_ */
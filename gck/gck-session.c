@@ -116,7 +116,7 @@ gck_session_real_discard_handle (GckSession *self, CK_OBJECT_HANDLE handle)
 	module = gck_session_get_module (self);
 	g_return_val_if_fail (module != NULL, FALSE);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, FALSE);
 
 	rv = (funcs->C_CloseSession) (handle);
@@ -474,6 +474,7 @@ gck_session_initable_init_async (GAsyncInitable *initable,
 	args->session = priv->handle;
 
 	_gck_call_async_ready (call, self, cancellable, callback, user_data);
+	_gck_call_set_priority (call, io_priority);
 
 	/* Already have a session setup? */
 	if (priv->handle && !want_login) {
@@ -682,7 +683,7 @@ gck_session_get_info (GckSession *self)
 	module = gck_session_get_module (self);
 	g_return_val_if_fail (GCK_IS_MODULE (module), NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, NULL);
 
 	memset (&info, 0, sizeof (info));
@@ -726,7 +727,7 @@ gck_session_get_state (GckSession *self)
 	module = gck_session_get_module (self);
 	g_return_val_if_fail (GCK_IS_MODULE (module), 0);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, 0);
 
 	memset (&info, 0, sizeof (info));
@@ -2771,7 +2772,7 @@ gck_session_encrypt_full (GckSession *self, GckObject *key, GckMechanism *mechan
 	g_object_get (self, "module", &module, NULL);
 	g_return_val_if_fail (module != NULL, NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (module != NULL, NULL);
 
 	ret = crypt_sync (self, key, mechanism, input, n_input, n_result, cancellable, error,
@@ -2806,7 +2807,7 @@ gck_session_encrypt_async (GckSession *self, GckObject *key, GckMechanism *mecha
 	g_object_get (self, "module", &module, NULL);
 	g_return_if_fail (module != NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_if_fail (module != NULL);
 
 	crypt_async (self, key, mechanism, input, n_input, cancellable, callback, user_data,
@@ -2892,7 +2893,7 @@ gck_session_decrypt_full (GckSession *self, GckObject *key, GckMechanism *mechan
 	g_object_get (self, "module", &module, NULL);
 	g_return_val_if_fail (module != NULL, NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (module != NULL, NULL);
 
 	ret = crypt_sync (self, key, mechanism, input, n_input, n_result, cancellable, error,
@@ -2926,7 +2927,7 @@ gck_session_decrypt_async (GckSession *self, GckObject *key, GckMechanism *mecha
 	g_object_get (self, "module", &module, NULL);
 	g_return_if_fail (module != NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_if_fail (module != NULL);
 
 	crypt_async (self, key, mechanism, input, n_input, cancellable, callback, user_data,
@@ -3010,7 +3011,7 @@ gck_session_sign_full (GckSession *self, GckObject *key, GckMechanism *mechanism
 	g_object_get (self, "module", &module, NULL);
 	g_return_val_if_fail (module != NULL, NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (module != NULL, NULL);
 
 	ret = crypt_sync (self, key, mechanism, input, n_input, n_result, cancellable, error,
@@ -3044,7 +3045,7 @@ gck_session_sign_async (GckSession *self, GckObject *key, GckMechanism *mechanis
 	g_object_get (self, "module", &module, NULL);
 	g_return_if_fail (module != NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_if_fail (module != NULL);
 
 	crypt_async (self, key, mechanism, input, n_input, cancellable, callback, user_data,
@@ -529,7 +529,7 @@ gck_slot_get_info (GckSlot *self)
 	g_object_get (self, "module", &module, "handle", &handle, NULL);
 	g_return_val_if_fail (GCK_IS_MODULE (module), NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, NULL);
 
 	memset (&info, 0, sizeof (info));
@@ -681,7 +681,7 @@ gck_slot_get_token_info (GckSlot *self)
 	g_object_get (self, "module", &module, "handle", &handle, NULL);
 	g_return_val_if_fail (GCK_IS_MODULE (module), NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, NULL);
 
 	memset (&info, 0, sizeof (info));
@@ -722,7 +722,7 @@ gck_slot_get_mechanisms (GckSlot *self)
 	g_object_get (self, "module", &module, "handle", &handle, NULL);
 	g_return_val_if_fail (GCK_IS_MODULE (module), NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, NULL);
 
 	rv = (funcs->C_GetMechanismList) (handle, NULL, &count);
@@ -778,7 +778,7 @@ gck_slot_get_mechanism_info (GckSlot *self, gulong mech_type)
 	g_object_get (self, "module", &module, "handle", &handle, NULL);
 	g_return_val_if_fail (GCK_IS_MODULE (module), NULL);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, NULL);
 
 	memset (&info, 0, sizeof (info));
@@ -822,7 +822,7 @@ gck_slot_has_flags (GckSlot *self, gulong flags)
 	g_object_get (self, "module", &module, "handle", &handle, NULL);
 	g_return_val_if_fail (GCK_IS_MODULE (module), FALSE);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, FALSE);
 
 	memset (&info, 0, sizeof (info));
@@ -861,7 +861,7 @@ gck_slot_token_has_flags (GckSlot *self, gulong flags)
 	g_object_get (self, "module", &module, "handle", &handle, NULL);
 	g_return_val_if_fail (GCK_IS_MODULE (module), FALSE);
 
-	funcs = gck_module_get_functions (module);
+	funcs = _gck_module_get_dispatch (module);
 	g_return_val_if_fail (funcs, FALSE);
 
 	memset (&info, 0, sizeof (info));
@@ -0,0 +1,817 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gck.h"
+#include "gck-private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define TRACE_PROBE_ENTRY(t, func) \
+	DTRACE_PROBE2 (gck, call_entry, (t)->name, TRACE_NAMES[func])
+#define TRACE_PROBE_RETURN(t, func, rv, usec) \
+	DTRACE_PROBE4 (gck, call_return, (t)->name, TRACE_NAMES[func], (rv), (usec))
+#else
+#define TRACE_PROBE_ENTRY(t, func)
+#define TRACE_PROBE_RETURN(t, func, rv, usec)
+#endif
+
+/* Latency buckets are powers of two in microseconds, the last one is open */
+#define TRACE_BUCKETS 24
+
+/* The function lists are static, so only this many modules can be traced at once */
+#define TRACE_MAX_MODULES 8
+
+/* Used for calls that aren't made against a slot or session */
+#define TRACE_NO_SLOT ((CK_SLOT_ID)-1)
+
+enum {
+	TRACE_BY_NONE,
+	TRACE_BY_SLOT,
+	TRACE_BY_SESSION,
+};
+
+#define TRACE_UNPAREN(...) __VA_ARGS__
+
+/* Bytes for a buffer filled in by the module, not counted on a length query */
+#define TRACE_OUT(buf, len) ((rv == CKR_OK && (buf) != NULL && (len) != NULL) ? *(len) : 0)
+
+#define TRACE_ATTRS(attrs, n) trace_attributes_size ((attrs), (n))
+
+/*
+ * Every function in CK_FUNCTION_LIST: the name, how to find the slot the
+ * call is for, the parameters, and the number of bytes passed to or from
+ * the module. Calls that need more than this are written out by hand below.
+ */
+#define TRACE_FUNCTIONS(X, N) \
+	X (N, Initialize, NONE, (CK_VOID_PTR a), (a), 0) \
+	X (N, Finalize, NONE, (CK_VOID_PTR a), (a), 0) \
+	X (N, GetInfo, NONE, (CK_INFO_PTR a), (a), 0) \
+	X (N, GetFunctionList, CUSTOM, (CK_FUNCTION_LIST_PTR_PTR a), (a), 0) \
+	X (N, GetSlotList, NONE, (CK_BBOOL a, CK_SLOT_ID_PTR b, CK_ULONG_PTR c), (a, b, c), 0) \
+	X (N, GetSlotInfo, SLOT, (CK_SLOT_ID a, CK_SLOT_INFO_PTR b), (a, b), 0) \
+	X (N, GetTokenInfo, SLOT, (CK_SLOT_ID a, CK_TOKEN_INFO_PTR b), (a, b), 0) \
+	X (N, GetMechanismList, SLOT, (CK_SLOT_ID a, CK_MECHANISM_TYPE_PTR b, CK_ULONG_PTR c), (a, b, c), 0) \
+	X (N, GetMechanismInfo, SLOT, (CK_SLOT_ID a, CK_MECHANISM_TYPE b, CK_MECHANISM_INFO_PTR c), (a, b, c), 0) \
+	X (N, InitToken, SLOT, (CK_SLOT_ID a, CK_UTF8CHAR_PTR b, CK_ULONG c, CK_UTF8CHAR_PTR d), (a, b, c, d), 0) \
+	X (N, InitPIN, SESSION, (CK_SESSION_HANDLE a, CK_UTF8CHAR_PTR b, CK_ULONG c), (a, b, c), 0) \
+	X (N, SetPIN, SESSION, (CK_SESSION_HANDLE a, CK_UTF8CHAR_PTR b, CK_ULONG c, CK_UTF8CHAR_PTR d, CK_ULONG e), (a, b, c, d, e), 0) \
+	X (N, OpenSession, CUSTOM, (CK_SLOT_ID a, CK_FLAGS b, CK_VOID_PTR c, CK_NOTIFY d, CK_SESSION_HANDLE_PTR e), (a, b, c, d, e), 0) \
+	X (N, CloseSession, CUSTOM, (CK_SESSION_HANDLE a), (a), 0) \
+	X (N, CloseAllSessions, CUSTOM, (CK_SLOT_ID a), (a), 0) \
+	X (N, GetSessionInfo, SESSION, (CK_SESSION_HANDLE a, CK_SESSION_INFO_PTR b), (a, b), 0) \
+	X (N, GetOperationState, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG_PTR c), (a, b, c), TRACE_OUT (b, c)) \
+	X (N, SetOperationState, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_OBJECT_HANDLE d, CK_OBJECT_HANDLE e), (a, b, c, d, e), c) \
+	X (N, Login, SESSION, (CK_SESSION_HANDLE a, CK_USER_TYPE b, CK_UTF8CHAR_PTR c, CK_ULONG d), (a, b, c, d), 0) \
+	X (N, Logout, SESSION, (CK_SESSION_HANDLE a), (a), 0) \
+	X (N, CreateObject, SESSION, (CK_SESSION_HANDLE a, CK_ATTRIBUTE_PTR b, CK_ULONG c, CK_OBJECT_HANDLE_PTR d), (a, b, c, d), TRACE_ATTRS (b, c)) \
+	X (N, CopyObject, SESSION, (CK_SESSION_HANDLE a, CK_OBJECT_HANDLE b, CK_ATTRIBUTE_PTR c, CK_ULONG d, CK_OBJECT_HANDLE_PTR e), (a, b, c, d, e), TRACE_ATTRS (c, d)) \
+	X (N, DestroyObject, SESSION, (CK_SESSION_HANDLE a, CK_OBJECT_HANDLE b), (a, b), 0) \
+	X (N, GetObjectSize, SESSION, (CK_SESSION_HANDLE a, CK_OBJECT_HANDLE b, CK_ULONG_PTR c), (a, b, c), 0) \
+	X (N, GetAttributeValue, SESSION, (CK_SESSION_HANDLE a, CK_OBJECT_HANDLE b, CK_ATTRIBUTE_PTR c, CK_ULONG d), (a, b, c, d), TRACE_ATTRS (c, d)) \
+	X (N, SetAttributeValue, SESSION, (CK_SESSION_HANDLE a, CK_OBJECT_HANDLE b, CK_ATTRIBUTE_PTR c, CK_ULONG d), (a, b, c, d), TRACE_ATTRS (c, d)) \
+	X (N, FindObjectsInit, SESSION, (CK_SESSION_HANDLE a, CK_ATTRIBUTE_PTR b, CK_ULONG c), (a, b, c), TRACE_ATTRS (b, c)) \
+	X (N, FindObjects, SESSION, (CK_SESSION_HANDLE a, CK_OBJECT_HANDLE_PTR b, CK_ULONG c, CK_ULONG_PTR d), (a, b, c, d), TRACE_OUT (b, d) * sizeof (CK_OBJECT_HANDLE)) \
+	X (N, FindObjectsFinal, SESSION, (CK_SESSION_HANDLE a), (a), 0) \
+	X (N, EncryptInit, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c), (a, b, c), 0) \
+	X (N, Encrypt, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, EncryptUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, EncryptFinal, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG_PTR c), (a, b, c), TRACE_OUT (b, c)) \
+	X (N, DecryptInit, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c), (a, b, c), 0) \
+	X (N, Decrypt, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, DecryptUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, DecryptFinal, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG_PTR c), (a, b, c), TRACE_OUT (b, c)) \
+	X (N, DigestInit, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b), (a, b), 0) \
+	X (N, Digest, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, DigestUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c), (a, b, c), c) \
+	X (N, DigestKey, SESSION, (CK_SESSION_HANDLE a, CK_OBJECT_HANDLE b), (a, b), 0) \
+	X (N, DigestFinal, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG_PTR c), (a, b, c), TRACE_OUT (b, c)) \
+	X (N, SignInit, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c), (a, b, c), 0) \
+	X (N, Sign, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, SignUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c), (a, b, c), c) \
+	X (N, SignFinal, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG_PTR c), (a, b, c), TRACE_OUT (b, c)) \
+	X (N, SignRecoverInit, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c), (a, b, c), 0) \
+	X (N, SignRecover, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, VerifyInit, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c), (a, b, c), 0) \
+	X (N, Verify, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG e), (a, b, c, d, e), c + e) \
+	X (N, VerifyUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c), (a, b, c), c) \
+	X (N, VerifyFinal, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c), (a, b, c), c) \
+	X (N, VerifyRecoverInit, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c), (a, b, c), 0) \
+	X (N, VerifyRecover, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, DigestEncryptUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, DecryptDigestUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, SignEncryptUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, DecryptVerifyUpdate, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c, CK_BYTE_PTR d, CK_ULONG_PTR e), (a, b, c, d, e), c + TRACE_OUT (d, e)) \
+	X (N, GenerateKey, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_ATTRIBUTE_PTR c, CK_ULONG d, CK_OBJECT_HANDLE_PTR e), (a, b, c, d, e), TRACE_ATTRS (c, d)) \
+	X (N, GenerateKeyPair, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_ATTRIBUTE_PTR c, CK_ULONG d, CK_ATTRIBUTE_PTR e, CK_ULONG f, CK_OBJECT_HANDLE_PTR g, CK_OBJECT_HANDLE_PTR h), (a, b, c, d, e, f, g, h), TRACE_ATTRS (c, d) + TRACE_ATTRS (e, f)) \
+	X (N, WrapKey, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c, CK_OBJECT_HANDLE d, CK_BYTE_PTR e, CK_ULONG_PTR f), (a, b, c, d, e, f), TRACE_OUT (e, f)) \
+	X (N, UnwrapKey, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c, CK_BYTE_PTR d, CK_ULONG e, CK_ATTRIBUTE_PTR f, CK_ULONG g, CK_OBJECT_HANDLE_PTR h), (a, b, c, d, e, f, g, h), e + TRACE_ATTRS (f, g)) \
+	X (N, DeriveKey, SESSION, (CK_SESSION_HANDLE a, CK_MECHANISM_PTR b, CK_OBJECT_HANDLE c, CK_ATTRIBUTE_PTR d, CK_ULONG e, CK_OBJECT_HANDLE_PTR f), (a, b, c, d, e, f), TRACE_ATTRS (d, e)) \
+	X (N, SeedRandom, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c), (a, b, c), c) \
+	X (N, GenerateRandom, SESSION, (CK_SESSION_HANDLE a, CK_BYTE_PTR b, CK_ULONG c), (a, b, c), rv == CKR_OK ? c : 0) \
+	X (N, GetFunctionStatus, SESSION, (CK_SESSION_HANDLE a), (a), 0) \
+	X (N, CancelFunction, SESSION, (CK_SESSION_HANDLE a), (a), 0) \
+	X (N, WaitForSlotEvent, NONE, (CK_FLAGS a, CK_SLOT_ID_PTR b, CK_VOID_PTR c), (a, b, c), 0)
+
+#define TRACE_ENUM(N, name, kind, params, args, bytes) TRACE_C_##name,
+#define TRACE_NAME(N, name, kind, params, args, bytes) "C_" #name,
+
+enum {
+	TRACE_FUNCTIONS (TRACE_ENUM, 0)
+	TRACE_N_FUNCTIONS
+};
+
+static const gchar *TRACE_NAMES[TRACE_N_FUNCTIONS] = {
+	TRACE_FUNCTIONS (TRACE_NAME, 0)
+};
+
+typedef struct {
+	GMutex mutex;
+	guint64 calls;
+	guint64 errors;
+	guint64 bytes;
+	guint64 total_usec;
+	guint64 buckets[TRACE_BUCKETS];
+} TraceCounter;
+
+typedef struct {
+	CK_SLOT_ID slot;
+	TraceCounter counters[TRACE_N_FUNCTIONS];
+} TraceSlot;
+
+typedef struct {
+	CK_FUNCTION_LIST_PTR funcs;
+	CK_FUNCTION_LIST_PTR list;
+	gchar *name;
+	gchar *label;
+
+	/* Protects the tables, each counter has its own lock */
+	GRWLock lock;
+	GHashTable *sessions;
+	GHashTable *slots;
+} Traced;
+
+gint _gck_trace_enabled = 0;
+
+/* Protects everything below, traced[] is also read by the calls without it */
+G_LOCK_DEFINE_STATIC (trace);
+static Traced *traced[TRACE_MAX_MODULES];
+static gint traced_refs[TRACE_MAX_MODULES];
+static GList *traced_modules = NULL;
+
+static gchar *report_path = NULL;
+
+static CK_ULONG
+trace_attributes_size (CK_ATTRIBUTE_PTR attrs,
+                       CK_ULONG n_attrs)
+{
+	CK_ULONG size = 0;
+	CK_ULONG i;
+
+	if (attrs == NULL)
+		return 0;
+
+	for (i = 0; i < n_attrs; i++) {
+		if (attrs[i].pValue != NULL && attrs[i].ulValueLen != (CK_ULONG)-1)
+			size += attrs[i].ulValueLen;
+	}
+
+	return size;
+}
+
+static void
+trace_slot_free (gpointer data)
+{
+	TraceSlot *slot = data;
+	guint i;
+
+	for (i = 0; i < TRACE_N_FUNCTIONS; i++)
+		g_mutex_clear (&slot->counters[i].mutex);
+	g_free (slot);
+}
+
+/* Called with at least a reader lock on t->lock */
+static CK_SLOT_ID
+trace_lookup_slot_id (Traced *t,
+                      gint by,
+                      CK_ULONG key)
+{
+	gpointer value;
+
+	if (by == TRACE_BY_SLOT)
+		return key;
+	if (by == TRACE_BY_SESSION &&
+	    g_hash_table_lookup_extended (t->sessions, GSIZE_TO_POINTER (key), NULL, &value))
+		return GPOINTER_TO_SIZE (value);
+	return TRACE_NO_SLOT;
+}
+
+static void
+trace_add_slot (Traced *t,
+                CK_SLOT_ID slot_id)
+{
+	TraceSlot *slot;
+	guint i;
+
+	g_rw_lock_writer_lock (&t->lock);
+
+	if (!g_hash_table_contains (t->slots, GSIZE_TO_POINTER (slot_id))) {
+		slot = g_new0 (TraceSlot, 1);
+		slot->slot = slot_id;
+		for (i = 0; i < TRACE_N_FUNCTIONS; i++)
+			g_mutex_init (&slot->counters[i].mutex);
+		g_hash_table_insert (t->slots, GSIZE_TO_POINTER (slot_id), slot);
+	}
+
+	g_rw_lock_writer_unlock (&t->lock);
+}
+
+static inline gint64
+trace_enter (Traced *t,
+             guint func)
+{
+	TRACE_PROBE_ENTRY (t, func);
+	return g_get_monotonic_time ();
+}
+
+static void
+trace_leave (Traced *t,
+             guint func,
+             gint by,
+             CK_ULONG key,
+             gint64 start,
+             CK_RV rv,
+             CK_ULONG bytes)
+{
+	TraceCounter *counter;
+	CK_SLOT_ID slot_id;
+	TraceSlot *slot;
+	gint64 usec;
+	guint bucket;
+
+	usec = MAX (g_get_monotonic_time () - start, 0);
+	TRACE_PROBE_RETURN (t, func, rv, usec);
+
+	bucket = g_bit_storage ((gulong)usec) - 1;
+	if (bucket >= TRACE_BUCKETS)
+		bucket = TRACE_BUCKETS - 1;
+
+	/* Slots are only added once, so the writer lock is rarely needed */
+	g_rw_lock_reader_lock (&t->lock);
+	slot_id = trace_lookup_slot_id (t, by, key);
+	while ((slot = g_hash_table_lookup (t->slots, GSIZE_TO_POINTER (slot_id))) == NULL) {
+		g_rw_lock_reader_unlock (&t->lock);
+		trace_add_slot (t, slot_id);
+		g_rw_lock_reader_lock (&t->lock);
+	}
+
+	counter = &slot->counters[func];
+	g_mutex_lock (&counter->mutex);
+	counter->calls++;
+	if (rv != CKR_OK)
+		counter->errors++;
+	counter->bytes += bytes;
+	counter->total_usec += usec;
+	counter->buckets[bucket]++;
+	g_mutex_unlock (&counter->mutex);
+
+	g_rw_lock_reader_unlock (&t->lock);
+}
+
+#define TRACE_IMPL(N, name, kind, params, args, bytes) \
+	TRACE_IMPL_##kind (name, params, args, bytes)
+#define TRACE_IMPL_NONE(name, params, args, bytes) \
+	TRACE_IMPL_BODY (name, TRACE_BY_NONE, 0, params, args, bytes)
+#define TRACE_IMPL_SLOT(name, params, args, bytes) \
+	TRACE_IMPL_BODY (name, TRACE_BY_SLOT, a, params, args, bytes)
+#define TRACE_IMPL_SESSION(name, params, args, bytes) \
+	TRACE_IMPL_BODY (name, TRACE_BY_SESSION, a, params, args, bytes)
+#define TRACE_IMPL_CUSTOM(name, params, args, bytes)
+
+#define TRACE_IMPL_BODY(name, by, key, params, args, bytes) \
+static CK_RV \
+trace_C_##name (Traced *t, TRACE_UNPAREN params) \
+{ \
+	gint64 start; \
+	CK_RV rv; \
+	start = trace_enter (t, TRACE_C_##name); \
+	rv = (t->funcs->C_##name) args; \
+	trace_leave (t, TRACE_C_##name, by, key, start, rv, bytes); \
+	return rv; \
+}
+
+TRACE_FUNCTIONS (TRACE_IMPL, 0)
+
+static CK_RV
+trace_C_OpenSession (Traced *t,
+                     CK_SLOT_ID slot_id,
+                     CK_FLAGS flags,
+                     CK_VOID_PTR application,
+                     CK_NOTIFY notify,
+                     CK_SESSION_HANDLE_PTR session)
+{
+	gint64 start;
+	CK_RV rv;
+
+	start = trace_enter (t, TRACE_C_OpenSession);
+	rv = (t->funcs->C_OpenSession) (slot_id, flags, application, notify, session);
+
+	/* So that later calls on the session are counted against its slot */
+	if (rv == CKR_OK && session != NULL) {
+		g_rw_lock_writer_lock (&t->lock);
+		g_hash_table_insert (t->sessions, GSIZE_TO_POINTER (*session),
+		                     GSIZE_TO_POINTER (slot_id));
+		g_rw_lock_writer_unlock (&t->lock);
+	}
+
+	trace_leave (t, TRACE_C_OpenSession, TRACE_BY_SLOT, slot_id, start, rv, 0);
+	return rv;
+}
+
+static CK_RV
+trace_C_CloseSession (Traced *t,
+                      CK_SESSION_HANDLE session)
+{
+	gint64 start;
+	CK_RV rv;
+
+	start = trace_enter (t, TRACE_C_CloseSession);
+	rv = (t->funcs->C_CloseSession) (session);
+	trace_leave (t, TRACE_C_CloseSession, TRACE_BY_SESSION, session, start, rv, 0);
+
+	g_rw_lock_writer_lock (&t->lock);
+	g_hash_table_remove (t->sessions, GSIZE_TO_POINTER (session));
+	g_rw_lock_writer_unlock (&t->lock);
+
+	return rv;
+}
+
+static gboolean
+remove_session_for_slot (gpointer key,
+                         gpointer value,
+                         gpointer user_data)
+{
+	return GPOINTER_TO_SIZE (value) == *((CK_SLOT_ID *)user_data);
+}
+
+static CK_RV
+trace_C_CloseAllSessions (Traced *t,
+                          CK_SLOT_ID slot_id)
+{
+	gint64 start;
+	CK_RV rv;
+
+	start = trace_enter (t, TRACE_C_CloseAllSessions);
+	rv = (t->funcs->C_CloseAllSessions) (slot_id);
+	trace_leave (t, TRACE_C_CloseAllSessions, TRACE_BY_SLOT, slot_id, start, rv, 0);
+
+	g_rw_lock_writer_lock (&t->lock);
+	g_hash_table_foreach_remove (t->sessions, remove_session_for_slot, &slot_id);
+	g_rw_lock_writer_unlock (&t->lock);
+
+	return rv;
+}
+
+static CK_RV
+trace_C_GetFunctionList (Traced *t,
+                         CK_FUNCTION_LIST_PTR_PTR list)
+{
+	gint64 start;
+
+	start = trace_enter (t, TRACE_C_GetFunctionList);
+	if (list != NULL)
+		*list = t->list;
+	trace_leave (t, TRACE_C_GetFunctionList, TRACE_BY_NONE, 0, start,
+	             list ? CKR_OK : CKR_ARGUMENTS_BAD, 0);
+
+	return list ? CKR_OK : CKR_ARGUMENTS_BAD;
+}
+
+/*
+ * PKCS#11 calls don't carry any context, so each traced module gets its
+ * own set of functions which know which module they're for.
+ */
+#define TRACE_TRAMPOLINE(N, name, kind, params, args, bytes) \
+static CK_RV \
+trace_##N##_C_##name params \
+{ \
+	return trace_C_##name (traced[N], TRACE_UNPAREN args); \
+}
+
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 0)
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 1)
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 2)
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 3)
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 4)
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 5)
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 6)
+TRACE_FUNCTIONS (TRACE_TRAMPOLINE, 7)
+
+#define TRACE_ENTRY(N, name, kind, params, args, bytes) \
+	.C_##name = trace_##N##_C_##name,
+#define TRACE_LIST(N) \
+	{ .version = { CRYPTOKI_VERSION_MAJOR, CRYPTOKI_VERSION_MINOR }, \
+	  TRACE_FUNCTIONS (TRACE_ENTRY, N) }
+
+static CK_FUNCTION_LIST trace_lists[TRACE_MAX_MODULES] = {
+	TRACE_LIST (0),
+	TRACE_LIST (1),
+	TRACE_LIST (2),
+	TRACE_LIST (3),
+	TRACE_LIST (4),
+	TRACE_LIST (5),
+	TRACE_LIST (6),
+	TRACE_LIST (7),
+};
+
+/* Label values are quoted, see the Prometheus text format */
+gchar *
+_gck_trace_escape_label (const gchar *value)
+{
+	GString *result;
+
+	result = g_string_sized_new (strlen (value));
+	for (; *value != '\0'; value++) {
+		if (*value == '\\')
+			g_string_append (result, "\\\\");
+		else if (*value == '"')
+			g_string_append (result, "\\\"");
+		else if (*value == '\n')
+			g_string_append (result, "\\n");
+		else
+			g_string_append_c (result, *value);
+	}
+
+	return g_string_free (result, FALSE);
+}
+
+static gboolean
+trace_label_in_use (const gchar *label)
+{
+	GList *l;
+
+	for (l = traced_modules; l != NULL; l = g_list_next (l)) {
+		if (g_str_equal (((Traced *)l->data)->label, label))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static Traced *
+trace_module_for (CK_FUNCTION_LIST_PTR funcs,
+                  const gchar *path)
+{
+	Traced *t;
+	gchar *name;
+	gchar *escaped;
+	GList *l;
+	gint n = 1;
+
+	name = path ? g_path_get_basename (path) : g_strdup ("module");
+
+	/* Keep counting where we left off if the module is traced again */
+	for (l = traced_modules; l != NULL; l = g_list_next (l)) {
+		t = l->data;
+		if (t->funcs == funcs && g_str_equal (t->name, name)) {
+			g_free (name);
+			return t;
+		}
+	}
+
+	t = g_new0 (Traced, 1);
+	t->funcs = funcs;
+	t->name = name;
+
+	/* Modules can share a file name, but each needs its own series */
+	escaped = _gck_trace_escape_label (name);
+	t->label = g_strdup (escaped);
+	while (trace_label_in_use (t->label)) {
+		g_free (t->label);
+		t->label = g_strdup_printf ("%s-%d", escaped, ++n);
+	}
+	g_free (escaped);
+
+	g_rw_lock_init (&t->lock);
+	t->sessions = g_hash_table_new (g_direct_hash, g_direct_equal);
+	t->slots = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, trace_slot_free);
+	traced_modules = g_list_append (traced_modules, t);
+
+	return t;
+}
+
+/*
+ * Returns a function list which traces calls to @funcs, or @funcs itself
+ * when all the function lists are in use. Each successful call must be
+ * matched by _gck_trace_unwrap() once the module is no longer used.
+ */
+CK_FUNCTION_LIST_PTR
+_gck_trace_wrap (CK_FUNCTION_LIST_PTR funcs,
+                 const gchar *path)
+{
+	static gboolean warned = FALSE;
+	CK_FUNCTION_LIST_PTR result = funcs;
+	gint unused = -1;
+	gint i;
+
+	if (funcs == NULL)
+		return NULL;
+
+	G_LOCK (trace);
+
+	for (i = 0; i < TRACE_MAX_MODULES; i++) {
+		if (traced_refs[i] > 0 && traced[i]->funcs == funcs)
+			break;
+		if (traced_refs[i] == 0 && unused < 0)
+			unused = i;
+	}
+
+	if (i < TRACE_MAX_MODULES) {
+		traced_refs[i]++;
+		result = &trace_lists[i];
+
+	} else if (unused >= 0) {
+		trace_lists[unused].version = funcs->version;
+		traced[unused] = trace_module_for (funcs, path);
+		traced[unused]->list = &trace_lists[unused];
+		traced_refs[unused] = 1;
+		result = &trace_lists[unused];
+
+	} else if (!warned) {
+		g_message ("not tracing PKCS#11 calls to %s, only %d modules can be traced at once",
+		           path ? path : "module", TRACE_MAX_MODULES);
+		warned = TRUE;
+	}
+
+	G_UNLOCK (trace);
+	return result;
+}
+
+void
+_gck_trace_unwrap (CK_FUNCTION_LIST_PTR list)
+{
+	Traced *t;
+	gint i;
+
+	/* Not a traced list, see above */
+	if (list < trace_lists || list >= trace_lists + TRACE_MAX_MODULES)
+		return;
+
+	i = list - trace_lists;
+
+	G_LOCK (trace);
+
+	g_assert (traced_refs[i] > 0);
+	if (--traced_refs[i] == 0) {
+		t = traced[i];
+		g_rw_lock_writer_lock (&t->lock);
+		g_hash_table_remove_all (t->sessions);
+		g_rw_lock_writer_unlock (&t->lock);
+	}
+
+	G_UNLOCK (trace);
+}
+
+static void
+write_report (void)
+{
+	gchar *report;
+	FILE *file;
+
+	report = gck_trace_dump ();
+
+	if (g_str_equal (report_path, "-")) {
+		fputs (report, stderr);
+	} else {
+		file = fopen (report_path, "w");
+		if (file == NULL) {
+			g_printerr ("couldn't write PKCS#11 trace to: %s\n", report_path);
+		} else {
+			fputs (report, file);
+			fclose (file);
+		}
+	}
+
+	g_free (report);
+}
+
+void
+_gck_trace_init (void)
+{
+	static gsize initialized = 0;
+	const gchar *env;
+
+	if (!g_once_init_enter (&initialized))
+		return;
+
+	env = g_getenv ("GCK_TRACE");
+	if (env != NULL && env[0] != '\0') {
+		if (!g_str_equal (env, "1")) {
+			report_path = g_strdup (env);
+			atexit (write_report);
+		}
+		g_atomic_int_set (&_gck_trace_enabled, 1);
+	}
+
+	g_once_init_leave (&initialized, 1);
+}
+
+/**
+ * gck_trace_set_enabled:
+ * @enabled: whether to trace PKCS#11 calls
+ *
+ * Turn tracing of PKCS#11 calls on or off.
+ *
+ * While tracing is on, every call that Gck makes into a module is counted and
+ * timed before it is passed on. The results can be retrieved with
+ * [func@trace_dump]. Calls made directly through the function list from
+ * [method@Module.get_functions] are not traced, and neither are calls already
+ * in progress when tracing is turned on.
+ *
+ * Tracing can also be turned on by setting the `GCK_TRACE` environment
+ * variable. If it is set to anything other than `1` the results are written
+ * to that file when the process exits, or to standard error when it is `-`.
+ */
+void
+gck_trace_set_enabled (gboolean enabled)
+{
+	_gck_trace_init ();
+	g_atomic_int_set (&_gck_trace_enabled, enabled ? 1 : 0);
+}
+
+/**
+ * gck_trace_get_enabled:
+ *
+ * Check whether PKCS#11 calls are being traced, see [func@trace_set_enabled].
+ *
+ * Returns: whether tracing is on
+ */
+gboolean
+gck_trace_get_enabled (void)
+{
+	_gck_trace_init ();
+	return g_atomic_int_get (&_gck_trace_enabled) ? TRUE : FALSE;
+}
+
+static gint
+compare_slots (gconstpointer a,
+               gconstpointer b)
+{
+	const TraceSlot *one = *((TraceSlot **)a);
+	const TraceSlot *two = *((TraceSlot **)b);
+	return (one->slot > two->slot) - (one->slot < two->slot);
+}
+
+static void
+dump_counter (TraceCounter *counter,
+              const gchar *labels,
+              GString *output)
+{
+	guint64 cumulative = 0;
+	guint i;
+
+	g_string_append_printf (output, "gck_call_total{%s} %" G_GUINT64_FORMAT "\n",
+	                        labels, counter->calls);
+	g_string_append_printf (output, "gck_call_errors_total{%s} %" G_GUINT64_FORMAT "\n",
+	                        labels, counter->errors);
+	g_string_append_printf (output, "gck_call_bytes_total{%s} %" G_GUINT64_FORMAT "\n",
+	                        labels, counter->bytes);
+
+	for (i = 0; i < TRACE_BUCKETS; i++) {
+		cumulative += counter->buckets[i];
+		if (i == TRACE_BUCKETS - 1)
+			g_string_append_printf (output, "gck_call_usec_bucket{%s,le=\"+Inf\"} %" G_GUINT64_FORMAT "\n",
+			                        labels, cumulative);
+		else
+			g_string_append_printf (output, "gck_call_usec_bucket{%s,le=\"%lu\"} %" G_GUINT64_FORMAT "\n",
+			                        labels, (1UL << (i + 1)) - 1, cumulative);
+	}
+
+	g_string_append_printf (output, "gck_call_usec_sum{%s} %" G_GUINT64_FORMAT "\n",
+	                        labels, counter->total_usec);
+}
+
+/**
+ * gck_trace_dump:
+ *
+ * Get the counts, latencies and bytes transferred for the PKCS#11 calls
+ * traced so far, per module, slot and function. Only functions which were
+ * called are listed. This is followed by the depth of each module's queue of
+ * asynchronous calls and how long calls waited in it, whether tracing is on
+ * or not.
+ *
+ * The result is in the Prometheus text exposition format, so that it can be
+ * read by people as well as scraped by the usual tools.
+ *
+ * Returns: (transfer full): the results, free with g_free()
+ */
+gchar *
+gck_trace_dump (void)
+{
+	GString *output;
+	GPtrArray *slots;
+	GHashTableIter iter;
+	TraceSlot *slot;
+	gchar *labels;
+	gchar *slot_name;
+	TraceCounter counter;
+	gpointer value;
+	Traced *t;
+	GList *l;
+	guint j, f;
+
+	output = g_string_new ("");
+	g_string_append (output, "# TYPE gck_call_total counter\n");
+	g_string_append (output, "# TYPE gck_call_errors_total counter\n");
+	g_string_append (output, "# TYPE gck_call_bytes_total counter\n");
+	g_string_append (output, "# TYPE gck_call_usec histogram\n");
+	g_string_append (output, "# TYPE gck_call_queue_depth gauge\n");
+	g_string_append (output, "# TYPE gck_call_queue_started_total counter\n");
+	g_string_append (output, "# TYPE gck_call_queue_cancelled_total counter\n");
+	g_string_append (output, "# TYPE gck_call_queue_wait_usec_sum counter\n");
+
+	G_LOCK (trace);
+
+	for (l = traced_modules; l != NULL; l = g_list_next (l)) {
+		t = l->data;
+		g_rw_lock_reader_lock (&t->lock);
+
+		slots = g_ptr_array_new ();
+		g_hash_table_iter_init (&iter, t->slots);
+		while (g_hash_table_iter_next (&iter, NULL, &value))
+			g_ptr_array_add (slots, value);
+		g_ptr_array_sort (slots, compare_slots);
+
+		for (j = 0; j < slots->len; j++) {
+			slot = slots->pdata[j];
+			if (slot->slot == TRACE_NO_SLOT)
+				slot_name = g_strdup ("none");
+			else
+				slot_name = g_strdup_printf ("%lu", (gulong)slot->slot);
+
+			for (f = 0; f < TRACE_N_FUNCTIONS; f++) {
+				g_mutex_lock (&slot->counters[f].mutex);
+				counter = slot->counters[f];
+				g_mutex_unlock (&slot->counters[f].mutex);
+
+				if (counter.calls == 0)
+					continue;
+				labels = g_strdup_printf ("module=\"%s\",slot=\"%s\",function=\"%s\"",
+				                          t->label, slot_name, TRACE_NAMES[f]);
+				dump_counter (&counter, labels, output);
+				g_free (labels);
+			}
+
+			g_free (slot_name);
+		}
+
+		g_ptr_array_free (slots, TRUE);
+		g_rw_lock_reader_unlock (&t->lock);
+	}
+
+	G_UNLOCK (trace);
+
+	_gck_call_queue_dump (output);
+
+	return g_string_free (output, FALSE);
+}
+
+/**
+ * gck_trace_reset:
+ *
+ * Clear the results of tracing PKCS#11 calls so far.
+ */
+void
+gck_trace_reset (void)
+{
+	Traced *t;
+	GList *l;
+
+	G_LOCK (trace);
+	for (l = traced_modules; l != NULL; l = g_list_next (l)) {
+		t = l->data;
+		g_rw_lock_writer_lock (&t->lock);
+		g_hash_table_remove_all (t->slots);
+		g_rw_lock_writer_unlock (&t->lock);
+	}
+	G_UNLOCK (trace);
+}
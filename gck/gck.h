@@ -461,6 +461,11 @@ GckModuleInfo*        gck_module_get_info                     (GckModule *self);
 GList*                gck_module_get_slots                    (GckModule *self,
                                                                gboolean token_present);
 
+void                  gck_module_set_max_concurrent_calls     (GckModule *self,
+                                                               guint max_calls);
+
+guint                 gck_module_get_max_concurrent_calls     (GckModule *self);
+
 GList*                gck_modules_initialize_registered        (GCancellable *cancellable,
                                                                 GError **error);
 
@@ -1441,6 +1446,14 @@ void                gck_uri_data_free                       (GckUriData *uri_dat
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (GckUriData, gck_uri_data_free);
 
+void                gck_trace_set_enabled                   (gboolean enabled);
+
+gboolean            gck_trace_get_enabled                   (void);
+
+gchar *             gck_trace_dump                          (void);
+
+void                gck_trace_reset                         (void);
+
 G_END_DECLS
 
 #undef __GCK_INSIDE_HEADER__
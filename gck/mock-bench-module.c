@@ -0,0 +1,1163 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gck-mock.h"
+#include "mock-bench-module.h"
+
+#include "egg/egg-asn1-defs.h"
+#include "egg/egg-asn1x.h"
+
+#include <p11-kit/pkcs11.h>
+
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * A read-only token with lots of certificates on it, to benchmark gck and
+ * gcr against. Unlike gck-mock.c every attribute value of every object is
+ * indexed, so that C_FindObjectsInit only looks at the objects that have
+ * the least common of the template attributes. Objects never change after
+ * C_Initialize, so they are read without locking.
+ *
+ * See mock-bench-module.h for how it is configured.
+ */
+
+#define DEFAULT_OBJECTS 1000
+
+#define BENCH_CALLS(X) \
+	X (Initialize) \
+	X (Finalize) \
+	X (GetInfo) \
+	X (GetSlotList) \
+	X (GetSlotInfo) \
+	X (GetTokenInfo) \
+	X (GetMechanismList) \
+	X (GetMechanismInfo) \
+	X (OpenSession) \
+	X (CloseSession) \
+	X (CloseAllSessions) \
+	X (GetSessionInfo) \
+	X (GetAttributeValue) \
+	X (FindObjectsInit) \
+	X (FindObjects) \
+	X (FindObjectsFinal)
+
+#define BENCH_CALL_ENUM(name) CALL_##name,
+#define BENCH_CALL_NAME(name) "C_" #name,
+
+typedef enum {
+	BENCH_CALLS (BENCH_CALL_ENUM)
+	N_CALLS
+} BenchCall;
+
+static const gchar *CALL_NAMES[] = {
+	BENCH_CALLS (BENCH_CALL_NAME)
+};
+
+G_STATIC_ASSERT (G_N_ELEMENTS (CALL_NAMES) == N_CALLS);
+
+enum {
+	ATTR_CLASS,
+	ATTR_CERTIFICATE_TYPE,
+	ATTR_TOKEN,
+	ATTR_PRIVATE,
+	ATTR_MODIFIABLE,
+	ATTR_TRUSTED,
+	ATTR_ID,
+	ATTR_LABEL,
+	ATTR_VALUE,
+	ATTR_SUBJECT,
+	ATTR_ISSUER,
+	ATTR_SERIAL_NUMBER,
+	N_ATTRS
+};
+
+typedef struct {
+	CK_ATTRIBUTE_TYPE type;
+	GBytes *value;
+} Attribute;
+
+typedef struct {
+	Attribute attrs[N_ATTRS];
+} Object;
+
+typedef struct {
+	GBytes *value;
+	GBytes *subject;
+	GBytes *issuer;
+	GBytes *serial;
+} Fixture;
+
+typedef struct {
+	CK_SESSION_HANDLE handle;
+	CK_FLAGS flags;
+	gboolean finding;
+	GArray *matches;
+	guint position;
+} Session;
+
+static gboolean initialized = FALSE;
+static CK_FUNCTION_LIST functionList;
+
+/* Set up in C_Initialize, read only after that */
+static Object *the_objects = NULL;
+static CK_ULONG n_the_objects = 0;
+static GHashTable *the_index = NULL;
+static gulong the_latency = 0;
+static gulong the_jitter = 0;
+static gchar *the_stats_path = NULL;
+
+static guint call_counts[N_CALLS];
+
+G_LOCK_DEFINE_STATIC (sessions);
+static GHashTable *the_sessions = NULL;
+static CK_SESSION_HANDLE unique_identifier = 0;
+
+G_LOCK_DEFINE_STATIC (jitter);
+static GRand *jitter_rand = NULL;
+
+static void
+enter_call (BenchCall call)
+{
+	gulong delay;
+
+	g_atomic_int_inc (&call_counts[call]);
+
+	delay = the_latency;
+	if (the_jitter > 0) {
+		G_LOCK (jitter);
+		delay += g_rand_int_range (jitter_rand, 0, the_jitter + 1);
+		G_UNLOCK (jitter);
+	}
+
+	if (delay > 0)
+		g_usleep (delay);
+}
+
+guint
+mock_bench_get_call_count (const gchar *function)
+{
+	guint i;
+
+	g_return_val_if_fail (function != NULL, 0);
+
+	for (i = 0; i < N_CALLS; i++) {
+		if (g_str_equal (CALL_NAMES[i], function))
+			return g_atomic_int_get (&call_counts[i]);
+	}
+
+	return 0;
+}
+
+void
+mock_bench_reset_call_counts (void)
+{
+	guint i;
+
+	for (i = 0; i < N_CALLS; i++)
+		g_atomic_int_set (&call_counts[i], 0);
+}
+
+static void
+write_call_counts (const gchar *path)
+{
+	FILE *file;
+	guint i;
+
+	if (g_str_equal (path, "-"))
+		file = stderr;
+	else
+		file = g_fopen (path, "w");
+	if (file == NULL) {
+		g_warning ("couldn't write call counts to: %s", path);
+		return;
+	}
+
+	for (i = 0; i < N_CALLS; i++) {
+		fprintf (file, "%s %u\n", CALL_NAMES[i],
+		         (guint)g_atomic_int_get (&call_counts[i]));
+	}
+
+	if (file != stderr)
+		fclose (file);
+}
+
+static gulong
+getenv_ulong (const gchar *name,
+              gulong def)
+{
+	const gchar *value;
+	gchar *end;
+	guint64 result;
+
+	value = g_getenv (name);
+	if (value == NULL || value[0] == '\0')
+		return def;
+
+	result = g_ascii_strtoull (value, &end, 10);
+	if (*end != '\0' || result > G_MAXULONG) {
+		g_warning ("invalid value for %s: %s", name, value);
+		return def;
+	}
+
+	return result;
+}
+
+/* Attribute values are looked up by type and contents */
+
+typedef struct {
+	CK_ATTRIBUTE_TYPE type;
+	GBytes *value;
+} IndexKey;
+
+static guint
+index_key_hash (gconstpointer data)
+{
+	const IndexKey *key = data;
+	return g_bytes_hash (key->value) ^ (guint)key->type;
+}
+
+static gboolean
+index_key_equal (gconstpointer one,
+                 gconstpointer two)
+{
+	const IndexKey *k1 = one;
+	const IndexKey *k2 = two;
+	return k1->type == k2->type && g_bytes_equal (k1->value, k2->value);
+}
+
+static void
+index_key_free (gpointer data)
+{
+	IndexKey *key = data;
+	g_bytes_unref (key->value);
+	g_free (key);
+}
+
+static void
+index_add (CK_OBJECT_HANDLE handle,
+           const Attribute *attr)
+{
+	IndexKey lookup = { attr->type, attr->value };
+	IndexKey *key;
+	GArray *handles;
+
+	handles = g_hash_table_lookup (the_index, &lookup);
+	if (handles == NULL) {
+		key = g_new (IndexKey, 1);
+		key->type = attr->type;
+		key->value = g_bytes_ref (attr->value);
+		handles = g_array_new (FALSE, FALSE, sizeof (CK_OBJECT_HANDLE));
+		g_hash_table_insert (the_index, key, handles);
+	}
+
+	g_array_append_val (handles, handle);
+}
+
+static GArray *
+index_lookup (CK_ATTRIBUTE_PTR attr)
+{
+	IndexKey lookup;
+	GArray *handles;
+
+	if (attr->pValue == NULL && attr->ulValueLen != 0)
+		return NULL;
+
+	lookup.type = attr->type;
+	lookup.value = g_bytes_new_static (attr->pValue, attr->ulValueLen);
+	handles = g_hash_table_lookup (the_index, &lookup);
+	g_bytes_unref (lookup.value);
+
+	return handles;
+}
+
+static const Attribute *
+object_find_attribute (const Object *object,
+                       CK_ATTRIBUTE_TYPE type)
+{
+	guint i;
+
+	for (i = 0; i < N_ATTRS; i++) {
+		if (object->attrs[i].type == type)
+			return &object->attrs[i];
+	}
+
+	return NULL;
+}
+
+static gboolean
+object_matches (const Object *object,
+                CK_ATTRIBUTE_PTR template,
+                CK_ULONG count)
+{
+	const Attribute *attr;
+	gconstpointer data;
+	gsize size;
+	CK_ULONG i;
+
+	for (i = 0; i < count; i++) {
+		attr = object_find_attribute (object, template[i].type);
+		if (attr == NULL)
+			return FALSE;
+		data = g_bytes_get_data (attr->value, &size);
+		if (size != template[i].ulValueLen)
+			return FALSE;
+		if (size != 0 && memcmp (data, template[i].pValue, size) != 0)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+static GBytes *
+element_raw (GNode *asn,
+             const gchar *name)
+{
+	return egg_asn1x_get_element_raw (egg_asn1x_node (asn, "tbsCertificate", name, NULL));
+}
+
+static gint
+compare_strings (gconstpointer a,
+                 gconstpointer b)
+{
+	return strcmp (*(const gchar **)a, *(const gchar **)b);
+}
+
+static GArray *
+load_fixtures (const gchar *directory)
+{
+	GPtrArray *names;
+	GArray *fixtures;
+	Fixture fixture;
+	const gchar *name;
+	GError *error = NULL;
+	GBytes *bytes;
+	gchar *contents;
+	gchar *path;
+	gsize length;
+	GNode *asn;
+	GDir *dir;
+	guint i;
+
+	dir = g_dir_open (directory, 0, &error);
+	if (dir == NULL) {
+		g_warning ("couldn't open certificate directory: %s", error->message);
+		g_clear_error (&error);
+		return NULL;
+	}
+
+	/* Sorted, so that a given object count always gives the same objects */
+	names = g_ptr_array_new_with_free_func (g_free);
+	while ((name = g_dir_read_name (dir)) != NULL) {
+		if (g_str_has_suffix (name, ".cer") || g_str_has_suffix (name, ".der"))
+			g_ptr_array_add (names, g_strdup (name));
+	}
+	g_dir_close (dir);
+	g_ptr_array_sort (names, compare_strings);
+
+	fixtures = g_array_new (FALSE, TRUE, sizeof (Fixture));
+	for (i = 0; i < names->len; i++) {
+		path = g_build_filename (directory, names->pdata[i], NULL);
+		if (!g_file_get_contents (path, &contents, &length, &error)) {
+			g_warning ("couldn't read certificate: %s", error->message);
+			g_clear_error (&error);
+			g_free (path);
+			continue;
+		}
+
+		bytes = g_bytes_new_take (contents, length);
+		asn = egg_asn1x_create_and_decode (pkix_asn1_tab, "Certificate", bytes);
+		if (asn == NULL) {
+			g_message ("skipping file that isn't a DER certificate: %s", path);
+		} else {
+			fixture.value = g_bytes_ref (bytes);
+			fixture.subject = element_raw (asn, "subject");
+			fixture.issuer = element_raw (asn, "issuer");
+			fixture.serial = element_raw (asn, "serialNumber");
+			egg_asn1x_destroy (asn);
+
+			if (fixture.subject && fixture.issuer && fixture.serial) {
+				g_array_append_val (fixtures, fixture);
+			} else {
+				g_bytes_unref (fixture.value);
+				g_clear_pointer (&fixture.subject, g_bytes_unref);
+				g_clear_pointer (&fixture.issuer, g_bytes_unref);
+				g_clear_pointer (&fixture.serial, g_bytes_unref);
+			}
+		}
+
+		g_bytes_unref (bytes);
+		g_free (path);
+	}
+
+	g_ptr_array_unref (names);
+	return fixtures;
+}
+
+static void
+fixtures_free (GArray *fixtures)
+{
+	Fixture *fixture;
+	guint i;
+
+	for (i = 0; i < fixtures->len; i++) {
+		fixture = &g_array_index (fixtures, Fixture, i);
+		g_bytes_unref (fixture->value);
+		g_bytes_unref (fixture->subject);
+		g_bytes_unref (fixture->issuer);
+		g_bytes_unref (fixture->serial);
+	}
+
+	g_array_free (fixtures, TRUE);
+}
+
+static GBytes *
+ulong_value (CK_ULONG value)
+{
+	return g_bytes_new (&value, sizeof (value));
+}
+
+static GBytes *
+bool_value (CK_BBOOL value)
+{
+	return g_bytes_new (&value, sizeof (value));
+}
+
+static void
+set_attribute (Object *object,
+               guint slot,
+               CK_ATTRIBUTE_TYPE type,
+               GBytes *value)
+{
+	object->attrs[slot].type = type;
+	object->attrs[slot].value = g_bytes_ref (value);
+}
+
+static void
+create_objects (GArray *fixtures,
+                CK_ULONG count)
+{
+	GBytes *class, *type, *true_value, *false_value;
+	const Fixture *fixture;
+	CK_OBJECT_HANDLE handle;
+	Object *object;
+	guint32 id;
+	gchar *label;
+	GBytes *bytes;
+	guint i;
+
+	class = ulong_value (CKO_CERTIFICATE);
+	type = ulong_value (CKC_X_509);
+	true_value = bool_value (CK_TRUE);
+	false_value = bool_value (CK_FALSE);
+
+	the_objects = g_new0 (Object, count);
+	n_the_objects = count;
+	the_index = g_hash_table_new_full (index_key_hash, index_key_equal,
+	                                   index_key_free, (GDestroyNotify)g_array_unref);
+
+	for (handle = 1; handle <= count; handle++) {
+		object = &the_objects[handle - 1];
+		fixture = &g_array_index (fixtures, Fixture, (handle - 1) % fixtures->len);
+
+		set_attribute (object, ATTR_CLASS, CKA_CLASS, class);
+		set_attribute (object, ATTR_CERTIFICATE_TYPE, CKA_CERTIFICATE_TYPE, type);
+		set_attribute (object, ATTR_TOKEN, CKA_TOKEN, true_value);
+		set_attribute (object, ATTR_PRIVATE, CKA_PRIVATE, false_value);
+		set_attribute (object, ATTR_MODIFIABLE, CKA_MODIFIABLE, false_value);
+		set_attribute (object, ATTR_TRUSTED, CKA_TRUSTED, true_value);
+		set_attribute (object, ATTR_VALUE, CKA_VALUE, fixture->value);
+		set_attribute (object, ATTR_SUBJECT, CKA_SUBJECT, fixture->subject);
+		set_attribute (object, ATTR_ISSUER, CKA_ISSUER, fixture->issuer);
+		set_attribute (object, ATTR_SERIAL_NUMBER, CKA_SERIAL_NUMBER, fixture->serial);
+
+		id = GUINT32_TO_BE (handle);
+		bytes = g_bytes_new (&id, sizeof (id));
+		set_attribute (object, ATTR_ID, CKA_ID, bytes);
+		g_bytes_unref (bytes);
+
+		label = g_strdup_printf (MOCK_BENCH_LABEL_FORMAT, (gulong)handle);
+		bytes = g_bytes_new_take (label, strlen (label));
+		set_attribute (object, ATTR_LABEL, CKA_LABEL, bytes);
+		g_bytes_unref (bytes);
+
+		for (i = 0; i < N_ATTRS; i++)
+			index_add (handle, &object->attrs[i]);
+	}
+
+	g_bytes_unref (class);
+	g_bytes_unref (type);
+	g_bytes_unref (true_value);
+	g_bytes_unref (false_value);
+}
+
+static void
+free_objects (void)
+{
+	CK_ULONG i;
+	guint j;
+
+	for (i = 0; i < n_the_objects; i++) {
+		for (j = 0; j < N_ATTRS; j++)
+			g_bytes_unref (the_objects[i].attrs[j].value);
+	}
+
+	g_free (the_objects);
+	the_objects = NULL;
+	n_the_objects = 0;
+
+	g_hash_table_destroy (the_index);
+	the_index = NULL;
+}
+
+static void
+free_session (gpointer data)
+{
+	Session *session = data;
+
+	if (session->matches)
+		g_array_unref (session->matches);
+	g_free (session);
+}
+
+static Session *
+lookup_session (CK_SESSION_HANDLE handle)
+{
+	Session *session;
+
+	G_LOCK (sessions);
+	session = g_hash_table_lookup (the_sessions, GSIZE_TO_POINTER (handle));
+	G_UNLOCK (sessions);
+
+	return session;
+}
+
+static CK_RV
+bench_C_Initialize (CK_VOID_PTR pInitArgs)
+{
+	CK_C_INITIALIZE_ARGS_PTR args;
+	const gchar *directory;
+	GArray *fixtures;
+	CK_ULONG count;
+
+	g_return_val_if_fail (initialized == FALSE, CKR_CRYPTOKI_ALREADY_INITIALIZED);
+
+	args = (CK_C_INITIALIZE_ARGS_PTR)pInitArgs;
+	if (args) {
+		/* We use our own locking, so only refuse when we can't make threads */
+		if (args->flags & CKF_LIBRARY_CANT_CREATE_OS_THREADS)
+			return CKR_NEED_TO_CREATE_THREADS;
+	}
+
+	directory = g_getenv ("GCK_MOCK_BENCH_CERTIFICATES");
+	if (directory == NULL)
+		directory = SRCDIR "/gcr/fixtures";
+
+	fixtures = load_fixtures (directory);
+	if (fixtures == NULL)
+		return CKR_GENERAL_ERROR;
+	if (fixtures->len == 0) {
+		g_warning ("no DER certificates found in: %s", directory);
+		fixtures_free (fixtures);
+		return CKR_GENERAL_ERROR;
+	}
+
+	count = getenv_ulong ("GCK_MOCK_BENCH_OBJECTS", DEFAULT_OBJECTS);
+	create_objects (fixtures, count);
+	fixtures_free (fixtures);
+
+	the_latency = getenv_ulong ("GCK_MOCK_BENCH_LATENCY", 0);
+	the_jitter = MIN (getenv_ulong ("GCK_MOCK_BENCH_JITTER", 0), G_MAXINT32 - 1);
+	if (g_getenv ("GCK_MOCK_BENCH_SEED"))
+		jitter_rand = g_rand_new_with_seed (getenv_ulong ("GCK_MOCK_BENCH_SEED", 0));
+	else
+		jitter_rand = g_rand_new ();
+
+	g_free (the_stats_path);
+	the_stats_path = g_strdup (g_getenv ("GCK_MOCK_BENCH_STATS"));
+
+	the_sessions = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, free_session);
+
+	initialized = TRUE;
+	enter_call (CALL_Initialize);
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_Finalize (CK_VOID_PTR pReserved)
+{
+	g_return_val_if_fail (pReserved == NULL, CKR_ARGUMENTS_BAD);
+	g_return_val_if_fail (initialized == TRUE, CKR_CRYPTOKI_NOT_INITIALIZED);
+
+	enter_call (CALL_Finalize);
+
+	if (the_stats_path)
+		write_call_counts (the_stats_path);
+	g_clear_pointer (&the_stats_path, g_free);
+
+	g_hash_table_destroy (the_sessions);
+	the_sessions = NULL;
+	free_objects ();
+	g_rand_free (jitter_rand);
+	jitter_rand = NULL;
+
+	initialized = FALSE;
+	return CKR_OK;
+}
+
+static const CK_INFO BENCH_INFO = {
+	{ CRYPTOKI_VERSION_MAJOR, CRYPTOKI_VERSION_MINOR },
+	"BENCH MANUFACTURER              ",
+	0,
+	"BENCH LIBRARY                   ",
+	{ 1, 0 }
+};
+
+static CK_RV
+bench_C_GetInfo (CK_INFO_PTR pInfo)
+{
+	g_return_val_if_fail (pInfo, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_GetInfo);
+	memcpy (pInfo, &BENCH_INFO, sizeof (*pInfo));
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_GetFunctionList (CK_FUNCTION_LIST_PTR_PTR list)
+{
+	g_return_val_if_fail (list, CKR_ARGUMENTS_BAD);
+	*list = &functionList;
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_GetSlotList (CK_BBOOL tokenPresent,
+                     CK_SLOT_ID_PTR pSlotList,
+                     CK_ULONG_PTR pulCount)
+{
+	g_return_val_if_fail (pulCount, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_GetSlotList);
+
+	if (pSlotList == NULL) {
+		*pulCount = 1;
+		return CKR_OK;
+	}
+
+	if (*pulCount < 1)
+		return CKR_BUFFER_TOO_SMALL;
+
+	*pulCount = 1;
+	pSlotList[0] = MOCK_BENCH_SLOT_ID;
+	return CKR_OK;
+}
+
+static const CK_SLOT_INFO BENCH_SLOT_INFO = {
+	"BENCH SLOT                                                      ",
+	"BENCH MANUFACTURER              ",
+	CKF_TOKEN_PRESENT,
+	{ 1, 0 },
+	{ 1, 0 },
+};
+
+static CK_RV
+bench_C_GetSlotInfo (CK_SLOT_ID slotID,
+                     CK_SLOT_INFO_PTR pInfo)
+{
+	g_return_val_if_fail (pInfo, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_GetSlotInfo);
+
+	if (slotID != MOCK_BENCH_SLOT_ID)
+		return CKR_SLOT_ID_INVALID;
+
+	memcpy (pInfo, &BENCH_SLOT_INFO, sizeof (*pInfo));
+	return CKR_OK;
+}
+
+static const CK_TOKEN_INFO BENCH_TOKEN_INFO = {
+	"BENCH LABEL                     ",
+	"BENCH MANUFACTURER              ",
+	"BENCH MODEL     ",
+	"BENCH SERIAL    ",
+	CKF_WRITE_PROTECTED | CKF_TOKEN_INITIALIZED,
+	CK_EFFECTIVELY_INFINITE,
+	0,
+	CK_EFFECTIVELY_INFINITE,
+	0,
+	0,
+	0,
+	CK_UNAVAILABLE_INFORMATION,
+	CK_UNAVAILABLE_INFORMATION,
+	CK_UNAVAILABLE_INFORMATION,
+	CK_UNAVAILABLE_INFORMATION,
+	{ 1, 0 },
+	{ 1, 0 },
+	{ 0 }
+};
+
+static CK_RV
+bench_C_GetTokenInfo (CK_SLOT_ID slotID,
+                      CK_TOKEN_INFO_PTR pInfo)
+{
+	g_return_val_if_fail (pInfo, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_GetTokenInfo);
+
+	if (slotID != MOCK_BENCH_SLOT_ID)
+		return CKR_SLOT_ID_INVALID;
+
+	memcpy (pInfo, &BENCH_TOKEN_INFO, sizeof (*pInfo));
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_GetMechanismList (CK_SLOT_ID slotID,
+                          CK_MECHANISM_TYPE_PTR pMechanismList,
+                          CK_ULONG_PTR pulCount)
+{
+	g_return_val_if_fail (pulCount, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_GetMechanismList);
+
+	if (slotID != MOCK_BENCH_SLOT_ID)
+		return CKR_SLOT_ID_INVALID;
+
+	/* No mechanisms at all */
+	*pulCount = 0;
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_GetMechanismInfo (CK_SLOT_ID slotID,
+                          CK_MECHANISM_TYPE type,
+                          CK_MECHANISM_INFO_PTR pInfo)
+{
+	enter_call (CALL_GetMechanismInfo);
+
+	if (slotID != MOCK_BENCH_SLOT_ID)
+		return CKR_SLOT_ID_INVALID;
+
+	return CKR_MECHANISM_INVALID;
+}
+
+static CK_RV
+bench_C_OpenSession (CK_SLOT_ID slotID,
+                     CK_FLAGS flags,
+                     CK_VOID_PTR pApplication,
+                     CK_NOTIFY Notify,
+                     CK_SESSION_HANDLE_PTR phSession)
+{
+	Session *session;
+
+	g_return_val_if_fail (phSession != NULL, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_OpenSession);
+
+	if (slotID != MOCK_BENCH_SLOT_ID)
+		return CKR_SLOT_ID_INVALID;
+	if ((flags & CKF_SERIAL_SESSION) == 0)
+		return CKR_SESSION_PARALLEL_NOT_SUPPORTED;
+	if (flags & CKF_RW_SESSION)
+		return CKR_TOKEN_WRITE_PROTECTED;
+
+	session = g_new0 (Session, 1);
+	session->flags = flags;
+
+	G_LOCK (sessions);
+	session->handle = ++unique_identifier;
+	g_hash_table_insert (the_sessions, GSIZE_TO_POINTER (session->handle), session);
+	G_UNLOCK (sessions);
+
+	*phSession = session->handle;
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_CloseSession (CK_SESSION_HANDLE hSession)
+{
+	gboolean removed;
+
+	enter_call (CALL_CloseSession);
+
+	G_LOCK (sessions);
+	removed = g_hash_table_remove (the_sessions, GSIZE_TO_POINTER (hSession));
+	G_UNLOCK (sessions);
+
+	return removed ? CKR_OK : CKR_SESSION_HANDLE_INVALID;
+}
+
+static CK_RV
+bench_C_CloseAllSessions (CK_SLOT_ID slotID)
+{
+	enter_call (CALL_CloseAllSessions);
+
+	if (slotID != MOCK_BENCH_SLOT_ID)
+		return CKR_SLOT_ID_INVALID;
+
+	G_LOCK (sessions);
+	g_hash_table_remove_all (the_sessions);
+	G_UNLOCK (sessions);
+
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_GetSessionInfo (CK_SESSION_HANDLE hSession,
+                        CK_SESSION_INFO_PTR pInfo)
+{
+	Session *session;
+
+	g_return_val_if_fail (pInfo != NULL, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_GetSessionInfo);
+
+	session = lookup_session (hSession);
+	if (session == NULL)
+		return CKR_SESSION_HANDLE_INVALID;
+
+	pInfo->slotID = MOCK_BENCH_SLOT_ID;
+	pInfo->state = CKS_RO_PUBLIC_SESSION;
+	pInfo->flags = session->flags;
+	pInfo->ulDeviceError = 0;
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_GetAttributeValue (CK_SESSION_HANDLE hSession,
+                           CK_OBJECT_HANDLE hObject,
+                           CK_ATTRIBUTE_PTR pTemplate,
+                           CK_ULONG ulCount)
+{
+	const Attribute *attr;
+	const Object *object;
+	gconstpointer data;
+	CK_RV rv = CKR_OK;
+	gsize size;
+	CK_ULONG i;
+
+	g_return_val_if_fail (pTemplate != NULL || ulCount == 0, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_GetAttributeValue);
+
+	if (lookup_session (hSession) == NULL)
+		return CKR_SESSION_HANDLE_INVALID;
+	if (hObject == 0 || hObject > n_the_objects)
+		return CKR_OBJECT_HANDLE_INVALID;
+
+	object = &the_objects[hObject - 1];
+	for (i = 0; i < ulCount; i++) {
+		attr = object_find_attribute (object, pTemplate[i].type);
+		if (attr == NULL) {
+			pTemplate[i].ulValueLen = (CK_ULONG)-1;
+			rv = CKR_ATTRIBUTE_TYPE_INVALID;
+			continue;
+		}
+
+		data = g_bytes_get_data (attr->value, &size);
+		if (pTemplate[i].pValue == NULL) {
+			pTemplate[i].ulValueLen = size;
+		} else if (pTemplate[i].ulValueLen < size) {
+			pTemplate[i].ulValueLen = (CK_ULONG)-1;
+			rv = CKR_BUFFER_TOO_SMALL;
+		} else {
+			memcpy (pTemplate[i].pValue, data, size);
+			pTemplate[i].ulValueLen = size;
+		}
+	}
+
+	return rv;
+}
+
+static CK_RV
+bench_C_FindObjectsInit (CK_SESSION_HANDLE hSession,
+                         CK_ATTRIBUTE_PTR pTemplate,
+                         CK_ULONG ulCount)
+{
+	GArray *candidates = NULL;
+	GArray *handles;
+	CK_OBJECT_HANDLE handle;
+	Session *session;
+	CK_ULONG i;
+
+	g_return_val_if_fail (pTemplate != NULL || ulCount == 0, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_FindObjectsInit);
+
+	session = lookup_session (hSession);
+	if (session == NULL)
+		return CKR_SESSION_HANDLE_INVALID;
+	if (session->finding)
+		return CKR_OPERATION_ACTIVE;
+
+	session->finding = TRUE;
+	session->position = 0;
+	session->matches = g_array_new (FALSE, FALSE, sizeof (CK_OBJECT_HANDLE));
+
+	/* Start from the shortest list of objects that share a value with the template */
+	for (i = 0; i < ulCount; i++) {
+		handles = index_lookup (pTemplate + i);
+		if (handles == NULL)
+			return CKR_OK;
+		if (candidates == NULL || handles->len < candidates->len)
+			candidates = handles;
+	}
+
+	if (candidates == NULL) {
+		for (handle = 1; handle <= n_the_objects; handle++)
+			g_array_append_val (session->matches, handle);
+		return CKR_OK;
+	}
+
+	for (i = 0; i < candidates->len; i++) {
+		handle = g_array_index (candidates, CK_OBJECT_HANDLE, i);
+		if (object_matches (&the_objects[handle - 1], pTemplate, ulCount))
+			g_array_append_val (session->matches, handle);
+	}
+
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_FindObjects (CK_SESSION_HANDLE hSession,
+                     CK_OBJECT_HANDLE_PTR phObject,
+                     CK_ULONG ulMaxObjectCount,
+                     CK_ULONG_PTR pulObjectCount)
+{
+	Session *session;
+	CK_ULONG count;
+
+	g_return_val_if_fail (phObject, CKR_ARGUMENTS_BAD);
+	g_return_val_if_fail (pulObjectCount, CKR_ARGUMENTS_BAD);
+	enter_call (CALL_FindObjects);
+
+	session = lookup_session (hSession);
+	if (session == NULL)
+		return CKR_SESSION_HANDLE_INVALID;
+	if (!session->finding)
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+	count = MIN (ulMaxObjectCount, session->matches->len - session->position);
+	if (count > 0) {
+		memcpy (phObject, &g_array_index (session->matches, CK_OBJECT_HANDLE, session->position),
+		        count * sizeof (CK_OBJECT_HANDLE));
+		session->position += count;
+	}
+
+	*pulObjectCount = count;
+	return CKR_OK;
+}
+
+static CK_RV
+bench_C_FindObjectsFinal (CK_SESSION_HANDLE hSession)
+{
+	Session *session;
+
+	enter_call (CALL_FindObjectsFinal);
+
+	session = lookup_session (hSession);
+	if (session == NULL)
+		return CKR_SESSION_HANDLE_INVALID;
+	if (!session->finding)
+		return CKR_OPERATION_NOT_INITIALIZED;
+
+	session->finding = FALSE;
+	g_clear_pointer (&session->matches, g_array_unref);
+	return CKR_OK;
+}
+
+static CK_RV
+bench_unsupported_C_InitToken (CK_SLOT_ID slotID,
+                               CK_UTF8CHAR_PTR pPin,
+                               CK_ULONG ulPinLen,
+                               CK_UTF8CHAR_PTR pLabel)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_unsupported_C_InitPIN (CK_SESSION_HANDLE hSession,
+                             CK_UTF8CHAR_PTR pPin,
+                             CK_ULONG ulPinLen)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_unsupported_C_SetPIN (CK_SESSION_HANDLE hSession,
+                            CK_UTF8CHAR_PTR pOldPin,
+                            CK_ULONG ulOldLen,
+                            CK_UTF8CHAR_PTR pNewPin,
+                            CK_ULONG ulNewLen)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_unsupported_C_Login (CK_SESSION_HANDLE hSession,
+                           CK_USER_TYPE userType,
+                           CK_UTF8CHAR_PTR pPin,
+                           CK_ULONG pPinLen)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_unsupported_C_Logout (CK_SESSION_HANDLE hSession)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_unsupported_C_CreateObject (CK_SESSION_HANDLE hSession,
+                                  CK_ATTRIBUTE_PTR pTemplate,
+                                  CK_ULONG ulCount,
+                                  CK_OBJECT_HANDLE_PTR phObject)
+{
+	return CKR_TOKEN_WRITE_PROTECTED;
+}
+
+static CK_RV
+bench_unsupported_C_DestroyObject (CK_SESSION_HANDLE hSession,
+                                   CK_OBJECT_HANDLE hObject)
+{
+	return CKR_TOKEN_WRITE_PROTECTED;
+}
+
+static CK_RV
+bench_unsupported_C_SetAttributeValue (CK_SESSION_HANDLE hSession,
+                                       CK_OBJECT_HANDLE hObject,
+                                       CK_ATTRIBUTE_PTR pTemplate,
+                                       CK_ULONG ulCount)
+{
+	return CKR_TOKEN_WRITE_PROTECTED;
+}
+
+static CK_RV
+bench_unsupported_C_OperationInit (CK_SESSION_HANDLE hSession,
+                                   CK_MECHANISM_PTR pMechanism,
+                                   CK_OBJECT_HANDLE hKey)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_unsupported_C_Operation (CK_SESSION_HANDLE hSession,
+                               CK_BYTE_PTR pInput,
+                               CK_ULONG ulInputLen,
+                               CK_BYTE_PTR pOutput,
+                               CK_ULONG_PTR pulOutputLen)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_unsupported_C_Verify (CK_SESSION_HANDLE hSession,
+                            CK_BYTE_PTR pData,
+                            CK_ULONG ulDataLen,
+                            CK_BYTE_PTR pSignature,
+                            CK_ULONG ulSignatureLen)
+{
+	return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+static CK_RV
+bench_C_GetFunctionStatus (CK_SESSION_HANDLE hSession)
+{
+	return CKR_FUNCTION_NOT_PARALLEL;
+}
+
+static CK_RV
+bench_C_CancelFunction (CK_SESSION_HANDLE hSession)
+{
+	return CKR_FUNCTION_NOT_PARALLEL;
+}
+
+static CK_FUNCTION_LIST functionList = {
+	{ 2, 11 },	/* version */
+	bench_C_Initialize,
+	bench_C_Finalize,
+	bench_C_GetInfo,
+	bench_C_GetFunctionList,
+	bench_C_GetSlotList,
+	bench_C_GetSlotInfo,
+	bench_C_GetTokenInfo,
+	bench_C_GetMechanismList,
+	bench_C_GetMechanismInfo,
+	bench_unsupported_C_InitToken,
+	bench_unsupported_C_InitPIN,
+	bench_unsupported_C_SetPIN,
+	bench_C_OpenSession,
+	bench_C_CloseSession,
+	bench_C_CloseAllSessions,
+	bench_C_GetSessionInfo,
+	gck_mock_unsupported_C_GetOperationState,
+	gck_mock_unsupported_C_SetOperationState,
+	bench_unsupported_C_Login,
+	bench_unsupported_C_Logout,
+	bench_unsupported_C_CreateObject,
+	gck_mock_unsupported_C_CopyObject,
+	bench_unsupported_C_DestroyObject,
+	gck_mock_unsupported_C_GetObjectSize,
+	bench_C_GetAttributeValue,
+	bench_unsupported_C_SetAttributeValue,
+	bench_C_FindObjectsInit,
+	bench_C_FindObjects,
+	bench_C_FindObjectsFinal,
+	bench_unsupported_C_OperationInit,
+	bench_unsupported_C_Operation,
+	gck_mock_unsupported_C_EncryptUpdate,
+	gck_mock_unsupported_C_EncryptFinal,
+	bench_unsupported_C_OperationInit,
+	bench_unsupported_C_Operation,
+	gck_mock_unsupported_C_DecryptUpdate,
+	gck_mock_unsupported_C_DecryptFinal,
+	gck_mock_unsupported_C_DigestInit,
+	gck_mock_unsupported_C_Digest,
+	gck_mock_unsupported_C_DigestUpdate,
+	gck_mock_unsupported_C_DigestKey,
+	gck_mock_unsupported_C_DigestFinal,
+	bench_unsupported_C_OperationInit,
+	bench_unsupported_C_Operation,
+	gck_mock_unsupported_C_SignUpdate,
+	gck_mock_unsupported_C_SignFinal,
+	gck_mock_unsupported_C_SignRecoverInit,
+	gck_mock_unsupported_C_SignRecover,
+	bench_unsupported_C_OperationInit,
+	bench_unsupported_C_Verify,
+	gck_mock_unsupported_C_VerifyUpdate,
+	gck_mock_unsupported_C_VerifyFinal,
+	gck_mock_unsupported_C_VerifyRecoverInit,
+	gck_mock_unsupported_C_VerifyRecover,
+	gck_mock_unsupported_C_DigestEncryptUpdate,
+	gck_mock_unsupported_C_DecryptDigestUpdate,
+	gck_mock_unsupported_C_SignEncryptUpdate,
+	gck_mock_unsupported_C_DecryptVerifyUpdate,
+	gck_mock_unsupported_C_GenerateKey,
+	gck_mock_unsupported_C_GenerateKeyPair,
+	gck_mock_unsupported_C_WrapKey,
+	gck_mock_unsupported_C_UnwrapKey,
+	gck_mock_unsupported_C_DeriveKey,
+	gck_mock_unsupported_C_SeedRandom,
+	gck_mock_unsupported_C_GenerateRandom,
+	bench_C_GetFunctionStatus,
+	bench_C_CancelFunction,
+	gck_mock_unsupported_C_WaitForSlotEvent
+};
+
+CK_RV
+C_GetFunctionList (CK_FUNCTION_LIST_PTR_PTR list)
+{
+	return bench_C_GetFunctionList (list);
+}
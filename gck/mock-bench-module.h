@@ -0,0 +1,51 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef MOCK_BENCH_MODULE_H
+#define MOCK_BENCH_MODULE_H
+
+#include <glib.h>
+
+/*
+ * The benchmark module is a read-only token full of certificates. It is
+ * configured through the environment when C_Initialize is called:
+ *
+ *  GCK_MOCK_BENCH_OBJECTS:       number of certificate objects (default 1000)
+ *  GCK_MOCK_BENCH_CERTIFICATES:  directory of DER certificates (*.cer, *.der)
+ *                                to generate the objects from
+ *  GCK_MOCK_BENCH_LATENCY:       microseconds added to every call
+ *  GCK_MOCK_BENCH_JITTER:        up to this many random microseconds added
+ *                                on top of the latency
+ *  GCK_MOCK_BENCH_SEED:          seed for the jitter, for reproducible runs
+ *  GCK_MOCK_BENCH_STATS:         file to write the call counts to when the
+ *                                module is finalized, or "-" for stderr
+ */
+
+#define MOCK_BENCH_SLOT_ID 1
+
+/* The objects are numbered from 1, CKA_ID is the handle as a big endian guint32 */
+#define MOCK_BENCH_LABEL_FORMAT "Benchmark Certificate %lu"
+
+/* Look up these symbols from the loaded module */
+typedef guint       (* MockBenchGetCallCount)          (const gchar *function);
+
+typedef void        (* MockBenchResetCallCounts)       (void);
+
+#define MOCK_BENCH_GET_CALL_COUNT "mock_bench_get_call_count"
+#define MOCK_BENCH_RESET_CALL_COUNTS "mock_bench_reset_call_counts"
+
+#endif /* MOCK_BENCH_MODULE_H */
@@ -0,0 +1,208 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include <glib.h>
+#include <gmodule.h>
+#include <string.h>
+
+#include "egg/egg-testing.h"
+
+#include "gck/gck.h"
+#include "gck/mock-bench-module.h"
+
+#define N_OBJECTS 50
+
+typedef struct {
+	GckModule *module;
+	GckSession *session;
+	GModule *library;
+	MockBenchGetCallCount get_call_count;
+} Test;
+
+static void
+setup (Test *test,
+       gconstpointer unused)
+{
+	GError *error = NULL;
+	MockBenchResetCallCounts reset_call_counts;
+	GList *slots;
+
+	test->module = gck_module_initialize (_GCK_BENCH_MODULE_PATH, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (test->module);
+	g_object_add_weak_pointer (G_OBJECT (test->module), (gpointer *)&test->module);
+
+	slots = gck_module_get_slots (test->module, TRUE);
+	g_assert_cmpuint (g_list_length (slots), ==, 1);
+
+	test->session = gck_slot_open_session (slots->data, GCK_SESSION_READ_ONLY,
+	                                       NULL, NULL, &error);
+	g_assert_no_error (error);
+	g_clear_list (&slots, g_object_unref);
+
+	/* Same library as loaded by the module, so the counts are shared */
+	test->library = g_module_open (_GCK_BENCH_MODULE_PATH, G_MODULE_BIND_LOCAL);
+	g_assert_nonnull (test->library);
+	g_assert_true (g_module_symbol (test->library, MOCK_BENCH_GET_CALL_COUNT,
+	                                (gpointer *)&test->get_call_count));
+	g_assert_true (g_module_symbol (test->library, MOCK_BENCH_RESET_CALL_COUNTS,
+	                                (gpointer *)&reset_call_counts));
+	(reset_call_counts) ();
+}
+
+static void
+teardown (Test *test,
+          gconstpointer unused)
+{
+	g_object_unref (test->session);
+	g_object_unref (test->module);
+	egg_test_wait_for_gtask_thread (test->module);
+	g_assert_null (test->module);
+	g_module_close (test->library);
+}
+
+static gulong *
+find_handles (Test *test,
+              GckBuilder *builder,
+              gulong *n_handles)
+{
+	GError *error = NULL;
+	GckAttributes *match;
+	gulong *handles;
+
+	match = gck_attributes_ref_sink (gck_builder_end (builder));
+	handles = gck_session_find_handles (test->session, match, NULL, n_handles, &error);
+	g_assert_no_error (error);
+	gck_attributes_unref (match);
+
+	return handles;
+}
+
+static void
+test_find_all (Test *test,
+               gconstpointer unused)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	gulong *handles;
+	gulong n_handles;
+
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_CERTIFICATE);
+	handles = find_handles (test, &builder, &n_handles);
+	g_assert_cmpuint (n_handles, ==, N_OBJECTS);
+	g_free (handles);
+
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_PRIVATE_KEY);
+	handles = find_handles (test, &builder, &n_handles);
+	g_assert_cmpuint (n_handles, ==, 0);
+	g_free (handles);
+
+	g_assert_cmpuint ((test->get_call_count) ("C_FindObjectsInit"), ==, 2);
+	g_assert_cmpuint ((test->get_call_count) ("C_FindObjectsFinal"), ==, 2);
+	g_assert_cmpuint ((test->get_call_count) ("C_GetAttributeValue"), ==, 0);
+}
+
+static void
+test_find_by_id (Test *test,
+                 gconstpointer unused)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GError *error = NULL;
+	GckObject *object;
+	gulong *handles;
+	gulong n_handles;
+	guint32 id;
+	gchar *label;
+	gsize n_label;
+	gchar *expected;
+
+	id = GUINT32_TO_BE (7);
+	gck_builder_add_data (&builder, CKA_ID, (const guchar *)&id, sizeof (id));
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_CERTIFICATE);
+	handles = find_handles (test, &builder, &n_handles);
+	g_assert_cmpuint (n_handles, ==, 1);
+	g_assert_cmpuint (handles[0], ==, 7);
+
+	object = gck_object_from_handle (test->session, handles[0]);
+	label = (gchar *)gck_object_get_data (object, CKA_LABEL, NULL, &n_label, &error);
+	g_assert_no_error (error);
+	expected = g_strdup_printf (MOCK_BENCH_LABEL_FORMAT, 7UL);
+	g_assert_cmpstr (label, ==, expected);
+	g_assert_cmpuint (n_label, ==, strlen (expected));
+
+	g_assert_cmpuint ((test->get_call_count) ("C_GetAttributeValue"), >, 0);
+
+	g_free (expected);
+	g_free (label);
+	g_object_unref (object);
+	g_free (handles);
+}
+
+static void
+test_find_by_subject (Test *test,
+                      gconstpointer unused)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GError *error = NULL;
+	GckObject *object;
+	guchar *subject;
+	gsize n_subject;
+	guchar *other;
+	gsize n_other;
+	gulong *handles;
+	gulong n_handles;
+	gulong i;
+
+	object = gck_object_from_handle (test->session, 1);
+	subject = gck_object_get_data (object, CKA_SUBJECT, NULL, &n_subject, &error);
+	g_assert_no_error (error);
+	g_object_unref (object);
+
+	gck_builder_add_data (&builder, CKA_SUBJECT, subject, n_subject);
+	handles = find_handles (test, &builder, &n_handles);
+	g_assert_cmpuint (n_handles, >, 0);
+	g_assert_cmpuint (n_handles, <, N_OBJECTS);
+
+	for (i = 0; i < n_handles; i++) {
+		object = gck_object_from_handle (test->session, handles[i]);
+		other = gck_object_get_data (object, CKA_SUBJECT, NULL, &n_other, &error);
+		g_assert_no_error (error);
+		egg_assert_cmpmem (subject, n_subject, ==, other, n_other);
+		g_object_unref (object);
+		g_free (other);
+	}
+
+	g_free (handles);
+	g_free (subject);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+
+	g_setenv ("GCK_MOCK_BENCH_OBJECTS", G_STRINGIFY (N_OBJECTS), TRUE);
+	g_unsetenv ("GCK_MOCK_BENCH_LATENCY");
+	g_unsetenv ("GCK_MOCK_BENCH_JITTER");
+
+	g_test_add ("/gck/bench-module/find_all", Test, NULL, setup, test_find_all, teardown);
+	g_test_add ("/gck/bench-module/find_by_id", Test, NULL, setup, test_find_by_id, teardown);
+	g_test_add ("/gck/bench-module/find_by_subject", Test, NULL, setup, test_find_by_subject, teardown);
+
+	return g_test_run ();
+}
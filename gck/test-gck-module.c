@@ -162,6 +162,53 @@ test_module_info (Test *test, gconstpointer unused)
 	gck_module_info_free (info);
 }
 
+static void
+test_trace (Test *test, gconstpointer unused)
+{
+	CK_FUNCTION_LIST_PTR funcs;
+	gpointer property;
+	GckSessionInfo *info;
+	GckSession *session;
+	GError *error = NULL;
+	GList *slots;
+	gchar *dump;
+
+	funcs = gck_module_get_functions (test->module);
+
+	gck_trace_set_enabled (TRUE);
+	gck_trace_reset ();
+	g_assert_true (gck_trace_get_enabled ());
+	g_assert_true (gck_module_get_functions (test->module) == funcs);
+
+	slots = gck_module_get_slots (test->module, TRUE);
+	g_assert_nonnull (slots);
+	session = gck_slot_open_session (slots->data, GCK_SESSION_READ_ONLY, NULL, NULL, &error);
+	g_assert_no_error (error);
+	info = gck_session_get_info (session);
+	g_assert_nonnull (info);
+	gck_session_info_free (info);
+	g_object_unref (session);
+	g_clear_list (&slots, g_object_unref);
+
+	/* The module's own function list is handed out, even while tracing */
+	g_object_get (test->module, "functions", &property, NULL);
+	g_assert_true (property == funcs);
+
+	gck_trace_set_enabled (FALSE);
+
+	dump = gck_trace_dump ();
+	g_assert_nonnull (strstr (dump, "slot=\"none\",function=\"C_GetSlotList\"}"));
+	g_assert_nonnull (strstr (dump, "slot=\"52\",function=\"C_OpenSession\"}"));
+	g_assert_nonnull (strstr (dump, "slot=\"52\",function=\"C_GetSessionInfo\"}"));
+	g_assert_null (strstr (dump, "function=\"C_Sign\""));
+	g_free (dump);
+
+	gck_trace_reset ();
+	dump = gck_trace_dump ();
+	g_assert_null (strstr (dump, "C_OpenSession"));
+	g_free (dump);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -172,6 +219,7 @@ main (int argc, char **argv)
 	g_test_add ("/gck/module/module_equals_hash", Test, NULL, setup, test_module_equals_hash, teardown);
 	g_test_add ("/gck/module/module_props", Test, NULL, setup, test_module_props, teardown);
 	g_test_add ("/gck/module/module_info", Test, NULL, setup, test_module_info, teardown);
+	g_test_add ("/gck/module/trace", Test, NULL, setup, test_trace, teardown);
 
 	return egg_tests_run_with_loop ();
 }
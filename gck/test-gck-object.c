@@ -409,6 +409,232 @@ test_find_objects (Test *test, gconstpointer unused)
 	g_clear_list (&objects, g_object_unref);
 }
 
+/*
+ * Wraps the module to see the order in which queued calls start, and
+ * how many of them run at once. Calls are held while blocked is set.
+ */
+static struct {
+	GMutex mutex;
+	GCond cond;
+	gboolean blocked;
+	gint running;
+	gint peak;
+	GString *order;
+	CK_FUNCTION_LIST_PTR funcs;
+	CK_FUNCTION_LIST wrapped;
+} probe;
+
+static void
+probe_enter (gchar tag)
+{
+	g_mutex_lock (&probe.mutex);
+	g_string_append_c (probe.order, tag);
+	probe.peak = MAX (probe.peak, ++probe.running);
+	g_cond_broadcast (&probe.cond);
+	while (probe.blocked)
+		g_cond_wait (&probe.cond, &probe.mutex);
+	g_mutex_unlock (&probe.mutex);
+}
+
+static void
+probe_leave (void)
+{
+	g_mutex_lock (&probe.mutex);
+	probe.running--;
+	g_mutex_unlock (&probe.mutex);
+}
+
+static CK_RV
+probe_C_GetAttributeValue (CK_SESSION_HANDLE session,
+                           CK_OBJECT_HANDLE object,
+                           CK_ATTRIBUTE_PTR template,
+                           CK_ULONG count)
+{
+	CK_RV rv;
+
+	/* Only the first of the two calls made to get a value */
+	if (template->pValue != NULL)
+		return (probe.funcs->C_GetAttributeValue) (session, object, template, count);
+
+	probe_enter ('a' + template->type);
+	rv = (probe.funcs->C_GetAttributeValue) (session, object, template, count);
+	probe_leave ();
+	return rv;
+}
+
+static CK_RV
+probe_C_OpenSession (CK_SLOT_ID slot,
+                     CK_FLAGS flags,
+                     CK_VOID_PTR app_data,
+                     CK_NOTIFY notify,
+                     CK_SESSION_HANDLE_PTR session)
+{
+	CK_RV rv;
+
+	probe_enter ('S');
+	rv = (probe.funcs->C_OpenSession) (slot, flags, app_data, notify, session);
+	probe_leave ();
+	return rv;
+}
+
+typedef struct {
+	gint completed;
+	gint cancelled;
+	gint waiting;
+} QueuedCalls;
+
+static void
+on_queued_get_data (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	QueuedCalls *calls = user_data;
+	GError *err = NULL;
+	gpointer data;
+	gsize n_data;
+
+	/* Some of the attributes don't exist, which is fine */
+	data = gck_object_get_data_finish (GCK_OBJECT (source), result, &n_data, &err);
+	if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		calls->cancelled++;
+	else
+		calls->completed++;
+
+	g_clear_error (&err);
+	g_free (data);
+
+	if (--calls->waiting == 0)
+		egg_test_wait_stop ();
+}
+
+static void
+on_queued_open_session (GObject *source, GAsyncResult *result, gpointer user_data)
+{
+	QueuedCalls *calls = user_data;
+	GckSession *session;
+	GError *err = NULL;
+
+	session = gck_session_open_finish (result, &err);
+	g_assert_no_error (err);
+	g_assert_true (GCK_IS_SESSION (session));
+	g_object_unref (session);
+	calls->completed++;
+
+	if (--calls->waiting == 0)
+		egg_test_wait_stop ();
+}
+
+static void
+test_queued_calls (Test *test, gconstpointer unused)
+{
+	QueuedCalls calls = { 0, };
+	GCancellable *cancellable;
+	GckModule *module, *other_module;
+	GckSession *session, *other_session;
+	GckObject *object, *other_object;
+	GckSlot *slot, *other_slot;
+	GHashTable *series;
+	gchar **lines;
+	gchar *dump;
+	guint i;
+
+	probe.funcs = gck_module_get_functions (test->module);
+	probe.order = g_string_new ("");
+	probe.peak = 0;
+	probe.wrapped = *probe.funcs;
+	probe.wrapped.C_GetAttributeValue = probe_C_GetAttributeValue;
+	probe.wrapped.C_OpenSession = probe_C_OpenSession;
+
+	module = gck_module_new (&probe.wrapped);
+	slot = gck_slot_from_handle (module, gck_slot_get_handle (test->slot));
+	session = gck_session_from_handle (slot, gck_session_get_handle (test->session), 0);
+	object = gck_object_from_handle (session, gck_object_get_handle (test->object));
+
+	gck_module_set_max_concurrent_calls (module, 1);
+	g_assert_cmpuint (gck_module_get_max_concurrent_calls (module), ==, 1);
+
+	/* Hold up the first call until everything else is queued */
+	probe.blocked = TRUE;
+	gck_object_get_data_async (object, CKA_CLASS, NULL, NULL, on_queued_get_data, &calls);
+	calls.waiting++;
+
+	g_mutex_lock (&probe.mutex);
+	while (probe.running == 0)
+		g_cond_wait (&probe.cond, &probe.mutex);
+	g_mutex_unlock (&probe.mutex);
+
+	gck_object_get_data_async (object, CKA_TOKEN, NULL, NULL, on_queued_get_data, &calls);
+	calls.waiting++;
+
+	/* Cancelled while queued, never reaches the module */
+	cancellable = g_cancellable_new ();
+	gck_object_get_data_async (object, CKA_PRIVATE, NULL, cancellable, on_queued_get_data, &calls);
+	calls.waiting++;
+
+	gck_object_get_data_async (object, CKA_LABEL, NULL, NULL, on_queued_get_data, &calls);
+	calls.waiting++;
+
+	/* Jumps ahead of the calls at the default priority */
+	g_async_initable_new_async (GCK_TYPE_SESSION, G_PRIORITY_HIGH, NULL,
+	                            on_queued_open_session, &calls,
+	                            "slot", slot, "options", GCK_SESSION_READ_ONLY, NULL);
+	calls.waiting++;
+
+	g_cancellable_cancel (cancellable);
+	g_object_unref (cancellable);
+
+	g_mutex_lock (&probe.mutex);
+	probe.blocked = FALSE;
+	g_cond_broadcast (&probe.cond);
+	g_mutex_unlock (&probe.mutex);
+
+	egg_test_wait_until (2000);
+	g_assert_cmpint (calls.waiting, ==, 0);
+	g_assert_cmpint (calls.completed, ==, 4);
+	g_assert_cmpint (calls.cancelled, ==, 1);
+
+	/* Priority first, then in the order they were made */
+	g_assert_cmpint (probe.peak, ==, 1);
+	g_assert_cmpstr (probe.order->str, ==, "aSbd");
+
+	/* A second module with the same name gets its own series */
+	other_module = gck_module_new (&probe.wrapped);
+	other_slot = gck_slot_from_handle (other_module, gck_slot_get_handle (test->slot));
+	other_session = gck_session_from_handle (other_slot, gck_session_get_handle (test->session), 0);
+	other_object = gck_object_from_handle (other_session, gck_object_get_handle (test->object));
+	gck_object_get_data_async (other_object, CKA_CLASS, NULL, NULL, on_queued_get_data, &calls);
+	calls.waiting++;
+	egg_test_wait_until (2000);
+	g_assert_cmpint (calls.waiting, ==, 0);
+
+	dump = gck_trace_dump ();
+	g_assert_nonnull (strstr (dump, "gck_call_queue_depth{module="));
+	g_assert_nonnull (strstr (dump, "gck_call_queue_cancelled_total{module="));
+	series = g_hash_table_new (g_str_hash, g_str_equal);
+	lines = g_strsplit (dump, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		if (lines[i][0] == '\0' || lines[i][0] == '#')
+			continue;
+		*strrchr (lines[i], ' ') = '\0';
+		g_assert_false (g_hash_table_contains (series, lines[i]));
+		g_hash_table_add (series, lines[i]);
+	}
+	g_hash_table_destroy (series);
+	g_strfreev (lines);
+	g_free (dump);
+
+	gck_module_set_max_concurrent_calls (module, 0);
+	g_assert_cmpuint (gck_module_get_max_concurrent_calls (module), >, 0);
+
+	g_object_unref (object);
+	g_object_unref (session);
+	g_object_unref (slot);
+	g_object_unref (module);
+	g_object_unref (other_object);
+	g_object_unref (other_session);
+	g_object_unref (other_slot);
+	g_object_unref (other_module);
+	g_string_free (probe.order, TRUE);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -422,6 +648,7 @@ main (int argc, char **argv)
 	g_test_add ("/gck/object/get_data_attribute", Test, NULL, setup, test_get_data_attribute, teardown);
 	g_test_add ("/gck/object/set_attributes", Test, NULL, setup, test_set_attributes, teardown);
 	g_test_add ("/gck/object/find_objects", Test, NULL, setup, test_find_objects, teardown);
+	g_test_add ("/gck/object/queued_calls", Test, NULL, setup, test_queued_calls, teardown);
 
 	return egg_tests_run_with_loop ();
 }
@@ -0,0 +1,127 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "gcr/gcr.h"
+
+#include "egg/egg-bench.h"
+
+#include "gck/mock-bench-module.h"
+
+#include <glib.h>
+
+#define N_OBJECTS 10000
+
+typedef struct {
+	GcrCertificate *host;
+	GcrCertificate *ca;
+} Fixture;
+
+static GcrCertificate *
+load_certificate (const gchar *filename)
+{
+	GcrCertificate *certificate;
+	gchar *contents;
+	gchar *path;
+	gsize length;
+
+	path = g_build_filename (SRCDIR "/gcr/fixtures", filename, NULL);
+	if (!g_file_get_contents (path, &contents, &length, NULL))
+		g_assert_not_reached ();
+	certificate = gcr_simple_certificate_new ((const guchar *)contents, length);
+	g_free (contents);
+	g_free (path);
+
+	return certificate;
+}
+
+static void
+bench_build_no_lookups (guint64 iterations,
+                        gconstpointer data)
+{
+	const Fixture *fixture = data;
+	GcrCertificateChain *chain;
+	GError *error = NULL;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		chain = gcr_certificate_chain_new ();
+		gcr_certificate_chain_add (chain, fixture->host);
+		gcr_certificate_chain_add (chain, fixture->ca);
+		gcr_certificate_chain_build (chain, GCR_PURPOSE_CLIENT_AUTH, NULL,
+		                             GCR_CERTIFICATE_CHAIN_NO_LOOKUPS, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (gcr_certificate_chain_get_length (chain) == 2);
+		g_object_unref (chain);
+	}
+}
+
+static void
+bench_build_lookups (guint64 iterations,
+                     gconstpointer data)
+{
+	const Fixture *fixture = data;
+	GcrCertificateChain *chain;
+	GError *error = NULL;
+	guint64 i;
+
+	/* The CA is found on the token, as are pinned certificates and anchors */
+	for (i = 0; i < iterations; i++) {
+		chain = gcr_certificate_chain_new ();
+		gcr_certificate_chain_add (chain, fixture->host);
+		gcr_certificate_chain_build (chain, GCR_PURPOSE_CLIENT_AUTH, "bench.example.com",
+		                             GCR_CERTIFICATE_CHAIN_NONE, NULL, &error);
+		g_assert_no_error (error);
+		g_assert (gcr_certificate_chain_get_length (chain) == 2);
+		g_object_unref (chain);
+	}
+}
+
+int
+main (int argc, char **argv)
+{
+	const gchar *uris[] = { "pkcs11:token=BENCH%20LABEL", NULL };
+	GError *error = NULL;
+	GckModule *module;
+	Fixture fixture;
+	GList *modules;
+	gint ret;
+
+	egg_bench_init (&argc, &argv);
+
+	g_setenv ("GCK_MOCK_BENCH_OBJECTS", G_STRINGIFY (N_OBJECTS), TRUE);
+	module = gck_module_initialize (_GCK_BENCH_MODULE_PATH, NULL, &error);
+	g_assert_no_error (error);
+
+	modules = g_list_append (NULL, module);
+	gcr_pkcs11_set_modules (modules);
+	gcr_pkcs11_set_trust_lookup_uris (uris);
+	g_clear_list (&modules, g_object_unref);
+
+	fixture.host = load_certificate ("dhansak-collabora.cer");
+	fixture.ca = load_certificate ("collabora-ca.cer");
+
+	egg_bench_add ("/gcr/certificate-chain/build-no-lookups", &fixture, bench_build_no_lookups);
+	egg_bench_add ("/gcr/certificate-chain/build-with-lookups", &fixture, bench_build_lookups);
+
+	ret = egg_bench_run ();
+
+	g_object_unref (fixture.host);
+	g_object_unref (fixture.ca);
+	gcr_pkcs11_set_modules (NULL);
+	return ret;
+}
@@ -0,0 +1,143 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "gcr/gcr.h"
+
+#include "egg/egg-bench.h"
+
+#include <glib.h>
+
+/* A mix of the formats we see, none of them need a password */
+static const gchar *CORPUS[] = {
+	"cacert.org.cer",
+	"startcom-intermediate.cer",
+	"client.pem",
+	"der-key.p8",
+	"der-rsa-1024.key",
+	"pem-dsa-1024.key",
+	"der-ec-256.key",
+	"der-rsa-2048.p10",
+	"pem-rsa-2048.req",
+	"base64-rsa-2048.spkac",
+	"test-x509-swiss.p7b",
+	"openssh_keys.pub",
+	"werner-koch.asc",
+};
+
+typedef struct {
+	GcrParser *parser;
+	GPtrArray *files;
+	guint parsed;
+	guint expected;
+	guint64 size;
+} Fixture;
+
+static void
+on_parsed (GcrParser *parser,
+           gpointer user_data)
+{
+	Fixture *fixture = user_data;
+	fixture->parsed++;
+}
+
+static void
+parse_all (Fixture *fixture)
+{
+	GError *error = NULL;
+	guint i;
+
+	for (i = 0; i < fixture->files->len; i++) {
+		gcr_parser_parse_bytes (fixture->parser, fixture->files->pdata[i], &error);
+		g_assert_no_error (error);
+	}
+}
+
+static void
+bench_parse (guint64 iterations,
+             gconstpointer data)
+{
+	Fixture *fixture = (Fixture *)data;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		fixture->parsed = 0;
+		parse_all (fixture);
+		g_assert (fixture->parsed == fixture->expected);
+	}
+}
+
+static void
+fixture_init (Fixture *fixture,
+              const gchar **files,
+              guint n_files)
+{
+	gchar *contents;
+	gchar *path;
+	gsize length;
+	guint i;
+
+	fixture->parser = gcr_parser_new ();
+	g_signal_connect (fixture->parser, "parsed", G_CALLBACK (on_parsed), fixture);
+	fixture->files = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	fixture->size = 0;
+
+	for (i = 0; i < n_files; i++) {
+		path = g_build_filename (SRCDIR "/gcr/fixtures", files[i], NULL);
+		if (!g_file_get_contents (path, &contents, &length, NULL))
+			g_assert_not_reached ();
+		g_ptr_array_add (fixture->files, g_bytes_new_take (contents, length));
+		fixture->size += length;
+		g_free (path);
+	}
+
+	/* Parse once to check that everything parses and count the items */
+	fixture->parsed = 0;
+	parse_all (fixture);
+	fixture->expected = fixture->parsed;
+	g_assert (fixture->expected >= n_files);
+}
+
+static void
+fixture_clear (Fixture *fixture)
+{
+	g_object_unref (fixture->parser);
+	g_ptr_array_unref (fixture->files);
+}
+
+int
+main (int argc, char **argv)
+{
+	const gchar *bundle[] = { "ca-certificates.crt" };
+	Fixture mixed;
+	Fixture ca;
+	gint ret;
+
+	egg_bench_init (&argc, &argv);
+
+	fixture_init (&mixed, CORPUS, G_N_ELEMENTS (CORPUS));
+	fixture_init (&ca, bundle, G_N_ELEMENTS (bundle));
+
+	egg_bench_add_sized ("/gcr/parser/mixed", &mixed, bench_parse, mixed.size);
+	egg_bench_add_sized ("/gcr/parser/ca-bundle", &ca, bench_parse, ca.size);
+
+	ret = egg_bench_run ();
+
+	fixture_clear (&mixed);
+	fixture_clear (&ca);
+	return ret;
+}
@@ -0,0 +1,83 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "gcr/gcr.h"
+
+#include "egg/egg-bench.h"
+
+#include <glib.h>
+
+/* A whole exchange, as a prompter and its caller would do it */
+static void
+bench_exchange (guint64 iterations,
+                gconstpointer data)
+{
+	const gchar *protocol = data;
+	GcrSecretExchange *caller;
+	GcrSecretExchange *callee;
+	gchar *exchange;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++) {
+		caller = gcr_secret_exchange_new (protocol);
+		callee = gcr_secret_exchange_new (NULL);
+
+		exchange = gcr_secret_exchange_begin (caller);
+		g_assert (exchange != NULL);
+		if (!gcr_secret_exchange_receive (callee, exchange))
+			g_assert_not_reached ();
+		g_free (exchange);
+
+		exchange = gcr_secret_exchange_send (callee, "secret", -1);
+		g_assert (exchange != NULL);
+		if (!gcr_secret_exchange_receive (caller, exchange))
+			g_assert_not_reached ();
+		g_free (exchange);
+
+		g_assert_cmpstr (gcr_secret_exchange_get_secret (caller, NULL), ==, "secret");
+
+		g_object_unref (caller);
+		g_object_unref (callee);
+	}
+}
+
+static gboolean
+protocol_supported (const gchar *protocol)
+{
+	GcrSecretExchange *exchange;
+	gchar *output;
+
+	exchange = gcr_secret_exchange_new (protocol);
+	output = gcr_secret_exchange_begin (exchange);
+	g_object_unref (exchange);
+	g_free (output);
+
+	return output != NULL;
+}
+
+int
+main (int argc, char **argv)
+{
+	egg_bench_init (&argc, &argv);
+
+	egg_bench_add ("/gcr/secret-exchange/sx-aes-1", GCR_SECRET_EXCHANGE_PROTOCOL_1, bench_exchange);
+	if (protocol_supported (GCR_SECRET_EXCHANGE_PROTOCOL_2))
+		egg_bench_add ("/gcr/secret-exchange/x25519", GCR_SECRET_EXCHANGE_PROTOCOL_2, bench_exchange);
+
+	return egg_bench_run ();
+}
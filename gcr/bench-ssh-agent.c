@@ -0,0 +1,199 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+#include "config.h"
+
+#include "gcr-ssh-agent-service.h"
+#include "gcr-ssh-agent-private.h"
+#include "gcr-ssh-agent-util.h"
+#include "gcr-ssh-agent-test.h"
+
+#include "egg/egg-bench.h"
+#include "egg/egg-testing.h"
+#include "egg/mock-interaction.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <gio/gunixsocketaddress.h>
+
+typedef struct {
+	gchar *directory;
+	EggBuffer req;
+	EggBuffer resp;
+	GcrSshAgentService *service;
+	GMainContext *server_thread_context;
+	gint server_thread_stop;
+	GSocketConnection *connection;
+	GThread *thread;
+	GMutex lock;
+	GCond cond;
+} Test;
+
+static gpointer
+server_thread (gpointer data)
+{
+	Test *test = data;
+
+	g_main_context_push_thread_default (test->server_thread_context);
+
+	if (!gcr_ssh_agent_service_start (test->service))
+		g_assert_not_reached ();
+
+	g_mutex_lock (&test->lock);
+	g_cond_signal (&test->cond);
+	g_mutex_unlock (&test->lock);
+
+	while (g_atomic_int_get (&test->server_thread_stop) == 0)
+		g_main_context_iteration (test->server_thread_context, TRUE);
+
+	g_main_context_pop_thread_default (test->server_thread_context);
+
+	return NULL;
+}
+
+static void
+call (Test *test)
+{
+	GError *error = NULL;
+
+	_gcr_ssh_agent_write_packet (test->connection, &test->req, NULL, &error);
+	g_assert_no_error (error);
+
+	_gcr_ssh_agent_read_packet (test->connection, &test->resp, NULL, &error);
+	g_assert_no_error (error);
+}
+
+DEFINE_CALL_FUNCS(Test, call)
+
+static void
+bench_request_identities (guint64 iterations,
+                          gconstpointer data)
+{
+	Test *test = (Test *)data;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++)
+		call_request_identities (test, 1);
+}
+
+static void
+bench_sign (guint64 iterations,
+            gconstpointer data)
+{
+	Test *test = (Test *)data;
+	guint64 i;
+
+	for (i = 0; i < iterations; i++)
+		call_sign (test);
+}
+
+static void
+setup (Test *test)
+{
+	GTlsInteraction *interaction;
+	GcrSshAgentPreload *preload;
+	GSocketAddress *address;
+	GSocketClient *client;
+	GError *error = NULL;
+	gchar *sockets_path;
+	gchar *preload_path;
+
+	test->directory = egg_tests_create_scratch_directory (NULL, NULL);
+
+	sockets_path = g_build_filename (test->directory, "sockets", NULL);
+	g_mkdir (sockets_path, 0700);
+	preload_path = g_build_filename (test->directory, "preload", NULL);
+	g_mkdir (preload_path, 0700);
+
+	egg_buffer_init_full (&test->req, 128, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&test->resp, 128, (EggBufferAllocator)g_realloc);
+
+	/* Native mode, so that ssh-agent itself isn't what we measure */
+	preload = gcr_ssh_agent_preload_new (preload_path);
+	test->service = g_object_new (GCR_TYPE_SSH_AGENT_SERVICE,
+	                              "path", sockets_path,
+	                              "preload", preload,
+	                              "native", TRUE,
+	                              NULL);
+	g_object_unref (preload);
+	g_free (preload_path);
+	g_free (sockets_path);
+
+	interaction = mock_interaction_new ("password");
+	g_object_set (test->service, "interaction", interaction, NULL);
+	g_object_unref (interaction);
+
+	g_mutex_init (&test->lock);
+	g_cond_init (&test->cond);
+	test->server_thread_context = g_main_context_new ();
+
+	g_mutex_lock (&test->lock);
+	test->thread = g_thread_new ("ssh-agent", server_thread, test);
+	g_cond_wait (&test->cond, &test->lock);
+	g_mutex_unlock (&test->lock);
+
+	address = g_unix_socket_address_new (g_getenv ("SSH_AUTH_SOCK"));
+	client = g_socket_client_new ();
+	test->connection = g_socket_client_connect (client, G_SOCKET_CONNECTABLE (address),
+	                                            NULL, &error);
+	g_assert_no_error (error);
+	g_object_unref (address);
+	g_object_unref (client);
+
+	call_add_identity (test);
+}
+
+static void
+teardown (Test *test)
+{
+	g_atomic_int_set (&test->server_thread_stop, 1);
+	g_main_context_wakeup (test->server_thread_context);
+	g_thread_join (test->thread);
+	g_main_context_unref (test->server_thread_context);
+
+	g_clear_object (&test->connection);
+
+	gcr_ssh_agent_service_stop (test->service);
+	g_object_unref (test->service);
+
+	egg_buffer_uninit (&test->req);
+	egg_buffer_uninit (&test->resp);
+
+	egg_tests_remove_scratch_directory (test->directory);
+	g_free (test->directory);
+
+	g_cond_clear (&test->cond);
+	g_mutex_clear (&test->lock);
+}
+
+int
+main (int argc, char **argv)
+{
+	Test test = { NULL, };
+	gint ret;
+
+	egg_bench_init (&argc, &argv);
+
+	setup (&test);
+
+	egg_bench_add ("/ssh-agent/round-trip/request-identities", &test, bench_request_identities);
+	egg_bench_add ("/ssh-agent/round-trip/sign", &test, bench_sign);
+
+	ret = egg_bench_run ();
+
+	teardown (&test);
+	return ret;
+}
@@ -30,38 +30,6 @@
 
 #include <glib/gi18n-lib.h>
 
-GBytes *
-_gcr_certificate_extension_find (GNode *cert,
-                                 GQuark oid,
-                                 gboolean *critical)
-{
-	GNode *node;
-	gint index;
-
-	g_return_val_if_fail (cert != NULL, NULL);
-
-	/* Extensions */
-	for (index = 1; TRUE; ++index) {
-		node = egg_asn1x_node (cert, "tbsCertificate", "extensions", index, NULL);
-		if (node == NULL)
-			return NULL;
-
-		/* Dig out the OID */
-		if (egg_asn1x_get_oid_as_quark (egg_asn1x_node (node, "extnID", NULL)) == oid) {
-
-			if (critical) {
-				if (!egg_asn1x_get_boolean (egg_asn1x_node (node, "critical", NULL), critical))
-					g_return_val_if_reached (NULL);
-			}
-
-			/* Extension value */
-			return egg_asn1x_get_string_as_bytes (egg_asn1x_node (node, "extnValue", NULL));
-		}
-	}
-
-	g_assert_not_reached ();
-}
-
 gboolean
 _gcr_certificate_extension_basic_constraints (GBytes *data,
                                               gboolean *is_ca,
@@ -107,7 +75,6 @@ _gcr_certificate_extension_extended_key_usage (GBytes *data)
 	GNode *node;
 	GArray *array;
 	GQuark oid;
-	int i;
 
 	g_return_val_if_fail (data != NULL, NULL);
 
@@ -116,10 +83,7 @@ _gcr_certificate_extension_extended_key_usage (GBytes *data)
 		return NULL;
 
 	array = g_array_new (TRUE, TRUE, sizeof (GQuark));
-	for (i = 0; TRUE; ++i) {
-		node = egg_asn1x_node (asn, i + 1, NULL);
-		if (node == NULL)
-			break;
+	for (node = egg_asn1x_first (asn); node; node = egg_asn1x_next (node)) {
 		oid = egg_asn1x_get_oid_as_quark (node);
 		g_array_append_val (array, oid);
 	}
@@ -275,7 +239,7 @@ GArray*
 _gcr_certificate_extension_subject_alt_name (GBytes *data)
 {
 	GNode *asn = NULL;
-	guint count, i;
+	GNode *node;
 	const gchar *node_name;
 	GArray *names;
 	GcrGeneralName general;
@@ -286,10 +250,8 @@ _gcr_certificate_extension_subject_alt_name (GBytes *data)
 		return NULL;
 
 	names = g_array_new (FALSE, TRUE, sizeof (GcrGeneralName));
-	count = egg_asn1x_count (asn);
-
-	for (i = 0; i < count; i++) {
-		choice = egg_asn1x_get_choice (egg_asn1x_node (asn, i + 1, NULL));
+	for (node = egg_asn1x_first (asn); node; node = egg_asn1x_next (node)) {
+		choice = egg_asn1x_get_choice (node);
 		g_return_val_if_fail (choice, NULL);
 
 		node_name = egg_asn1x_name (choice);
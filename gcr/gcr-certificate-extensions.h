@@ -30,10 +30,6 @@
 
 G_BEGIN_DECLS
 
-GBytes *   _gcr_certificate_extension_find                    (GNode *cert,
-                                                               GQuark oid,
-                                                               gboolean *critical);
-
 gboolean   _gcr_certificate_extension_basic_constraints       (GBytes *data,
                                                                gboolean *is_ca,
                                                                gint *path_len);
@@ -78,11 +78,55 @@
  * keep from parsing things over again.
  */
 
+typedef struct {
+	GQuark oid;
+	gboolean critical;
+	GBytes *value;
+} CertificateExtension;
+
+enum {
+	DECODED_BASIC_CONSTRAINTS = 1 << 0,
+	DECODED_KEY_USAGE = 1 << 1,
+	DECODED_EXTENDED_KEY_USAGE = 1 << 2,
+	DECODED_SUBJECT_KEY_IDENTIFIER = 1 << 3,
+	DECODED_SUBJECT_ALT_NAME = 1 << 4,
+	DECODED_SUBJECT = 1 << 5,
+	DECODED_ISSUER = 1 << 6,
+	DECODED_PUBLIC_KEY = 1 << 7,
+	DECODED_KEY_FINGERPRINTS = 1 << 8,
+};
+
+typedef struct {
+	GBytes *canonical;
+	guint64 hash;
+} CertificateName;
+
 typedef struct _GcrCertificateInfo {
 	gconstpointer der;
 	gsize n_der;
 	GNode *asn1;
+
+	/* The public key, and fingerprints of its subjectPublicKeyInfo */
+	GQuark key_algorithm;
 	guint key_size;
+	guint8 key_sha1[20];
+	guint8 key_sha256[32];
+
+	/* Extensions in certificate order, and those decoded so far */
+	GArray *extensions;
+	guint decoded;
+	gboolean have_basic_constraints;
+	gboolean is_ca;
+	gint path_len;
+	gboolean have_key_usage;
+	gulong key_usage;
+	GQuark *extended_key_usage;
+	GBytes *subject_key_identifier;
+	GArray *subject_alt_names;
+
+	/* Canonical subject and issuer DNs for matching */
+	CertificateName subject;
+	CertificateName issuer;
 } GcrCertificateInfo;
 
 /* Forward declarations */
@@ -111,11 +155,58 @@ certificate_info_free (gpointer data)
 	GcrCertificateInfo *info = data;
 	if (info) {
 		g_assert (info->asn1);
+		g_array_unref (info->extensions);
+		g_free (info->extended_key_usage);
+		if (info->subject_key_identifier)
+			g_bytes_unref (info->subject_key_identifier);
+		if (info->subject_alt_names)
+			_gcr_general_names_free (info->subject_alt_names);
+		if (info->subject.canonical)
+			g_bytes_unref (info->subject.canonical);
+		if (info->issuer.canonical)
+			g_bytes_unref (info->issuer.canonical);
 		egg_asn1x_destroy (info->asn1);
 		g_free (info);
 	}
 }
 
+static void
+certificate_extension_clear (gpointer data)
+{
+	CertificateExtension *extension = data;
+	g_bytes_unref (extension->value);
+}
+
+static GArray *
+certificate_info_index_extensions (GNode *asn1)
+{
+	CertificateExtension extension;
+	GArray *extensions;
+	GNode *node;
+
+	extensions = g_array_new (FALSE, FALSE, sizeof (CertificateExtension));
+	g_array_set_clear_func (extensions, certificate_extension_clear);
+
+	node = egg_asn1x_node (asn1, "tbsCertificate", "extensions", NULL);
+	for (node = egg_asn1x_first (node); node; node = egg_asn1x_next (node)) {
+		extension.oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (node, "extnID", NULL));
+		if (!extension.oid)
+			continue;
+
+		/* The value is a slice of the decoded certificate */
+		extension.value = egg_asn1x_get_string_as_bytes (egg_asn1x_node (node, "extnValue", NULL));
+		if (!extension.value)
+			continue;
+
+		if (!egg_asn1x_get_boolean (egg_asn1x_node (node, "critical", NULL), &extension.critical))
+			extension.critical = FALSE;
+
+		g_array_append_val (extensions, extension);
+	}
+
+	return extensions;
+}
+
 static GcrCertificateInfo*
 certificate_info_load (GcrCertificate *cert)
 {
@@ -154,11 +245,223 @@ certificate_info_load (GcrCertificate *cert)
 	info->der = der;
 	info->n_der = n_der;
 	info->asn1 = asn1;
+	info->extensions = certificate_info_index_extensions (asn1);
 
 	g_object_set_qdata_full (G_OBJECT (cert), CERTIFICATE_INFO, info, certificate_info_free);
 	return info;
 }
 
+static GBytes *
+certificate_info_find_extension (GcrCertificateInfo *info,
+                                 GQuark oid,
+                                 gboolean *critical)
+{
+	CertificateExtension *extension;
+	guint i;
+
+	for (i = 0; i < info->extensions->len; i++) {
+		extension = &g_array_index (info->extensions, CertificateExtension, i);
+		if (extension->oid == oid) {
+			if (critical)
+				*critical = extension->critical;
+			return extension->value;
+		}
+	}
+
+	return NULL;
+}
+
+static gboolean
+certificate_info_get_basic_constraints (GcrCertificateInfo *info,
+                                        gboolean *is_ca,
+                                        gint *path_len)
+{
+	GBytes *value;
+
+	if (!(info->decoded & DECODED_BASIC_CONSTRAINTS)) {
+		info->decoded |= DECODED_BASIC_CONSTRAINTS;
+		info->is_ca = FALSE;
+		info->path_len = -1;
+		value = certificate_info_find_extension (info, GCR_OID_BASIC_CONSTRAINTS, NULL);
+		if (value)
+			info->have_basic_constraints = _gcr_certificate_extension_basic_constraints (value, &info->is_ca,
+			                                                                             &info->path_len);
+	}
+
+	if (!info->have_basic_constraints)
+		return FALSE;
+	if (is_ca)
+		*is_ca = info->is_ca;
+	if (path_len)
+		*path_len = info->path_len;
+	return TRUE;
+}
+
+static gboolean
+certificate_info_get_key_usage (GcrCertificateInfo *info,
+                                gulong *key_usage)
+{
+	GBytes *value;
+
+	if (!(info->decoded & DECODED_KEY_USAGE)) {
+		info->decoded |= DECODED_KEY_USAGE;
+		value = certificate_info_find_extension (info, GCR_OID_KEY_USAGE, NULL);
+		if (value)
+			info->have_key_usage = _gcr_certificate_extension_key_usage (value, &info->key_usage);
+	}
+
+	if (!info->have_key_usage)
+		return FALSE;
+	*key_usage = info->key_usage;
+	return TRUE;
+}
+
+static const GQuark *
+certificate_info_get_extended_key_usage (GcrCertificateInfo *info)
+{
+	GBytes *value;
+
+	if (!(info->decoded & DECODED_EXTENDED_KEY_USAGE)) {
+		info->decoded |= DECODED_EXTENDED_KEY_USAGE;
+		value = certificate_info_find_extension (info, GCR_OID_EXTENDED_KEY_USAGE, NULL);
+		if (value)
+			info->extended_key_usage = _gcr_certificate_extension_extended_key_usage (value);
+	}
+
+	return info->extended_key_usage;
+}
+
+static GBytes *
+certificate_info_get_subject_key_identifier (GcrCertificateInfo *info)
+{
+	GBytes *value;
+	gpointer keyid;
+	gsize n_keyid;
+
+	if (!(info->decoded & DECODED_SUBJECT_KEY_IDENTIFIER)) {
+		info->decoded |= DECODED_SUBJECT_KEY_IDENTIFIER;
+		value = certificate_info_find_extension (info, GCR_OID_SUBJECT_KEY_IDENTIFIER, NULL);
+		keyid = value ? _gcr_certificate_extension_subject_key_identifier (value, &n_keyid) : NULL;
+		if (keyid)
+			info->subject_key_identifier = g_bytes_new_take (keyid, n_keyid);
+	}
+
+	return info->subject_key_identifier;
+}
+
+static GArray *
+certificate_info_get_subject_alt_names (GcrCertificateInfo *info)
+{
+	GBytes *value;
+
+	if (!(info->decoded & DECODED_SUBJECT_ALT_NAME)) {
+		info->decoded |= DECODED_SUBJECT_ALT_NAME;
+		value = certificate_info_find_extension (info, GCR_OID_SUBJECT_ALT_NAME, NULL);
+		if (value)
+			info->subject_alt_names = _gcr_certificate_extension_subject_alt_name (value);
+	}
+
+	return info->subject_alt_names;
+}
+
+static guint64
+hash_canonical_name (GBytes *canonical)
+{
+	const guchar *data;
+	guint64 hash = G_GUINT64_CONSTANT (0xcbf29ce484222325);
+	gsize size, i;
+
+	/* FNV-1a */
+	data = g_bytes_get_data (canonical, &size);
+	for (i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= G_GUINT64_CONSTANT (0x100000001b3);
+	}
+
+	return hash;
+}
+
+static const CertificateName *
+certificate_info_get_name (GcrCertificateInfo *info,
+                           gboolean subject)
+{
+	CertificateName *name = subject ? &info->subject : &info->issuer;
+	guint flag = subject ? DECODED_SUBJECT : DECODED_ISSUER;
+	GNode *node;
+
+	if (!(info->decoded & flag)) {
+		info->decoded |= flag;
+		node = egg_asn1x_node (info->asn1, "tbsCertificate", subject ? "subject" : "issuer",
+		                       "rdnSequence", NULL);
+		name->canonical = egg_dn_canonicalize (node);
+		if (name->canonical)
+			name->hash = hash_canonical_name (name->canonical);
+	}
+
+	return name->canonical ? name : NULL;
+}
+
+static void
+certificate_info_load_public_key (GcrCertificateInfo *info)
+{
+	GNode *subject_public_key;
+
+	if (info->decoded & DECODED_PUBLIC_KEY)
+		return;
+
+	info->decoded |= DECODED_PUBLIC_KEY;
+	subject_public_key = egg_asn1x_node (info->asn1, "tbsCertificate", "subjectPublicKeyInfo", NULL);
+	info->key_algorithm = egg_asn1x_get_oid_as_quark (egg_asn1x_node (subject_public_key,
+	                                                                  "algorithm", "algorithm", NULL));
+	info->key_size = _gcr_subject_public_key_calculate_size (subject_public_key);
+}
+
+static void
+digest_into (GChecksumType type,
+             GBytes *data,
+             guint8 *digest,
+             gsize n_digest)
+{
+	GChecksum *checksum;
+
+	checksum = g_checksum_new (type);
+	g_checksum_update (checksum, g_bytes_get_data (data, NULL), g_bytes_get_size (data));
+	g_checksum_get_digest (checksum, digest, &n_digest);
+	g_checksum_free (checksum);
+}
+
+static const guint8 *
+certificate_info_get_key_fingerprint (GcrCertificateInfo *info,
+                                      GChecksumType type,
+                                      gsize *n_fingerprint)
+{
+	GBytes *value;
+
+	if (!(info->decoded & DECODED_KEY_FINGERPRINTS)) {
+
+		/* Hash the subjectPublicKeyInfo as it appears in the DER */
+		value = egg_asn1x_get_element_raw (egg_asn1x_node (info->asn1, "tbsCertificate",
+		                                                   "subjectPublicKeyInfo", NULL));
+		g_return_val_if_fail (value != NULL, NULL);
+		digest_into (G_CHECKSUM_SHA1, value, info->key_sha1, sizeof (info->key_sha1));
+		digest_into (G_CHECKSUM_SHA256, value, info->key_sha256, sizeof (info->key_sha256));
+		g_bytes_unref (value);
+
+		info->decoded |= DECODED_KEY_FINGERPRINTS;
+	}
+
+	switch (type) {
+	case G_CHECKSUM_SHA1:
+		*n_fingerprint = sizeof (info->key_sha1);
+		return info->key_sha1;
+	case G_CHECKSUM_SHA256:
+		*n_fingerprint = sizeof (info->key_sha256);
+		return info->key_sha256;
+	default:
+		return NULL;
+	}
+}
+
 static GChecksum*
 digest_certificate (GcrCertificate *self, GChecksumType type)
 {
@@ -397,15 +700,18 @@ gcr_certificate_get_issuer_raw (GcrCertificate *self,
  * @issuer: a possible issuer #GcrCertificate
  *
  * Check if @issuer could be the issuer of this certificate. This is done by
- * comparing the relevant subject and issuer fields. No signature check is
- * done. Proper verification of certificates must be done via a crypto
- * library.
+ * comparing the relevant subject and issuer fields, following the name
+ * matching rules of RFC 5280. No signature check is done. Proper verification
+ * of certificates must be done via a crypto library.
  *
  * Returns: whether @issuer could be the issuer of the certificate.
  */
 gboolean
 gcr_certificate_is_issuer (GcrCertificate *self, GcrCertificate *issuer)
 {
+	const CertificateName *subject_name;
+	const CertificateName *issuer_name;
+	GcrCertificateInfo *info;
 	GBytes *subject_dn;
 	GBytes *issuer_dn;
 	gboolean ret;
@@ -413,6 +719,18 @@ gcr_certificate_is_issuer (GcrCertificate *self, GcrCertificate *issuer)
 	g_return_val_if_fail (GCR_IS_CERTIFICATE (self), FALSE);
 	g_return_val_if_fail (GCR_IS_CERTIFICATE (issuer), FALSE);
 
+	/* Compare the hashes of the canonical names, then the names */
+	info = certificate_info_load (issuer);
+	subject_name = info ? certificate_info_get_name (info, TRUE) : NULL;
+	info = certificate_info_load (self);
+	issuer_name = info ? certificate_info_get_name (info, FALSE) : NULL;
+
+	if (subject_name && issuer_name) {
+		return subject_name->hash == issuer_name->hash &&
+		       g_bytes_equal (subject_name->canonical, issuer_name->canonical);
+	}
+
+	/* Names which couldn't be canonicalized must match exactly */
 	subject_dn = _gcr_certificate_get_subject_const (issuer);
 	if (subject_dn == NULL)
 		return FALSE;
@@ -661,7 +979,6 @@ guint
 gcr_certificate_get_key_size (GcrCertificate *self)
 {
 	GcrCertificateInfo *info;
-	GNode *subject_public_key;
 
 	g_return_val_if_fail (GCR_IS_CERTIFICATE (self), 0);
 
@@ -669,12 +986,7 @@ gcr_certificate_get_key_size (GcrCertificate *self)
 	if (info == NULL)
 		return 0;
 
-	if (!info->key_size) {
-		subject_public_key = egg_asn1x_node (info->asn1, "tbsCertificate",
-		                                     "subjectPublicKeyInfo", NULL);
-		info->key_size = _gcr_subject_public_key_calculate_size (subject_public_key);
-	}
-
+	certificate_info_load_public_key (info);
 	return info->key_size;
 }
 
@@ -717,6 +1029,81 @@ gcr_certificate_get_fingerprint (GcrCertificate *self, GChecksumType type, gsize
 	return digest;
 }
 
+/**
+ * gcr_certificate_get_fingerprints:
+ * @self: a #GcrCertificate
+ * @types: (array length=n_types): the types of fingerprints to calculate
+ * @n_types: the number of types, at most 8
+ * @fingerprints: (array length=n_fingerprints) (out caller-allocates): buffer
+ *   for the fingerprints
+ * @n_fingerprints: the length of the buffer
+ *
+ * Calculate several fingerprints for this certificate in one pass over its
+ * data. The fingerprints are placed one after another in @fingerprints, in
+ * the order of @types. See gcr_fingerprints_from_data().
+ *
+ * Returns: whether the fingerprints were calculated
+ */
+gboolean
+gcr_certificate_get_fingerprints (GcrCertificate *self,
+                                  const GChecksumType *types,
+                                  guint n_types,
+                                  guchar *fingerprints,
+                                  gsize n_fingerprints)
+{
+	gconstpointer der;
+	gsize n_der;
+
+	g_return_val_if_fail (GCR_IS_CERTIFICATE (self), FALSE);
+
+	der = gcr_certificate_get_der_data (self, &n_der);
+	if (der == NULL)
+		return FALSE;
+
+	return gcr_fingerprints_from_data (der, n_der, types, n_types, fingerprints, n_fingerprints);
+}
+
+/**
+ * gcr_certificate_get_key_fingerprint:
+ * @self: a #GcrCertificate
+ * @type: the type of algorithm for the fingerprint, %G_CHECKSUM_SHA1 or
+ *   %G_CHECKSUM_SHA256
+ * @n_length: (out): the length of the resulting fingerprint
+ *
+ * Get the fingerprint of the public key in this certificate. This is a
+ * fingerprint of its subjectPublicKeyInfo, the same as
+ * gcr_fingerprint_from_attributes() creates for the certificate, and not
+ * of the certificate data. It is only calculated once for each certificate.
+ *
+ * The caller should free the returned data using g_free() when
+ * it is no longer required.
+ *
+ * Returns: (array length=n_length) (nullable): the raw binary fingerprint
+ */
+guchar *
+gcr_certificate_get_key_fingerprint (GcrCertificate *self,
+                                     GChecksumType type,
+                                     gsize *n_length)
+{
+	GcrCertificateInfo *info;
+	const guint8 *fingerprint;
+
+	g_return_val_if_fail (GCR_IS_CERTIFICATE (self), NULL);
+	g_return_val_if_fail (n_length != NULL, NULL);
+
+	*n_length = 0;
+
+	info = certificate_info_load (self);
+	if (info == NULL)
+		return NULL;
+
+	fingerprint = certificate_info_get_key_fingerprint (info, type, n_length);
+	if (fingerprint == NULL)
+		return NULL;
+
+	return g_memdup2 (fingerprint, *n_length);
+}
+
 /**
  * gcr_certificate_get_fingerprint_hex:
  * @self: a #GcrCertificate
@@ -872,7 +1259,6 @@ gcr_certificate_get_basic_constraints (GcrCertificate *self,
                                        gint *path_len)
 {
 	GcrCertificateInfo *info;
-	GBytes *value;
 
 	g_return_val_if_fail (GCR_IS_CERTIFICATE (self), FALSE);
 
@@ -880,19 +1266,11 @@ gcr_certificate_get_basic_constraints (GcrCertificate *self,
 	if (info == NULL)
 		return FALSE;
 
-	value = _gcr_certificate_extension_find (info->asn1, GCR_OID_BASIC_CONSTRAINTS, NULL);
-	if (!value)
-		return FALSE;
-
-	if (!_gcr_certificate_extension_basic_constraints (value, is_ca, path_len))
-		g_return_val_if_reached (FALSE);
-
-	g_bytes_unref (value);
-	return TRUE;
+	return certificate_info_get_basic_constraints (info, is_ca, path_len);
 }
 
 static void
-append_subject_public_key (GcrCertificate        *self,
+append_subject_public_key (GcrCertificateInfo    *info,
                            GcrCertificateSection *section,
                            GNode                 *subject_public_key)
 {
@@ -900,16 +1278,14 @@ append_subject_public_key (GcrCertificate        *self,
 	const gchar *text;
 	gchar *display;
 	GBytes *value;
-	guchar *raw;
+	const guint8 *raw;
 	gsize n_raw;
-	GQuark oid;
 	guint bits;
 
-	key_nbits = gcr_certificate_get_key_size (self);
+	certificate_info_load_public_key (info);
+	key_nbits = info->key_size;
 
-	oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (subject_public_key,
-	                                                  "algorithm", "algorithm", NULL));
-	text = egg_oid_get_description (oid);
+	text = egg_oid_get_description (info->key_algorithm);
 	_gcr_certificate_section_new_field (section, _("Key Algorithm"), text);
 
 	value = egg_asn1x_get_element_raw (egg_asn1x_node (subject_public_key,
@@ -927,28 +1303,33 @@ append_subject_public_key (GcrCertificate        *self,
 		                                               g_steal_pointer (&display));
 	}
 
-	value = egg_asn1x_get_element_raw (subject_public_key);
-	raw = gcr_fingerprint_from_subject_public_key_info (g_bytes_get_data (value, NULL),
-	                                                    g_bytes_get_size (value),
-	                                                    G_CHECKSUM_SHA1, &n_raw);
-	g_clear_pointer (&value, g_bytes_unref);
-	_gcr_certificate_section_new_field_take_bytes (section,
-	                                               _("Key SHA1 Fingerprint"),
-	                                               g_bytes_new_take (raw, n_raw));
+	raw = certificate_info_get_key_fingerprint (info, G_CHECKSUM_SHA1, &n_raw);
+	if (raw) {
+		_gcr_certificate_section_new_field_take_bytes (section,
+		                                               _("Key SHA1 Fingerprint"),
+		                                               g_bytes_new (raw, n_raw));
+	}
+
+	raw = certificate_info_get_key_fingerprint (info, G_CHECKSUM_SHA256, &n_raw);
+	if (raw) {
+		_gcr_certificate_section_new_field_take_bytes (section,
+		                                               _("Key SHA256 Fingerprint"),
+		                                               g_bytes_new (raw, n_raw));
+	}
 
 	value = egg_asn1x_get_bits_as_raw (egg_asn1x_node (subject_public_key, "subjectPublicKey", NULL), &bits);
 	_gcr_certificate_section_new_field_take_bytes (section, _("Public Key"), g_steal_pointer (&value));
 }
 
 static GcrCertificateSection *
-append_extension_basic_constraints (GBytes *data)
+append_extension_basic_constraints (GcrCertificateInfo *info)
 {
 	GcrCertificateSection *section;
 	gboolean is_ca = FALSE;
 	gint path_len = -1;
 	gchar *number;
 
-	if (!_gcr_certificate_extension_basic_constraints (data, &is_ca, &path_len))
+	if (!certificate_info_get_basic_constraints (info, &is_ca, &path_len))
 		return NULL;
 
 	section = _gcr_certificate_section_new (_("Basic Constraints"), FALSE);
@@ -965,14 +1346,14 @@ append_extension_basic_constraints (GBytes *data)
 }
 
 static GcrCertificateSection *
-append_extension_extended_key_usage (GBytes *data)
+append_extension_extended_key_usage (GcrCertificateInfo *info)
 {
 	GcrCertificateSection *section;
-	GQuark *oids;
+	const GQuark *oids;
 	GStrvBuilder *text;
 	guint i;
 
-	oids = _gcr_certificate_extension_extended_key_usage (data);
+	oids = certificate_info_get_extended_key_usage (info);
 	if (!oids)
 		return NULL;
 
@@ -981,8 +1362,6 @@ append_extension_extended_key_usage (GBytes *data)
 		g_strv_builder_add (text, egg_oid_get_description (oids[i]));
 	}
 
-	g_free (oids);
-
 	section = _gcr_certificate_section_new (_("Extended Key Usage"), FALSE);
 	_gcr_certificate_section_new_field_take_values (section, _("Allowed Purposes"), g_strv_builder_end (text));
 	g_strv_builder_unref (text);
@@ -991,19 +1370,17 @@ append_extension_extended_key_usage (GBytes *data)
 }
 
 static GcrCertificateSection *
-append_extension_subject_key_identifier (GBytes *data)
+append_extension_subject_key_identifier (GcrCertificateInfo *info)
 {
 	GcrCertificateSection *section;
-	gpointer keyid;
-	gsize n_keyid;
+	GBytes *keyid;
 
-	keyid = _gcr_certificate_extension_subject_key_identifier (data, &n_keyid);
+	keyid = certificate_info_get_subject_key_identifier (info);
 	if (!keyid)
 		return NULL;
 
 	section = _gcr_certificate_section_new (_("Subject Key Identifier"), FALSE);
-	gchar *display = egg_hex_encode_full (keyid, n_keyid, TRUE, " ", 1);
-	g_free (keyid);
+	gchar *display = egg_hex_encode_full (g_bytes_get_data (keyid, NULL), g_bytes_get_size (keyid), TRUE, " ", 1);
 	_gcr_certificate_section_new_field_take_value (section, _("Key Identifier"), g_steal_pointer (&display));
 
 	return section;
@@ -1025,14 +1402,14 @@ static const struct {
 };
 
 static GcrCertificateSection *
-append_extension_key_usage (GBytes *data)
+append_extension_key_usage (GcrCertificateInfo *info)
 {
 	GcrCertificateSection *section;
 	gulong key_usage;
 	GStrvBuilder *values;
 	guint i;
 
-	if (!_gcr_certificate_extension_key_usage (data, &key_usage))
+	if (!certificate_info_get_key_usage (info, &key_usage))
 		return NULL;
 
 	values = g_strv_builder_new ();
@@ -1050,14 +1427,14 @@ append_extension_key_usage (GBytes *data)
 }
 
 static GcrCertificateSection *
-append_extension_subject_alt_name (GBytes *data)
+append_extension_subject_alt_name (GcrCertificateInfo *info)
 {
 	GcrCertificateSection *section;
 	GArray *general_names;
 	GcrGeneralName *general;
 	guint i;
 
-	general_names = _gcr_certificate_extension_subject_alt_name (data);
+	general_names = certificate_info_get_subject_alt_names (info);
 	if (general_names == NULL)
 		return FALSE;
 
@@ -1071,8 +1448,6 @@ append_extension_subject_alt_name (GBytes *data)
 			_gcr_certificate_section_new_field (section, general->description, general->display);
 	}
 
-	_gcr_general_names_free (general_names);
-
 	return section;
 }
 
@@ -1094,44 +1469,34 @@ append_extension_hex (GQuark oid,
 }
 
 static GcrCertificateSection *
-append_extension (GcrCertificate *self,
-                  GNode *node)
+append_extension (GcrCertificateInfo *info,
+                  CertificateExtension *extension)
 {
-	GQuark oid;
-	GBytes *value;
-	gboolean critical;
 	GcrCertificateSection *section = NULL;
+	GQuark oid = extension->oid;
 
-	/* Dig out the OID */
-	oid = egg_asn1x_get_oid_as_quark (egg_asn1x_node (node, "extnID", NULL));
-	g_return_val_if_fail (oid, NULL);
-
-	/* Extension value */
-	value = egg_asn1x_get_string_as_bytes (egg_asn1x_node (node, "extnValue", NULL));
-
-	/* The custom parsers */
+	/* The custom parsers, these only decode once per certificate */
 	if (oid == GCR_OID_BASIC_CONSTRAINTS)
-		section = append_extension_basic_constraints (value);
+		section = append_extension_basic_constraints (info);
 	else if (oid == GCR_OID_EXTENDED_KEY_USAGE)
-		section = append_extension_extended_key_usage (value);
+		section = append_extension_extended_key_usage (info);
 	else if (oid == GCR_OID_SUBJECT_KEY_IDENTIFIER)
-		section = append_extension_subject_key_identifier (value);
+		section = append_extension_subject_key_identifier (info);
 	else if (oid == GCR_OID_KEY_USAGE)
-		section = append_extension_key_usage (value);
+		section = append_extension_key_usage (info);
 	else if (oid == GCR_OID_SUBJECT_ALT_NAME)
-		section = append_extension_subject_alt_name (value);
+		section = append_extension_subject_alt_name (info);
 
 	/* Otherwise the default raw display */
 	if (!section) {
-		section = append_extension_hex (oid, g_steal_pointer (&value));
+		section = append_extension_hex (oid, g_bytes_ref (extension->value));
 	}
 
 	/* Critical */
-	if (section && egg_asn1x_get_boolean (egg_asn1x_node (node, "critical", NULL), &critical)) {
-		_gcr_certificate_section_new_field (section, _("Critical"), critical ? _("Yes") : _("No"));
+	if (section) {
+		_gcr_certificate_section_new_field (section, _("Critical"), extension->critical ? _("Yes") : _("No"));
 	}
 
-	g_clear_pointer (&value, g_bytes_unref);
 	return section;
 }
 
@@ -1294,16 +1659,13 @@ gcr_certificate_get_interface_elements (GcrCertificate *self)
 	/* Public Key Info */
 	section = _gcr_certificate_section_new (_("Public Key Info"), FALSE);
 	subject_public_key = egg_asn1x_node (info->asn1, "tbsCertificate", "subjectPublicKeyInfo", NULL);
-	append_subject_public_key (self, section, subject_public_key);
+	append_subject_public_key (info, section, subject_public_key);
 
 	list = g_list_prepend (list, g_steal_pointer (&section));
 
 	/* Extensions */
-	for (guint extension_num = 1; TRUE; ++extension_num) {
-		GNode *extension = egg_asn1x_node (info->asn1, "tbsCertificate", "extensions", extension_num, NULL);
-		if (extension == NULL)
-			break;
-		section = append_extension (self, extension);
+	for (guint i = 0; i < info->extensions->len; i++) {
+		section = append_extension (info, &g_array_index (info->extensions, CertificateExtension, i));
 		if (section)
 			list = g_list_prepend (list, g_steal_pointer (&section));
 	}
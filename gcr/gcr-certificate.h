@@ -118,6 +118,16 @@ guchar*             gcr_certificate_get_fingerprint        (GcrCertificate *self
 gchar*              gcr_certificate_get_fingerprint_hex    (GcrCertificate *self,
                                                             GChecksumType type);
 
+gboolean            gcr_certificate_get_fingerprints       (GcrCertificate *self,
+                                                            const GChecksumType *types,
+                                                            guint n_types,
+                                                            guchar *fingerprints,
+                                                            gsize n_fingerprints);
+
+guchar*             gcr_certificate_get_key_fingerprint    (GcrCertificate *self,
+                                                            GChecksumType type,
+                                                            gsize *n_length);
+
 gboolean            gcr_certificate_get_basic_constraints  (GcrCertificate *self,
                                                             gboolean *is_ca,
                                                             gint *path_len);
@@ -31,6 +31,13 @@
 
 #include <glib.h>
 
+#include <string.h>
+
+/* Older PKCS#11 headers don't have this, it's from version 2.40 */
+#ifndef CKA_PUBLIC_KEY_INFO
+#define CKA_PUBLIC_KEY_INFO 0x129UL
+#endif
+
 /**
  * gcr_fingerprint_from_subject_public_key_info:
  * @key_info: (array length=n_key_info): DER encoded subjectPublicKeyInfo structure
@@ -75,6 +82,219 @@ gcr_fingerprint_from_subject_public_key_info (const guchar *key_info,
 	return fingerprint;
 }
 
+/* Feed the data to all the digests a block at a time, so it's only read once */
+#define DIGEST_BLOCK 4096
+#define MAX_DIGESTS 8
+
+typedef struct {
+	GChecksum *checksums[MAX_DIGESTS];
+	gsize lengths[MAX_DIGESTS];
+	guint n_checksums;
+	gsize length;
+} Digests;
+
+static void
+digests_clear (Digests *digests)
+{
+	guint i;
+
+	for (i = 0; i < digests->n_checksums; i++)
+		g_checksum_free (digests->checksums[i]);
+	digests->n_checksums = 0;
+}
+
+static gboolean
+digests_init (Digests *digests,
+              const GChecksumType *types,
+              guint n_types)
+{
+	gssize length;
+	guint i;
+
+	memset (digests, 0, sizeof (Digests));
+	g_return_val_if_fail (n_types <= MAX_DIGESTS, FALSE);
+
+	for (i = 0; i < n_types; i++) {
+		length = g_checksum_type_get_length (types[i]);
+		if (length <= 0) {
+			digests_clear (digests);
+			g_return_val_if_reached (FALSE);
+		}
+		digests->checksums[i] = g_checksum_new (types[i]);
+		digests->lengths[i] = length;
+		digests->length += length;
+		digests->n_checksums++;
+	}
+
+	return TRUE;
+}
+
+static void
+digests_run (Digests *digests,
+             const guchar *data,
+             gsize n_data,
+             guchar *output)
+{
+	gsize block, length;
+	guint i;
+
+	while (n_data > 0) {
+		block = MIN (n_data, DIGEST_BLOCK);
+		for (i = 0; i < digests->n_checksums; i++)
+			g_checksum_update (digests->checksums[i], data, block);
+		data += block;
+		n_data -= block;
+	}
+
+	/* Reset them so they can be used for the next input */
+	for (i = 0; i < digests->n_checksums; i++) {
+		length = digests->lengths[i];
+		g_checksum_get_digest (digests->checksums[i], output, &length);
+		g_checksum_reset (digests->checksums[i]);
+		output += digests->lengths[i];
+	}
+}
+
+/**
+ * gcr_fingerprints_from_data:
+ * @data: (array length=n_data): the data to digest
+ * @n_data: length of the data
+ * @types: (array length=n_types): the types of fingerprints to create
+ * @n_types: the number of types, at most 8
+ * @fingerprints: (array length=n_fingerprints) (out caller-allocates): buffer
+ *   for the fingerprints
+ * @n_fingerprints: the length of the buffer
+ *
+ * Create several fingerprints of the same data, reading the data once.
+ *
+ * The fingerprints are placed one after another in @fingerprints, in the
+ * order of @types. The buffer must be large enough to hold all of them,
+ * as returned by g_checksum_type_get_length() for each type.
+ *
+ * Returns: whether the fingerprints were created
+ */
+gboolean
+gcr_fingerprints_from_data (const guchar *data,
+                            gsize n_data,
+                            const GChecksumType *types,
+                            guint n_types,
+                            guchar *fingerprints,
+                            gsize n_fingerprints)
+{
+	Digests digests;
+
+	g_return_val_if_fail (data != NULL || n_data == 0, FALSE);
+	g_return_val_if_fail (types != NULL || n_types == 0, FALSE);
+	g_return_val_if_fail (fingerprints != NULL || n_fingerprints == 0, FALSE);
+
+	if (!digests_init (&digests, types, n_types))
+		return FALSE;
+
+	if (n_fingerprints < digests.length) {
+		digests_clear (&digests);
+		g_return_val_if_reached (FALSE);
+	}
+
+	digests_run (&digests, data, n_data, fingerprints);
+	digests_clear (&digests);
+	return TRUE;
+}
+
+/**
+ * gcr_fingerprints_from_certificates:
+ * @certificates: (array length=n_certificates): the certificates
+ * @n_certificates: the number of certificates
+ * @types: (array length=n_types): the types of fingerprints to create
+ * @n_types: the number of types, at most 8
+ * @fingerprints: (array length=n_fingerprints) (out caller-allocates): buffer
+ *   for the fingerprints
+ * @n_fingerprints: the length of the buffer
+ *
+ * Create several fingerprints for each of many certificates. Each certificate's
+ * data is read once, and the digest state is reused between certificates.
+ *
+ * The fingerprints of each certificate are placed one after another in the
+ * order of @types, and the certificates follow each other in the same way.
+ * Fingerprints of certificates without any data are left zeroed.
+ *
+ * Returns: whether fingerprints were created for all the certificates
+ */
+gboolean
+gcr_fingerprints_from_certificates (GcrCertificate **certificates,
+                                    guint n_certificates,
+                                    const GChecksumType *types,
+                                    guint n_types,
+                                    guchar *fingerprints,
+                                    gsize n_fingerprints)
+{
+	gboolean ret = TRUE;
+	Digests digests;
+	const guchar *der;
+	gsize n_der;
+	guint i;
+
+	g_return_val_if_fail (certificates != NULL || n_certificates == 0, FALSE);
+	g_return_val_if_fail (types != NULL || n_types == 0, FALSE);
+	g_return_val_if_fail (fingerprints != NULL || n_fingerprints == 0, FALSE);
+
+	if (!digests_init (&digests, types, n_types))
+		return FALSE;
+
+	if (n_fingerprints / MAX (digests.length, 1) < n_certificates) {
+		digests_clear (&digests);
+		g_return_val_if_reached (FALSE);
+	}
+
+	for (i = 0; i < n_certificates; i++) {
+		der = gcr_certificate_get_der_data (certificates[i], &n_der);
+		if (der == NULL) {
+			memset (fingerprints, 0, digests.length);
+			ret = FALSE;
+		} else {
+			digests_run (&digests, der, n_der, fingerprints);
+		}
+		fingerprints += digests.length;
+	}
+
+	digests_clear (&digests);
+	return ret;
+}
+
+static GBytes *
+subject_public_key_info_raw (GckAttributes *attrs)
+{
+	const GckAttribute *attr;
+	GBytes *bytes = NULL;
+	GNode *cert;
+	gulong klass;
+
+	/* The token may have already done the work for us */
+	attr = gck_attributes_find (attrs, CKA_PUBLIC_KEY_INFO);
+	if (attr != NULL && !gck_attribute_is_invalid (attr) && attr->length > 0)
+		return g_bytes_new (attr->value, attr->length);
+
+	if (!gck_attributes_find_ulong (attrs, CKA_CLASS, &klass) || klass != CKO_CERTIFICATE)
+		return NULL;
+
+	/* Use the subjectPublicKeyInfo exactly as it is in the certificate */
+	attr = gck_attributes_find (attrs, CKA_VALUE);
+	if (attr == NULL || gck_attribute_is_invalid (attr))
+		return NULL;
+
+	bytes = g_bytes_new_with_free_func (attr->value, attr->length,
+	                                    gck_attributes_unref,
+	                                    gck_attributes_ref (attrs));
+	cert = egg_asn1x_create_and_decode (pkix_asn1_tab, "Certificate", bytes);
+	g_bytes_unref (bytes);
+
+	if (cert == NULL)
+		return NULL;
+
+	bytes = egg_asn1x_get_element_raw (egg_asn1x_node (cert, "tbsCertificate", "subjectPublicKeyInfo", NULL));
+	egg_asn1x_destroy (cert);
+	return bytes;
+}
+
 /**
  * gcr_fingerprint_from_attributes:
  * @attrs: attributes for key or certificate
@@ -100,10 +320,17 @@ gcr_fingerprint_from_attributes (GckAttributes *attrs,
 	g_return_val_if_fail (attrs != NULL, NULL);
 	g_return_val_if_fail (n_fingerprint, NULL);
 
-	asn = _gcr_subject_public_key_for_attributes (attrs);
-
-	if (asn != NULL) {
+	/* Hash the DER directly when we have it, rather than rebuilding it */
+	info = subject_public_key_info_raw (attrs);
+	if (info == NULL) {
+		asn = _gcr_subject_public_key_for_attributes (attrs);
+		if (asn == NULL)
+			return NULL;
 		info = egg_asn1x_encode (asn, NULL);
+		egg_asn1x_destroy (asn);
+	}
+
+	if (info != NULL) {
 		fingerprint = gcr_fingerprint_from_subject_public_key_info (g_bytes_get_data (info, NULL),
 		                                                            g_bytes_get_size (info),
 		                                                            checksum_type,
@@ -111,6 +338,5 @@ gcr_fingerprint_from_attributes (GckAttributes *attrs,
 		g_bytes_unref (info);
 	}
 
-	egg_asn1x_destroy (asn);
 	return fingerprint;
 }
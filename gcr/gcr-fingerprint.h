@@ -40,4 +40,18 @@ guchar *        gcr_fingerprint_from_attributes                 (GckAttributes *
                                                                  GChecksumType checksum_type,
                                                                  gsize *n_fingerprint);
 
+gboolean        gcr_fingerprints_from_data                      (const guchar *data,
+                                                                 gsize n_data,
+                                                                 const GChecksumType *types,
+                                                                 guint n_types,
+                                                                 guchar *fingerprints,
+                                                                 gsize n_fingerprints);
+
+gboolean        gcr_fingerprints_from_certificates              (GcrCertificate **certificates,
+                                                                 guint n_certificates,
+                                                                 const GChecksumType *types,
+                                                                 guint n_types,
+                                                                 guchar *fingerprints,
+                                                                 gsize n_fingerprints);
+
 #endif /* GCR_FINGERPRINT_H_ */
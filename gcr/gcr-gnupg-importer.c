@@ -27,13 +27,16 @@
 
 #include <glib/gi18n-lib.h>
 
+#include <string.h>
+
 enum {
 	PROP_0,
 	PROP_LABEL,
 	PROP_IMPORTED,
 	PROP_DIRECTORY,
 	PROP_INTERACTION,
-	PROP_URI
+	PROP_URI,
+	PROP_BATCH
 };
 
 struct _GcrGnupgImporterPrivate {
@@ -42,8 +45,52 @@ struct _GcrGnupgImporterPrivate {
 	GTlsInteraction *interaction;
 	gchar *first_error;
 	GArray *imported;
+	gboolean batch;
+	GPtrArray *blocks;
+	GPtrArray *fingerprints;
 };
 
+/*
+ * In batch mode, imports started for the same directory during one main
+ * loop iteration, or while an earlier batch is still running, are all
+ * streamed through a single gpg process. The results are handed back to
+ * each import by the fingerprints in the status output. Importers made
+ * by gcr_importer_create_for_parsed() always use batch mode.
+ *
+ * Batches belong to the thread-default main context the imports were
+ * started from, and everything but the tables below happens there.
+ */
+typedef struct {
+	gchar *key;
+	gchar *directory;
+	GMainContext *context;
+	GcrGnupgProcess *process;
+	GCancellable *cancellable;
+	GPtrArray *imports;
+	GHashTable *fingerprints;
+	GHashTable *keyids;
+	gchar *first_error;
+	GSource *idle;
+} GnupgBatch;
+
+typedef struct {
+	GTask *task;
+	GnupgBatch *batch;
+	GSource *cancelled;
+	GPtrArray *blocks;
+	GPtrArray *fingerprints;
+	gboolean finished;
+	guint outstanding;
+	gboolean unmatched;
+	gboolean problem;
+	gchar *error;
+} BatchImport;
+
+/* Context and directory -> GnupgBatch, see batch_key () */
+G_LOCK_DEFINE_STATIC (batches);
+static GHashTable *pending_batches = NULL;
+static GHashTable *running_batches = NULL;
+
 static void gcr_gnupg_importer_iface (GcrImporterInterface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (GcrGnupgImporter, _gcr_gnupg_importer, G_TYPE_OBJECT,
@@ -57,6 +104,8 @@ _gcr_gnupg_importer_init (GcrGnupgImporter *self)
 	self->pv = _gcr_gnupg_importer_get_instance_private (self);
 	self->pv->packets = G_MEMORY_INPUT_STREAM (g_memory_input_stream_new ());
 	self->pv->imported = g_array_new (TRUE, TRUE, sizeof (gchar *));
+	self->pv->blocks = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	self->pv->fingerprints = g_ptr_array_new_with_free_func (g_free);
 }
 
 static void
@@ -79,6 +128,8 @@ _gcr_gnupg_importer_finalize (GObject *obj)
 	GcrGnupgImporter *self = GCR_GNUPG_IMPORTER (obj);
 
 	g_array_free (self->pv->imported, TRUE);
+	g_ptr_array_unref (self->pv->blocks);
+	g_ptr_array_unref (self->pv->fingerprints);
 	g_free (self->pv->first_error);
 
 	G_OBJECT_CLASS (_gcr_gnupg_importer_parent_class)->finalize (obj);
@@ -108,6 +159,34 @@ calculate_uri (GcrGnupgImporter *self)
 		return g_strdup_printf ("gnupg://%s", directory);
 }
 
+static gchar *
+parse_error_line (const gchar *line,
+                  gchar **keyid)
+{
+	const gchar *colon;
+	gsize length;
+
+	if (g_str_has_prefix (line, "gpg: ")) {
+		line += 5;
+
+		/* Short or long key id, depending on the gpg version */
+		if (g_str_has_prefix (line, "key ")) {
+			colon = strchr (line + 4, ':');
+			length = colon ? colon - (line + 4) : 0;
+			if (length == 8 || length == 16) {
+				if (keyid)
+					*keyid = g_ascii_strup (line + 4, length);
+				line = colon + 1;
+			}
+		}
+	}
+
+	while (line[0] && g_ascii_isspace (line[0]))
+		line++;
+
+	return g_strstrip (g_strdup (line));
+}
+
 static gboolean
 on_process_error_line (GcrGnupgProcess *process,
                        const gchar *line,
@@ -118,17 +197,7 @@ on_process_error_line (GcrGnupgProcess *process,
 	if (self->pv->first_error)
 		return TRUE;
 
-	if (g_str_has_prefix (line, "gpg: ")) {
-		line += 5;
-		if (g_pattern_match_simple ("key ????????:*", line))
-			line += 13;
-	}
-
-	while (line[0] && g_ascii_isspace (line[0]))
-		line++;
-
-	self->pv->first_error = g_strdup (line);
-	g_strstrip (self->pv->first_error);
+	self->pv->first_error = parse_error_line (line, NULL);
 	return TRUE;
 }
 
@@ -172,6 +241,9 @@ _gcr_gnupg_importer_set_property (GObject *obj,
 		g_clear_object (&self->pv->interaction);
 		self->pv->interaction = g_value_dup_object (value);
 		break;
+	case PROP_BATCH:
+		self->pv->batch = g_value_get_boolean (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
 		break;
@@ -202,6 +274,9 @@ _gcr_gnupg_importer_get_property (GObject *obj,
 	case PROP_URI:
 		g_value_take_string (value, calculate_uri (self));
 		break;
+	case PROP_BATCH:
+		g_value_set_boolean (value, self->pv->batch);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
 		break;
@@ -233,6 +308,11 @@ _gcr_gnupg_importer_class_init (GcrGnupgImporterClass *klass)
 		                     NULL,
 		                     G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property (gobject_class, PROP_BATCH,
+		g_param_spec_boolean ("batch", "Batch", "Share a gpg process with other imports",
+		                      FALSE,
+		                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+
 	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_GCR_GNUPG_RECORDS);
 	gcr_importer_register (GCR_TYPE_GNUPG_IMPORTER, gck_builder_end (&builder));
 
@@ -247,13 +327,40 @@ _gcr_gnupg_importer_create_for_parsed (GcrParsed *parsed)
 	if (gcr_parsed_get_format (parsed) != GCR_FORMAT_OPENPGP_PACKET)
 		return NULL;
 
-	self = _gcr_gnupg_importer_new (NULL);
+	self = _gcr_gnupg_importer_new_batch (NULL);
 	if (!gcr_importer_queue_for_parsed (self, parsed))
 		g_assert_not_reached ();
 
 	return g_list_append (NULL, self);
 }
 
+/* The fingerprint from the records the parser found, or %NULL */
+static gchar *
+parsed_fingerprint (GcrParsed *parsed)
+{
+	const GckAttribute *attr;
+	GckAttributes *attrs;
+	GPtrArray *records;
+	GcrRecord *record;
+	gchar *fingerprint = NULL;
+
+	attrs = gcr_parsed_get_attributes (parsed);
+	attr = attrs ? gck_attributes_find (attrs, CKA_VALUE) : NULL;
+	if (attr == NULL || gck_attribute_is_invalid (attr))
+		return NULL;
+
+	records = _gcr_records_parse_colons (attr->value, attr->length);
+	if (records == NULL)
+		return NULL;
+
+	record = _gcr_records_find (records, GCR_RECORD_SCHEMA_FPR);
+	if (record != NULL)
+		fingerprint = _gcr_record_get_string (record, GCR_RECORD_FPR_FINGERPRINT);
+
+	g_ptr_array_unref (records);
+	return fingerprint;
+}
+
 static gboolean
 _gcr_gnupg_importer_queue_for_parsed (GcrImporter *importer,
                                       GcrParsed *parsed)
@@ -268,6 +375,12 @@ _gcr_gnupg_importer_queue_for_parsed (GcrImporter *importer,
 	block = gcr_parsed_get_data (parsed, &n_block);
 	g_return_val_if_fail (block, FALSE);
 
+	if (self->pv->batch) {
+		g_ptr_array_add (self->pv->blocks, g_bytes_new (block, n_block));
+		g_ptr_array_add (self->pv->fingerprints, parsed_fingerprint (parsed));
+		return TRUE;
+	}
+
 	g_memory_input_stream_add_data (self->pv->packets, g_memdup2 (block, n_block),
 	                                n_block, g_free);
 	return TRUE;
@@ -297,6 +410,366 @@ on_process_run_complete (GObject *source,
 	g_clear_object (&task);
 }
 
+static gchar *
+batch_key (GMainContext *context,
+           const gchar *directory)
+{
+	/* The batch holds a reference, so the context can't be reused meanwhile */
+	return g_strdup_printf ("%p:%s", context, directory ? directory : "");
+}
+
+static void
+batch_import_free (gpointer data)
+{
+	BatchImport *import = data;
+
+	if (import->cancelled) {
+		g_source_destroy (import->cancelled);
+		g_source_unref (import->cancelled);
+	}
+	g_clear_object (&import->task);
+	g_ptr_array_unref (import->blocks);
+	g_ptr_array_unref (import->fingerprints);
+	g_free (import->error);
+	g_free (import);
+}
+
+static GnupgBatch *
+batch_new (GMainContext *context,
+           const gchar *directory,
+           gchar *key)
+{
+	GnupgBatch *batch;
+
+	batch = g_new0 (GnupgBatch, 1);
+	batch->key = key;
+	batch->directory = g_strdup (directory);
+	batch->context = g_main_context_ref (context);
+	batch->cancellable = g_cancellable_new ();
+	batch->imports = g_ptr_array_new_with_free_func (batch_import_free);
+	batch->fingerprints = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	batch->keyids = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	return batch;
+}
+
+static void
+batch_free (GnupgBatch *batch)
+{
+	if (batch->idle) {
+		g_source_destroy (batch->idle);
+		g_source_unref (batch->idle);
+	}
+	if (batch->process)
+		g_signal_handlers_disconnect_by_data (batch->process, batch);
+	g_clear_object (&batch->process);
+	g_clear_object (&batch->cancellable);
+	g_ptr_array_unref (batch->imports);
+	g_hash_table_destroy (batch->fingerprints);
+	g_hash_table_destroy (batch->keyids);
+	g_main_context_unref (batch->context);
+	g_free (batch->first_error);
+	g_free (batch->directory);
+	g_free (batch->key);
+	g_free (batch);
+}
+
+static gboolean
+on_batch_error_line (GcrGnupgProcess *process,
+                     const gchar *line,
+                     gpointer user_data)
+{
+	GnupgBatch *batch = user_data;
+	BatchImport *import = NULL;
+	gchar *keyid = NULL;
+	gchar *message;
+
+	message = parse_error_line (line, &keyid);
+	if (keyid != NULL)
+		import = g_hash_table_lookup (batch->keyids, keyid);
+
+	if (import != NULL && import->error == NULL)
+		import->error = g_strdup (message);
+	if (batch->first_error == NULL)
+		batch->first_error = g_steal_pointer (&message);
+
+	g_free (message);
+	g_free (keyid);
+	return TRUE;
+}
+
+static gboolean
+on_batch_status_record (GcrGnupgProcess *process,
+                        GcrRecord *record,
+                        gpointer user_data)
+{
+	GnupgBatch *batch = user_data;
+	GcrGnupgImporter *self;
+	BatchImport *import;
+	const gchar *value;
+	gchar *fingerprint;
+	GQuark schema;
+
+	schema = _gcr_record_get_schema (record);
+	if (schema != GCR_RECORD_SCHEMA_IMPORT_OK &&
+	    schema != GCR_RECORD_SCHEMA_IMPORT_PROBLEM)
+		return TRUE;
+
+	value = _gcr_record_get_raw (record, GCR_RECORD_IMPORT_FINGERPRINT);
+	if (value == NULL || value[0] == 0)
+		return TRUE;
+
+	import = g_hash_table_lookup (batch->fingerprints, value);
+	if (import == NULL || import->finished)
+		return TRUE;
+
+	if (schema == GCR_RECORD_SCHEMA_IMPORT_PROBLEM) {
+		import->problem = TRUE;
+		return TRUE;
+	}
+
+	/* Each fingerprint is only counted once */
+	g_hash_table_remove (batch->fingerprints, value);
+	g_assert (import->outstanding > 0);
+	import->outstanding--;
+
+	self = GCR_GNUPG_IMPORTER (g_task_get_source_object (import->task));
+	fingerprint = g_strdup (value);
+	g_array_append_val (self->pv->imported, fingerprint);
+	return TRUE;
+}
+
+static void batch_start (GnupgBatch *batch);
+
+static void
+on_batch_run_complete (GObject *source,
+                       GAsyncResult *result,
+                       gpointer user_data)
+{
+	GnupgBatch *batch = user_data;
+	GnupgBatch *pending;
+	BatchImport *import;
+	GError *error = NULL;
+	const gchar *message;
+	gboolean failed;
+	guint i;
+
+	_gcr_gnupg_process_run_finish (GCR_GNUPG_PROCESS (source), result, &error);
+
+	/* Imports that came in meanwhile wait for this one */
+	G_LOCK (batches);
+	g_hash_table_steal (running_batches, batch->key);
+	pending = g_hash_table_lookup (pending_batches, batch->key);
+	G_UNLOCK (batches);
+
+	for (i = 0; i < batch->imports->len; i++) {
+		import = batch->imports->pdata[i];
+
+		/* Already returned when it was cancelled */
+		if (import->finished)
+			continue;
+
+		/* gpg couldn't run at all, or was cancelled */
+		if (error && !g_error_matches (error, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED)) {
+			g_task_return_error (import->task, g_error_copy (error));
+			continue;
+		}
+
+		/* gpg exits with failure when any key had a problem */
+		failed = import->problem || (error && (import->outstanding > 0 || import->unmatched));
+		if (!failed) {
+			g_task_return_boolean (import->task, TRUE);
+			continue;
+		}
+
+		message = import->error;
+		if (message == NULL)
+			message = batch->first_error;
+		if (message == NULL && error)
+			message = error->message;
+		if (message == NULL)
+			message = _("Couldn’t import the key");
+		g_task_return_new_error (import->task, G_SPAWN_ERROR, G_SPAWN_ERROR_FAILED,
+		                         "%s", message);
+	}
+
+	g_clear_error (&error);
+	batch_free (batch);
+
+	if (pending != NULL && pending->idle == NULL)
+		batch_start (pending);
+}
+
+static void
+batch_add_fingerprint (GnupgBatch *batch,
+                       BatchImport *import,
+                       const gchar *fingerprint)
+{
+	gsize length;
+
+	/* Keys we can't tell apart, only gpg's exit code counts */
+	if (fingerprint == NULL || g_hash_table_contains (batch->fingerprints, fingerprint)) {
+		import->unmatched = TRUE;
+		return;
+	}
+
+	g_hash_table_insert (batch->fingerprints, g_strdup (fingerprint), import);
+	import->outstanding++;
+
+	/* gpg refers to keys by short or long key id on stderr */
+	length = strlen (fingerprint);
+	if (length >= 16) {
+		g_hash_table_replace (batch->keyids, g_strdup (fingerprint + length - 16), import);
+		g_hash_table_replace (batch->keyids, g_strdup (fingerprint + length - 8), import);
+	}
+}
+
+static void
+batch_start (GnupgBatch *batch)
+{
+	const gchar *argv[] = { "--import", NULL };
+	GMemoryInputStream *packets;
+	BatchImport *import;
+	guint n_blocks = 0;
+	guint i, j;
+
+	G_LOCK (batches);
+
+	if (g_hash_table_contains (running_batches, batch->key)) {
+		G_UNLOCK (batches);
+		return;
+	}
+
+	g_hash_table_steal (pending_batches, batch->key);
+	g_hash_table_insert (running_batches, batch->key, batch);
+
+	G_UNLOCK (batches);
+
+	/* Keys of imports cancelled while waiting never reach gpg */
+	packets = G_MEMORY_INPUT_STREAM (g_memory_input_stream_new ());
+	for (i = 0; i < batch->imports->len; i++) {
+		import = batch->imports->pdata[i];
+		if (import->finished)
+			continue;
+		for (j = 0; j < import->blocks->len; j++) {
+			g_memory_input_stream_add_bytes (packets, import->blocks->pdata[j]);
+			batch_add_fingerprint (batch, import, import->fingerprints->pdata[j]);
+		}
+		n_blocks += import->blocks->len;
+	}
+
+	g_debug ("importing %u blocks with one gpg process", n_blocks);
+
+	batch->process = _gcr_gnupg_process_new (batch->directory, NULL);
+	_gcr_gnupg_process_set_input_stream (batch->process, G_INPUT_STREAM (packets));
+	g_signal_connect (batch->process, "error-line", G_CALLBACK (on_batch_error_line), batch);
+	g_signal_connect (batch->process, "status-record", G_CALLBACK (on_batch_status_record), batch);
+	g_object_unref (packets);
+
+	/* So that the process completes on the batch's context */
+	g_main_context_push_thread_default (batch->context);
+	_gcr_gnupg_process_run_async (batch->process, argv, NULL,
+	                              GCR_GNUPG_PROCESS_WITH_STATUS,
+	                              batch->cancellable, on_batch_run_complete, batch);
+	g_main_context_pop_thread_default (batch->context);
+}
+
+static gboolean
+on_batch_idle (gpointer user_data)
+{
+	GnupgBatch *batch = user_data;
+
+	g_clear_pointer (&batch->idle, g_source_unref);
+	batch_start (batch);
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+on_batch_import_cancelled (GCancellable *cancellable,
+                           gpointer user_data)
+{
+	BatchImport *import = user_data;
+	GnupgBatch *batch = import->batch;
+	guint i;
+
+	import->finished = TRUE;
+	g_task_return_error_if_cancelled (import->task);
+
+	/* The other imports still need the shared gpg process */
+	for (i = 0; i < batch->imports->len; i++) {
+		if (!((BatchImport *)batch->imports->pdata[i])->finished)
+			return G_SOURCE_REMOVE;
+	}
+
+	/* Nobody is waiting on this batch anymore */
+	if (batch->process) {
+		g_cancellable_cancel (batch->cancellable);
+	} else {
+		G_LOCK (batches);
+		g_hash_table_remove (pending_batches, batch->key);
+		G_UNLOCK (batches);
+		batch_free (batch);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+batch_add_import (GcrGnupgImporter *self,
+                  GTask *task)
+{
+	GCancellable *cancellable;
+	GMainContext *context;
+	const gchar *directory;
+	GnupgBatch *batch;
+	BatchImport *import;
+	gchar *key;
+
+	import = g_new0 (BatchImport, 1);
+	import->task = g_object_ref (task);
+	import->blocks = g_steal_pointer (&self->pv->blocks);
+	import->fingerprints = g_steal_pointer (&self->pv->fingerprints);
+	self->pv->blocks = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+	self->pv->fingerprints = g_ptr_array_new_with_free_func (g_free);
+
+	context = g_main_context_ref_thread_default ();
+	directory = _gcr_gnupg_process_get_directory (self->pv->process);
+	key = batch_key (context, directory);
+
+	G_LOCK (batches);
+
+	if (pending_batches == NULL) {
+		pending_batches = g_hash_table_new (g_str_hash, g_str_equal);
+		running_batches = g_hash_table_new (g_str_hash, g_str_equal);
+	}
+
+	batch = g_hash_table_lookup (pending_batches, key);
+	if (batch == NULL) {
+		batch = batch_new (context, directory, g_steal_pointer (&key));
+		g_hash_table_insert (pending_batches, batch->key, batch);
+		batch->idle = g_idle_source_new ();
+		g_source_set_callback (batch->idle, on_batch_idle, batch, NULL);
+		g_source_attach (batch->idle, context);
+	}
+
+	import->batch = batch;
+	g_ptr_array_add (batch->imports, import);
+
+	/* Cancelling returns this import right away and detaches it from the batch */
+	cancellable = g_task_get_cancellable (task);
+	if (cancellable != NULL) {
+		import->cancelled = g_cancellable_source_new (cancellable);
+		g_source_set_callback (import->cancelled, (GSourceFunc)on_batch_import_cancelled,
+		                       import, NULL);
+		g_source_attach (import->cancelled, context);
+	}
+
+	G_UNLOCK (batches);
+
+	g_main_context_unref (context);
+	g_free (key);
+}
+
 static void
 _gcr_gnupg_importer_import_async (GcrImporter *importer,
                                   GCancellable *cancellable,
@@ -312,6 +785,12 @@ _gcr_gnupg_importer_import_async (GcrImporter *importer,
 	task = g_task_new (importer, cancellable, callback, user_data);
 	g_task_set_source_tag (task, _gcr_gnupg_importer_import_async);
 
+	if (self->pv->batch) {
+		batch_add_import (self, task);
+		g_clear_object (&task);
+		return;
+	}
+
 	_gcr_gnupg_process_run_async (self->pv->process, argv, NULL,
 	                              GCR_GNUPG_PROCESS_WITH_STATUS,
 	                              cancellable, on_process_run_complete,
@@ -355,6 +834,24 @@ _gcr_gnupg_importer_new (const gchar *directory)
 	                     NULL);
 }
 
+/**
+ * _gcr_gnupg_importer_new_batch:
+ * @directory: (nullable): the directory to import to, or %NULL for default
+ *
+ * Create a new #GcrGnupgImporter which shares a gpg process with the
+ * other batch importers for @directory that import at the same time.
+ *
+ * Returns: (transfer full) (type Gcr.GnupgImporter): the new importer
+ */
+GcrImporter *
+_gcr_gnupg_importer_new_batch (const gchar *directory)
+{
+	return g_object_new (GCR_TYPE_GNUPG_IMPORTER,
+	                     "directory", directory,
+	                     "batch", TRUE,
+	                     NULL);
+}
+
 const gchar **
 _gcr_gnupg_importer_get_imported (GcrGnupgImporter *self)
 {
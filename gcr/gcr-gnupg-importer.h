@@ -58,6 +58,8 @@ GType                   _gcr_gnupg_importer_get_type         (void) G_GNUC_CONST
 
 GcrImporter *           _gcr_gnupg_importer_new              (const gchar *directory);
 
+GcrImporter *           _gcr_gnupg_importer_new_batch        (const gchar *directory);
+
 const gchar **          _gcr_gnupg_importer_get_imported     (GcrGnupgImporter *self);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC (GcrGnupgImporter, g_object_unref)
@@ -22,7 +22,6 @@
 #include "config.h"
 
 #include "gcr-gnupg-process.h"
-#include "gcr-util.h"
 
 #include "gcr/gcr-marshal.h"
 
@@ -40,6 +39,7 @@
  * @GCR_GNUPG_PROCESS_RESPECT_LOCALE: Respect the user's locale when running gnupg.
  * @GCR_GNUPG_PROCESS_WITH_STATUS: Ask the process to send status records.
  * @GCR_GNUPG_PROCESS_WITH_ATTRIBUTES: Ask the process to output attribute data.
+ * @GCR_GNUPG_PROCESS_OUTPUT_RECORDS: Parse the output as colon records.
  *
  * Flags for running a gnupg process.
  */
@@ -65,6 +65,7 @@ enum {
 enum {
 	ERROR_LINE,
 	STATUS_RECORD,
+	OUTPUT_RECORD,
 	NUM_SIGNALS
 };
 
@@ -77,8 +78,9 @@ typedef struct _GnupgSource {
 	GcrGnupgProcess *process;       /* Pointer back to the process object */
 
 	GByteArray *input_buf;
-	GString *error_buf;
-	GString *status_buf;
+	GcrRecordReader *error_reader;
+	GcrRecordReader *status_reader;
+	GcrRecordReader *output_reader;
 
 	GPid child_pid;
 	guint child_sig;
@@ -297,6 +299,18 @@ _gcr_gnupg_process_class_init (GcrGnupgProcessClass *klass)
 	           G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GcrGnupgProcessClass, status_record),
 	           NULL, NULL, _gcr_marshal_VOID__BOXED,
 	           G_TYPE_NONE, 1, GCR_TYPE_RECORD);
+
+	/**
+	 * GcrGnupgProcess::output-record:
+	 * @record: a colon record.
+	 *
+	 * Signal emitted for each record of colon output from the gnupg process,
+	 * when run with the %GCR_GNUPG_PROCESS_OUTPUT_RECORDS flag.
+	 */
+	signals[OUTPUT_RECORD] = g_signal_new ("output-record", GCR_TYPE_GNUPG_PROCESS,
+	           G_SIGNAL_RUN_LAST, G_STRUCT_OFFSET (GcrGnupgProcessClass, output_record),
+	           NULL, NULL, _gcr_marshal_VOID__BOXED,
+	           G_TYPE_NONE, 1, GCR_TYPE_RECORD);
 }
 
 static gpointer
@@ -560,33 +574,27 @@ on_gnupg_source_finalize (GSource *source)
 	g_object_unref (gnupg_source->process);
 	if (gnupg_source->input_buf)
 		g_byte_array_free (gnupg_source->input_buf, TRUE);
-	g_string_free (gnupg_source->error_buf, TRUE);
-	g_string_free (gnupg_source->status_buf, TRUE);
+	_gcr_record_reader_free (gnupg_source->error_reader);
+	_gcr_record_reader_free (gnupg_source->status_reader);
+	_gcr_record_reader_free (gnupg_source->output_reader);
 
 	g_assert (!gnupg_source->child_pid);
 	g_assert (!gnupg_source->child_sig);
 }
 
-static gboolean
-read_output (int fd, GByteArray *buffer)
+static gssize
+read_output (int fd, gpointer data, gsize n_data)
 {
-	guchar block[1024];
 	gssize result;
 
-	g_return_val_if_fail (fd >= 0, FALSE);
-
-	do {
-		result = read (fd, block, sizeof (block));
-		if (result < 0) {
-			if (errno == EINTR || errno == EAGAIN)
-				continue;
-			return FALSE;
-		} else {
-			g_byte_array_append (buffer, block, result);
-		}
-	} while (result == sizeof (block));
+	g_return_val_if_fail (fd >= 0, -1);
 
-	return TRUE;
+	for (;;) {
+		result = read (fd, data, n_data);
+		if (result < 0 && (errno == EINTR || errno == EAGAIN))
+			continue;
+		return result;
+	}
 }
 
 static gboolean
@@ -609,34 +617,104 @@ write_input (int fd, GByteArray *buffer)
 	}
 }
 
+typedef void (* ReadLineFunc) (GcrGnupgProcess *self, GcrRecordReader *reader,
+                               gchar *line, gsize n_line);
+
+/*
+ * Reads straight into the reader's buffer, and hands each complete line
+ * to @func without copying it. When @copy is set the data is also written
+ * there as is.
+ */
+static gboolean
+read_lines (GcrGnupgProcess *self,
+            GnupgSource *gnupg_source,
+            GcrRecordReader *reader,
+            gint fd,
+            gboolean last,
+            GOutputStream *copy,
+            ReadLineFunc func)
+{
+	gssize result;
+	gsize n_space;
+	gchar *space;
+	gchar *line;
+	gsize n_line;
+
+	do {
+		space = _gcr_record_reader_begin_write (reader, &n_space);
+		result = read_output (fd, space, n_space);
+		if (result < 0)
+			return FALSE;
+		if (result == 0)
+			last = TRUE;
+
+		/* Before the lines are terminated in place */
+		if (copy != NULL && result > 0)
+			g_output_stream_write_all (copy, space, result, NULL,
+			                           gnupg_source->cancellable, NULL);
+
+		_gcr_record_reader_end_write (reader, result);
+		while (_gcr_record_reader_next_line (reader, last && (gsize)result < n_space,
+		                                     &line, &n_line))
+			(func) (self, reader, line, n_line);
+	} while ((gsize)result == n_space);
+
+	return TRUE;
+}
+
 static void
-emit_status_for_each_line (const gchar *line, gpointer user_data)
+emit_status_for_line (GcrGnupgProcess *self,
+                      GcrRecordReader *reader,
+                      gchar *line,
+                      gsize n_line)
 {
 	GcrRecord *record;
 
 	if (g_str_has_prefix (line, "[GNUPG:] ")) {
 		g_debug ("received status line: %s", line);
 		line += 9;
+		n_line -= 9;
 	} else {
 		g_message ("gnupg status record was not prefixed appropriately: %s", line);
 		return;
 	}
 
-	record = _gcr_record_parse_spaces (line, -1);
+	record = _gcr_record_reader_parse_line (reader, line, n_line);
 	if (!record) {
 		g_message ("couldn't parse status record: %s", line);
 		return;
 	}
 
-	g_signal_emit (GCR_GNUPG_PROCESS (user_data), signals[STATUS_RECORD], 0, record);
+	g_signal_emit (self, signals[STATUS_RECORD], 0, record);
 	_gcr_record_free (record);
 }
 
 static void
-emit_error_for_each_line (const gchar *line, gpointer user_data)
+emit_output_for_line (GcrGnupgProcess *self,
+                      GcrRecordReader *reader,
+                      gchar *line,
+                      gsize n_line)
+{
+	GcrRecord *record;
+
+	record = _gcr_record_reader_parse_line (reader, line, n_line);
+	if (!record) {
+		g_message ("couldn't parse output record: %s", line);
+		return;
+	}
+
+	g_signal_emit (self, signals[OUTPUT_RECORD], 0, record);
+	_gcr_record_free (record);
+}
+
+static void
+emit_error_for_line (GcrGnupgProcess *self,
+                     GcrRecordReader *reader,
+                     gchar *line,
+                     gsize n_line)
 {
 	g_debug ("received error line: %s", line);
-	g_signal_emit (GCR_GNUPG_PROCESS (user_data), signals[ERROR_LINE], 0, line);
+	g_signal_emit (self, signals[ERROR_LINE], 0, line);
 }
 
 static gboolean
@@ -675,22 +753,16 @@ on_gnupg_source_input (GcrGnupgProcess *self,
 static gboolean
 on_gnupg_source_status (GcrGnupgProcess *self,
                         GnupgSource *gnupg_source,
-                        gint fd)
+                        gint fd,
+                        gboolean last)
 {
-	GByteArray *buffer = g_byte_array_new ();
-	gboolean result = TRUE;
-
-	if (!read_output (fd, buffer)) {
+	if (!read_lines (self, gnupg_source, gnupg_source->status_reader, fd, last,
+	                 NULL, emit_status_for_line)) {
 		g_warning ("couldn't read status data from gnupg process");
-		result = FALSE;
-	} else {
-		g_string_append_len (gnupg_source->status_buf, (gchar*)buffer->data, buffer->len);
-		_gcr_util_parse_lines (gnupg_source->status_buf, buffer->len == 0,
-		                       emit_status_for_each_line, self);
+		return FALSE;
 	}
 
-	g_byte_array_unref (buffer);
-	return result;
+	return TRUE;
 }
 
 static gboolean
@@ -698,44 +770,57 @@ on_gnupg_source_attribute (GcrGnupgProcess *self,
                            GnupgSource *gnupg_source,
                            gint fd)
 {
-	GByteArray *buffer = g_byte_array_new ();
-	gboolean result = TRUE;
-
-	if (!read_output (fd, buffer)) {
-		g_warning ("couldn't read attribute data from gnupg process");
-		result = FALSE;
-	} else if (buffer->len > 0) {
-		g_debug ("received %d bytes of attribute data", (gint)buffer->len);
-		if (self->pv->attributes != NULL)
-			g_output_stream_write_all (self->pv->attributes, buffer->data,
-			                           buffer->len, NULL,
-			                           gnupg_source->cancellable, NULL);
-	}
+	guchar block[16384];
+	gssize result;
+
+	do {
+		result = read_output (fd, block, sizeof (block));
+		if (result < 0) {
+			g_warning ("couldn't read attribute data from gnupg process");
+			return FALSE;
+		} else if (result > 0) {
+			g_debug ("received %d bytes of attribute data", (gint)result);
+			if (self->pv->attributes != NULL)
+				g_output_stream_write_all (self->pv->attributes, block, result,
+				                           NULL, gnupg_source->cancellable, NULL);
+		}
+	} while (result == sizeof (block));
 
-	g_byte_array_unref (buffer);
-	return result;
+	return TRUE;
 }
 
 static gboolean
 on_gnupg_source_output (GcrGnupgProcess *self,
                         GnupgSource *gnupg_source,
-                        gint fd)
+                        gint fd,
+                        gboolean last)
 {
-	GByteArray *buffer = g_byte_array_new ();
-	gboolean result = TRUE;
-
-	if (!read_output (fd, buffer)) {
-		g_warning ("couldn't read output data from gnupg process");
-		result = FALSE;
-	} else if (buffer->len > 0) {
-		g_debug ("received %d bytes of output data", (gint)buffer->len);
-		if (self->pv->output != NULL)
-			g_output_stream_write_all (self->pv->output, buffer->data, buffer->len,
-			                           NULL, gnupg_source->cancellable, NULL);
+	guchar block[16384];
+	gssize result;
+
+	if (gnupg_source->output_reader) {
+		if (!read_lines (self, gnupg_source, gnupg_source->output_reader, fd, last,
+		                 self->pv->output, emit_output_for_line)) {
+			g_warning ("couldn't read output data from gnupg process");
+			return FALSE;
+		}
+		return TRUE;
 	}
 
-	g_byte_array_unref (buffer);
-	return result;
+	do {
+		result = read_output (fd, block, sizeof (block));
+		if (result < 0) {
+			g_warning ("couldn't read output data from gnupg process");
+			return FALSE;
+		} else if (result > 0) {
+			g_debug ("received %d bytes of output data", (gint)result);
+			if (self->pv->output != NULL)
+				g_output_stream_write_all (self->pv->output, block, result,
+				                           NULL, gnupg_source->cancellable, NULL);
+		}
+	} while (result == sizeof (block));
+
+	return TRUE;
 }
 
 static gboolean
@@ -744,20 +829,13 @@ on_gnupg_source_error (GcrGnupgProcess *self,
                        gint fd,
                        gboolean last)
 {
-	GByteArray *buffer = g_byte_array_new ();
-	gboolean result = TRUE;
-
-	if (!read_output (fd, buffer)) {
+	if (!read_lines (self, gnupg_source, gnupg_source->error_reader, fd, last,
+	                 NULL, emit_error_for_line)) {
 		g_warning ("couldn't read error data from gnupg process");
-		result = FALSE;
-	} else {
-		g_string_append_len (gnupg_source->error_buf, (gchar*)buffer->data, buffer->len);
-		_gcr_util_parse_lines (gnupg_source->error_buf, last,
-		                       emit_error_for_each_line, gnupg_source->process);
+		return FALSE;
 	}
 
-	g_byte_array_unref (buffer);
-	return result;
+	return TRUE;
 }
 
 static gboolean
@@ -782,8 +860,9 @@ on_gnupg_source_dispatch (GSource *source, GSourceFunc unused, gpointer user_dat
 	/* Status output */
 	poll = &gnupg_source->polls[FD_STATUS];
 	if (poll->fd >= 0) {
-		if (poll->revents & G_IO_IN)
-			if (!on_gnupg_source_status (self, gnupg_source, poll->fd))
+		if (poll->revents & (G_IO_IN | G_IO_HUP))
+			if (!on_gnupg_source_status (self, gnupg_source, poll->fd,
+			                             (poll->revents & G_IO_HUP) ? TRUE : FALSE))
 				poll->revents |= G_IO_HUP;
 		if (poll->revents & G_IO_HUP)
 			close_poll (source, poll);
@@ -804,8 +883,9 @@ on_gnupg_source_dispatch (GSource *source, GSourceFunc unused, gpointer user_dat
 	/* Standard output */
 	poll = &gnupg_source->polls[FD_OUTPUT];
 	if (poll->fd >= 0) {
-		if (poll->revents & G_IO_IN)
-			if (!on_gnupg_source_output (self, gnupg_source, poll->fd))
+		if (poll->revents & (G_IO_IN | G_IO_HUP))
+			if (!on_gnupg_source_output (self, gnupg_source, poll->fd,
+			                             (poll->revents & G_IO_HUP) ? TRUE : FALSE))
 				poll->revents |= G_IO_HUP;
 		if (poll->revents & G_IO_HUP)
 			close_poll (source, poll);
@@ -815,7 +895,7 @@ on_gnupg_source_dispatch (GSource *source, GSourceFunc unused, gpointer user_dat
 	/* Standard error */
 	poll = &gnupg_source->polls[FD_ERROR];
 	if (poll->fd >= 0) {
-		if (poll->revents & G_IO_IN)
+		if (poll->revents & (G_IO_IN | G_IO_HUP))
 			if (!on_gnupg_source_error (self, gnupg_source, poll->fd,
 			                            (poll->revents & G_IO_HUP) ? TRUE : FALSE))
 				poll->revents |= G_IO_HUP;
@@ -954,7 +1034,9 @@ on_cancellable_cancelled (GCancellable *cancellable, gpointer user_data)
  * %GCR_GNUPG_PROCESS_WITH_ATTRIBUTES flags are set, then the gpg process
  * will be status and attribute output respectively. The
  * GcrGnupgProcess:status_record and GcrGnupgProcess:attribute_data signals
- * will provide this data.
+ * will provide this data. With %GCR_GNUPG_PROCESS_OUTPUT_RECORDS the output
+ * is also parsed as colon records, and emitted with the
+ * GcrGnupgProcess:output_record signal as it arrives.
  */
 void
 _gcr_gnupg_process_run_async (GcrGnupgProcess *self, const gchar **argv, const gchar **envp,
@@ -1074,8 +1156,10 @@ _gcr_gnupg_process_run_async (GcrGnupgProcess *self, const gchar **argv, const g
 	gnupg_source = (GnupgSource*)source;
 	for (i = 0; i < NUM_FDS; i++)
 		gnupg_source->polls[i].fd = -1;
-	gnupg_source->error_buf = g_string_sized_new (128);
-	gnupg_source->status_buf = g_string_sized_new (128);
+	gnupg_source->error_reader = _gcr_record_reader_new ('\n');
+	gnupg_source->status_reader = _gcr_record_reader_new (' ');
+	if (flags & GCR_GNUPG_PROCESS_OUTPUT_RECORDS)
+		gnupg_source->output_reader = _gcr_record_reader_new (':');
 	gnupg_source->process = g_object_ref (self);
 	gnupg_source->child_pid = pid;
 
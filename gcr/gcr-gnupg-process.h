@@ -53,13 +53,16 @@ struct _GcrGnupgProcessClass {
 	gboolean (*error_line) (GcrGnupgProcess *self, const gchar *line);
 
 	gboolean (*status_record) (GcrGnupgProcess *self, GcrRecord *record);
+
+	gboolean (*output_record) (GcrGnupgProcess *self, GcrRecord *record);
 };
 
 typedef enum {
 	GCR_GNUPG_PROCESS_NONE              = 0,
 	GCR_GNUPG_PROCESS_RESPECT_LOCALE    = 1 << 0,
 	GCR_GNUPG_PROCESS_WITH_STATUS       = 1 << 1,
-	GCR_GNUPG_PROCESS_WITH_ATTRIBUTES   = 1 << 2
+	GCR_GNUPG_PROCESS_WITH_ATTRIBUTES   = 1 << 2,
+	GCR_GNUPG_PROCESS_OUTPUT_RECORDS    = 1 << 3
 } GcrGnupgProcessFlags;
 
 GType               _gcr_gnupg_process_get_type                (void) G_GNUC_CONST;
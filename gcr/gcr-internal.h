@@ -36,6 +36,9 @@ void              _gcr_uninitialize_library        (void);
 
 void              _gcr_set_pkcs11_config_dir       (const gchar *dir);
 
+/* Start generating exchange keys in the background, before they're needed */
+void              _gcr_secret_exchange_prepare_keys (void);
+
 /* Functions defined in gcr-parser-libgcrypt.c or gcr-parser-gnutls.c */
 
 gint              _gcr_parser_parse_der_private_key_rsa
@@ -151,4 +154,7 @@ gint              _gcr_enum_next_password          (GcrParser *self,
                                                     PasswordState *state,
                                                     const gchar **password);
 
+const gchar     **_gcr_parser_get_passwords        (GcrParser *self,
+                                                    guint *n_passwords);
+
 #endif /* GCR_INTERNAL_H_ */
@@ -0,0 +1,692 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gcr-openpgp-index.h"
+#include "gcr-record.h"
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#include <string.h>
+
+/*
+ * An index of the keys in a GnuPG keyring, so that keys can be listed and
+ * looked up without running gpg. Both the old pubring.gpg format (a plain
+ * sequence of OpenPGP packets) and the keybox format of pubring.kbx are
+ * read.
+ *
+ * The index can be saved in a cache file. Keyrings mostly grow by having
+ * key blocks appended, so when the keyring has grown and everything that
+ * was indexed is unchanged only the new data is parsed. Anything else
+ * rebuilds the index. gpg deletes keybox blobs in place, so it's not
+ * enough to check the last indexed block.
+ *
+ * Whether a key has expired depends on when it's asked, so the expiry is
+ * stored rather than the validity computed when the key was parsed.
+ */
+
+#define INDEX_VERSION "gcr-openpgp-index-2"
+
+/* version, size, mtime, inode, indexed, prefix checksum, entries */
+#define INDEX_TYPE "(sttttsa(tubytsasas))"
+
+#define KEYBOX_BLOB_HEADER   1
+#define KEYBOX_BLOB_OPENPGP  2
+#define KEYBOX_BLOB_MIN      16
+
+struct _GcrOpenpgpIndex {
+	gchar *keyring;
+	gchar *cache;
+	gboolean loaded;
+
+	/* State of the keyring when it was indexed */
+	guint64 size;
+	guint64 mtime;
+	guint64 inode;
+	guint64 indexed;
+	gchar *prefix_checksum;
+
+	GPtrArray *entries;
+	GHashTable *ids;
+};
+
+static void
+entry_free (gpointer data)
+{
+	GcrOpenpgpIndexEntry *entry = data;
+
+	g_free (entry->keyid);
+	g_free (entry->fingerprint);
+	g_strfreev (entry->subkey_ids);
+	g_strfreev (entry->user_ids);
+	g_free (entry);
+}
+
+static GcrOpenpgpIndexEntry *
+entry_new_for_records (GPtrArray *records,
+                       guint64 offset,
+                       guint32 length)
+{
+	GcrOpenpgpIndexEntry *entry;
+	GPtrArray *subkeys;
+	GPtrArray *uids;
+	GcrRecord *record;
+	GQuark schema;
+	gulong expires;
+	guint i;
+
+	if (records->len == 0)
+		return NULL;
+
+	record = records->pdata[0];
+	schema = _gcr_record_get_schema (record);
+	if (schema != GCR_RECORD_SCHEMA_PUB && schema != GCR_RECORD_SCHEMA_SEC)
+		return NULL;
+
+	entry = g_new0 (GcrOpenpgpIndexEntry, 1);
+	entry->offset = offset;
+	entry->length = length;
+	entry->secret = (schema == GCR_RECORD_SCHEMA_SEC);
+	entry->validity = _gcr_record_get_char (record, GCR_RECORD_TRUST);
+	if (_gcr_record_get_ulong (record, GCR_RECORD_KEY_EXPIRY, &expires))
+		entry->expires = expires;
+	entry->keyid = g_strdup (_gcr_record_get_raw (record, GCR_RECORD_KEY_KEYID));
+
+	subkeys = g_ptr_array_new ();
+	uids = g_ptr_array_new ();
+
+	for (i = 1; i < records->len; i++) {
+		record = records->pdata[i];
+		schema = _gcr_record_get_schema (record);
+		if (schema == GCR_RECORD_SCHEMA_FPR) {
+			if (entry->fingerprint == NULL)
+				entry->fingerprint = g_strdup (_gcr_record_get_raw (record, GCR_RECORD_FPR_FINGERPRINT));
+		} else if (schema == GCR_RECORD_SCHEMA_UID) {
+			g_ptr_array_add (uids, _gcr_record_get_string (record, GCR_RECORD_UID_USERID));
+		} else if (schema == GCR_RECORD_SCHEMA_SUB || schema == GCR_RECORD_SCHEMA_SSB) {
+			g_ptr_array_add (subkeys, g_strdup (_gcr_record_get_raw (record, GCR_RECORD_KEY_KEYID)));
+		}
+	}
+
+	g_ptr_array_add (subkeys, NULL);
+	entry->subkey_ids = (gchar **)g_ptr_array_free (subkeys, FALSE);
+	g_ptr_array_add (uids, NULL);
+	entry->user_ids = (gchar **)g_ptr_array_free (uids, FALSE);
+
+	if (entry->keyid == NULL) {
+		entry_free (entry);
+		return NULL;
+	}
+
+	return entry;
+}
+
+static void
+index_add_id (GcrOpenpgpIndex *index,
+              gchar *id,
+              GcrOpenpgpIndexEntry *entry)
+{
+	if (id == NULL)
+		return;
+
+	/* Stored uppercase, so lookups can ignore case */
+	g_strup (id);
+
+	/* The first key with an id wins, like gpg */
+	if (!g_hash_table_contains (index->ids, id))
+		g_hash_table_insert (index->ids, id, entry);
+}
+
+static void
+index_add (GcrOpenpgpIndex *index,
+           GcrOpenpgpIndexEntry *entry)
+{
+	guint i;
+
+	g_ptr_array_add (index->entries, entry);
+	index_add_id (index, entry->keyid, entry);
+	index_add_id (index, entry->fingerprint, entry);
+	for (i = 0; entry->subkey_ids[i] != NULL; i++)
+		index_add_id (index, entry->subkey_ids[i], entry);
+}
+
+static void
+index_clear (GcrOpenpgpIndex *index)
+{
+	g_hash_table_remove_all (index->ids);
+	g_ptr_array_set_size (index->entries, 0);
+	g_clear_pointer (&index->prefix_checksum, g_free);
+	index->size = index->mtime = index->inode = index->indexed = 0;
+}
+
+GcrOpenpgpIndex *
+_gcr_openpgp_index_new (const gchar *keyring,
+                        const gchar *cache)
+{
+	GcrOpenpgpIndex *index;
+
+	g_return_val_if_fail (keyring != NULL, NULL);
+
+	index = g_new0 (GcrOpenpgpIndex, 1);
+	index->keyring = g_strdup (keyring);
+	index->cache = g_strdup (cache);
+	index->entries = g_ptr_array_new_with_free_func (entry_free);
+	index->ids = g_hash_table_new (g_str_hash, g_str_equal);
+
+	return index;
+}
+
+void
+_gcr_openpgp_index_free (GcrOpenpgpIndex *index)
+{
+	if (index == NULL)
+		return;
+
+	g_hash_table_destroy (index->ids);
+	g_ptr_array_unref (index->entries);
+	g_free (index->prefix_checksum);
+	g_free (index->keyring);
+	g_free (index->cache);
+	g_free (index);
+}
+
+static guint32
+load_uint32_be (const guchar *data)
+{
+	return ((guint32)data[0] << 24) | ((guint32)data[1] << 16) |
+	       ((guint32)data[2] << 8) | (guint32)data[3];
+}
+
+static gboolean
+is_keybox (const guchar *data,
+           gsize n_data)
+{
+	return n_data >= KEYBOX_BLOB_MIN &&
+	       data[4] == KEYBOX_BLOB_HEADER &&
+	       memcmp (data + 8, "KBXf", 4) == 0;
+}
+
+/*
+ * Returns the length of the keybox blob at @offset, and where its OpenPGP
+ * key block is if it has one. Zero is returned when the blob is invalid
+ * or incomplete.
+ */
+static gsize
+keybox_blob_at (const guchar *data,
+                gsize n_data,
+                gsize offset,
+                gsize *block_offset,
+                gsize *block_length)
+{
+	gsize length;
+	gsize kb_offset;
+	gsize kb_length;
+
+	*block_offset = *block_length = 0;
+
+	if (offset >= n_data || n_data - offset < KEYBOX_BLOB_MIN)
+		return 0;
+
+	data += offset;
+	length = load_uint32_be (data);
+	if (length < KEYBOX_BLOB_MIN || length > n_data - offset)
+		return 0;
+
+	if (data[4] == KEYBOX_BLOB_OPENPGP) {
+		kb_offset = load_uint32_be (data + 8);
+		kb_length = load_uint32_be (data + 12);
+		if (kb_offset > length || kb_length > length - kb_offset)
+			return 0;
+		*block_offset = offset + kb_offset;
+		*block_length = kb_length;
+	}
+
+	return length;
+}
+
+typedef struct {
+	GcrOpenpgpIndex *index;
+	const guchar *base;
+	gboolean keybox;
+	guint64 blob_offset;
+	guint32 blob_length;
+	guint64 end;
+} IndexClosure;
+
+static void
+on_openpgp_block (GPtrArray *records,
+                  GBytes *outer,
+                  gpointer user_data)
+{
+	IndexClosure *closure = user_data;
+	GcrOpenpgpIndexEntry *entry;
+	const guchar *data;
+	gsize length;
+
+	if (closure->keybox) {
+		entry = entry_new_for_records (records, closure->blob_offset, closure->blob_length);
+	} else {
+		data = g_bytes_get_data (outer, &length);
+		entry = entry_new_for_records (records, data - closure->base, length);
+		closure->end = (data - closure->base) + length;
+	}
+
+	if (entry != NULL)
+		index_add (closure->index, entry);
+}
+
+static void
+index_parse (GcrOpenpgpIndex *index,
+             GBytes *keyring,
+             guint64 start)
+{
+	IndexClosure closure = { index, };
+	GBytes *bytes;
+	const guchar *data;
+	gsize n_data;
+	gsize block_offset;
+	gsize block_length;
+	gsize length;
+	gsize at;
+
+	data = g_bytes_get_data (keyring, &n_data);
+	closure.base = data;
+	closure.keybox = is_keybox (data, n_data);
+	closure.end = start;
+
+	if (closure.keybox) {
+		for (at = start; at < n_data; at += length) {
+			length = keybox_blob_at (data, n_data, at, &block_offset, &block_length);
+			if (length == 0)
+				break;
+			if (block_length > 0) {
+				closure.blob_offset = at;
+				closure.blob_length = length;
+				bytes = g_bytes_new_from_bytes (keyring, block_offset, block_length);
+				_gcr_openpgp_parse (bytes, GCR_OPENPGP_PARSE_KEYS, on_openpgp_block, &closure);
+				g_bytes_unref (bytes);
+			}
+			closure.end = at + length;
+		}
+
+	} else if (start < n_data) {
+		bytes = g_bytes_new_from_bytes (keyring, start, n_data - start);
+		_gcr_openpgp_parse (bytes, GCR_OPENPGP_PARSE_KEYS | GCR_OPENPGP_PARSE_PARALLEL,
+		                    on_openpgp_block, &closure);
+		g_bytes_unref (bytes);
+	}
+
+	index->indexed = closure.end;
+}
+
+/* Adds the keyring data up to @length, and returns the checksum so far */
+static gchar *
+checksum_prefix (GChecksum *checksum,
+                 GBytes *keyring,
+                 guint64 *summed,
+                 guint64 length)
+{
+	const guchar *data;
+	GChecksum *copy;
+	gchar *result;
+	gsize n_data;
+
+	data = g_bytes_get_data (keyring, &n_data);
+	g_return_val_if_fail (*summed <= length && length <= n_data, NULL);
+
+	g_checksum_update (checksum, data + *summed, length - *summed);
+	*summed = length;
+
+	/* Getting the string finishes a checksum, so use a copy */
+	copy = g_checksum_copy (checksum);
+	result = g_strdup (g_checksum_get_string (copy));
+	g_checksum_free (copy);
+
+	return result;
+}
+
+static void
+index_load_cache (GcrOpenpgpIndex *index)
+{
+	GcrOpenpgpIndexEntry *entry;
+	GError *error = NULL;
+	GVariantIter *iter;
+	GVariant *variant;
+	const gchar *version;
+	const gchar *checksum;
+	gchar *contents;
+	gsize length;
+	guchar validity;
+	guint64 expires;
+
+	if (!g_file_get_contents (index->cache, &contents, &length, &error)) {
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_message ("couldn't read keyring index: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	variant = g_variant_new_from_data (G_VARIANT_TYPE (INDEX_TYPE), contents, length,
+	                                   FALSE, g_free, contents);
+	g_variant_ref_sink (variant);
+
+	g_variant_get (variant, "(&sttttsa(tubytsasas))", &version, NULL, NULL, NULL,
+	               NULL, NULL, NULL);
+	if (!g_str_equal (version, INDEX_VERSION)) {
+		g_debug ("ignoring keyring index with version: %s", version);
+		g_variant_unref (variant);
+		return;
+	}
+
+	index_clear (index);
+	g_variant_get (variant, "(&sttttsa(tubytsasas))", NULL, &index->size, &index->mtime,
+	               &index->inode, &index->indexed, &checksum, &iter);
+	index->prefix_checksum = checksum[0] ? g_strdup (checksum) : NULL;
+
+	for (;;) {
+		entry = g_new0 (GcrOpenpgpIndexEntry, 1);
+		if (!g_variant_iter_next (iter, "(tubytsasas)", &entry->offset, &entry->length,
+		                          &entry->secret, &validity, &expires, &entry->keyid,
+		                          &entry->fingerprint, &entry->subkey_ids,
+		                          &entry->user_ids)) {
+			g_free (entry);
+			break;
+		}
+
+		entry->validity = validity;
+		entry->expires = expires;
+		if (entry->fingerprint[0] == '\0')
+			g_clear_pointer (&entry->fingerprint, g_free);
+		index_add (index, entry);
+	}
+
+	g_variant_iter_free (iter);
+	g_variant_unref (variant);
+}
+
+static void
+index_save_cache (GcrOpenpgpIndex *index)
+{
+	GcrOpenpgpIndexEntry *entry;
+	GVariantBuilder builder;
+	GError *error = NULL;
+	GVariant *variant;
+	guint i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(tubytsasas)"));
+	for (i = 0; i < index->entries->len; i++) {
+		entry = index->entries->pdata[i];
+		g_variant_builder_add (&builder, "(tubyts^as^as)", entry->offset, entry->length,
+		                       entry->secret, (guchar)entry->validity, entry->expires, entry->keyid,
+		                       entry->fingerprint ? entry->fingerprint : "",
+		                       entry->subkey_ids, entry->user_ids);
+	}
+
+	variant = g_variant_new ("(sttttsa(tubytsasas))", INDEX_VERSION, index->size,
+	                         index->mtime, index->inode, index->indexed,
+	                         index->prefix_checksum ? index->prefix_checksum : "",
+	                         &builder);
+	g_variant_ref_sink (variant);
+
+	if (!g_file_set_contents (index->cache, g_variant_get_data (variant),
+	                          g_variant_get_size (variant), &error)) {
+		g_message ("couldn't write keyring index: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_variant_unref (variant);
+}
+
+static GBytes *
+map_keyring (GcrOpenpgpIndex *index,
+             GError **error)
+{
+	GMappedFile *mapped;
+	GBytes *bytes;
+
+	mapped = g_mapped_file_new (index->keyring, FALSE, error);
+	if (mapped == NULL)
+		return NULL;
+
+	bytes = g_mapped_file_get_bytes (mapped);
+	g_mapped_file_unref (mapped);
+	return bytes;
+}
+
+/*
+ * Brings the index up to date with the keyring, parsing as little of it as
+ * possible, and saves the cache when anything changed.
+ */
+gboolean
+_gcr_openpgp_index_update (GcrOpenpgpIndex *index,
+                           GError **error)
+{
+	GChecksum *prefix;
+	GStatBuf sb;
+	GBytes *keyring;
+	gchar *checksum;
+	guint64 summed;
+	guint64 start;
+	int errn;
+
+	g_return_val_if_fail (index != NULL, FALSE);
+	g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+	if (!index->loaded && index->cache)
+		index_load_cache (index);
+	index->loaded = TRUE;
+
+	if (g_stat (index->keyring, &sb) < 0) {
+		errn = errno;
+		g_set_error (error, G_FILE_ERROR, g_file_error_from_errno (errn),
+		             "Couldn't access keyring: %s: %s", index->keyring, g_strerror (errn));
+		return FALSE;
+	}
+
+	/* Nothing changed since it was indexed */
+	if (index->inode != 0 &&
+	    index->inode == (guint64)sb.st_ino &&
+	    index->size == (guint64)sb.st_size &&
+	    index->mtime == (guint64)sb.st_mtime)
+		return TRUE;
+
+	keyring = map_keyring (index, error);
+	if (keyring == NULL)
+		return FALSE;
+
+	/* Only appended to, so parse the new part */
+	start = 0;
+	summed = 0;
+	prefix = g_checksum_new (G_CHECKSUM_SHA1);
+	if (index->inode != 0 &&
+	    index->inode == (guint64)sb.st_ino &&
+	    index->size < (guint64)g_bytes_get_size (keyring) &&
+	    index->indexed <= index->size) {
+		checksum = checksum_prefix (prefix, keyring, &summed, index->indexed);
+		if (g_strcmp0 (checksum, index->prefix_checksum) == 0)
+			start = index->indexed;
+		g_free (checksum);
+	}
+
+	if (start == 0) {
+		index_clear (index);
+		g_checksum_reset (prefix);
+		summed = 0;
+	}
+
+	g_debug ("indexing keyring %s from offset %" G_GUINT64_FORMAT,
+	         index->keyring, start);
+
+	index_parse (index, keyring, start);
+	index->size = g_bytes_get_size (keyring);
+	index->mtime = sb.st_mtime;
+	index->inode = sb.st_ino;
+	g_free (index->prefix_checksum);
+	index->prefix_checksum = checksum_prefix (prefix, keyring, &summed, index->indexed);
+
+	g_checksum_free (prefix);
+	g_bytes_unref (keyring);
+
+	if (index->cache)
+		index_save_cache (index);
+
+	return TRUE;
+}
+
+/*
+ * The entries in keyring order. The returned array is owned by the index
+ * and is only valid until the next update.
+ */
+GPtrArray *
+_gcr_openpgp_index_get_entries (GcrOpenpgpIndex *index)
+{
+	g_return_val_if_fail (index != NULL, NULL);
+	return index->entries;
+}
+
+/*
+ * The validity of the key now, as in the trust column. Revocation and
+ * other problems found when indexing stay, otherwise a key that has
+ * expired since is reported as such.
+ */
+gchar
+_gcr_openpgp_index_get_validity (const GcrOpenpgpIndexEntry *entry)
+{
+	g_return_val_if_fail (entry != NULL, 0);
+
+	switch (entry->validity) {
+	case 'e':
+	case 'r':
+	case 'd':
+	case 'i':
+	case 'n':
+		return entry->validity;
+	default:
+		break;
+	}
+
+	if (entry->expires != 0 && entry->expires <= (guint64)g_get_real_time () / G_USEC_PER_SEC)
+		return 'e';
+
+	return entry->validity;
+}
+
+/*
+ * Finds a key by fingerprint, or the long or short key id of the key or
+ * one of its subkeys. Case is ignored, and a "0x" prefix is allowed.
+ */
+const GcrOpenpgpIndexEntry *
+_gcr_openpgp_index_lookup (GcrOpenpgpIndex *index,
+                           const gchar *id)
+{
+	GcrOpenpgpIndexEntry *candidate;
+	GcrOpenpgpIndexEntry *entry;
+	gchar *upper;
+	guint i, j;
+
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (id != NULL, NULL);
+
+	if (id[0] == '0' && (id[1] == 'x' || id[1] == 'X'))
+		id += 2;
+
+	upper = g_ascii_strup (id, -1);
+	entry = g_hash_table_lookup (index->ids, upper);
+
+	/* Short key ids aren't in the table */
+	if (entry == NULL && strlen (upper) == 8) {
+		for (i = 0; entry == NULL && i < index->entries->len; i++) {
+			candidate = index->entries->pdata[i];
+			if (g_str_has_suffix (candidate->keyid, upper))
+				entry = candidate;
+			for (j = 0; entry == NULL && candidate->subkey_ids[j] != NULL; j++) {
+				if (g_str_has_suffix (candidate->subkey_ids[j], upper))
+					entry = candidate;
+			}
+		}
+	}
+
+	g_free (upper);
+	return entry;
+}
+
+static void
+on_load_records (GPtrArray *records,
+                 GBytes *outer,
+                 gpointer user_data)
+{
+	GPtrArray **result = user_data;
+
+	if (*result == NULL)
+		*result = g_ptr_array_ref (records);
+}
+
+/*
+ * Reads the full records of one key from the keyring, as the parser
+ * produces them with the given flags. The index should be up to date.
+ */
+GPtrArray *
+_gcr_openpgp_index_load_records (GcrOpenpgpIndex *index,
+                                 const GcrOpenpgpIndexEntry *entry,
+                                 GcrOpenpgpParseFlags flags,
+                                 GError **error)
+{
+	GPtrArray *records = NULL;
+	const guchar *data;
+	gsize n_data;
+	gsize block_offset;
+	gsize block_length;
+	GBytes *keyring;
+	GBytes *bytes;
+
+	g_return_val_if_fail (index != NULL, NULL);
+	g_return_val_if_fail (entry != NULL, NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	keyring = map_keyring (index, error);
+	if (keyring == NULL)
+		return NULL;
+
+	data = g_bytes_get_data (keyring, &n_data);
+	block_offset = entry->offset;
+	block_length = entry->length;
+
+	if (is_keybox (data, n_data) &&
+	    keybox_blob_at (data, n_data, entry->offset, &block_offset, &block_length) != entry->length)
+		block_length = 0;
+
+	if (block_length == 0 || block_offset + block_length > n_data) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+		             "The keyring has changed since it was indexed: %s", index->keyring);
+		g_bytes_unref (keyring);
+		return NULL;
+	}
+
+	bytes = g_bytes_new_from_bytes (keyring, block_offset, block_length);
+	_gcr_openpgp_parse (bytes, flags | GCR_OPENPGP_PARSE_KEYS, on_load_records, &records);
+	g_bytes_unref (bytes);
+	g_bytes_unref (keyring);
+
+	if (records == NULL) {
+		g_set_error (error, G_FILE_ERROR, G_FILE_ERROR_INVAL,
+		             "Couldn't parse key in keyring: %s", index->keyring);
+	}
+
+	return records;
+}
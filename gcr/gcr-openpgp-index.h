@@ -0,0 +1,63 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GCR_OPENPGP_INDEX_H__
+#define __GCR_OPENPGP_INDEX_H__
+
+#include <glib.h>
+
+#include "gcr-openpgp.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GcrOpenpgpIndex GcrOpenpgpIndex;
+
+typedef struct {
+	guint64 offset;           /* Of the key block, or keybox blob */
+	guint32 length;
+	gboolean secret;
+	gchar validity;           /* As in the trust column when indexed, or zero */
+	guint64 expires;          /* Zero if the key doesn't expire */
+	gchar *keyid;
+	gchar *fingerprint;
+	gchar **subkey_ids;
+	gchar **user_ids;
+} GcrOpenpgpIndexEntry;
+
+GcrOpenpgpIndex *             _gcr_openpgp_index_new           (const gchar *keyring,
+                                                                const gchar *cache);
+
+void                          _gcr_openpgp_index_free          (GcrOpenpgpIndex *index);
+
+gboolean                      _gcr_openpgp_index_update        (GcrOpenpgpIndex *index,
+                                                                GError **error);
+
+GPtrArray *                   _gcr_openpgp_index_get_entries   (GcrOpenpgpIndex *index);
+
+gchar                         _gcr_openpgp_index_get_validity  (const GcrOpenpgpIndexEntry *entry);
+
+const GcrOpenpgpIndexEntry *  _gcr_openpgp_index_lookup        (GcrOpenpgpIndex *index,
+                                                                const gchar *id);
+
+GPtrArray *                   _gcr_openpgp_index_load_records  (GcrOpenpgpIndex *index,
+                                                                const GcrOpenpgpIndexEntry *entry,
+                                                                GcrOpenpgpParseFlags flags,
+                                                                GError **error);
+
+G_END_DECLS
+
+#endif /* __GCR_OPENPGP_INDEX_H__ */
@@ -405,6 +405,7 @@ parse_public_key_or_subkey (GQuark schema,
                             const guchar **at,
                             const guchar *end,
                             GcrOpenpgpParseFlags flags,
+                            GcrRecordArena *arena,
                             GPtrArray *records)
 {
 	gchar *fingerprint = NULL;
@@ -452,7 +453,7 @@ parse_public_key_or_subkey (GQuark schema,
 		keyid = hash_v4_keyid (data, *at, &fingerprint);
 	}
 
-	record = _gcr_record_new (schema, n_columns, ':');
+	record = _gcr_record_new_in (arena, schema, n_columns, ':');
 	_gcr_record_set_uint (record, GCR_RECORD_KEY_BITS, bits);
 	_gcr_record_set_uint (record, GCR_RECORD_KEY_ALGO, algo);
 	_gcr_record_take_raw (record, GCR_RECORD_KEY_KEYID, keyid);
@@ -468,7 +469,7 @@ parse_public_key_or_subkey (GQuark schema,
 	g_ptr_array_add (records, record);
 
 	if (fingerprint && (schema == GCR_RECORD_SCHEMA_PUB || schema == GCR_RECORD_SCHEMA_SEC)) {
-		record = _gcr_record_new (GCR_RECORD_SCHEMA_FPR, GCR_RECORD_FPR_MAX, ':');
+		record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_FPR, GCR_RECORD_FPR_MAX, ':');
 		_gcr_record_take_raw (record, GCR_RECORD_FPR_FINGERPRINT, fingerprint);
 		g_ptr_array_add (records, record);
 		fingerprint = NULL;
@@ -484,6 +485,7 @@ parse_secret_key_or_subkey (GQuark schema,
                             const guchar **at,
                             const guchar *end,
                             GcrOpenpgpParseFlags flags,
+                            GcrRecordArena *arena,
                             GPtrArray *records)
 {
 	/*
@@ -496,7 +498,7 @@ parse_secret_key_or_subkey (GQuark schema,
 	 */
 
 	if (!parse_public_key_or_subkey (schema, GCR_RECORD_SEC_MAX,
-	                                 beg, at, end, flags, records))
+	                                 beg, at, end, flags, arena, records))
 		return FALSE;
 
 	*at = end;
@@ -508,6 +510,7 @@ parse_user_id (const guchar *beg,
                const guchar **at,
                const guchar *end,
                GcrOpenpgpParseFlags flags,
+               GcrRecordArena *arena,
                GPtrArray *records)
 {
 	gchar *string;
@@ -521,7 +524,7 @@ parse_user_id (const guchar *beg,
 	string = g_strndup ((gchar *)*at, end - *at);
 
 	fingerprint = hash_user_id_or_attribute (*at, end);
-	record = _gcr_record_new (GCR_RECORD_SCHEMA_UID, GCR_RECORD_UID_MAX, ':');
+	record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_UID, GCR_RECORD_UID_MAX, ':');
 	_gcr_record_take_raw (record, GCR_RECORD_UID_FINGERPRINT, fingerprint);
 	_gcr_record_set_string (record, GCR_RECORD_UID_USERID, string);
 	g_free (string);
@@ -537,12 +540,13 @@ parse_user_attribute_packet (const guchar *beg,
                              const guchar **at,
                              const guchar *end,
                              guchar subpkt_type,
+                             GcrRecordArena *arena,
                              GPtrArray *records)
 {
 	GcrRecord *record;
 	gchar *fingerprint;
 
-	record = _gcr_record_new (GCR_RECORD_SCHEMA_XA1, GCR_RECORD_XA1_MAX, ':');
+	record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_XA1, GCR_RECORD_XA1_MAX, ':');
 	_gcr_record_set_uint (record, GCR_RECORD_XA1_LENGTH, end - *at);
 	_gcr_record_set_uint (record, GCR_RECORD_XA1_TYPE, subpkt_type);
 	fingerprint = hash_user_id_or_attribute (*at, end);
@@ -560,6 +564,7 @@ parse_user_attribute (const guchar *beg,
                       const guchar **at,
                       const guchar *end,
                       GcrOpenpgpParseFlags flags,
+                      GcrRecordArena *arena,
                       GPtrArray *records)
 {
 	gsize subpkt_len;
@@ -584,7 +589,7 @@ parse_user_attribute (const guchar *beg,
 		if (flags & GCR_OPENPGP_PARSE_ATTRIBUTES) {
 			if (!parse_user_attribute_packet (subpkt_beg, at,
 			                                  *at + (subpkt_len - 1),
-			                                  subpkt_type, records))
+			                                  subpkt_type, arena, records))
 				return FALSE;
 
 		/* We already progressed one extra byte for the subpkt_type */
@@ -595,7 +600,7 @@ parse_user_attribute (const guchar *beg,
 
 	fingerprint = hash_user_id_or_attribute (start, end);
 	string = g_strdup_printf ("%d %d", count, (guint)(*at - start));
-	record = _gcr_record_new (GCR_RECORD_SCHEMA_UAT, GCR_RECORD_UAT_MAX, ':');
+	record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_UAT, GCR_RECORD_UAT_MAX, ':');
 	_gcr_record_take_raw (record, GCR_RECORD_UAT_FINGERPRINT, fingerprint);
 	_gcr_record_take_raw (record, GCR_RECORD_UAT_COUNT_SIZE, string);
 
@@ -627,6 +632,7 @@ static gboolean
 parse_v3_signature (const guchar **at,
                     const guchar *end,
                     GcrOpenpgpParseFlags flags,
+                    GcrRecordArena *arena,
                     GPtrArray *records)
 {
 	guchar keyid[8];
@@ -652,7 +658,7 @@ parse_v3_signature (const guchar **at,
 		return FALSE;
 
 	if (flags & GCR_OPENPGP_PARSE_SIGNATURES) {
-		record = _gcr_record_new (GCR_RECORD_SCHEMA_SIG, GCR_RECORD_SIG_MAX, ':');
+		record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_SIG, GCR_RECORD_SIG_MAX, ':');
 		_gcr_record_set_uint (record, GCR_RECORD_SIG_ALGO, key_algo);
 		value = egg_hex_encode_full (keyid, sizeof (keyid), TRUE, NULL, 0);
 		_gcr_record_take_raw (record, GCR_RECORD_SIG_KEYID, value);
@@ -924,6 +930,7 @@ static gboolean
 parse_v4_signature (const guchar **at,
                     const guchar *end,
                     GcrOpenpgpParseFlags flags,
+                    GcrRecordArena *arena,
                     GPtrArray *records)
 {
 	guint8 sig_type;
@@ -949,8 +956,10 @@ parse_v4_signature (const guchar **at,
 	    !read_uint16 (at, end, &hashed_len))
 		return FALSE;
 
-	/* Hashed subpackets which we use */
-	record = _gcr_record_new (GCR_RECORD_SCHEMA_SIG, GCR_RECORD_SIG_MAX, ':');
+	/* Hashed subpackets which we use, only kept with PARSE_SIGNATURES */
+	if (!(flags & GCR_OPENPGP_PARSE_SIGNATURES))
+		arena = NULL;
+	record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_SIG, GCR_RECORD_SIG_MAX, ':');
 	stop = *at + hashed_len;
 	if (stop > end ||
 	    !parse_v4_signature_subpackets (at, stop, record, &subpkt)) {
@@ -1019,6 +1028,7 @@ parse_signature (const guchar *beg,
                  const guchar **at,
                  const guchar *end,
                  GcrOpenpgpParseFlags flags,
+                 GcrRecordArena *arena,
                  GPtrArray *records)
 {
 	guint8 version;
@@ -1027,9 +1037,9 @@ parse_signature (const guchar *beg,
 		return FALSE;
 
 	if (version == 3)
-		return parse_v3_signature (at, end, flags, records);
+		return parse_v3_signature (at, end, flags, arena, records);
 	else if (version == 4)
-		return parse_v4_signature (at, end, flags, records);
+		return parse_v4_signature (at, end, flags, arena, records);
 	else
 		return FALSE;
 }
@@ -1040,6 +1050,7 @@ parse_openpgp_packet (const guchar *beg,
                       const guchar *end,
                       guint8 pkt_type,
                       GcrOpenpgpParseFlags flags,
+                      GcrRecordArena *arena,
                       GPtrArray *records)
 {
 	gboolean ret;
@@ -1047,28 +1058,28 @@ parse_openpgp_packet (const guchar *beg,
 	switch (pkt_type) {
 	case OPENPGP_PKT_PUBLIC_KEY:
 		ret = parse_public_key_or_subkey (GCR_RECORD_SCHEMA_PUB, GCR_RECORD_PUB_MAX,
-		                                  beg, &at, end, flags, records);
+		                                  beg, &at, end, flags, arena, records);
 		break;
 	case OPENPGP_PKT_PUBLIC_SUBKEY:
 		ret = parse_public_key_or_subkey (GCR_RECORD_SCHEMA_SUB, GCR_RECORD_PUB_MAX,
-		                                  beg, &at, end, flags, records);
+		                                  beg, &at, end, flags, arena, records);
 		break;
 	case OPENPGP_PKT_USER_ID:
-		ret = parse_user_id (beg, &at, end, flags, records);
+		ret = parse_user_id (beg, &at, end, flags, arena, records);
 		break;
 	case OPENPGP_PKT_ATTRIBUTE:
-		ret = parse_user_attribute (beg, &at, end, flags, records);
+		ret = parse_user_attribute (beg, &at, end, flags, arena, records);
 		break;
 	case OPENPGP_PKT_SIGNATURE:
-		ret = parse_signature (beg, &at, end, flags, records);
+		ret = parse_signature (beg, &at, end, flags, arena, records);
 		break;
 	case OPENPGP_PKT_SECRET_KEY:
 		ret = parse_secret_key_or_subkey (GCR_RECORD_SCHEMA_SEC,
-		                                  beg, &at, end, flags, records);
+		                                  beg, &at, end, flags, arena, records);
 		break;
 	case OPENPGP_PKT_SECRET_SUBKEY:
 		ret = parse_secret_key_or_subkey (GCR_RECORD_SCHEMA_SSB,
-		                                  beg, &at, end, flags, records);
+		                                  beg, &at, end, flags, arena, records);
 		break;
 
 	/* Stuff we don't want to be meddling with right now */
@@ -1191,118 +1202,269 @@ normalize_key_records (GPtrArray *records)
 	}
 }
 
-typedef struct {
-	GcrOpenpgpCallback callback;
-	gpointer user_data;
-	guint count;
-	GBytes *backing;
-	GPtrArray *records;
-} openpgp_parse_closure;
+/* Below this much data it isn't worth starting threads */
+#define PARALLEL_MIN_SIZE (256 * 1024)
 
-static void
-openpgp_parse_free (gpointer data)
-{
-	openpgp_parse_closure *closure = data;
-	g_ptr_array_unref (closure->records);
-	g_bytes_unref (closure->backing);
-	g_free (closure);
-}
+/* How many blocks each thread may parse ahead of the callback */
+#define PARALLEL_WINDOW 8
 
 static void
-maybe_emit_openpgp_block (openpgp_parse_closure *closure,
-                          const guchar *block,
-                          const guchar *end)
+add_block (GArray *blocks,
+           const guchar *data,
+           const guchar *block,
+           const guchar *end)
 {
-	GBytes *outer;
-	gsize length;
-	GPtrArray *records;
+	GcrOpenpgpBlock info;
 
-	if (block == NULL || block == end)
-		return;
-
-	g_assert (end != NULL);
 	g_assert (end > block);
 
-	length = end - block;
-	closure->count++;
-
-	records = closure->records;
-	closure->records = g_ptr_array_new_with_free_func (_gcr_record_free);
-
-	outer = g_bytes_new_with_free_func (block, length, (GDestroyNotify)g_bytes_unref,
-	                                      g_bytes_ref (closure->backing));
-	if (closure->callback)
-		(closure->callback) (records, outer, closure->user_data);
-	g_bytes_unref (outer);
-
-	g_ptr_array_unref (records);
+	info.offset = block - data;
+	info.length = end - block;
+	g_array_append_val (blocks, info);
 }
 
-guint
-_gcr_openpgp_parse (GBytes *data,
-                    GcrOpenpgpParseFlags flags,
-                    GcrOpenpgpCallback callback,
-                    gpointer user_data)
+/*
+ * Finds where the blocks are in the data, only looking at the packet
+ * headers. Each block is a key with the packets that follow it when the
+ * %GCR_OPENPGP_PARSE_KEYS flag is set, otherwise a single packet. Parsing
+ * stops at the first invalid packet.
+ */
+GArray *
+_gcr_openpgp_find_blocks (GBytes *data,
+                          GcrOpenpgpParseFlags flags)
 {
-	openpgp_parse_closure *closure;
+	const guchar *start;
 	const guchar *at;
 	const guchar *beg;
 	const guchar *end;
 	const guchar *block;
+	gboolean new_key;
 	guint8 pkt_type;
 	GcrDataError res;
+	GArray *blocks;
 	gsize length;
-	gboolean new_key;
-	guint ret;
 
-	g_return_val_if_fail (data != NULL, 0);
-
-	/* For libgcrypt */
-	_gcr_initialize_library ();
+	g_return_val_if_fail (data != NULL, NULL);
 
-	at = g_bytes_get_data (data, NULL);
+	start = at = g_bytes_get_data (data, NULL);
 	end = at + g_bytes_get_size (data);
 	block = NULL;
 
-	closure = g_new0 (openpgp_parse_closure, 1);
-	closure->callback = callback;
-	closure->user_data = user_data;
-	closure->backing = g_bytes_ref (data);
-	closure->records = g_ptr_array_new_with_free_func (_gcr_record_free);
+	blocks = g_array_new (FALSE, FALSE, sizeof (GcrOpenpgpBlock));
 
 	while (at != NULL && at != end) {
 		beg = at;
 		res = read_openpgp_packet (&at, end, &pkt_type, &length);
 
-		if (res == GCR_SUCCESS) {
-			new_key = (pkt_type == OPENPGP_PKT_PUBLIC_KEY ||
-			           pkt_type == OPENPGP_PKT_SECRET_KEY);
-			if (flags & GCR_OPENPGP_PARSE_KEYS && new_key)
-				normalize_key_records (closure->records);
-			/* Start of a new set of packets, per key */
-			if (!(flags & GCR_OPENPGP_PARSE_KEYS) || new_key) {
-				maybe_emit_openpgp_block (closure, block, beg);
-				block = beg;
-			}
-			if (!(flags & GCR_OPENPGP_PARSE_NO_RECORDS))
-				parse_openpgp_packet (beg, at, at + length, pkt_type,
-				                      flags, closure->records);
-		}
-
 		if (res != GCR_SUCCESS) {
 			if (block != NULL && block != beg)
-				maybe_emit_openpgp_block (closure, block, beg);
+				add_block (blocks, start, block, beg);
 			block = NULL;
 			break;
 		}
 
+		/* Start of a new set of packets, per key */
+		new_key = (pkt_type == OPENPGP_PKT_PUBLIC_KEY ||
+		           pkt_type == OPENPGP_PKT_SECRET_KEY);
+		if (!(flags & GCR_OPENPGP_PARSE_KEYS) || new_key) {
+			if (block != NULL)
+				add_block (blocks, start, block, beg);
+			block = beg;
+		}
+
 		at += length;
 	}
 
+	if (block != NULL && block != at)
+		add_block (blocks, start, block, at);
+
+	return blocks;
+}
+
+static GPtrArray *
+parse_openpgp_block (const guchar *at,
+                     const guchar *end,
+                     GcrOpenpgpParseFlags flags)
+{
+	GcrRecordArena *arena;
+	GPtrArray *records;
+	const guchar *beg;
+	guint8 pkt_type;
+	gsize length;
+
+	records = g_ptr_array_new_with_free_func (_gcr_record_free);
+	if (flags & GCR_OPENPGP_PARSE_NO_RECORDS)
+		return records;
+
+	/* One arena per block, each record holds a reference to it */
+	arena = _gcr_record_arena_new ();
+
+	/* The packets were already checked when finding the blocks */
+	while (at != end) {
+		beg = at;
+		if (read_openpgp_packet (&at, end, &pkt_type, &length) != GCR_SUCCESS)
+			break;
+		parse_openpgp_packet (beg, at, at + length, pkt_type, flags, arena, records);
+		at += length;
+	}
+
+	_gcr_record_arena_unref (arena);
+
 	if (flags & GCR_OPENPGP_PARSE_KEYS)
-		normalize_key_records (closure->records);
-	maybe_emit_openpgp_block (closure, block, at);
-	ret = closure->count;
-	openpgp_parse_free (closure);
+		normalize_key_records (records);
+
+	return records;
+}
+
+static void
+emit_openpgp_block (GBytes *data,
+                    const GcrOpenpgpBlock *block,
+                    GPtrArray *records,
+                    GcrOpenpgpCallback callback,
+                    gpointer user_data)
+{
+	GBytes *outer;
+
+	outer = g_bytes_new_from_bytes (data, block->offset, block->length);
+	if (callback)
+		(callback) (records, outer, user_data);
+	g_bytes_unref (outer);
+}
+
+typedef struct {
+	GBytes *data;
+	GcrOpenpgpParseFlags flags;
+	GArray *blocks;
+	GPtrArray **results;
+	GMutex mutex;
+	GCond cond;
+} ParallelParse;
+
+static void
+parallel_parse_block (gpointer data,
+                      gpointer user_data)
+{
+	ParallelParse *parse = user_data;
+	guint i = GPOINTER_TO_UINT (data) - 1;
+	GcrOpenpgpBlock *block;
+	GPtrArray *records;
+	const guchar *start;
+
+	block = &g_array_index (parse->blocks, GcrOpenpgpBlock, i);
+	start = g_bytes_get_data (parse->data, NULL);
+	records = parse_openpgp_block (start + block->offset,
+	                               start + block->offset + block->length,
+	                               parse->flags);
+
+	g_mutex_lock (&parse->mutex);
+	parse->results[i] = records;
+	g_cond_broadcast (&parse->cond);
+	g_mutex_unlock (&parse->mutex);
+}
+
+/*
+ * Parses the blocks on a thread pool, but still calls the callback for
+ * each of them in order, from this thread.
+ */
+static void
+parse_blocks_parallel (GBytes *data,
+                       GcrOpenpgpParseFlags flags,
+                       GArray *blocks,
+                       guint n_threads,
+                       GcrOpenpgpCallback callback,
+                       gpointer user_data)
+{
+	ParallelParse parse = { data, flags, blocks, };
+	GThreadPool *pool;
+	GPtrArray *records;
+	guint window;
+	guint pushed;
+	guint i;
+
+	parse.results = g_new0 (GPtrArray *, blocks->len);
+	g_mutex_init (&parse.mutex);
+	g_cond_init (&parse.cond);
+
+	pool = g_thread_pool_new (parallel_parse_block, &parse, n_threads, FALSE, NULL);
+	window = n_threads * PARALLEL_WINDOW;
+
+	for (pushed = 0; pushed < blocks->len && pushed < window; pushed++)
+		g_thread_pool_push (pool, GUINT_TO_POINTER (pushed + 1), NULL);
+
+	for (i = 0; i < blocks->len; i++) {
+		g_mutex_lock (&parse.mutex);
+		while (parse.results[i] == NULL)
+			g_cond_wait (&parse.cond, &parse.mutex);
+		records = parse.results[i];
+		parse.results[i] = NULL;
+		g_mutex_unlock (&parse.mutex);
+
+		if (pushed < blocks->len)
+			g_thread_pool_push (pool, GUINT_TO_POINTER (++pushed), NULL);
+
+		emit_openpgp_block (data, &g_array_index (blocks, GcrOpenpgpBlock, i),
+		                    records, callback, user_data);
+		g_ptr_array_unref (records);
+	}
+
+	g_thread_pool_free (pool, FALSE, TRUE);
+	g_mutex_clear (&parse.mutex);
+	g_cond_clear (&parse.cond);
+	g_free (parse.results);
+}
+
+/*
+ * Parses the data in two passes: first the packet headers are scanned to
+ * find the blocks, and then each block is parsed on its own. Blocks don't
+ * depend on each other, so with %GCR_OPENPGP_PARSE_PARALLEL large data is
+ * parsed on several threads. The callback is always called in order.
+ *
+ * With %GCR_OPENPGP_PARSE_NO_RECORDS only the first pass is done, and the
+ * callback gets empty record arrays.
+ */
+guint
+_gcr_openpgp_parse (GBytes *data,
+                    GcrOpenpgpParseFlags flags,
+                    GcrOpenpgpCallback callback,
+                    gpointer user_data)
+{
+	GcrOpenpgpBlock *block;
+	GPtrArray *records;
+	const guchar *start;
+	GArray *blocks;
+	guint n_threads;
+	guint ret;
+	guint i;
+
+	g_return_val_if_fail (data != NULL, 0);
+
+	/* For libgcrypt */
+	_gcr_initialize_library ();
+
+	blocks = _gcr_openpgp_find_blocks (data, flags);
+	start = g_bytes_get_data (data, NULL);
+
+	n_threads = 1;
+	if (flags & GCR_OPENPGP_PARSE_PARALLEL &&
+	    !(flags & GCR_OPENPGP_PARSE_NO_RECORDS) &&
+	    g_bytes_get_size (data) >= PARALLEL_MIN_SIZE)
+		n_threads = MIN (g_get_num_processors (), blocks->len);
+
+	if (n_threads > 1) {
+		parse_blocks_parallel (data, flags, blocks, n_threads, callback, user_data);
+
+	} else {
+		for (i = 0; i < blocks->len; i++) {
+			block = &g_array_index (blocks, GcrOpenpgpBlock, i);
+			records = parse_openpgp_block (start + block->offset,
+			                               start + block->offset + block->length,
+			                               flags);
+			emit_openpgp_block (data, block, records, callback, user_data);
+			g_ptr_array_unref (records);
+		}
+	}
+
+	ret = blocks->len;
+	g_array_unref (blocks);
 	return ret;
 }
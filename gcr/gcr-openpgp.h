@@ -40,14 +40,23 @@ typedef enum {
 	GCR_OPENPGP_PARSE_NO_RECORDS = 1 << 2,
 	GCR_OPENPGP_PARSE_SIGNATURES = 1 << 3,
 	GCR_OPENPGP_PARSE_ATTRIBUTES = 1 << 4,
+	GCR_OPENPGP_PARSE_PARALLEL = 1 << 5,
 } GcrOpenpgpParseFlags;
 
+typedef struct {
+	gsize offset;
+	gsize length;
+} GcrOpenpgpBlock;
+
 G_BEGIN_DECLS
 
 typedef void             (*GcrOpenpgpCallback)             (GPtrArray *records,
                                                             GBytes *outer,
                                                             gpointer user_data);
 
+GArray *                 _gcr_openpgp_find_blocks          (GBytes *data,
+                                                            GcrOpenpgpParseFlags flags);
+
 guint                    _gcr_openpgp_parse                (GBytes *data,
                                                             GcrOpenpgpParseFlags flags,
                                                             GcrOpenpgpCallback callback,
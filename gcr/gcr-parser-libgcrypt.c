@@ -32,6 +32,30 @@
 
 EGG_SECURE_DECLARE (parser_libgcrypt);
 
+/* -----------------------------------------------------------------------------
+ * DERIVED KEYS
+ */
+
+static EggSymkeyCache *
+parser_get_symkeys (GcrParser *self)
+{
+	static GQuark quark = 0;
+	EggSymkeyCache *cache;
+
+	if (quark == 0)
+		quark = g_quark_from_static_string ("gcr-parser-symkeys");
+
+	/* Derived keys live as long as the passwords they came from */
+	cache = g_object_get_qdata (G_OBJECT (self), quark);
+	if (cache == NULL) {
+		cache = egg_symkey_cache_new ();
+		g_object_set_qdata_full (G_OBJECT (self), quark, cache,
+		                         egg_symkey_cache_free);
+	}
+
+	return cache;
+}
+
 #define SUCCESS 0
 
 /* -----------------------------------------------------------------------------
@@ -256,6 +280,9 @@ _gcr_parser_parse_der_pkcs8_encrypted (GcrParser *self,
 				       GBytes *data)
 {
 	PasswordState pstate = PASSWORD_STATE_INIT;
+	EggSymkeyCache *symkeys;
+	const gchar **passwords;
+	guint n_passwords;
 	GNode *asn = NULL;
 	gcry_cipher_hd_t cih = NULL;
 	gcry_error_t gcry;
@@ -286,6 +313,11 @@ _gcr_parser_parse_der_pkcs8_encrypted (GcrParser *self,
 
 	params = egg_asn1x_node (asn, "encryptionAlgorithm", "parameters", NULL);
 
+	/* Derive keys for all the passwords we already know in parallel */
+	symkeys = parser_get_symkeys (self);
+	passwords = _gcr_parser_get_passwords (self, &n_passwords);
+	egg_symkey_cache_prepare_cipher (symkeys, scheme, passwords, n_passwords, params);
+
 	/* Loop to try different passwords */
 	for (;;) {
 
@@ -298,7 +330,7 @@ _gcr_parser_parse_der_pkcs8_encrypted (GcrParser *self,
 		}
 
 		/* Parse the encryption stuff into a cipher. */
-		if (!egg_symkey_read_cipher (scheme, password, -1, params, &cih))
+		if (!egg_symkey_read_cipher_cached (symkeys, scheme, password, -1, params, &cih))
 			break;
 
 		crypted = egg_asn1x_get_string_as_raw (egg_asn1x_node (asn, "encryptedData", NULL), egg_secure_realloc, &n_crypted);
@@ -471,6 +503,9 @@ handle_pkcs12_encrypted_bag (GcrParser *self,
                              GNode *bag)
 {
 	PasswordState pstate = PASSWORD_STATE_INIT;
+	EggSymkeyCache *symkeys;
+	const gchar **passwords;
+	guint n_passwords;
 	GNode *asn = NULL;
 	gcry_cipher_hd_t cih = NULL;
 	gcry_error_t gcry;
@@ -501,6 +536,11 @@ handle_pkcs12_encrypted_bag (GcrParser *self,
 	if (!params)
 		goto done;
 
+	/* Derive keys for all the passwords we already know in parallel */
+	symkeys = parser_get_symkeys (self);
+	passwords = _gcr_parser_get_passwords (self, &n_passwords);
+	egg_symkey_cache_prepare_cipher (symkeys, scheme, passwords, n_passwords, params);
+
 	/* Loop to try different passwords */
 	for (;;) {
 
@@ -513,7 +553,7 @@ handle_pkcs12_encrypted_bag (GcrParser *self,
 		}
 
 		/* Parse the encryption stuff into a cipher. */
-		if (!egg_symkey_read_cipher (scheme, password, -1, params, &cih)) {
+		if (!egg_symkey_read_cipher_cached (symkeys, scheme, password, -1, params, &cih)) {
 			ret = GCR_ERROR_FAILURE;
 			goto done;
 		}
@@ -646,6 +686,9 @@ verify_pkcs12_safe (GcrParser *self,
                     GBytes *content)
 {
 	PasswordState pstate = PASSWORD_STATE_INIT;
+	EggSymkeyCache *symkeys;
+	const gchar **passwords;
+	guint n_passwords;
 	const gchar *password;
 	gcry_md_hd_t mdh = NULL;
 	const guchar *mac_digest;
@@ -676,6 +719,11 @@ verify_pkcs12_safe (GcrParser *self,
 	if (!digest)
 		goto done;
 
+	/* Derive keys for all the passwords we already know in parallel */
+	symkeys = parser_get_symkeys (self);
+	passwords = _gcr_parser_get_passwords (self, &n_passwords);
+	egg_symkey_cache_prepare_mac (symkeys, algorithm, passwords, n_passwords, mac_data);
+
 	/* Loop to try different passwords */
 	for (;;) {
 		g_assert (mdh == NULL);
@@ -687,7 +735,7 @@ verify_pkcs12_safe (GcrParser *self,
 		}
 
 		/* Parse the encryption stuff into a cipher. */
-		if (!egg_symkey_read_mac (algorithm, password, -1, mac_data, &mdh, &mac_len)) {
+		if (!egg_symkey_read_mac_cached (symkeys, algorithm, password, -1, mac_data, &mdh, &mac_len)) {
 			ret = GCR_ERROR_FAILURE;
 			goto done;
 		}
@@ -466,6 +466,16 @@ _gcr_enum_next_password (GcrParser *self,
 	return GCR_ERROR_LOCKED;
 }
 
+const gchar **
+_gcr_parser_get_passwords (GcrParser *self,
+                           guint *n_passwords)
+{
+	g_assert (n_passwords != NULL);
+
+	*n_passwords = self->pv->passwords->len;
+	return (const gchar **)self->pv->passwords->pdata;
+}
+
 void
 _gcr_parser_fire_parsed (GcrParser *self,
 			 GcrParsed *parsed)
@@ -43,9 +43,17 @@ enum {
 	PROP_INTERACTION,
 	PROP_SLOT,
 	PROP_QUEUED,
-	PROP_URI
+	PROP_URI,
+	PROP_WINDOW
 };
 
+enum {
+	PROGRESS,
+	NUM_SIGNALS
+};
+
+static guint signals[NUM_SIGNALS] = { 0, };
+
 struct _GcrPkcs11Importer {
 	GObject parent;
 	GckSlot *slot;
@@ -54,6 +62,7 @@ struct _GcrPkcs11Importer {
 	GQueue *queue;
 	GTlsInteraction *interaction;
 	gboolean any_private;
+	guint window;
 };
 
 typedef struct  {
@@ -61,13 +70,30 @@ typedef struct  {
 	gboolean prompted;
 	gboolean async;
 	GckBuilder *supplement;
+	guint created;
+	guint total;
 } GcrImporterData;
 
+/* A run of objects created in one go, on a worker thread */
+typedef struct {
+	GckSession *session;
+	GPtrArray *attrs;
+	GPtrArray *objects;
+} CreateBatch;
+
+/* A lookup of the queued certificates, on a worker thread */
+typedef struct {
+	GckSession *session;
+	GPtrArray *values;
+} FindExisting;
+
 /* frward declarations */
 static void   state_cancelled                  (GTask *task,
                                                 gboolean async);
 static void   state_create_object              (GTask *task,
                                                 gboolean async);
+static void   state_find_existing              (GTask *task,
+                                                gboolean async);
 static void   _gcr_pkcs11_importer_init_iface  (GcrImporterInterface *iface);
 
 G_DEFINE_TYPE_WITH_CODE (GcrPkcs11Importer, _gcr_pkcs11_importer, G_TYPE_OBJECT,
@@ -76,6 +102,9 @@ G_DEFINE_TYPE_WITH_CODE (GcrPkcs11Importer, _gcr_pkcs11_importer, G_TYPE_OBJECT,
 
 #define BLOCK 4096
 
+/* Objects created per round trip to a worker thread */
+#define DEFAULT_WINDOW 64
+
 static void
 gcr_importer_data_free (gpointer data)
 {
@@ -123,33 +152,85 @@ state_cancelled (GTask *task,
  */
 
 static void
-complete_create_object (GTask *task,
-                        GckObject *object,
-                        GError *error)
+create_batch_free (gpointer data)
+{
+	CreateBatch *batch = data;
+
+	g_object_unref (batch->session);
+	g_ptr_array_unref (batch->attrs);
+	g_ptr_array_unref (batch->objects);
+	g_free (batch);
+}
+
+static gboolean
+create_batch_objects (CreateBatch *batch,
+                      GCancellable *cancellable,
+                      GError **error)
+{
+	GckObject *object;
+	guint i;
+
+	for (i = 0; i < batch->attrs->len; i++) {
+		object = gck_session_create_object (batch->session, batch->attrs->pdata[i],
+		                                    cancellable, error);
+		if (object == NULL)
+			return FALSE;
+		g_ptr_array_add (batch->objects, object);
+	}
+
+	return TRUE;
+}
+
+static void
+thread_create_batch (GTask *task,
+                     gpointer source_object,
+                     gpointer task_data,
+                     GCancellable *cancellable)
+{
+	GError *error = NULL;
+
+	if (create_batch_objects (task_data, cancellable, &error))
+		g_task_return_boolean (task, TRUE);
+	else
+		g_task_return_error (task, g_steal_pointer (&error));
+}
+
+static void
+complete_create_batch (GTask *task,
+                       CreateBatch *batch,
+                       GError *error)
 {
 	GcrImporterData *data = g_task_get_task_data (task);
 	GcrPkcs11Importer *self = data->importer;
+	GList *created = NULL;
+	guint i;
 
-	if (object == NULL) {
-		g_task_return_error (task, g_steal_pointer (&error));
+	/* Objects created before any failure are still imported */
+	for (i = batch->objects->len; i > 0; i--)
+		created = g_list_prepend (created, g_object_ref (batch->objects->pdata[i - 1]));
+	self->objects = g_list_concat (self->objects, created);
+	data->created += batch->objects->len;
 
+	if (batch->objects->len > 0)
+		g_signal_emit (self, signals[PROGRESS], 0, data->created, data->total);
+
+	if (error != NULL) {
+		g_task_return_error (task, g_steal_pointer (&error));
 	} else {
-		self->objects = g_list_append (self->objects, object);
 		next_state (task, state_create_object);
 	}
 }
 
 static void
-on_create_object (GObject *source,
-                  GAsyncResult *result,
-                  gpointer user_data)
+on_create_batch (GObject *source,
+                 GAsyncResult *result,
+                 gpointer user_data)
 {
 	GTask *task = G_TASK (user_data);
 	GError *error = NULL;
-	GckObject *object;
 
-	object = gck_session_create_object_finish (GCK_SESSION (source), result, &error);
-	complete_create_object (task, object, error);
+	g_task_propagate_boolean (G_TASK (result), &error);
+	complete_create_batch (task, g_task_get_task_data (G_TASK (result)), error);
 	g_clear_object (&task);
 }
 
@@ -160,31 +241,278 @@ state_create_object (GTask *task,
 	GcrImporterData *data = g_task_get_task_data (task);
 	GCancellable *cancellable = g_task_get_cancellable (task);
 	GcrPkcs11Importer *self = data->importer;
-	GckAttributes *attrs;
-	GckObject *object;
+	CreateBatch *batch;
 	GError *error = NULL;
+	GTask *thread;
 
 	/* No more objects */
 	if (g_queue_is_empty (self->queue)) {
 		g_task_return_boolean (task, TRUE);
+		return;
+	}
 
+	/*
+	 * A session can't be used by two threads at once, so the batches
+	 * go one after another. But each one is a single round trip.
+	 */
+	batch = g_new0 (CreateBatch, 1);
+	batch->session = g_object_ref (self->session);
+	batch->attrs = g_ptr_array_new_with_free_func ((GDestroyNotify)gck_attributes_unref);
+	batch->objects = g_ptr_array_new_with_free_func (g_object_unref);
+	while (batch->attrs->len < self->window && !g_queue_is_empty (self->queue))
+		g_ptr_array_add (batch->attrs, g_queue_pop_head (self->queue));
+
+	if (async) {
+		thread = g_task_new (self, cancellable, on_create_batch, g_object_ref (task));
+		g_task_set_source_tag (thread, state_create_object);
+		g_task_set_task_data (thread, batch, create_batch_free);
+		g_task_run_in_thread (thread, thread_create_batch);
+		g_object_unref (thread);
 	} else {
+		create_batch_objects (batch, cancellable, &error);
+		complete_create_batch (task, batch, error);
+		create_batch_free (batch);
+	}
+}
 
-		/* Pop first one off the list */
-		attrs = g_queue_pop_head (self->queue);
-		g_assert (attrs != NULL);
+/* ---------------------------------------------------------------------------------
+ * SKIPPING EXISTING
+ */
 
-		if (async) {
-			gck_session_create_object_async (self->session, attrs,
-			                                 cancellable, on_create_object,
-			                                 g_object_ref (task));
-		} else {
-			object = gck_session_create_object (self->session, attrs,
-			                                    cancellable, &error);
-			complete_create_object (task, object, error);
+/* The values of the queued certificates */
+static GPtrArray *
+queue_certificate_values (GQueue *queue)
+{
+	const GckAttribute *value;
+	GPtrArray *values;
+	gulong klass;
+	GList *l;
+
+	values = g_ptr_array_new_with_free_func ((GDestroyNotify)g_bytes_unref);
+
+	for (l = queue->head; l != NULL; l = g_list_next (l)) {
+		if (!gck_attributes_find_ulong (l->data, CKA_CLASS, &klass) ||
+		    klass != CKO_CERTIFICATE)
+			continue;
+
+		value = gck_attributes_find (l->data, CKA_VALUE);
+		if (value != NULL && !gck_attribute_is_invalid (value))
+			g_ptr_array_add (values, g_bytes_new (value->value, value->length));
+	}
+
+	return values;
+}
+
+static void
+find_existing_free (gpointer data)
+{
+	FindExisting *find = data;
+
+	g_object_unref (find->session);
+	g_ptr_array_unref (find->values);
+	g_free (find);
+}
+
+/*
+ * Which of the queued certificates are already on the token. The value
+ * is part of the match, so the token does the comparing, rather than us
+ * reading back every certificate on it.
+ */
+static GHashTable *
+find_existing_certificates (FindExisting *find,
+                            GCancellable *cancellable,
+                            GError **error)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GckAttributes *match;
+	GHashTable *existing;
+	GError *err = NULL;
+	gulong *handles;
+	gulong n_handles;
+	GBytes *value;
+	guint i;
+
+	existing = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+	                                  (GDestroyNotify)g_bytes_unref, NULL);
+
+	for (i = 0; i < find->values->len; i++) {
+		value = find->values->pdata[i];
+		if (g_hash_table_contains (existing, value))
+			continue;
+
+		gck_builder_add_ulong (&builder, CKA_CLASS, CKO_CERTIFICATE);
+		gck_builder_add_data (&builder, CKA_VALUE, g_bytes_get_data (value, NULL),
+		                      g_bytes_get_size (value));
+		match = gck_builder_end (&builder);
+
+		n_handles = 0;
+		handles = gck_session_find_handles (find->session, match, cancellable,
+		                                    &n_handles, &err);
+		gck_attributes_unref (match);
+
+		if (err != NULL) {
+			g_propagate_error (error, err);
+			g_hash_table_unref (existing);
+			return NULL;
 		}
 
-		gck_attributes_unref (attrs);
+		if (n_handles > 0)
+			g_hash_table_add (existing, g_bytes_ref (value));
+		g_free (handles);
+	}
+
+	return existing;
+}
+
+static void
+thread_find_existing (GTask *task,
+                      gpointer source_object,
+                      gpointer task_data,
+                      GCancellable *cancellable)
+{
+	GHashTable *existing;
+	GError *error = NULL;
+
+	existing = find_existing_certificates (task_data, cancellable, &error);
+	if (existing != NULL)
+		g_task_return_pointer (task, existing, (GDestroyNotify)g_hash_table_unref);
+	else
+		g_task_return_error (task, g_steal_pointer (&error));
+}
+
+/*
+ * Drop certificates that are already on the token. Certificates that
+ * were paired with a key get the same CKA_ID as it, so they're kept.
+ */
+static void
+skip_existing_certificates (GcrPkcs11Importer *self,
+                            GHashTable *existing)
+{
+	const GckAttribute *value;
+	const GckAttribute *id;
+	GHashTable *key_ids;
+	GBytes *bytes;
+	gulong klass;
+	gboolean skip;
+	GList *l, *next;
+	guint skipped = 0;
+
+	key_ids = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+	                                 (GDestroyNotify)g_bytes_unref, NULL);
+
+	for (l = self->queue->head; l != NULL; l = g_list_next (l)) {
+		id = gck_attributes_find (l->data, CKA_ID);
+		if (id != NULL && !gck_attribute_is_invalid (id) &&
+		    gck_attributes_find_ulong (l->data, CKA_CLASS, &klass) &&
+		    klass == CKO_PRIVATE_KEY)
+			g_hash_table_add (key_ids, g_bytes_new (id->value, id->length));
+	}
+
+	for (l = self->queue->head; l != NULL; l = next) {
+		next = g_list_next (l);
+
+		if (!gck_attributes_find_ulong (l->data, CKA_CLASS, &klass) ||
+		    klass != CKO_CERTIFICATE)
+			continue;
+
+		value = gck_attributes_find (l->data, CKA_VALUE);
+		if (value == NULL || gck_attribute_is_invalid (value))
+			continue;
+
+		bytes = g_bytes_new_static (value->value, value->length);
+		skip = g_hash_table_contains (existing, bytes);
+		g_bytes_unref (bytes);
+
+		id = gck_attributes_find (l->data, CKA_ID);
+		if (skip && id != NULL) {
+			bytes = g_bytes_new_static (id->value, id->length);
+			skip = !g_hash_table_contains (key_ids, bytes);
+			g_bytes_unref (bytes);
+		}
+
+		if (skip) {
+			gck_attributes_unref (l->data);
+			g_queue_delete_link (self->queue, l);
+			skipped++;
+		}
+	}
+
+	if (skipped > 0)
+		g_debug ("skipping %u certificates already on the token", skipped);
+
+	g_hash_table_destroy (key_ids);
+}
+
+static void
+complete_find_existing (GTask *task,
+                        GHashTable *existing,
+                        GError *error)
+{
+	GcrImporterData *data = g_task_get_task_data (task);
+	GcrPkcs11Importer *self = data->importer;
+
+	if (existing == NULL) {
+		g_task_return_error (task, g_steal_pointer (&error));
+		return;
+	}
+
+	skip_existing_certificates (self, existing);
+	g_hash_table_unref (existing);
+
+	data->total = g_queue_get_length (self->queue);
+	next_state (task, state_create_object);
+}
+
+static void
+on_find_existing (GObject *source,
+                  GAsyncResult *result,
+                  gpointer user_data)
+{
+	GTask *task = G_TASK (user_data);
+	GHashTable *existing;
+	GError *error = NULL;
+
+	existing = g_task_propagate_pointer (G_TASK (result), &error);
+	complete_find_existing (task, existing, error);
+	g_clear_object (&task);
+}
+
+static void
+state_find_existing (GTask *task,
+                     gboolean async)
+{
+	GcrImporterData *data = g_task_get_task_data (task);
+	GCancellable *cancellable = g_task_get_cancellable (task);
+	GcrPkcs11Importer *self = data->importer;
+	GHashTable *existing;
+	FindExisting *find;
+	GError *error = NULL;
+	GPtrArray *values;
+	GTask *thread;
+
+	values = queue_certificate_values (self->queue);
+	if (values->len == 0) {
+		g_ptr_array_unref (values);
+		data->total = g_queue_get_length (self->queue);
+		next_state (task, state_create_object);
+		return;
+	}
+
+	find = g_new0 (FindExisting, 1);
+	find->session = g_object_ref (self->session);
+	find->values = values;
+
+	if (async) {
+		thread = g_task_new (self, cancellable, on_find_existing, g_object_ref (task));
+		g_task_set_source_tag (thread, state_find_existing);
+		g_task_set_task_data (thread, find, find_existing_free);
+		g_task_run_in_thread (thread, thread_find_existing);
+		g_object_unref (thread);
+
+	} else {
+		existing = find_existing_certificates (find, cancellable, &error);
+		complete_find_existing (task, existing, error);
+		find_existing_free (find);
 	}
 }
 
@@ -392,7 +720,7 @@ complete_supplement (GTask *task,
 		supplement_attributes (data->importer, attributes);
 		gck_attributes_unref (attributes);
 
-		next_state (task, state_create_object);
+		next_state (task, state_find_existing);
 	} else {
 		g_task_return_error (task, g_steal_pointer (&error));
 	}
@@ -535,6 +863,7 @@ static void
 _gcr_pkcs11_importer_init (GcrPkcs11Importer *self)
 {
 	self->queue = g_queue_new ();
+	self->window = DEFAULT_WINDOW;
 }
 
 static void
@@ -581,6 +910,9 @@ _gcr_pkcs11_importer_set_property (GObject *obj,
 		self->interaction = g_value_dup_object (value);
 		g_object_notify (G_OBJECT (self), "interaction");
 		break;
+	case PROP_WINDOW:
+		self->window = g_value_get_uint (value);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
 		break;
@@ -639,6 +971,9 @@ _gcr_pkcs11_importer_get_property (GObject *obj,
 	case PROP_URI:
 		g_value_take_string (value, calculate_uri (self));
 		break;
+	case PROP_WINDOW:
+		g_value_set_uint (value, self->window);
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (obj, prop_id, pspec);
 		break;
@@ -669,6 +1004,22 @@ _gcr_pkcs11_importer_class_init (GcrPkcs11ImporterClass *klass)
 		g_param_spec_pointer ("queued", "Queued", "Queued attributes",
 		                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
+	g_object_class_install_property (gobject_class, PROP_WINDOW,
+		g_param_spec_uint ("window", "Window", "Objects to create per round trip",
+		                   1, G_MAXUINT, DEFAULT_WINDOW,
+		                   G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+	/**
+	 * GcrPkcs11Importer::progress:
+	 * @created: number of objects created so far
+	 * @total: number of objects to create
+	 *
+	 * Emitted as objects are created on the token during an import.
+	 */
+	signals[PROGRESS] = g_signal_new ("progress", GCR_TYPE_PKCS11_IMPORTER,
+	                                  G_SIGNAL_RUN_LAST, 0, NULL, NULL, NULL,
+	                                  G_TYPE_NONE, 2, G_TYPE_UINT, G_TYPE_UINT);
+
 	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_CERTIFICATE);
 	gck_builder_add_ulong (&builder, CKA_CERTIFICATE_TYPE, CKC_X_509);
 	gcr_importer_register (GCR_TYPE_PKCS11_IMPORTER, gck_builder_end (&builder));
@@ -858,6 +1209,13 @@ _gcr_pkcs11_importer_get_queued (GcrPkcs11Importer *self)
 	return g_list_copy (self->queue->head);
 }
 
+GList *
+_gcr_pkcs11_importer_get_imported (GcrPkcs11Importer *self)
+{
+	g_return_val_if_fail (GCR_IS_PKCS11_IMPORTER (self), NULL);
+	return g_list_copy (self->objects);
+}
+
 void
 _gcr_pkcs11_importer_queue (GcrPkcs11Importer *self,
                             const gchar *label,
@@ -36,15 +36,186 @@ typedef struct {
 	/* Hangs off the end */
 } GcrRecordBlock;
 
+/*
+ * Many records parsed out of the same data share one of these, the
+ * columns point into it.
+ */
+typedef struct {
+	gint refs;
+	gsize size;
+	gchar data[1];
+	/* Hangs off the end */
+} GcrRecordBuffer;
+
+typedef struct _GcrRecordChunk {
+	struct _GcrRecordChunk *next;
+	gsize size;
+	gsize used;
+	gchar data[1];
+	/* Hangs off the end */
+} GcrRecordChunk;
+
+/*
+ * The records of a set, along with their values, can be allocated from
+ * an arena. Each record holds a reference, and it's all freed at once with
+ * the last one. Allocating from an arena is not thread safe.
+ */
+struct _GcrRecordArena {
+	gint refs;
+	GcrRecordChunk *chunks;
+};
+
+#define ARENA_CHUNK_MIN    4096
+#define ARENA_CHUNK_MAX    (64 * 1024)
+#define ARENA_ALIGN        sizeof (gpointer)
+
 struct _GcrRecord {
 	GcrRecordBlock *block;
-	const gchar *columns[MAX_COLUMNS];
-	guint n_columns;
+	GcrRecordBuffer *buffer;
+	GcrRecordArena *arena;
+	guint16 n_columns;
 	gchar delimiter;
+	const gchar *columns[1];
+	/* Sized to the number of columns */
 };
 
 G_DEFINE_BOXED_TYPE (GcrRecord, _gcr_record, _gcr_record_copy, _gcr_record_free);
 
+static GcrRecordBuffer *
+record_buffer_new (gsize size)
+{
+	GcrRecordBuffer *buffer;
+
+	buffer = g_malloc (sizeof (GcrRecordBuffer) + size);
+	buffer->refs = 1;
+	buffer->size = size;
+	buffer->data[0] = 0;
+
+	return buffer;
+}
+
+static GcrRecordBuffer *
+record_buffer_ref (GcrRecordBuffer *buffer)
+{
+	g_atomic_int_inc (&buffer->refs);
+	return buffer;
+}
+
+static void
+record_buffer_unref (GcrRecordBuffer *buffer)
+{
+	if (buffer && g_atomic_int_dec_and_test (&buffer->refs))
+		g_free (buffer);
+}
+
+static GcrRecordChunk *
+arena_chunk_new (gsize size)
+{
+	GcrRecordChunk *chunk;
+
+	chunk = g_malloc (G_STRUCT_OFFSET (GcrRecordChunk, data) + size);
+	chunk->next = NULL;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
+
+static gpointer
+arena_alloc (GcrRecordArena *arena,
+             gsize size)
+{
+	GcrRecordChunk *chunk;
+	GcrRecordChunk *large;
+	gsize chunk_size;
+	gpointer result;
+
+	size = (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+	chunk = arena->chunks;
+
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		chunk_size = chunk ? MIN (chunk->size * 2, ARENA_CHUNK_MAX) : ARENA_CHUNK_MIN;
+
+		/* Big allocations get their own chunk, behind the current one */
+		if (size > chunk_size / 4) {
+			large = arena_chunk_new (size);
+			large->used = size;
+			if (chunk != NULL) {
+				large->next = chunk->next;
+				chunk->next = large;
+			} else {
+				arena->chunks = large;
+			}
+			return large->data;
+		}
+
+		chunk = arena_chunk_new (chunk_size);
+		chunk->next = arena->chunks;
+		arena->chunks = chunk;
+	}
+
+	result = chunk->data + chunk->used;
+	chunk->used += size;
+	return result;
+}
+
+GcrRecordArena *
+_gcr_record_arena_new (void)
+{
+	GcrRecordArena *arena;
+
+	arena = g_new0 (GcrRecordArena, 1);
+	arena->refs = 1;
+
+	return arena;
+}
+
+GcrRecordArena *
+_gcr_record_arena_ref (GcrRecordArena *arena)
+{
+	g_return_val_if_fail (arena != NULL, NULL);
+	g_atomic_int_inc (&arena->refs);
+	return arena;
+}
+
+void
+_gcr_record_arena_unref (GcrRecordArena *arena)
+{
+	GcrRecordChunk *chunk, *next;
+
+	if (arena == NULL || !g_atomic_int_dec_and_test (&arena->refs))
+		return;
+
+	for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		g_free (chunk);
+	}
+
+	g_free (arena);
+}
+
+static GcrRecord *
+record_alloc (GcrRecordArena *arena,
+              guint n_columns)
+{
+	GcrRecord *record;
+	gsize size;
+
+	g_assert (n_columns <= MAX_COLUMNS);
+
+	size = G_STRUCT_OFFSET (GcrRecord, columns) + MAX (n_columns, 1) * sizeof (gchar *);
+	if (arena != NULL) {
+		record = arena_alloc (arena, size);
+		memset (record, 0, size);
+		record->arena = _gcr_record_arena_ref (arena);
+	} else {
+		record = g_malloc0 (size);
+	}
+
+	record->n_columns = n_columns;
+	return record;
+}
+
 static GcrRecordBlock *
 record_block_new (const gchar *value,
                   gsize length)
@@ -99,7 +270,7 @@ record_flatten (GcrRecord *record)
 		total += strlen (record->columns[i]) + 1;
 
 	/* Allocate a new GcrRecordData which will hold all that */
-	result = g_new0 (GcrRecord, 1);
+	result = record_alloc (NULL, record->n_columns);
 	result->block = block = record_block_new (NULL, total);
 
 	at = 0;
@@ -110,7 +281,6 @@ record_flatten (GcrRecord *record)
 		at += len + 1;
 	}
 
-	result->n_columns = record->n_columns;
 	result->delimiter = record->delimiter;
 	g_assert (at == total);
 
@@ -141,62 +311,71 @@ _gcr_record_format (GcrRecord *record)
 	return g_string_free (string, FALSE);
 }
 
+/*
+ * Allocates the record and the values set on it from @arena when it's
+ * not %NULL. The record must still be freed with _gcr_record_free().
+ */
 GcrRecord *
-_gcr_record_new (GQuark schema,
-                 guint n_columns,
-                 gchar delimiter)
+_gcr_record_new_in (GcrRecordArena *arena,
+                    GQuark schema,
+                    guint n_columns,
+                    gchar delimiter)
 {
 	GcrRecord *result;
 	guint i;
 
-	result = g_new0 (GcrRecord, 1);
-	result->block = NULL;
+	g_return_val_if_fail (n_columns > 0 && n_columns <= MAX_COLUMNS, NULL);
+
+	result = record_alloc (arena, n_columns);
 	result->delimiter = delimiter;
 
 	for (i = 0; i < n_columns; i++)
 		result->columns[i] = "";
 	result->columns[0] = g_quark_to_string (schema);
-	result->n_columns = n_columns;
 
 	return result;
 }
 
+GcrRecord *
+_gcr_record_new (GQuark schema,
+                 guint n_columns,
+                 gchar delimiter)
+{
+	return _gcr_record_new_in (NULL, schema, n_columns, delimiter);
+}
+
 GcrRecord *
 _gcr_record_copy (GcrRecord *record)
 {
 	return record_flatten (record);
 }
 
-static GcrRecord *
-take_and_parse_internal (GcrRecordBlock *block,
-                         gchar delimiter,
-                         gboolean allow_empty)
+static gboolean
+parse_columns (const gchar **columns,
+               guint *n_columns,
+               gchar *line,
+               gsize n_line,
+               gchar delimiter,
+               gboolean allow_empty)
 {
-	GcrRecord *result;
 	gchar *at, *beg, *end;
 
-	g_assert (block);
-
-	result = g_new0 (GcrRecord, 1);
-	result->block = block;
-	result->delimiter = delimiter;
-
-	g_debug ("parsing line %s", block->value);
+	g_debug ("parsing line %s", line);
 
-	at = block->value;
+	*n_columns = 0;
+	at = line;
 	for (;;) {
-		if (result->n_columns >= MAX_COLUMNS) {
+		if (*n_columns >= MAX_COLUMNS) {
 			g_debug ("too many record (%d) in gnupg line", MAX_COLUMNS);
-			_gcr_record_free (result);
-			return NULL;
+			return FALSE;
 		}
 
 		beg = at;
-		result->columns[result->n_columns] = beg;
+		columns[*n_columns] = beg;
 
 		at = strchr (beg, delimiter);
 		if (at == NULL) {
-			end = (block->value + block->n_value) - 1;
+			end = (line + n_line) - 1;
 		} else {
 			at[0] = '\0';
 			end = at;
@@ -204,12 +383,72 @@ take_and_parse_internal (GcrRecordBlock *block,
 		}
 
 		if (allow_empty || end > beg)
-			result->n_columns++;
+			(*n_columns)++;
 
 		if (at == NULL)
 			break;
 	}
 
+	return TRUE;
+}
+
+static GcrRecord *
+parse_internal (GcrRecordArena *arena,
+                gchar *line,
+                gsize n_line,
+                gchar delimiter,
+                gboolean allow_empty)
+{
+	const gchar *columns[MAX_COLUMNS];
+	GcrRecord *result;
+	guint n_columns;
+
+	if (!parse_columns (columns, &n_columns, line, n_line, delimiter, allow_empty))
+		return NULL;
+
+	result = record_alloc (arena, n_columns);
+	result->delimiter = delimiter;
+	memcpy (result->columns, columns, n_columns * sizeof (gchar *));
+
+	return result;
+}
+
+static GcrRecord *
+take_and_parse_internal (GcrRecordBlock *block,
+                         gchar delimiter,
+                         gboolean allow_empty)
+{
+	GcrRecord *result;
+
+	g_assert (block);
+
+	result = parse_internal (NULL, block->value, block->n_value, delimiter, allow_empty);
+	if (result == NULL)
+		g_free (block);
+	else
+		result->block = block;
+
+	return result;
+}
+
+/* The line must be null terminated, and is modified in place */
+static GcrRecord *
+parse_shared_internal (GcrRecordBuffer *buffer,
+                       gchar *line,
+                       gsize n_line,
+                       gchar delimiter,
+                       gboolean allow_empty)
+{
+	GcrRecord *result;
+
+	g_assert (buffer);
+	g_assert (line >= buffer->data && line + n_line < buffer->data + buffer->size);
+	g_assert (line[n_line] == '\0');
+
+	result = parse_internal (NULL, line, n_line, delimiter, allow_empty);
+	if (result != NULL)
+		result->buffer = record_buffer_ref (buffer);
+
 	return result;
 }
 
@@ -243,12 +482,61 @@ record_take_column (GcrRecord *record,
                     guint column,
                     GcrRecordBlock *block)
 {
+	gchar *value;
+
+	g_assert (column < record->n_columns);
+
+	/* Values of arena records go in the arena too */
+	if (record->arena != NULL) {
+		value = arena_alloc (record->arena, block->n_value + 1);
+		memcpy (value, block->value, block->n_value + 1);
+		record->columns[column] = value;
+		g_free (block);
+		return;
+	}
+
 	g_assert (block->next == NULL);
 	block->next = record->block;
 	record->block = block;
+	record->columns[column] = block->value;
+}
+
+/* Room for a value of @length, set as the column */
+static gchar *
+record_alloc_column (GcrRecord *record,
+                     guint column,
+                     gsize length)
+{
+	GcrRecordBlock *block;
+	gchar *value;
 
 	g_assert (column < record->n_columns);
-	record->columns[column] = block->value;
+
+	if (record->arena != NULL) {
+		value = arena_alloc (record->arena, length + 1);
+	} else {
+		block = record_block_new (NULL, length);
+		block->next = record->block;
+		record->block = block;
+		value = block->value;
+	}
+
+	value[0] = 0;
+	record->columns[column] = value;
+	return value;
+}
+
+static void
+record_set_column (GcrRecord *record,
+                   guint column,
+                   const gchar *value,
+                   gsize length)
+{
+	gchar *copy;
+
+	copy = record_alloc_column (record, column, length);
+	memcpy (copy, value, length);
+	copy[length] = 0;
 }
 
 static const char HEXC_LOWER[] = "0123456789abcdef";
@@ -447,7 +735,6 @@ _gcr_record_set_string (GcrRecord *record,
                         guint column,
                         const gchar *string)
 {
-	GcrRecordBlock *block;
 	gchar *escaped;
 
 	g_return_if_fail (record != NULL);
@@ -455,12 +742,14 @@ _gcr_record_set_string (GcrRecord *record,
 	g_return_if_fail (column < record->n_columns);
 
 	escaped = c_colons_escape (string, record->delimiter, NULL);
-	if (escaped != NULL)
-		block = record_block_take (escaped, strlen (escaped));
-	else
-		block = record_block_new (string, strlen (string));
-
-	record_take_column (record, column, block);
+	if (escaped != NULL && record->arena == NULL) {
+		record_take_column (record, column, record_block_take (escaped, strlen (escaped)));
+	} else {
+		if (escaped != NULL)
+			string = escaped;
+		record_set_column (record, column, string, strlen (string));
+		g_free (escaped);
+	}
 }
 
 gchar
@@ -490,7 +779,7 @@ _gcr_record_set_char (GcrRecord *record,
 	g_return_if_fail (column < record->n_columns);
 	g_return_if_fail (value != 0);
 
-	record_take_column (record, column, record_block_new (&value, 1));
+	record_set_column (record, column, &value, 1);
 }
 
 gboolean
@@ -527,14 +816,14 @@ _gcr_record_set_uint (GcrRecord *record,
                       guint column,
                       guint value)
 {
-	gchar *escaped;
+	gchar digits[16];
+	gint length;
 
 	g_return_if_fail (record != NULL);
 	g_return_if_fail (column < record->n_columns);
 
-	escaped = g_strdup_printf ("%u", value);
-	record_take_column (record, column,
-	                    record_block_take (escaped, strlen (escaped)));
+	length = g_snprintf (digits, sizeof (digits), "%u", value);
+	record_set_column (record, column, digits, length);
 }
 
 gboolean
@@ -574,14 +863,14 @@ _gcr_record_set_ulong (GcrRecord *record,
                        guint column,
                        gulong value)
 {
-	gchar *escaped;
+	gchar digits[32];
+	gint length;
 
 	g_return_if_fail (record != NULL);
 	g_return_if_fail (column < record->n_columns);
 
-	escaped = g_strdup_printf ("%lu", value);
-	record_take_column (record, column,
-	                    record_block_take (escaped, strlen (escaped)));
+	length = g_snprintf (digits, sizeof (digits), "%lu", value);
+	record_set_column (record, column, digits, length);
 }
 
 GDateTime *
@@ -647,28 +936,27 @@ _gcr_record_set_base64 (GcrRecord *record,
                         gconstpointer data,
                         gsize n_data)
 {
-	GcrRecordBlock *block;
 	gint state, save;
 	gsize estimate;
 	gsize length;
+	gchar *value;
 
 	g_return_if_fail (record != NULL);
 	g_return_if_fail (column < record->n_columns);
 
 	estimate = n_data * 4 / 3 + n_data * 4 / (3 * 65) + 7;
-	block = record_block_new (NULL, estimate);
+	value = record_alloc_column (record, column, estimate);
 
 	/* The actual base64 data, without line breaks */
 	state = save = 0;
 	length = g_base64_encode_step ((guchar *)data, n_data, FALSE,
-	                               block->value, &state, &save);
-	length += g_base64_encode_close (TRUE, block->value + length,
+	                               value, &state, &save);
+	length += g_base64_encode_close (TRUE, value + length,
 	                                 &state, &save);
-	block->value[length] = 0;
+	value[length] = 0;
 	g_assert (length < estimate);
 
-	g_strchomp (block->value);
-	record_take_column (record, column, block);
+	g_strchomp (value);
 }
 
 const gchar*
@@ -694,8 +982,7 @@ _gcr_record_set_raw (GcrRecord *record,
 	g_return_if_fail (value != NULL);
 	g_return_if_fail (column < record->n_columns);
 
-	record_take_column (record, column,
-	                    record_block_new (value, strlen (value)));
+	record_set_column (record, column, value, strlen (value));
 }
 
 void
@@ -707,8 +994,12 @@ _gcr_record_take_raw (GcrRecord *record,
 	g_return_if_fail (value != NULL);
 	g_return_if_fail (column < record->n_columns);
 
-	record_take_column (record, column,
-	                    record_block_take (value, strlen (value)));
+	if (record->arena != NULL) {
+		record_set_column (record, column, value, strlen (value));
+		g_free (value);
+	} else {
+		record_take_column (record, column, record_block_take (value, strlen (value)));
+	}
 }
 
 void
@@ -720,11 +1011,18 @@ _gcr_record_free (gpointer record)
 	if (!record)
 		return;
 
+	/* Everything else is in the arena */
+	if (rec->arena != NULL) {
+		_gcr_record_arena_unref (rec->arena);
+		return;
+	}
+
 	for (block = rec->block; block != NULL; block = next) {
 		next = block->next;
 		g_free (block);
 	}
 
+	record_buffer_unref (rec->buffer);
 	g_free (record);
 }
 
@@ -772,84 +1070,236 @@ _gcr_records_format (GPtrArray *records)
 	return g_string_free (string, FALSE);
 }
 
-static gchar **
-strnsplit (const gchar *string,
-           gsize length,
-           gchar delimiter)
-{
-  GSList *string_list = NULL, *slist;
-  gchar **str_array, *s;
-  guint n = 0;
-  const gchar *remainder;
-  const gchar *end;
-
-  g_return_val_if_fail (string != NULL, NULL);
-  g_return_val_if_fail (delimiter != '\0', NULL);
-
-  end = string + length;
-  remainder = string;
-  s = memchr (remainder, delimiter, end - remainder);
-  if (s)
-    {
-      while (s)
-        {
-          gsize len;
-
-          len = s - remainder;
-          string_list = g_slist_prepend (string_list,
-                                         g_strndup (remainder, len));
-          n++;
-          remainder = s + 1;
-          s = memchr (remainder, delimiter, end - remainder);
-        }
-    }
-  if (*string)
-    {
-      n++;
-      string_list = g_slist_prepend (string_list, g_strndup (remainder, end - remainder));
-    }
-
-  str_array = g_new (gchar*, n + 1);
-
-  str_array[n--] = NULL;
-  for (slist = string_list; slist; slist = slist->next)
-    str_array[n--] = slist->data;
-
-  g_slist_free (string_list);
-
-  return str_array;
-}
-
+/*
+ * The records are all allocated from one arena, along with a single
+ * copy of the data.
+ */
 GPtrArray *
 _gcr_records_parse_colons (gconstpointer data,
                            gssize n_data)
 {
-	GPtrArray *result = NULL;
-	GcrRecordBlock *block;
+	GcrRecordArena *arena;
+	GPtrArray *result;
 	GcrRecord *record;
-	gchar **lines;
-	guint i;
+	gchar *line, *end, *at;
+
+	g_return_val_if_fail (data != NULL, NULL);
+
+	if (n_data < 0)
+		n_data = strlen (data);
+
+	arena = _gcr_record_arena_new ();
+	line = arena_alloc (arena, n_data + 1);
+	memcpy (line, data, n_data);
+	line[n_data] = '\0';
 
-	lines = strnsplit (data, n_data, '\n');
 	result = g_ptr_array_new_with_free_func (_gcr_record_free);
+	end = line + n_data;
+
+	/* Like g_strsplit(), the text after the last new line is a line too */
+	while (n_data > 0) {
+		at = memchr (line, '\n', end - line);
+		if (at != NULL)
+			*at = '\0';
 
-	for (i = 0; lines[i] != NULL; i++) {
-		block = record_block_take (lines[i], strlen (lines[i]));
-		record = take_and_parse_internal (block, ':', TRUE);
+		record = parse_internal (arena, line, (at ? at : end) - line, ':', TRUE);
 		if (record == NULL) {
 			g_ptr_array_unref (result);
 			result = NULL;
 			break;
 		}
 		g_ptr_array_add (result, record);
+
+		if (at == NULL)
+			break;
+		line = at + 1;
 	}
 
-	/* Free any not done */
-	for (; lines[i] != NULL; i++)
-		g_free (lines[i]);
+	_gcr_record_arena_unref (arena);
+	return result;
+}
+
+/* Enough for most lines, larger ones grow the buffer */
+#define READER_BUFFER_SIZE 65536
 
-	/* Individual lines already freed */
-	g_free (lines);
+struct _GcrRecordReader {
+	GcrRecordBuffer *buffer;
+	gsize start;
+	gsize scanned;
+	gsize end;
+	gchar delimiter;
+	gboolean allow_empty;
+};
 
-	return result;
+/*
+ * Reads records one line at a time as data arrives, for example from a
+ * pipe. The data is read straight into a buffer which the records then
+ * point into, so that lines are never copied.
+ *
+ * The buffer is only reused once the records parsed out of it are freed,
+ * otherwise the partial line at its end is moved into a new one.
+ */
+GcrRecordReader *
+_gcr_record_reader_new (gchar delimiter)
+{
+	GcrRecordReader *reader;
+
+	reader = g_new0 (GcrRecordReader, 1);
+	reader->delimiter = delimiter;
+
+	/* Same as _gcr_record_parse_spaces() and _gcr_record_parse_colons() */
+	reader->allow_empty = (delimiter != ' ');
+
+	return reader;
+}
+
+void
+_gcr_record_reader_free (GcrRecordReader *reader)
+{
+	if (reader == NULL)
+		return;
+
+	record_buffer_unref (reader->buffer);
+	g_free (reader);
+}
+
+gchar *
+_gcr_record_reader_begin_write (GcrRecordReader *reader,
+                                gsize *n_space)
+{
+	GcrRecordBuffer *buffer;
+	gsize pending;
+	gsize size;
+
+	g_return_val_if_fail (reader != NULL, NULL);
+	g_return_val_if_fail (n_space != NULL, NULL);
+
+	buffer = reader->buffer;
+	pending = reader->end - reader->start;
+
+	/* Always leave room for a terminating null */
+	if (buffer == NULL || reader->end + 1 >= buffer->size) {
+
+		/* Nothing points into the buffer, so move the partial line to the front */
+		if (buffer != NULL && g_atomic_int_get (&buffer->refs) == 1 &&
+		    pending * 2 < buffer->size) {
+			memmove (buffer->data, buffer->data + reader->start, pending);
+
+		/* Otherwise start a new one */
+		} else {
+			size = READER_BUFFER_SIZE;
+			while (size < (pending + 1) * 2)
+				size *= 2;
+			reader->buffer = record_buffer_new (size);
+			if (buffer != NULL) {
+				memcpy (reader->buffer->data, buffer->data + reader->start, pending);
+				record_buffer_unref (buffer);
+			}
+		}
+
+		reader->scanned -= reader->start;
+		reader->start = 0;
+		reader->end = pending;
+	}
+
+	*n_space = reader->buffer->size - reader->end - 1;
+	return reader->buffer->data + reader->end;
+}
+
+void
+_gcr_record_reader_end_write (GcrRecordReader *reader,
+                              gsize n_written)
+{
+	g_return_if_fail (reader != NULL);
+	g_return_if_fail (reader->buffer != NULL);
+	g_return_if_fail (reader->end + n_written < reader->buffer->size);
+
+	reader->end += n_written;
+}
+
+/*
+ * Gets the next complete line, or if @last is set the remaining data. The
+ * line is null terminated, and is only valid until the next write.
+ */
+gboolean
+_gcr_record_reader_next_line (GcrRecordReader *reader,
+                              gboolean last,
+                              gchar **line,
+                              gsize *n_line)
+{
+	gchar *data;
+	gchar *at;
+	gsize length;
+
+	g_return_val_if_fail (reader != NULL, FALSE);
+	g_return_val_if_fail (line != NULL, FALSE);
+	g_return_val_if_fail (n_line != NULL, FALSE);
+
+	if (reader->buffer == NULL)
+		return FALSE;
+
+	data = reader->buffer->data;
+	at = memchr (data + reader->scanned, '\n', reader->end - reader->scanned);
+
+	if (at != NULL) {
+		length = at - (data + reader->start);
+		*at = '\0';
+		if (length > 0 && at[-1] == '\r') {
+			at[-1] = '\0';
+			length--;
+		}
+		*line = data + reader->start;
+		*n_line = length;
+		reader->start = reader->scanned = (at - data) + 1;
+		return TRUE;
+	}
+
+	reader->scanned = reader->end;
+
+	if (last && reader->end > reader->start) {
+		data[reader->end] = '\0';
+		*line = data + reader->start;
+		*n_line = reader->end - reader->start;
+		reader->start = reader->scanned = reader->end;
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Parses a line returned by _gcr_record_reader_next_line(), in place. The
+ * record keeps the buffer alive and remains valid after further writes.
+ */
+GcrRecord *
+_gcr_record_reader_parse_line (GcrRecordReader *reader,
+                               gchar *line,
+                               gsize n_line)
+{
+	g_return_val_if_fail (reader != NULL, NULL);
+	g_return_val_if_fail (reader->buffer != NULL, NULL);
+	g_return_val_if_fail (line != NULL, NULL);
+
+	return parse_shared_internal (reader->buffer, line, n_line,
+	                              reader->delimiter, reader->allow_empty);
+}
+
+GcrRecord *
+_gcr_record_reader_next (GcrRecordReader *reader,
+                         gboolean last)
+{
+	GcrRecord *record;
+	gchar *line;
+	gsize n_line;
+
+	g_return_val_if_fail (reader != NULL, NULL);
+
+	/* Skips lines that can't be parsed */
+	while (_gcr_record_reader_next_line (reader, last, &line, &n_line)) {
+		record = _gcr_record_reader_parse_line (reader, line, n_line);
+		if (record != NULL)
+			return record;
+	}
+
+	return NULL;
 }
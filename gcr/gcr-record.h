@@ -47,6 +47,7 @@ G_BEGIN_DECLS
 
 #define GCR_RECORD_SCHEMA_ATTRIBUTE  (g_quark_from_static_string ("ATTRIBUTE"))
 #define GCR_RECORD_SCHEMA_IMPORT_OK  (g_quark_from_static_string ("IMPORT_OK"))
+#define GCR_RECORD_SCHEMA_IMPORT_PROBLEM  (g_quark_from_static_string ("IMPORT_PROBLEM"))
 #define GCR_RECORD_SCHEMA_FPR  (g_quark_from_static_string ("fpr"))
 #define GCR_RECORD_SCHEMA_PUB  (g_quark_from_static_string ("pub"))
 #define GCR_RECORD_SCHEMA_SUB  (g_quark_from_static_string ("sub"))
@@ -185,14 +186,27 @@ typedef enum {
 
 typedef struct _GcrRecord GcrRecord;
 
+typedef struct _GcrRecordArena GcrRecordArena;
+
 #define        GCR_TYPE_RECORD                  (_gcr_record_get_type ())
 
 GType          _gcr_record_get_type             (void) G_GNUC_CONST;
 
+GcrRecordArena * _gcr_record_arena_new          (void);
+
+GcrRecordArena * _gcr_record_arena_ref          (GcrRecordArena *arena);
+
+void           _gcr_record_arena_unref          (GcrRecordArena *arena);
+
 GcrRecord *    _gcr_record_new                  (GQuark schema,
                                                  guint n_columns,
                                                  gchar delimiter);
 
+GcrRecord *    _gcr_record_new_in               (GcrRecordArena *arena,
+                                                 GQuark schema,
+                                                 guint n_columns,
+                                                 gchar delimiter);
+
 GcrRecord*     _gcr_record_copy                 (GcrRecord *record);
 
 GcrRecord*     _gcr_record_parse_colons         (const gchar *line,
@@ -270,6 +284,30 @@ gchar *        _gcr_records_format              (GPtrArray *records);
 GcrRecord *    _gcr_records_find                (GPtrArray *records,
                                                  GQuark schema);
 
+typedef struct _GcrRecordReader GcrRecordReader;
+
+GcrRecordReader * _gcr_record_reader_new        (gchar delimiter);
+
+void           _gcr_record_reader_free          (GcrRecordReader *reader);
+
+gchar *        _gcr_record_reader_begin_write   (GcrRecordReader *reader,
+                                                 gsize *n_space);
+
+void           _gcr_record_reader_end_write     (GcrRecordReader *reader,
+                                                 gsize n_written);
+
+gboolean       _gcr_record_reader_next_line     (GcrRecordReader *reader,
+                                                 gboolean last,
+                                                 gchar **line,
+                                                 gsize *n_line);
+
+GcrRecord *    _gcr_record_reader_parse_line    (GcrRecordReader *reader,
+                                                 gchar *line,
+                                                 gsize n_line);
+
+GcrRecord *    _gcr_record_reader_next          (GcrRecordReader *reader,
+                                                 gboolean last);
+
 G_END_DECLS
 
 #endif /* GCR_RECORD_H */
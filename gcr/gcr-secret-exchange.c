@@ -19,10 +19,12 @@
 
 #include "config.h"
 
+#include "gcr-internal.h"
 #include "gcr-secret-exchange.h"
 
 #include "egg/egg-crypto.h"
 #include "egg/egg-dh.h"
+#include "egg/egg-ecdh.h"
 #include "egg/egg-fips.h"
 #include "egg/egg-hkdf.h"
 
@@ -63,12 +65,29 @@ EGG_SECURE_DECLARE (secret_exchange);
 /**
  * GCR_SECRET_EXCHANGE_PROTOCOL_1:
  *
- * The current secret exchange protocol. Key agreement is done using DH with the
- * 1536 bit IKE parameter group. Keys are derived using SHA256 with HKDF. The
- * transport encryption is done with 128 bit AES.
+ * The original secret exchange protocol. Key agreement is done using DH with
+ * the 1536 bit IKE parameter group. Keys are derived using SHA256 with HKDF.
+ * The transport encryption is done with 128 bit AES.
  */
 
-#define SECRET_EXCHANGE_PROTOCOL_1_PREFIX "[" GCR_SECRET_EXCHANGE_PROTOCOL_1 "]\n"
+/**
+ * GCR_SECRET_EXCHANGE_PROTOCOL_2:
+ *
+ * The current secret exchange protocol. Key agreement is done using X25519.
+ * Keys are derived using SHA256 with HKDF. The transport encryption is done
+ * with 128 bit AES.
+ *
+ * Unless a protocol is specified, this is offered alongside
+ * %GCR_SECRET_EXCHANGE_PROTOCOL_1 and used when the other side supports it.
+ */
+
+/* Oldest first, which is also the order they're offered in */
+static const gchar *PROTOCOLS[] = {
+	GCR_SECRET_EXCHANGE_PROTOCOL_1,
+	GCR_SECRET_EXCHANGE_PROTOCOL_2,
+};
+
+#define N_PROTOCOLS ((gint)G_N_ELEMENTS (PROTOCOLS))
 
 enum {
 	PROP_0,
@@ -80,10 +99,11 @@ typedef struct _GcrSecretExchangeDefault GcrSecretExchangeDefault;
 struct _GcrSecretExchangePrivate {
 	GcrSecretExchangeDefault *default_exchange;
 	GDestroyNotify destroy_exchange;
-	gboolean explicit_protocol;
+	const gchar *explicit_protocol;
+	const gchar *protocol;
 	gboolean generated;
-	guchar *publi;
-	gsize n_publi;
+	guchar *publi[N_PROTOCOLS];
+	gsize n_publi[N_PROTOCOLS];
 	gboolean derived;
 	gchar *secret;
 	gsize n_secret;
@@ -121,6 +141,54 @@ key_file_get_base64 (GKeyFile *key_file, const gchar *section,
 	return result;
 }
 
+static gboolean   gcr_secret_exchange_default_generate_exchange_key  (GcrSecretExchange *exchange,
+                                                                     const gchar *scheme,
+                                                                     guchar **public_key,
+                                                                     gsize *n_public_key);
+
+static gint
+protocol_index (const gchar *protocol)
+{
+	gint i;
+
+	for (i = 0; i < N_PROTOCOLS; i++) {
+		if (g_str_equal (PROTOCOLS[i], protocol))
+			return i;
+	}
+
+	return -1;
+}
+
+static gboolean
+protocol_is_wanted (GcrSecretExchange *self,
+                    gint index)
+{
+	GcrSecretExchangeClass *klass;
+
+	if (self->pv->explicit_protocol)
+		return self->pv->explicit_protocol == PROTOCOLS[index];
+
+	/*
+	 * Derived classes written before there was more than one protocol
+	 * may ignore the scheme, only pick newer ones with our own crypto.
+	 */
+	klass = GCR_SECRET_EXCHANGE_GET_CLASS (self);
+	return index == 0 ||
+	       klass->generate_exchange_key == gcr_secret_exchange_default_generate_exchange_key;
+}
+
+static void
+check_protocol_prefix (const gchar *result,
+                       const gchar *protocol)
+{
+	gchar *prefix;
+
+	prefix = g_strdup_printf ("[%s]\n", protocol);
+	if (!g_str_has_prefix (result, prefix))
+		g_warning ("the prepared data does not have the correct protocol prefix: %s", result);
+	g_free (prefix);
+}
+
 static void
 gcr_secret_exchange_init (GcrSecretExchange *self)
 {
@@ -136,6 +204,7 @@ gcr_secret_exchange_set_property (GObject *obj,
 {
 	GcrSecretExchange *self = GCR_SECRET_EXCHANGE (obj);
 	const gchar *protocol;
+	gint index;
 
 	switch (prop_id) {
 	case PROP_PROTOCOL:
@@ -144,13 +213,14 @@ gcr_secret_exchange_set_property (GObject *obj,
 			g_debug ("automatically selecting secret exchange protocol");
 
 		} else {
-			if (g_str_equal (protocol, GCR_SECRET_EXCHANGE_PROTOCOL_1)) {
+			index = protocol_index (protocol);
+			if (index >= 0) {
 				g_debug ("explicitly using secret exchange protocol: %s",
-				         GCR_SECRET_EXCHANGE_PROTOCOL_1);
-				self->pv->explicit_protocol = TRUE;
+				         PROTOCOLS[index]);
+				self->pv->explicit_protocol = PROTOCOLS[index];
 			} else {
-				g_warning ("the GcrSecretExchange protocol %s is unsupported defaulting to %s",
-				           protocol, GCR_SECRET_EXCHANGE_PROTOCOL_1);
+				g_warning ("the GcrSecretExchange protocol %s is unsupported, selecting automatically",
+				           protocol);
 			}
 		}
 		break;
@@ -178,12 +248,26 @@ gcr_secret_exchange_get_property (GObject *obj,
 	}
 }
 
+static void
+clear_public_keys (GcrSecretExchange *self,
+                   gint except)
+{
+	gint i;
+
+	for (i = 0; i < N_PROTOCOLS; i++) {
+		if (i == except)
+			continue;
+		g_free (self->pv->publi[i]);
+		self->pv->publi[i] = NULL;
+		self->pv->n_publi[i] = 0;
+	}
+}
+
 static void
 clear_secret_exchange (GcrSecretExchange *self)
 {
-	g_free (self->pv->publi);
-	self->pv->publi = NULL;
-	self->pv->n_publi = 0;
+	clear_public_keys (self, -1);
+	self->pv->protocol = NULL;
 	self->pv->derived = FALSE;
 	self->pv->generated = TRUE;
 	egg_secure_free (self->pv->secret);
@@ -212,8 +296,9 @@ gcr_secret_exchange_finalize (GObject *obj)
  *
  * Specify a protocol of %NULL to allow any protocol. This is especially
  * relevant on the side of the exchange that does not call
- * [method@SecretExchange.begin], that is the originator. Currently the only
- * protocol supported is %GCR_SECRET_EXCHANGE_PROTOCOL_1.
+ * [method@SecretExchange.begin], that is the originator. The supported
+ * protocols are %GCR_SECRET_EXCHANGE_PROTOCOL_1 and
+ * %GCR_SECRET_EXCHANGE_PROTOCOL_2.
  *
  * Returns: (transfer full): A new #GcrSecretExchange object
  */
@@ -232,7 +317,8 @@ gcr_secret_exchange_new (const gchar *protocol)
  *
  * Will return %NULL if no protocol was specified, and either
  * [method@SecretExchange.begin] or [method@SecretExchange.receive] have not
- * been called successfully.
+ * been called successfully. After [method@SecretExchange.begin] this is the
+ * preferred protocol offered, until a reply from the other side settles it.
  *
  * Returns: the protocol or %NULL
  */
@@ -240,9 +326,9 @@ const gchar *
 gcr_secret_exchange_get_protocol (GcrSecretExchange *self)
 {
 	g_return_val_if_fail (GCR_IS_SECRET_EXCHANGE (self), NULL);
-	if (self->pv->explicit_protocol || self->pv->generated)
-		return GCR_SECRET_EXCHANGE_PROTOCOL_1;
-	return NULL;
+	if (self->pv->protocol)
+		return self->pv->protocol;
+	return self->pv->explicit_protocol;
 }
 
 /**
@@ -260,8 +346,10 @@ gchar *
 gcr_secret_exchange_begin (GcrSecretExchange *self)
 {
 	GcrSecretExchangeClass *klass;
+	const gchar *first = NULL;
 	GKeyFile *output;
 	gchar *result;
+	gint i;
 
 	g_return_val_if_fail (GCR_IS_SECRET_EXCHANGE (self), NULL);
 
@@ -272,13 +360,37 @@ gcr_secret_exchange_begin (GcrSecretExchange *self)
 
 	output = g_key_file_new ();
 
-	if (!(klass->generate_exchange_key) (self, GCR_SECRET_EXCHANGE_PROTOCOL_1,
-	                                     &self->pv->publi, &self->pv->n_publi))
-		g_return_val_if_reached (NULL);
-	self->pv->generated = TRUE;
+	/*
+	 * Unless told otherwise, offer every protocol we can generate a key
+	 * for. Older peers only look at the first one, and the other side
+	 * replies using the one it prefers.
+	 */
+	for (i = 0; i < N_PROTOCOLS; i++) {
+		if (!protocol_is_wanted (self, i))
+			continue;
+
+		if (!(klass->generate_exchange_key) (self, PROTOCOLS[i],
+		                                     &self->pv->publi[i], &self->pv->n_publi[i])) {
+			if (i == 0)
+				g_return_val_if_reached (NULL);
+			g_debug ("not offering secret exchange protocol: %s", PROTOCOLS[i]);
+			continue;
+		}
+
+		key_file_set_base64 (output, PROTOCOLS[i], "public",
+		                     self->pv->publi[i], self->pv->n_publi[i]);
+		if (first == NULL)
+			first = PROTOCOLS[i];
+		self->pv->protocol = PROTOCOLS[i];
+	}
+
+	if (first == NULL) {
+		g_message ("secret-exchange: protocol is not supported: %s", self->pv->explicit_protocol);
+		g_key_file_free (output);
+		return NULL;
+	}
 
-	key_file_set_base64 (output, GCR_SECRET_EXCHANGE_PROTOCOL_1, "public",
-	                     self->pv->publi, self->pv->n_publi);
+	self->pv->generated = TRUE;
 
 	result = g_key_file_to_data (output, NULL, NULL);
 	g_return_val_if_fail (result != NULL, NULL);
@@ -289,14 +401,53 @@ gcr_secret_exchange_begin (GcrSecretExchange *self)
 	g_debug ("beginning the secret exchange: %s", string);
 	g_free (string);
 
-	if (!g_str_has_prefix (result, SECRET_EXCHANGE_PROTOCOL_1_PREFIX))
-		g_warning ("the prepared data does not have the correct protocol prefix");
+	check_protocol_prefix (result, first);
 
 	g_key_file_free (output);
 
 	return result;
 }
 
+static gboolean
+select_protocol (GcrSecretExchange *self,
+                 GKeyFile *input)
+{
+	GcrSecretExchangeClass *klass;
+	gint i;
+
+	/* Once a key is derived, the conversation continues with its protocol */
+	if (self->pv->derived)
+		return g_key_file_has_group (input, self->pv->protocol);
+
+	klass = GCR_SECRET_EXCHANGE_GET_CLASS (self);
+
+	/* Most preferred protocol that both sides have a key for */
+	for (i = N_PROTOCOLS - 1; i >= 0; i--) {
+		if (!protocol_is_wanted (self, i))
+			continue;
+		if (!g_key_file_has_group (input, PROTOCOLS[i]))
+			continue;
+
+		if (self->pv->generated) {
+			if (self->pv->publi[i] == NULL)
+				continue;
+		} else {
+			if (!(klass->generate_exchange_key) (self, PROTOCOLS[i],
+			                                     &self->pv->publi[i], &self->pv->n_publi[i]))
+				continue;
+			self->pv->generated = TRUE;
+		}
+
+		/* Don't hang onto keys for the protocols not chosen */
+		clear_public_keys (self, i);
+		self->pv->protocol = PROTOCOLS[i];
+		g_debug ("using secret exchange protocol: %s", PROTOCOLS[i]);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 static gboolean
 derive_key (GcrSecretExchange *self,
             GKeyFile *input)
@@ -311,7 +462,7 @@ derive_key (GcrSecretExchange *self,
 
 	g_debug ("deriving shared transport key");
 
-	peer = key_file_get_base64 (input, GCR_SECRET_EXCHANGE_PROTOCOL_1, "public", &n_peer);
+	peer = key_file_get_base64 (input, self->pv->protocol, "public", &n_peer);
 	if (peer == NULL) {
 		g_message ("secret-exchange: invalid or missing 'public' argument");
 		return FALSE;
@@ -339,9 +490,9 @@ perform_decrypt (GcrSecretExchange *self,
 	klass = GCR_SECRET_EXCHANGE_GET_CLASS (self);
 	g_return_val_if_fail (klass->decrypt_transport_data, FALSE);
 
-	iv = key_file_get_base64 (input, GCR_SECRET_EXCHANGE_PROTOCOL_1, "iv", &n_iv);
+	iv = key_file_get_base64 (input, self->pv->protocol, "iv", &n_iv);
 
-	value = key_file_get_base64 (input, GCR_SECRET_EXCHANGE_PROTOCOL_1, "secret", &n_value);
+	value = key_file_get_base64 (input, self->pv->protocol, "secret", &n_value);
 	if (value == NULL) {
 		g_message ("secret-exchange: invalid or missing value");
 		g_free (iv);
@@ -413,11 +564,10 @@ gcr_secret_exchange_receive (GcrSecretExchange *self,
 		return FALSE;
 	}
 
-	if (!self->pv->generated) {
-		if (!(klass->generate_exchange_key) (self, GCR_SECRET_EXCHANGE_PROTOCOL_1,
-		                                     &self->pv->publi, &self->pv->n_publi))
-			g_return_val_if_reached (FALSE);
-		self->pv->generated = TRUE;
+	if (!select_protocol (self, input)) {
+		g_key_file_free (input);
+		g_message ("secret-exchange: no supported protocol in data");
+		return FALSE;
 	}
 
 	ret = TRUE;
@@ -427,7 +577,7 @@ gcr_secret_exchange_receive (GcrSecretExchange *self,
 			ret = FALSE;
 	}
 
-	if (ret && g_key_file_has_key (input, GCR_SECRET_EXCHANGE_PROTOCOL_1, "secret", NULL))
+	if (ret && g_key_file_has_key (input, self->pv->protocol, "secret", NULL))
 		ret = perform_decrypt (self, input, (guchar **)&secret, &n_secret);
 
 	if (ret) {
@@ -485,8 +635,8 @@ perform_encrypt (GcrSecretExchange *self,
 	                                      n_secret, &iv, &n_iv, &result, &n_result))
 		return FALSE;
 
-	key_file_set_base64 (output, GCR_SECRET_EXCHANGE_PROTOCOL_1, "secret", result, n_result);
-	key_file_set_base64 (output, GCR_SECRET_EXCHANGE_PROTOCOL_1, "iv", iv, n_iv);
+	key_file_set_base64 (output, self->pv->protocol, "secret", result, n_result);
+	key_file_set_base64 (output, self->pv->protocol, "iv", iv, n_iv);
 
 	g_free (result);
 	g_free (iv);
@@ -517,6 +667,7 @@ gcr_secret_exchange_send (GcrSecretExchange *self,
 {
 	GKeyFile *output;
 	gchar *result;
+	gint index;
 
 	g_return_val_if_fail (GCR_IS_SECRET_EXCHANGE (self), NULL);
 
@@ -526,9 +677,12 @@ gcr_secret_exchange_send (GcrSecretExchange *self,
 		return NULL;
 	}
 
+	index = protocol_index (self->pv->protocol);
+	g_return_val_if_fail (index >= 0, NULL);
+
 	output = g_key_file_new ();
-	key_file_set_base64 (output, GCR_SECRET_EXCHANGE_PROTOCOL_1, "public", self->pv->publi,
-	                     self->pv->n_publi);
+	key_file_set_base64 (output, self->pv->protocol, "public", self->pv->publi[index],
+	                     self->pv->n_publi[index]);
 
 	if (secret != NULL) {
 		if (secret_len < 0)
@@ -548,19 +702,21 @@ gcr_secret_exchange_send (GcrSecretExchange *self,
 	g_debug ("sending the secret exchange: %s", string);
 	g_free (string);
 
-	if (!g_str_has_prefix (result, SECRET_EXCHANGE_PROTOCOL_1_PREFIX))
-		g_warning ("the prepared data does not have the correct protocol prefix: %s", result);
+	check_protocol_prefix (result, self->pv->protocol);
 
 	g_key_file_free (output);
 	return result;
 }
 
 /*
- * This is the only set we support so far. It includes:
+ * The first protocol includes:
  *  - DH with the 1536 ike modp group for key exchange
  *  - HKDF SHA256 for hashing of the key to appropriate size
  *  - AES 128 CBC for encryption
  *  - PKCS#7 style padding
+ *
+ * The second protocol uses X25519 for key exchange, and the protocol name
+ * as HKDF info. The transport is the same.
  */
 
 #define EXCHANGE_1_IKE_NAME     "ietf-ike-grp-modp-1536"
@@ -569,10 +725,197 @@ gcr_secret_exchange_send (GcrSecretExchange *self,
 #define EXCHANGE_1_HASH_ALGO    "sha256"
 #define EXCHANGE_1_CIPHER_ALGO  EGG_CIPHER_AES_128_CBC
 
+#define EXCHANGE_2_CURVE        EGG_ECDH_X25519
+
+/*
+ * Exchange keys are ephemeral and each one is only ever used once. Generating
+ * them, especially for DH, is slow enough to be noticed when a prompt opens, so
+ * a few are generated ahead of time on a worker thread. The private parts are
+ * in secure memory, as allocated by the crypto backend.
+ */
+
+#define KEY_POOL_SIZE           2
+
+typedef struct {
+	egg_dh_pubkey *dh_pub;
+	egg_dh_privkey *dh_priv;
+	egg_ecdh_privkey *ecdh_priv;
+	GBytes *publi;
+} ExchangeKey;
+
+static GMutex key_pool_mutex;
+static GQueue key_pool[N_PROTOCOLS];
+static gboolean key_pool_refilling[N_PROTOCOLS];
+static GThreadPool *key_pool_worker;
+
+static egg_dh_params *
+default_dh_params (void)
+{
+	static egg_dh_params *params = NULL;
+	egg_dh_params *created;
+
+	/* Never modified once created, so safe to share between threads */
+	if (g_once_init_enter (&params)) {
+		created = egg_dh_default_params (EXCHANGE_1_IKE_NAME);
+		g_assert (created != NULL);
+		g_once_init_leave (&params, created);
+	}
+
+	return params;
+}
+
+static void
+exchange_key_free (gpointer data)
+{
+	ExchangeKey *key = data;
+
+	if (key == NULL)
+		return;
+
+	egg_dh_pubkey_free (key->dh_pub);
+	egg_dh_privkey_free (key->dh_priv);
+	egg_ecdh_privkey_free (key->ecdh_priv);
+	if (key->publi)
+		g_bytes_unref (key->publi);
+	g_free (key);
+}
+
+static ExchangeKey *
+exchange_key_generate_dh (void)
+{
+	EggFipsScope fips;
+	ExchangeKey *key;
+	gboolean ret;
+
+	key = g_new0 (ExchangeKey, 1);
+
+	egg_fips_scope_begin (&fips, EGG_FIPS_MODE_DISABLED);
+	ret = egg_dh_gen_pair (default_dh_params (), 0, &key->dh_pub, &key->dh_priv);
+	egg_fips_scope_end (&fips);
+
+	if (ret)
+		key->publi = egg_dh_pubkey_export (key->dh_pub);
+	if (key->publi == NULL) {
+		exchange_key_free (key);
+		g_return_val_if_reached (NULL);
+	}
+
+	return key;
+}
+
+static ExchangeKey *
+exchange_key_generate_ecdh (void)
+{
+	EggFipsScope fips;
+	ExchangeKey *key;
+	gboolean ret;
+
+	/* Not all crypto backends have it, just don't offer the protocol */
+	if (!egg_ecdh_is_supported (EXCHANGE_2_CURVE))
+		return NULL;
+
+	key = g_new0 (ExchangeKey, 1);
+
+	egg_fips_scope_begin (&fips, EGG_FIPS_MODE_DISABLED);
+	ret = egg_ecdh_gen_pair (EXCHANGE_2_CURVE, &key->publi, &key->ecdh_priv);
+	egg_fips_scope_end (&fips);
+
+	if (!ret) {
+		exchange_key_free (key);
+		return NULL;
+	}
+
+	return key;
+}
+
+static ExchangeKey *
+exchange_key_generate (gint index)
+{
+	if (g_str_equal (PROTOCOLS[index], GCR_SECRET_EXCHANGE_PROTOCOL_2))
+		return exchange_key_generate_ecdh ();
+	return exchange_key_generate_dh ();
+}
+
+static void
+key_pool_refill (gpointer data,
+                 gpointer unused)
+{
+	gint index = GPOINTER_TO_INT (data) - 1;
+	ExchangeKey *key;
+	gboolean full;
+
+	for (;;) {
+		g_mutex_lock (&key_pool_mutex);
+		full = g_queue_get_length (&key_pool[index]) >= KEY_POOL_SIZE;
+		if (full)
+			key_pool_refilling[index] = FALSE;
+		g_mutex_unlock (&key_pool_mutex);
+
+		if (full)
+			break;
+
+		key = exchange_key_generate (index);
+
+		g_mutex_lock (&key_pool_mutex);
+		if (key == NULL)
+			key_pool_refilling[index] = FALSE;
+		else
+			g_queue_push_tail (&key_pool[index], key);
+		g_mutex_unlock (&key_pool_mutex);
+
+		if (key == NULL)
+			break;
+	}
+}
+
+/* Called with key_pool_mutex held */
+static void
+key_pool_schedule_refill (gint index)
+{
+	if (key_pool_refilling[index])
+		return;
+
+	if (key_pool_worker == NULL) {
+		key_pool_worker = g_thread_pool_new (key_pool_refill, NULL, 1, FALSE, NULL);
+		g_return_if_fail (key_pool_worker != NULL);
+	}
+
+	key_pool_refilling[index] = TRUE;
+	g_thread_pool_push (key_pool_worker, GINT_TO_POINTER (index + 1), NULL);
+}
+
+static ExchangeKey *
+key_pool_take (gint index)
+{
+	ExchangeKey *key;
+
+	g_mutex_lock (&key_pool_mutex);
+	key = g_queue_pop_head (&key_pool[index]);
+	key_pool_schedule_refill (index);
+	g_mutex_unlock (&key_pool_mutex);
+
+	/* Pool is empty, don't wait for the worker */
+	if (key == NULL)
+		key = exchange_key_generate (index);
+
+	return key;
+}
+
+void
+_gcr_secret_exchange_prepare_keys (void)
+{
+	gint i;
+
+	g_mutex_lock (&key_pool_mutex);
+	for (i = 0; i < N_PROTOCOLS; i++) {
+		if (g_queue_get_length (&key_pool[i]) < KEY_POOL_SIZE)
+			key_pool_schedule_refill (i);
+	}
+	g_mutex_unlock (&key_pool_mutex);
+}
+
 struct _GcrSecretExchangeDefault {
-	egg_dh_params *params;
-	egg_dh_pubkey *pub;
-	egg_dh_privkey *priv;
+	ExchangeKey *keys[N_PROTOCOLS];
 	gpointer key;
 };
 
@@ -580,9 +923,10 @@ static void
 gcr_secret_exchange_default_free (gpointer to_free)
 {
 	GcrSecretExchangeDefault *data = to_free;
-	egg_dh_pubkey_free (data->pub);
-	egg_dh_privkey_free (data->priv);
-	egg_dh_params_free (data->params);
+	gint i;
+
+	for (i = 0; i < N_PROTOCOLS; i++)
+		exchange_key_free (data->keys[i]);
 	if (data->key) {
 		egg_secure_clear (data->key, EXCHANGE_1_KEY_LENGTH);
 		egg_secure_free (data->key);
@@ -597,39 +941,63 @@ gcr_secret_exchange_default_generate_exchange_key (GcrSecretExchange *exchange,
                                                    gsize *n_public_key)
 {
 	GcrSecretExchangeDefault *data = exchange->pv->default_exchange;
-	GBytes *buffer;
-	EggFipsMode fips_mode;
+	ExchangeKey *key;
+	gint index;
+
+	g_debug ("generating public key for %s", scheme);
 
-	g_debug ("generating public key");
+	index = protocol_index (scheme);
+	g_return_val_if_fail (index >= 0, FALSE);
 
 	if (data == NULL) {
 		data = g_new0 (GcrSecretExchangeDefault, 1);
-		data->params = egg_dh_default_params (EXCHANGE_1_IKE_NAME);
-		if (!data->params)
-			g_return_val_if_reached (FALSE);
-
 		exchange->pv->default_exchange = data;
 		exchange->pv->destroy_exchange = gcr_secret_exchange_default_free;
 	}
 
-	egg_dh_pubkey_free (data->pub);
-	data->pub = NULL;
-	egg_dh_privkey_free (data->priv);
-	data->priv = NULL;
+	/* Taken out of the pool, so never used by another exchange */
+	key = key_pool_take (index);
+	if (key == NULL)
+		return FALSE;
 
-	fips_mode = egg_fips_get_mode ();
-	egg_fips_set_mode (EGG_FIPS_MODE_DISABLED);
-	if (!egg_dh_gen_pair (data->params, 0,
-	                      &data->pub, &data->priv)) {
-		egg_fips_set_mode (fips_mode);
-		g_return_val_if_reached (FALSE);
-	}
-	egg_fips_set_mode (fips_mode);
+	exchange_key_free (data->keys[index]);
+	data->keys[index] = key;
+
+	*public_key = g_memdup2 (g_bytes_get_data (key->publi, NULL),
+	                         g_bytes_get_size (key->publi));
+	*n_public_key = g_bytes_get_size (key->publi);
+	return TRUE;
+}
 
-	buffer = egg_dh_pubkey_export (data->pub);
-	g_return_val_if_fail (buffer != NULL, FALSE);
-	*public_key = g_bytes_unref_to_data (buffer, n_public_key);
-	return *public_key != NULL;
+static GBytes *
+derive_dh_secret (GcrSecretExchangeDefault *data,
+                  GBytes *peer)
+{
+	ExchangeKey *key = data->keys[0];
+	egg_dh_pubkey *peer_pubkey;
+	GBytes *ikm;
+
+	g_return_val_if_fail (key != NULL, NULL);
+
+	peer_pubkey = egg_dh_pubkey_new_from_bytes (default_dh_params (), peer);
+	if (peer_pubkey == NULL)
+		return NULL;
+
+	ikm = egg_dh_gen_secret (peer_pubkey, key->dh_priv, default_dh_params ());
+
+	egg_dh_pubkey_free (peer_pubkey);
+	return ikm;
+}
+
+static GBytes *
+derive_ecdh_secret (GcrSecretExchangeDefault *data,
+                    GBytes *peer)
+{
+	ExchangeKey *key = data->keys[1];
+
+	g_return_val_if_fail (key != NULL, NULL);
+
+	return egg_ecdh_gen_secret (key->ecdh_priv, peer);
 }
 
 static gboolean
@@ -638,39 +1006,55 @@ gcr_secret_exchange_default_derive_transport_key (GcrSecretExchange *exchange,
                                                   gsize n_peer)
 {
 	GcrSecretExchangeDefault *data = exchange->pv->default_exchange;
+	const gchar *protocol;
+	const gchar *info = NULL;
+	EggFipsScope fips;
+	gsize n_info = 0;
 	GBytes *buffer;
-	egg_dh_pubkey *peer_pubkey;
+	gboolean ret;
 	GBytes *ikm;
-	EggFipsMode fips_mode;
+
+	g_return_val_if_fail (data != NULL, FALSE);
 
 	g_debug ("deriving transport key");
 
+	protocol = gcr_secret_exchange_get_protocol (exchange);
 	buffer = g_bytes_new_static (peer, n_peer);
-	g_return_val_if_fail (buffer != NULL, FALSE);
 
-	peer_pubkey = egg_dh_pubkey_new_from_bytes (data->params, buffer);
-	g_bytes_unref (buffer);
+	/* Only affects this thread, so exchanges can run concurrently */
+	egg_fips_scope_begin (&fips, EGG_FIPS_MODE_DISABLED);
 
 	/* Build up a key we can use */
-	fips_mode = egg_fips_get_mode ();
-	egg_fips_set_mode (EGG_FIPS_MODE_DISABLED);
-	ikm = egg_dh_gen_secret (peer_pubkey, data->priv, data->params);
-	egg_fips_set_mode (fips_mode);
-	g_return_val_if_fail (ikm != NULL, FALSE);
-	egg_dh_pubkey_free (peer_pubkey);
+	if (g_strcmp0 (protocol, GCR_SECRET_EXCHANGE_PROTOCOL_2) == 0) {
+		ikm = derive_ecdh_secret (data, buffer);
+		info = protocol;
+		n_info = strlen (protocol);
+	} else {
+		ikm = derive_dh_secret (data, buffer);
+	}
+
+	g_bytes_unref (buffer);
+
+	if (ikm == NULL) {
+		egg_fips_scope_end (&fips);
+		g_message ("secret-exchange: invalid 'public' argument");
+		return FALSE;
+	}
 
 	if (data->key == NULL)
 		data->key = egg_secure_alloc (EXCHANGE_1_KEY_LENGTH);
 
-	if (!egg_hkdf_perform (EXCHANGE_1_HASH_ALGO,
-			       g_bytes_get_data (ikm, NULL),
-			       g_bytes_get_size (ikm),
-			       NULL, 0, NULL, 0,
-			       data->key, EXCHANGE_1_KEY_LENGTH))
-		g_return_val_if_reached (FALSE);
-
+	ret = egg_hkdf_perform (EXCHANGE_1_HASH_ALGO,
+	                        g_bytes_get_data (ikm, NULL),
+	                        g_bytes_get_size (ikm),
+	                        NULL, 0, info, n_info,
+	                        data->key, EXCHANGE_1_KEY_LENGTH);
+	egg_fips_scope_end (&fips);
 	g_bytes_unref (ikm);
 
+	if (!ret)
+		g_return_val_if_reached (FALSE);
+
 	return TRUE;
 }
 
@@ -34,6 +34,8 @@ G_BEGIN_DECLS
 
 #define GCR_SECRET_EXCHANGE_PROTOCOL_1 "sx-aes-1"
 
+#define GCR_SECRET_EXCHANGE_PROTOCOL_2 "sx-x25519-hkdf-sha256-aes128"
+
 #define GCR_TYPE_SECRET_EXCHANGE               (gcr_secret_exchange_get_type ())
 #define GCR_SECRET_EXCHANGE(obj)               (G_TYPE_CHECK_INSTANCE_CAST ((obj), GCR_TYPE_SECRET_EXCHANGE, GcrSecretExchange))
 #define GCR_SECRET_EXCHANGE_CLASS(klass)       (G_TYPE_CHECK_CLASS_CAST ((klass), GCR_TYPE_SECRET_EXCHANGE, GcrSecretExchangeClass))
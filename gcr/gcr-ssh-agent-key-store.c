@@ -0,0 +1,661 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gcr-ssh-agent-key-store.h"
+
+#include "gcr-ssh-agent-private.h"
+
+#include "egg/egg-secure-memory.h"
+#include "egg/egg-sign.h"
+
+#include <string.h>
+
+EGG_SECURE_DECLARE (ssh_agent_key_store);
+
+/*
+ * Holds the keys added to the agent when it serves the protocol itself
+ * rather than relaying to ssh-agent. The private parts of the keys are
+ * only ever copied into secure memory, and the crypto backend picks that
+ * up for its own copies.
+ */
+
+typedef struct {
+	gint refs;
+	GBytes *public_key;
+	gchar *comment;
+	egg_sign_key *key;
+	const gchar *algorithm;
+	gboolean is_rsa;
+	gint64 expires;
+} StoredKey;
+
+struct _GcrSshAgentKeyStore
+{
+	GObject object;
+
+	GHashTable *keys;
+	gchar *password;
+	GMutex lock;
+};
+
+G_DEFINE_TYPE (GcrSshAgentKeyStore, gcr_ssh_agent_key_store, G_TYPE_OBJECT);
+
+static const struct {
+	const gchar *algorithm;
+	const gchar *curve_name;
+	EggSignCurve curve;
+} ECDSA_CURVES[] = {
+	{ "ecdsa-sha2-nistp256", "nistp256", EGG_SIGN_CURVE_NIST_P256 },
+	{ "ecdsa-sha2-nistp384", "nistp384", EGG_SIGN_CURVE_NIST_P384 },
+	{ "ecdsa-sha2-nistp521", "nistp521", EGG_SIGN_CURVE_NIST_P521 },
+};
+
+static StoredKey *
+stored_key_ref (StoredKey *stored)
+{
+	g_atomic_int_inc (&stored->refs);
+	return stored;
+}
+
+static void
+stored_key_unref (gpointer data)
+{
+	StoredKey *stored = data;
+
+	if (!g_atomic_int_dec_and_test (&stored->refs))
+		return;
+
+	g_bytes_unref (stored->public_key);
+	g_free (stored->comment);
+	egg_sign_key_free (stored->key);
+	g_free (stored);
+}
+
+static void
+gcr_ssh_agent_key_store_init (GcrSshAgentKeyStore *self)
+{
+	self->keys = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+					    (GDestroyNotify)g_bytes_unref,
+					    stored_key_unref);
+	g_mutex_init (&self->lock);
+}
+
+static void
+gcr_ssh_agent_key_store_finalize (GObject *object)
+{
+	GcrSshAgentKeyStore *self = GCR_SSH_AGENT_KEY_STORE (object);
+
+	g_hash_table_unref (self->keys);
+	egg_secure_strfree (self->password);
+	g_mutex_clear (&self->lock);
+
+	G_OBJECT_CLASS (gcr_ssh_agent_key_store_parent_class)->finalize (object);
+}
+
+static void
+gcr_ssh_agent_key_store_class_init (GcrSshAgentKeyStoreClass *klass)
+{
+	GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+	gobject_class->finalize = gcr_ssh_agent_key_store_finalize;
+}
+
+GcrSshAgentKeyStore *
+gcr_ssh_agent_key_store_new (void)
+{
+	return g_object_new (GCR_TYPE_SSH_AGENT_KEY_STORE, NULL);
+}
+
+static GBytes *
+secure_bytes_new (const guchar *data,
+                  gsize n_data)
+{
+	gpointer copy;
+
+	copy = egg_secure_alloc (MAX (n_data, 1));
+	memcpy (copy, data, n_data);
+	return g_bytes_new_with_free_func (copy, n_data, egg_secure_free, copy);
+}
+
+static gboolean
+get_field (EggBuffer *req,
+           gsize *offset,
+           const guchar **data,
+           gsize *n_data)
+{
+	return egg_buffer_get_byte_array (req, *offset, offset, data, n_data) &&
+	       *data != NULL;
+}
+
+static gboolean
+get_secure_field (EggBuffer *req,
+                  gsize *offset,
+                  GBytes **field)
+{
+	const guchar *data;
+	gsize n_data;
+
+	if (!get_field (req, offset, &data, &n_data))
+		return FALSE;
+	*field = secure_bytes_new (data, n_data);
+	return TRUE;
+}
+
+static gboolean
+field_equal (const guchar *data,
+             gsize n_data,
+             const gchar *str)
+{
+	gsize len = strlen (str);
+	return n_data == len && memcmp (data, str, len) == 0;
+}
+
+static egg_sign_key *
+parse_rsa (EggBuffer *req,
+           gsize *offset,
+           EggBuffer *public_key)
+{
+	const guchar *n, *e;
+	gsize n_n, n_e;
+	GBytes *bn = NULL, *be = NULL;
+	GBytes *d = NULL, *iqmp = NULL, *p = NULL, *q = NULL;
+	egg_sign_key *key = NULL;
+
+	if (get_field (req, offset, &n, &n_n) &&
+	    get_field (req, offset, &e, &n_e) &&
+	    get_secure_field (req, offset, &d) &&
+	    get_secure_field (req, offset, &iqmp) &&
+	    get_secure_field (req, offset, &p) &&
+	    get_secure_field (req, offset, &q)) {
+		bn = g_bytes_new (n, n_n);
+		be = g_bytes_new (e, n_e);
+		key = egg_sign_key_new_rsa (bn, be, d, p, q, iqmp);
+
+		egg_buffer_add_string (public_key, "ssh-rsa");
+		egg_buffer_add_byte_array (public_key, e, n_e);
+		egg_buffer_add_byte_array (public_key, n, n_n);
+	}
+
+	g_clear_pointer (&bn, g_bytes_unref);
+	g_clear_pointer (&be, g_bytes_unref);
+	g_clear_pointer (&d, g_bytes_unref);
+	g_clear_pointer (&iqmp, g_bytes_unref);
+	g_clear_pointer (&p, g_bytes_unref);
+	g_clear_pointer (&q, g_bytes_unref);
+	return key;
+}
+
+static egg_sign_key *
+parse_ed25519 (EggBuffer *req,
+               gsize *offset,
+               EggBuffer *public_key)
+{
+	const guchar *pk, *sk;
+	gsize n_pk, n_sk;
+	GBytes *bpk, *seed;
+	egg_sign_key *key;
+
+	/* The private key is the seed followed by the public key */
+	if (!get_field (req, offset, &pk, &n_pk) ||
+	    !get_field (req, offset, &sk, &n_sk) ||
+	    n_pk != 32 || n_sk != 64 ||
+	    memcmp (sk + 32, pk, 32) != 0)
+		return NULL;
+
+	bpk = g_bytes_new (pk, n_pk);
+	seed = secure_bytes_new (sk, 32);
+	key = egg_sign_key_new_ed25519 (bpk, seed);
+	g_bytes_unref (bpk);
+	g_bytes_unref (seed);
+
+	egg_buffer_add_string (public_key, "ssh-ed25519");
+	egg_buffer_add_byte_array (public_key, pk, n_pk);
+	return key;
+}
+
+static egg_sign_key *
+parse_ecdsa (EggBuffer *req,
+             gsize *offset,
+             guint index,
+             EggBuffer *public_key)
+{
+	const guchar *curve, *point;
+	gsize n_curve, n_point;
+	GBytes *q, *d;
+	egg_sign_key *key;
+
+	if (!get_field (req, offset, &curve, &n_curve) ||
+	    !field_equal (curve, n_curve, ECDSA_CURVES[index].curve_name) ||
+	    !get_field (req, offset, &point, &n_point) ||
+	    !get_secure_field (req, offset, &d))
+		return NULL;
+
+	q = g_bytes_new (point, n_point);
+	key = egg_sign_key_new_ecdsa (ECDSA_CURVES[index].curve, q, d);
+	g_bytes_unref (q);
+	g_bytes_unref (d);
+
+	egg_buffer_add_string (public_key, ECDSA_CURVES[index].algorithm);
+	egg_buffer_add_string (public_key, ECDSA_CURVES[index].curve_name);
+	egg_buffer_add_byte_array (public_key, point, n_point);
+	return key;
+}
+
+/*
+ * Lifetime is the only constraint enforced here. Anything else, such as
+ * confirmation or extensions, makes the caller relay the key to
+ * ssh-agent instead.
+ */
+static GcrSshAgentKeyStoreResult
+parse_constraints (EggBuffer *req,
+                   gsize offset,
+                   gint64 *expires)
+{
+	guint32 lifetime;
+	guchar type;
+
+	*expires = 0;
+
+	while (offset < req->len) {
+		if (!egg_buffer_get_byte (req, offset, &offset, &type))
+			return GCR_SSH_AGENT_KEY_STORE_INVALID;
+
+		switch (type) {
+		case GCR_SSH_FLAG_CONSTRAIN_LIFETIME:
+			if (!egg_buffer_get_uint32 (req, offset, &offset, &lifetime))
+				return GCR_SSH_AGENT_KEY_STORE_INVALID;
+			*expires = g_get_monotonic_time () + (gint64)lifetime * G_USEC_PER_SEC;
+			break;
+		default:
+			return GCR_SSH_AGENT_KEY_STORE_UNSUPPORTED;
+		}
+	}
+
+	return GCR_SSH_AGENT_KEY_STORE_ADDED;
+}
+
+GcrSshAgentKeyStoreResult
+gcr_ssh_agent_key_store_add (GcrSshAgentKeyStore *self,
+                             EggBuffer *req,
+                             gboolean constrained,
+                             GBytes **public_key)
+{
+	GcrSshAgentKeyStoreResult result;
+	const guchar *type;
+	gsize n_type;
+	gsize offset = 5;
+	EggBuffer blob;
+	egg_sign_key *key = NULL;
+	const gchar *algorithm = NULL;
+	gboolean is_rsa = FALSE;
+	StoredKey *stored;
+	gchar *comment;
+	gint64 expires;
+	guint i;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), GCR_SSH_AGENT_KEY_STORE_INVALID);
+	g_return_val_if_fail (req != NULL, GCR_SSH_AGENT_KEY_STORE_INVALID);
+
+	if (!get_field (req, &offset, &type, &n_type))
+		return GCR_SSH_AGENT_KEY_STORE_INVALID;
+
+	egg_buffer_init_full (&blob, 128, (EggBufferAllocator)g_realloc);
+
+	if (field_equal (type, n_type, "ssh-rsa")) {
+		key = parse_rsa (req, &offset, &blob);
+		is_rsa = TRUE;
+	} else if (field_equal (type, n_type, "ssh-ed25519")) {
+		key = parse_ed25519 (req, &offset, &blob);
+		algorithm = "ssh-ed25519";
+	} else {
+		for (i = 0; i < G_N_ELEMENTS (ECDSA_CURVES); i++) {
+			if (field_equal (type, n_type, ECDSA_CURVES[i].algorithm)) {
+				key = parse_ecdsa (req, &offset, i, &blob);
+				algorithm = ECDSA_CURVES[i].algorithm;
+				break;
+			}
+		}
+
+		/* DSA, certificates and security keys */
+		if (algorithm == NULL) {
+			egg_buffer_uninit (&blob);
+			return GCR_SSH_AGENT_KEY_STORE_UNSUPPORTED;
+		}
+	}
+
+	if (key == NULL || egg_buffer_has_error (&blob) ||
+	    !egg_buffer_get_string (req, offset, &offset, &comment, (EggBufferAllocator)g_realloc)) {
+		egg_sign_key_free (key);
+		egg_buffer_uninit (&blob);
+		return GCR_SSH_AGENT_KEY_STORE_INVALID;
+	}
+
+	result = GCR_SSH_AGENT_KEY_STORE_ADDED;
+	if (constrained)
+		result = parse_constraints (req, offset, &expires);
+	else
+		expires = 0;
+
+	if (result != GCR_SSH_AGENT_KEY_STORE_ADDED) {
+		egg_sign_key_free (key);
+		egg_buffer_uninit (&blob);
+		g_free (comment);
+		return result;
+	}
+
+	stored = g_new0 (StoredKey, 1);
+	stored->refs = 1;
+	stored->public_key = g_bytes_new (blob.buf, blob.len);
+	stored->comment = comment;
+	stored->key = key;
+	stored->algorithm = algorithm;
+	stored->is_rsa = is_rsa;
+	stored->expires = expires;
+	egg_buffer_uninit (&blob);
+
+	if (public_key)
+		*public_key = g_bytes_ref (stored->public_key);
+
+	/* Adding a key again updates its comment and constraints */
+	g_mutex_lock (&self->lock);
+	g_hash_table_replace (self->keys, g_bytes_ref (stored->public_key), stored);
+	g_mutex_unlock (&self->lock);
+
+	return GCR_SSH_AGENT_KEY_STORE_ADDED;
+}
+
+static gboolean
+remove_expired (gpointer key,
+                gpointer value,
+                gpointer user_data)
+{
+	StoredKey *stored = value;
+	gint64 *now = user_data;
+	return stored->expires != 0 && stored->expires <= *now;
+}
+
+static void
+expire_keys_inlock (GcrSshAgentKeyStore *self)
+{
+	gint64 now = g_get_monotonic_time ();
+	g_hash_table_foreach_remove (self->keys, remove_expired, &now);
+}
+
+gboolean
+gcr_ssh_agent_key_store_remove (GcrSshAgentKeyStore *self,
+                                GBytes *public_key)
+{
+	gboolean ret;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), FALSE);
+	g_return_val_if_fail (public_key != NULL, FALSE);
+
+	g_mutex_lock (&self->lock);
+	expire_keys_inlock (self);
+	ret = g_hash_table_remove (self->keys, public_key);
+	g_mutex_unlock (&self->lock);
+
+	return ret;
+}
+
+void
+gcr_ssh_agent_key_store_clear (GcrSshAgentKeyStore *self)
+{
+	g_return_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self));
+
+	g_mutex_lock (&self->lock);
+	g_hash_table_remove_all (self->keys);
+	g_mutex_unlock (&self->lock);
+}
+
+gboolean
+gcr_ssh_agent_key_store_contains (GcrSshAgentKeyStore *self,
+                                  GBytes *public_key)
+{
+	gboolean ret;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), FALSE);
+	g_return_val_if_fail (public_key != NULL, FALSE);
+
+	g_mutex_lock (&self->lock);
+	expire_keys_inlock (self);
+	ret = g_hash_table_contains (self->keys, public_key);
+	g_mutex_unlock (&self->lock);
+
+	return ret;
+}
+
+/*
+ * Appends a key blob and comment pair for each key not in @exclude, and
+ * returns how many were added. Nothing is listed while the store is
+ * locked, as with ssh-agent.
+ */
+guint32
+gcr_ssh_agent_key_store_add_identities (GcrSshAgentKeyStore *self,
+                                        EggBuffer *resp,
+                                        GHashTable *exclude)
+{
+	GHashTableIter iter;
+	StoredKey *stored;
+	guint32 added = 0;
+	gsize length;
+	const guchar *blob;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), 0);
+	g_return_val_if_fail (resp != NULL, 0);
+
+	g_mutex_lock (&self->lock);
+
+	if (self->password == NULL) {
+		expire_keys_inlock (self);
+
+		g_hash_table_iter_init (&iter, self->keys);
+		while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&stored)) {
+			if (exclude && g_hash_table_contains (exclude, stored->public_key))
+				continue;
+			blob = g_bytes_get_data (stored->public_key, &length);
+			egg_buffer_add_byte_array (resp, blob, length);
+			egg_buffer_add_string (resp, stored->comment);
+			added++;
+		}
+	}
+
+	g_mutex_unlock (&self->lock);
+
+	return added;
+}
+
+static void
+add_mpint (EggBuffer *buffer,
+           const guchar *data,
+           gsize n_data)
+{
+	guchar *output;
+
+	while (n_data > 0 && data[0] == 0) {
+		data++;
+		n_data--;
+	}
+
+	/* Positive numbers with the top bit set need a leading zero */
+	if (n_data > 0 && (data[0] & 0x80)) {
+		output = egg_buffer_add_byte_array_empty (buffer, n_data + 1);
+		if (output) {
+			output[0] = 0;
+			memcpy (output + 1, data, n_data);
+		}
+	} else {
+		egg_buffer_add_byte_array (buffer, data, n_data);
+	}
+}
+
+gboolean
+gcr_ssh_agent_key_store_sign (GcrSshAgentKeyStore *self,
+                              GBytes *public_key,
+                              const guchar *data,
+                              gsize n_data,
+                              guint32 flags,
+                              EggBuffer *resp)
+{
+	StoredKey *stored = NULL;
+	const gchar *algorithm;
+	EggSignHash hash;
+	GBytes *signature;
+	const guchar *sig;
+	gsize n_sig;
+	EggBuffer blob;
+	EggBuffer inner;
+	gboolean ret;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), FALSE);
+	g_return_val_if_fail (public_key != NULL, FALSE);
+	g_return_val_if_fail (resp != NULL, FALSE);
+
+	g_mutex_lock (&self->lock);
+	if (self->password == NULL) {
+		expire_keys_inlock (self);
+		stored = g_hash_table_lookup (self->keys, public_key);
+		if (stored)
+			stored_key_ref (stored);
+	}
+	g_mutex_unlock (&self->lock);
+
+	if (stored == NULL)
+		return FALSE;
+
+	/* Keys can be used concurrently, so don't hold the lock here */
+	if (stored->is_rsa) {
+		if (flags & GCR_SSH_FLAG_RSA_SHA2_512) {
+			hash = EGG_SIGN_HASH_SHA512;
+			algorithm = "rsa-sha2-512";
+		} else if (flags & GCR_SSH_FLAG_RSA_SHA2_256) {
+			hash = EGG_SIGN_HASH_SHA256;
+			algorithm = "rsa-sha2-256";
+		} else {
+			hash = EGG_SIGN_HASH_SHA1;
+			algorithm = "ssh-rsa";
+		}
+	} else {
+		hash = EGG_SIGN_HASH_SHA512;
+		algorithm = stored->algorithm;
+	}
+
+	signature = egg_sign_key_sign (stored->key, hash, data, n_data);
+	if (signature == NULL) {
+		stored_key_unref (stored);
+		return FALSE;
+	}
+
+	sig = g_bytes_get_data (signature, &n_sig);
+
+	egg_buffer_init_full (&blob, 256, (EggBufferAllocator)g_realloc);
+	egg_buffer_add_string (&blob, algorithm);
+
+	/* ECDSA signatures are a pair of numbers rather than a blob */
+	if (!stored->is_rsa && stored->algorithm != NULL &&
+	    g_str_has_prefix (stored->algorithm, "ecdsa-")) {
+		egg_buffer_init_full (&inner, 160, (EggBufferAllocator)g_realloc);
+		add_mpint (&inner, sig, n_sig / 2);
+		add_mpint (&inner, sig + n_sig / 2, n_sig / 2);
+		egg_buffer_add_byte_array (&blob, inner.buf, inner.len);
+		egg_buffer_uninit (&inner);
+	} else {
+		egg_buffer_add_byte_array (&blob, sig, n_sig);
+	}
+
+	egg_buffer_add_byte (resp, GCR_SSH_RES_SIGN_RESPONSE);
+	egg_buffer_add_byte_array (resp, blob.buf, blob.len);
+	ret = !egg_buffer_has_error (&blob) && !egg_buffer_has_error (resp);
+
+	egg_buffer_uninit (&blob);
+	g_bytes_unref (signature);
+	stored_key_unref (stored);
+
+	return ret;
+}
+
+gboolean
+gcr_ssh_agent_key_store_lock (GcrSshAgentKeyStore *self,
+                              const gchar *password)
+{
+	gboolean ret = FALSE;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), FALSE);
+	g_return_val_if_fail (password != NULL, FALSE);
+
+	g_mutex_lock (&self->lock);
+	if (self->password == NULL) {
+		self->password = egg_secure_strdup (password);
+		ret = TRUE;
+	}
+	g_mutex_unlock (&self->lock);
+
+	return ret;
+}
+
+static gboolean
+password_equal (const gchar *a,
+                const gchar *b)
+{
+	gsize len = strlen (a);
+	guchar diff = 0;
+	gsize i;
+
+	if (strlen (b) != len)
+		return FALSE;
+
+	/* Don't leak how much of the password matched */
+	for (i = 0; i < len; i++)
+		diff |= a[i] ^ b[i];
+	return diff == 0;
+}
+
+gboolean
+gcr_ssh_agent_key_store_unlock (GcrSshAgentKeyStore *self,
+                                const gchar *password)
+{
+	gboolean ret = FALSE;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), FALSE);
+	g_return_val_if_fail (password != NULL, FALSE);
+
+	g_mutex_lock (&self->lock);
+	if (self->password != NULL && password_equal (self->password, password)) {
+		egg_secure_strfree (self->password);
+		self->password = NULL;
+		ret = TRUE;
+	}
+	g_mutex_unlock (&self->lock);
+
+	return ret;
+}
+
+gboolean
+gcr_ssh_agent_key_store_is_locked (GcrSshAgentKeyStore *self)
+{
+	gboolean ret;
+
+	g_return_val_if_fail (GCR_IS_SSH_AGENT_KEY_STORE (self), FALSE);
+
+	g_mutex_lock (&self->lock);
+	ret = self->password != NULL;
+	g_mutex_unlock (&self->lock);
+
+	return ret;
+}
@@ -0,0 +1,71 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GCR_SSH_AGENT_KEY_STORE_H
+#define GCR_SSH_AGENT_KEY_STORE_H
+
+#include <glib-object.h>
+#include "egg/egg-buffer.h"
+
+typedef enum {
+	GCR_SSH_AGENT_KEY_STORE_ADDED,
+	GCR_SSH_AGENT_KEY_STORE_INVALID,
+	GCR_SSH_AGENT_KEY_STORE_UNSUPPORTED,
+} GcrSshAgentKeyStoreResult;
+
+#define GCR_TYPE_SSH_AGENT_KEY_STORE gcr_ssh_agent_key_store_get_type ()
+G_DECLARE_FINAL_TYPE (GcrSshAgentKeyStore, gcr_ssh_agent_key_store, GCR, SSH_AGENT_KEY_STORE, GObject)
+
+GcrSshAgentKeyStore      *gcr_ssh_agent_key_store_new    (void);
+
+GcrSshAgentKeyStoreResult gcr_ssh_agent_key_store_add    (GcrSshAgentKeyStore *self,
+                                                          EggBuffer *req,
+                                                          gboolean constrained,
+                                                          GBytes **public_key);
+
+gboolean                  gcr_ssh_agent_key_store_remove (GcrSshAgentKeyStore *self,
+                                                          GBytes *public_key);
+
+void                      gcr_ssh_agent_key_store_clear  (GcrSshAgentKeyStore *self);
+
+gboolean                  gcr_ssh_agent_key_store_contains
+                                                         (GcrSshAgentKeyStore *self,
+                                                          GBytes *public_key);
+
+guint32                   gcr_ssh_agent_key_store_add_identities
+                                                         (GcrSshAgentKeyStore *self,
+                                                          EggBuffer *resp,
+                                                          GHashTable *exclude);
+
+gboolean                  gcr_ssh_agent_key_store_sign   (GcrSshAgentKeyStore *self,
+                                                          GBytes *public_key,
+                                                          const guchar *data,
+                                                          gsize n_data,
+                                                          guint32 flags,
+                                                          EggBuffer *resp);
+
+gboolean                  gcr_ssh_agent_key_store_lock   (GcrSshAgentKeyStore *self,
+                                                          const gchar *password);
+
+gboolean                  gcr_ssh_agent_key_store_unlock (GcrSshAgentKeyStore *self,
+                                                          const gchar *password);
+
+gboolean                  gcr_ssh_agent_key_store_is_locked
+                                                         (GcrSshAgentKeyStore *self);
+
+#endif /* GCR_SSH_AGENT_KEY_STORE_H */
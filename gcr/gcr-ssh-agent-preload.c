@@ -43,10 +43,19 @@ struct _GcrSshAgentPreload
 	GHashTable *keys_by_public_key;
 	EggFileTracker *file_tracker;
 	GMutex lock;
+
+	/* For the initial scan of the directory */
+	GPtrArray *batch;
+	GThreadPool *pool;
+	GHashTable *scanning;
+	GCond scanned;
 };
 
 G_DEFINE_TYPE (GcrSshAgentPreload, gcr_ssh_agent_preload, G_TYPE_OBJECT);
 
+/* Below this many keys it's not worth using threads */
+#define PARALLEL_SCAN_THRESHOLD 32
+
 void
 gcr_ssh_agent_key_info_free (gpointer boxed)
 {
@@ -76,11 +85,14 @@ static void file_load_inlock   (EggFileTracker *tracker,
 static void file_remove_inlock (EggFileTracker *tracker,
                                 const gchar *path,
                                 gpointer user_data);
+static void scan_inlock        (GcrSshAgentPreload *self);
 
 static void
 gcr_ssh_agent_preload_init (GcrSshAgentPreload *self)
 {
         g_mutex_init (&self->lock);
+	g_cond_init (&self->scanned);
+	self->scanning = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	self->keys_by_public_filename = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 	self->keys_by_public_key = g_hash_table_new_full (g_bytes_hash, g_bytes_equal, NULL, gcr_ssh_agent_key_info_free);
 }
@@ -95,6 +107,11 @@ gcr_ssh_agent_preload_constructed (GObject *object)
 	g_signal_connect (self->file_tracker, "file-removed", G_CALLBACK (file_remove_inlock), self);
 	g_signal_connect (self->file_tracker, "file-changed", G_CALLBACK (file_load_inlock), self);
 
+	/* Start loading the keys before the first request comes in */
+	g_mutex_lock (&self->lock);
+	scan_inlock (self);
+	g_mutex_unlock (&self->lock);
+
 	G_OBJECT_CLASS (gcr_ssh_agent_preload_parent_class)->constructed (object);
 }
 
@@ -121,6 +138,12 @@ gcr_ssh_agent_preload_finalize (GObject *object)
 {
 	GcrSshAgentPreload *self = GCR_SSH_AGENT_PRELOAD (object);
 
+	/* Wait for the scan, the threads use the tables below */
+	if (self->pool)
+		g_thread_pool_free (self->pool, FALSE, TRUE);
+	g_hash_table_unref (self->scanning);
+	g_cond_clear (&self->scanned);
+
 	g_free (self->path);
 	g_clear_pointer (&self->keys_by_public_key, g_hash_table_unref);
 	g_clear_pointer (&self->keys_by_public_filename, g_hash_table_unref);
@@ -179,6 +202,11 @@ file_remove_inlock (EggFileTracker *tracker,
 	GcrSshAgentPreload *self = GCR_SSH_AGENT_PRELOAD (user_data);
 	GcrSshAgentKeyInfo *info;
 
+	/* A pending load from the scan is out of date now */
+	if (g_hash_table_remove (self->scanning, path) &&
+	    g_hash_table_size (self->scanning) == 0)
+		g_cond_broadcast (&self->scanned);
+
 	info = g_hash_table_lookup (self->keys_by_public_filename, path);
 	if (info) {
 		g_hash_table_remove (self->keys_by_public_filename, path);
@@ -186,28 +214,24 @@ file_remove_inlock (EggFileTracker *tracker,
 	}
 }
 
-static void
-file_load_inlock (EggFileTracker *tracker,
-                  const gchar *path,
-                  gpointer user_data)
+/* Doesn't touch the preload, so can be called without the lock */
+static GcrSshAgentKeyInfo *
+load_key_info (const gchar *path)
 {
-	GcrSshAgentPreload *self = GCR_SSH_AGENT_PRELOAD (user_data);
 	gchar *private_path;
 	GBytes *private_bytes;
 	GBytes *public_bytes;
 	GBytes *public_key;
-	GcrSshAgentKeyInfo *info;
+	GcrSshAgentKeyInfo *info = NULL;
 	gchar *comment;
 
-	file_remove_inlock (tracker, path, user_data);
-
 	private_path = private_path_for_public (path);
 
 	private_bytes = file_get_contents (private_path, FALSE);
 	if (!private_bytes) {
 		g_debug ("no private key present for public key: %s", path);
 		g_free (private_path);
-		return;
+		return NULL;
 	}
 
 	public_bytes = file_get_contents (path, TRUE);
@@ -219,8 +243,6 @@ file_load_inlock (EggFileTracker *tracker,
 			private_path = NULL;
 			info->public_key = public_key;
 			info->comment = comment;
-			g_hash_table_replace (self->keys_by_public_filename, g_strdup (path), info);
-			g_hash_table_replace (self->keys_by_public_key, info->public_key, info);
 		} else {
 			g_message ("failed to parse ssh public key: %s", path);
 		}
@@ -230,6 +252,86 @@ file_load_inlock (EggFileTracker *tracker,
 
 	g_bytes_unref (private_bytes);
 	g_free (private_path);
+	return info;
+}
+
+static void
+publish_inlock (GcrSshAgentPreload *self,
+                const gchar *path,
+                GcrSshAgentKeyInfo *info)
+{
+	file_remove_inlock (self->file_tracker, path, self);
+
+	if (info) {
+		g_hash_table_replace (self->keys_by_public_filename, g_strdup (path), info);
+		g_hash_table_replace (self->keys_by_public_key, info->public_key, info);
+	}
+}
+
+static void
+file_load_inlock (EggFileTracker *tracker,
+                  const gchar *path,
+                  gpointer user_data)
+{
+	GcrSshAgentPreload *self = GCR_SSH_AGENT_PRELOAD (user_data);
+
+	if (self->batch)
+		g_ptr_array_add (self->batch, g_strdup (path));
+	else
+		publish_inlock (self, path, load_key_info (path));
+}
+
+static void
+load_in_thread (gpointer data,
+                gpointer user_data)
+{
+	GcrSshAgentPreload *self = GCR_SSH_AGENT_PRELOAD (user_data);
+	gchar *path = data;
+	GcrSshAgentKeyInfo *info;
+
+	info = load_key_info (path);
+
+	g_mutex_lock (&self->lock);
+
+	/* Each key shows up as soon as it's loaded, unless superseded */
+	if (g_hash_table_contains (self->scanning, path))
+		publish_inlock (self, path, info);
+	else
+		gcr_ssh_agent_key_info_free (info);
+
+	g_mutex_unlock (&self->lock);
+
+	g_free (path);
+}
+
+/*
+ * Large directories are loaded by a pool of threads. Listing keys
+ * doesn't wait for that, but looking up a specific key does.
+ */
+static void
+scan_inlock (GcrSshAgentPreload *self)
+{
+	GPtrArray *batch;
+	guint i;
+
+	self->batch = g_ptr_array_new_with_free_func (g_free);
+	egg_file_tracker_refresh (self->file_tracker, FALSE);
+	batch = g_steal_pointer (&self->batch);
+
+	if (batch->len < PARALLEL_SCAN_THRESHOLD) {
+		for (i = 0; i < batch->len; i++)
+			publish_inlock (self, batch->pdata[i], load_key_info (batch->pdata[i]));
+	} else {
+		self->pool = g_thread_pool_new (load_in_thread, self,
+		                                g_get_num_processors (),
+		                                FALSE, NULL);
+		for (i = 0; i < batch->len; i++) {
+			g_hash_table_add (self->scanning, g_strdup (batch->pdata[i]));
+			g_thread_pool_push (self->pool, g_strdup (batch->pdata[i]), NULL);
+		}
+	}
+
+	g_ptr_array_unref (batch);
 }
 
 GcrSshAgentPreload *
@@ -271,6 +373,13 @@ gcr_ssh_agent_preload_lookup_by_public_key (GcrSshAgentPreload *self,
 	egg_file_tracker_refresh (self->file_tracker, FALSE);
 
 	info = g_hash_table_lookup (self->keys_by_public_key, public_key);
+
+	/* The key may not have been loaded yet */
+	while (!info && g_hash_table_size (self->scanning) > 0) {
+		g_cond_wait (&self->scanned, &self->lock);
+		info = g_hash_table_lookup (self->keys_by_public_key, public_key);
+	}
+
 	if (info)
 		info = gcr_ssh_agent_key_info_copy (info);
 
@@ -45,6 +45,7 @@
 #define GCR_SSH_OP_ADD_RSA_ID_CONSTRAINED               24
 #define GCR_SSH_OP_ADD_ID_CONSTRAINED                   25
 #define GCR_SSH_OP_ADD_SMARTCARD_KEY_CONSTRAINED        26
+#define GCR_SSH_OP_EXTENSION                            27
 
 #define GCR_SSH_OP_MAX                                  27
 
@@ -67,4 +68,7 @@
 #define	GCR_SSH_FLAG_RSA_SHA2_256                       0x02
 #define	GCR_SSH_FLAG_RSA_SHA2_512                       0x04
 
+/* Same limit as OpenSSH's agent */
+#define GCR_SSH_MAX_PACKET_SIZE                         (256 * 1024)
+
 #endif /*GCRSSHPRIVATE_H_*/
@@ -26,9 +26,11 @@
 #include "gcr-ssh-agent-service.h"
 
 #include "gcr-ssh-agent-interaction.h"
+#include "gcr-ssh-agent-key-store.h"
 #include "gcr-ssh-agent-preload.h"
 #include "gcr-ssh-agent-private.h"
 #include "gcr-ssh-agent-process.h"
+#include "gcr-ssh-agent-stats.h"
 #include "gcr-ssh-agent-util.h"
 
 #include "egg/egg-buffer.h"
@@ -50,12 +52,16 @@ EGG_SECURE_DECLARE (ssh_agent);
 typedef gboolean (*GcrSshAgentOperation) (GcrSshAgentService *agent, GSocketConnection *connection, EggBuffer *req, EggBuffer *resp, GCancellable *cancellable, GError **error);
 static const GcrSshAgentOperation operations[GCR_SSH_OP_MAX];
 
+typedef gboolean (*GcrSshAgentNativeOperation) (GcrSshAgentService *agent, EggBuffer *req, EggBuffer *resp);
+static const GcrSshAgentNativeOperation native_operations[GCR_SSH_OP_MAX];
+
 enum {
 	PROP_0,
 	PROP_PATH,
         PROP_SSH_AGENT_ARGS,
 	PROP_PRELOAD,
-	PROP_INTERACTION
+	PROP_INTERACTION,
+	PROP_NATIVE
 };
 
 struct _GcrSshAgentService
@@ -69,19 +75,42 @@ struct _GcrSshAgentService
 	GTlsInteraction *interaction;
 	GSocketAddress *address;
 	GSocketListener *listener;
+	GSocketAddress *stats_address;
+	GSocketService *stats_service;
+	GcrSshAgentStats *stats;
+	/* only set when serving keys ourselves */
+	GcrSshAgentKeyStore *store;
+	/* set once ssh-agent holds a key added through it */
+	gint relayed;
 	GHashTable *keys;
+	GHashTable *pending;
 	GMutex lock;
 	GCancellable *cancellable;
 };
 
 G_DEFINE_TYPE (GcrSshAgentService, gcr_ssh_agent_service, G_TYPE_OBJECT);
 
+/* How long to wait for another client loading the same key */
+#define ENSURE_KEY_TIMEOUT (120 * G_USEC_PER_SEC)
+
+typedef struct {
+	gint refs;
+	gboolean done;
+	GCond cond;
+} PendingKey;
+
+static void pending_key_unref (gpointer data);
+
 static void
 gcr_ssh_agent_service_init (GcrSshAgentService *self)
 {
 	self->keys = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
 					    (GDestroyNotify)g_bytes_unref, NULL);
+	self->pending = g_hash_table_new_full (g_bytes_hash, g_bytes_equal,
+					       (GDestroyNotify)g_bytes_unref,
+					       pending_key_unref);
 	g_mutex_init (&self->lock);
+	self->stats = gcr_ssh_agent_stats_new ();
 }
 
 static void
@@ -95,6 +124,7 @@ gcr_ssh_agent_service_constructed (GObject *object)
 	g_free (path);
 
 	self->listener = G_SOCKET_LISTENER (g_threaded_socket_service_new (-1));
+	self->stats_service = g_socket_service_new ();
 	self->cancellable = g_cancellable_new ();
 
 	G_OBJECT_CLASS (gcr_ssh_agent_service_parent_class)->constructed (object);
@@ -121,6 +151,10 @@ gcr_ssh_agent_service_set_property (GObject *object,
 	case PROP_INTERACTION:
 		self->interaction = g_value_dup_object (value);
 		break;
+	case PROP_NATIVE:
+		if (g_value_get_boolean (value))
+			self->store = gcr_ssh_agent_key_store_new ();
+		break;
 	default:
 		G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 		break;
@@ -136,12 +170,17 @@ gcr_ssh_agent_service_finalize (GObject *object)
         g_strfreev (self->ssh_agent_args);
 	g_object_unref (self->preload);
 	g_clear_object (&self->interaction);
+	g_clear_object (&self->store);
 
 	g_object_unref (self->process);
 	g_object_unref (self->listener);
 	g_clear_object (&self->address);
+	g_object_unref (self->stats_service);
+	g_clear_object (&self->stats_address);
+	gcr_ssh_agent_stats_free (self->stats);
 	g_mutex_clear (&self->lock);
 	g_hash_table_unref (self->keys);
+	g_hash_table_unref (self->pending);
 	g_object_unref (self->cancellable);
 
 	G_OBJECT_CLASS (gcr_ssh_agent_service_parent_class)->finalize (object);
@@ -171,6 +210,10 @@ gcr_ssh_agent_service_class_init (GcrSshAgentServiceClass *klass)
 		 g_param_spec_object ("interaction", "Interaction", "Interaction",
 				      G_TYPE_TLS_INTERACTION,
 				      G_PARAM_WRITABLE));
+	g_object_class_install_property (gobject_class, PROP_NATIVE,
+		 g_param_spec_boolean ("native", "Native", "Serve keys without ssh-agent",
+				       FALSE,
+				       G_PARAM_CONSTRUCT_ONLY | G_PARAM_WRITABLE));
 }
 
 static gboolean
@@ -184,6 +227,30 @@ relay_request (GcrSshAgentService *self,
 	return _gcr_ssh_agent_call (connection, req, resp, cancellable, error);
 }
 
+/* Requests which may leave a key in ssh-agent */
+static gboolean
+is_add_request (guchar op)
+{
+	switch (op) {
+	case GCR_SSH_OP_ADD_IDENTITY:
+	case GCR_SSH_OP_ADD_ID_CONSTRAINED:
+	case GCR_SSH_OP_ADD_SMARTCARD_KEY:
+	case GCR_SSH_OP_ADD_SMARTCARD_KEY_CONSTRAINED:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
+
+static gboolean
+is_success (EggBuffer *resp)
+{
+	guchar code;
+
+	return egg_buffer_get_byte (resp, 4, NULL, &code) &&
+	       code == GCR_SSH_RES_SUCCESS;
+}
+
 static gboolean
 handle_request (GcrSshAgentService *self,
 		GSocketConnection *connection,
@@ -193,7 +260,8 @@ handle_request (GcrSshAgentService *self,
 		GError **error)
 {
 	GcrSshAgentOperation func;
-	guchar op;
+	gboolean ret;
+	guchar op = 0;
 
 	egg_buffer_reset (resp);
 	egg_buffer_add_uint32 (resp, 0);
@@ -205,15 +273,59 @@ handle_request (GcrSshAgentService *self,
 	else
 		func = relay_request;
 
-	return func (self, connection, req, resp, cancellable, error);
+	ret = func (self, connection, req, resp, cancellable, error);
+
+	/* Once ssh-agent holds a key, it has to be asked from then on */
+	if (ret && self->store && is_add_request (op) && is_success (resp))
+		g_atomic_int_set (&self->relayed, 1);
+
+	return ret;
+}
+
+/*
+ * Returns TRUE if the request was answered from the native key store,
+ * otherwise it should be relayed to ssh-agent as usual.
+ */
+static gboolean
+handle_native_request (GcrSshAgentService *self,
+		       EggBuffer *req,
+		       EggBuffer *resp)
+{
+	guchar op;
+
+	egg_buffer_reset (resp);
+	egg_buffer_add_uint32 (resp, 0);
+
+	if (!egg_buffer_get_byte (req, 4, NULL, &op))
+		return FALSE;
+
+	if (op < GCR_SSH_OP_MAX && native_operations[op] != NULL)
+		return native_operations[op] (self, req, resp);
+
+	/*
+	 * Extensions such as session-bind@openssh.com, and anything else we
+	 * don't know, only matter to ssh-agent once it holds keys.
+	 */
+	if (g_atomic_int_get (&self->relayed) || is_add_request (op))
+		return FALSE;
+
+	egg_buffer_add_byte (resp, GCR_SSH_RES_FAILURE);
+	return TRUE;
 }
 
+/* The key may be a view into a request, so it is copied when stored */
 static void
 add_key (GcrSshAgentService *self,
 	 GBytes *key)
 {
+	gconstpointer data;
+	gsize size;
+
 	g_mutex_lock (&self->lock);
-	g_hash_table_add (self->keys, g_bytes_ref (key));
+	if (!g_hash_table_contains (self->keys, key)) {
+		data = g_bytes_get_data (key, &size);
+		g_hash_table_add (self->keys, g_bytes_new (data, size));
+	}
 	g_mutex_unlock (&self->lock);
 }
 
@@ -235,8 +347,8 @@ clear_keys (GcrSshAgentService *self)
 }
 
 static void
-ensure_key (GcrSshAgentService *self,
-	    GBytes *key)
+load_key (GcrSshAgentService *self,
+	  GBytes *key)
 {
 	GcrSshAskpass *askpass;
 	GError *error = NULL;
@@ -247,6 +359,8 @@ ensure_key (GcrSshAgentService *self,
 	GHashTable *fields;
 	GTlsInteraction *interaction;
 	gchar *standard_error;
+	gint64 started;
+	gboolean ret;
 
 	gchar *argv[] = {
 		SSH_ADD_EXECUTABLE,
@@ -254,10 +368,10 @@ ensure_key (GcrSshAgentService *self,
 		NULL
 	};
 
-	if (gcr_ssh_agent_service_lookup_key (self, key))
-		return;
-
+	started = g_get_monotonic_time ();
 	info = gcr_ssh_agent_preload_lookup_by_public_key (self->preload, key);
+	gcr_ssh_agent_stats_record_timer (self->stats, GCR_SSH_AGENT_STATS_PRELOAD,
+	                                  g_get_monotonic_time () - started);
 	if (!info)
 		return;
 
@@ -277,15 +391,21 @@ ensure_key (GcrSshAgentService *self,
 	askpass = gcr_ssh_askpass_new (interaction);
 	g_object_unref (interaction);
 
-	if (!g_spawn_sync (NULL, argv, NULL,
-	                   G_SPAWN_STDOUT_TO_DEV_NULL,
-	                   gcr_ssh_askpass_child_setup, askpass,
-	                   NULL, &standard_error, &status, &error)) {
+	started = g_get_monotonic_time ();
+	ret = g_spawn_sync (NULL, argv, NULL,
+	                    G_SPAWN_STDOUT_TO_DEV_NULL,
+	                    gcr_ssh_askpass_child_setup, askpass,
+	                    NULL, &standard_error, &status, &error);
+	gcr_ssh_agent_stats_record_timer (self->stats, GCR_SSH_AGENT_STATS_ENSURE_KEY,
+	                                  g_get_monotonic_time () - started);
+
+	if (!ret) {
 		g_warning ("couldn't run %s: %s", argv[0], error->message);
 	} else if (!g_spawn_check_exit_status (status, &error)) {
 		g_message ("the %s command failed: %s", argv[0], error->message);
 		g_printerr ("%s", _gcr_ssh_agent_canon_error (standard_error));
-	} else {
+	} else if (!self->store || !gcr_ssh_agent_key_store_contains (self->store, key)) {
+		/* Keys in the native store are tracked, and expire, there */
 		add_key (self, key);
 	}
 
@@ -297,6 +417,84 @@ ensure_key (GcrSshAgentService *self,
 	g_object_unref (askpass);
 }
 
+static PendingKey *
+pending_key_ref (PendingKey *pending)
+{
+	pending->refs++;
+	return pending;
+}
+
+/* Only called with the service lock held */
+static void
+pending_key_unref (gpointer data)
+{
+	PendingKey *pending = data;
+
+	if (--pending->refs > 0)
+		return;
+
+	g_cond_clear (&pending->cond);
+	g_free (pending);
+}
+
+/*
+ * Many clients may ask for the same key at once, for example when a
+ * number of ssh connections are started together. Only the first one
+ * runs ssh-add and prompts, the others wait until it is done.
+ */
+static void
+ensure_key (GcrSshAgentService *self,
+	    GBytes *key)
+{
+	PendingKey *pending;
+	gconstpointer data;
+	gint64 end_time;
+	gsize size;
+
+	if (gcr_ssh_agent_service_lookup_key (self, key))
+		return;
+
+	g_mutex_lock (&self->lock);
+
+	pending = g_hash_table_lookup (self->pending, key);
+	if (pending) {
+		pending_key_ref (pending);
+		end_time = g_get_monotonic_time () + ENSURE_KEY_TIMEOUT;
+		while (!pending->done) {
+			if (!g_cond_wait_until (&pending->cond, &self->lock, end_time)) {
+				g_message ("timed out waiting for a key to be loaded");
+				break;
+			}
+		}
+		pending_key_unref (pending);
+		g_mutex_unlock (&self->lock);
+		return;
+	}
+
+	/* It may have been loaded since it was looked up */
+	if (g_hash_table_contains (self->keys, key) ||
+	    (self->store && gcr_ssh_agent_key_store_contains (self->store, key))) {
+		g_mutex_unlock (&self->lock);
+		return;
+	}
+
+	pending = g_new0 (PendingKey, 1);
+	pending->refs = 1;
+	g_cond_init (&pending->cond);
+	data = g_bytes_get_data (key, &size);
+	g_hash_table_insert (self->pending, g_bytes_new (data, size), pending);
+
+	g_mutex_unlock (&self->lock);
+
+	load_key (self, key);
+
+	g_mutex_lock (&self->lock);
+	pending->done = TRUE;
+	g_cond_broadcast (&pending->cond);
+	g_hash_table_remove (self->pending, key);
+	g_mutex_unlock (&self->lock);
+}
+
 static gboolean
 on_run (GThreadedSocketService *service,
 	GSocketConnection *connection,
@@ -304,27 +502,33 @@ on_run (GThreadedSocketService *service,
 	gpointer user_data)
 {
 	GcrSshAgentService *self = g_object_ref (GCR_SSH_AGENT_SERVICE (user_data));
-	EggBuffer req;
+	GInputStream *input;
+	EggBuffer plain_req;
+	EggBuffer secure_req;
+	EggBuffer *req;
 	EggBuffer resp;
 	GError *error;
-	GSocketConnection *agent_connection;
+	GSocketConnection *agent_connection = NULL;
 	gboolean ret;
+	gint64 started;
+	guchar op;
 
-	egg_buffer_init_full (&req, 128, egg_secure_realloc);
+	gcr_ssh_agent_stats_client_connected (self->stats);
+
+	/* Only requests carrying private keys or passphrases use secure memory */
+	egg_buffer_init_full (&plain_req, 128, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&secure_req, 128, egg_secure_realloc);
 	egg_buffer_init_full (&resp, 128, (EggBufferAllocator)g_realloc);
 
-	error = NULL;
-	agent_connection = gcr_ssh_agent_process_connect (self->process, self->cancellable, &error);
-	if (!agent_connection) {
-		g_warning ("couldn't connect to ssh-agent: %s", error->message);
-		g_error_free (error);
-		goto out;
-	}
+	/* Buffered so that pipelined requests are read with one call */
+	input = g_buffered_input_stream_new (g_io_stream_get_input_stream (G_IO_STREAM (connection)));
+	g_filter_input_stream_set_close_base_stream (G_FILTER_INPUT_STREAM (input), FALSE);
 
 	while (TRUE) {
 		/* Read in the request */
 		error = NULL;
-		if (!_gcr_ssh_agent_read_packet (connection, &req, self->cancellable, &error)) {
+		if (!_gcr_ssh_agent_read_packet_full (input, &plain_req, &secure_req, &req,
+						      self->cancellable, &error)) {
 			if (error->code != G_IO_ERROR_CANCELLED &&
 			    error->code != G_IO_ERROR_CONNECTION_CLOSED)
 				g_message ("couldn't read from client: %s", error->message);
@@ -334,7 +538,22 @@ on_run (GThreadedSocketService *service,
 
 		/* Handle the request */
 		error = NULL;
-		while (!(ret = handle_request (self, agent_connection, &req, &resp, self->cancellable, &error))) {
+		started = g_get_monotonic_time ();
+
+		/* In native mode ssh-agent is only started once it is needed */
+		if (self->store && handle_native_request (self, req, &resp))
+			goto done;
+
+		if (!agent_connection) {
+			agent_connection = gcr_ssh_agent_process_connect (self->process, self->cancellable, &error);
+			if (!agent_connection) {
+				g_warning ("couldn't connect to ssh-agent: %s", error->message);
+				g_error_free (error);
+				goto out;
+			}
+		}
+
+		while (!(ret = handle_request (self, agent_connection, req, &resp, self->cancellable, &error))) {
 			if (gcr_ssh_agent_process_get_pid (self->process) != 0) {
 				if (error->code != G_IO_ERROR_CANCELLED)
 					g_message ("couldn't handle client request: %s", error->message);
@@ -345,6 +564,7 @@ on_run (GThreadedSocketService *service,
 			/* Reconnect to the ssh-agent */
 			g_clear_object (&agent_connection);
 			g_clear_error (&error);
+			gcr_ssh_agent_stats_record_reconnect (self->stats);
 			agent_connection = gcr_ssh_agent_process_connect (self->process, self->cancellable, &error);
 			if (!agent_connection) {
 				if (error->code != G_IO_ERROR_CANCELLED)
@@ -354,6 +574,14 @@ on_run (GThreadedSocketService *service,
 			}
 		}
 
+	done:
+		if (!egg_buffer_get_byte (req, 4, NULL, &op))
+			op = 0;
+		gcr_ssh_agent_stats_record_op (self->stats, op, g_get_monotonic_time () - started);
+
+		if (req == &secure_req)
+			egg_secure_clear (secure_req.buf, secure_req.len);
+
 		/* Write the reply back out */
 		error = NULL;
 		if (!_gcr_ssh_agent_write_packet (connection, &resp, self->cancellable, &error)) {
@@ -365,21 +593,84 @@ on_run (GThreadedSocketService *service,
 	}
 
  out:
-	egg_buffer_uninit (&req);
+	g_object_unref (input);
+	egg_buffer_uninit (&plain_req);
+	egg_buffer_uninit (&secure_req);
 	egg_buffer_uninit (&resp);
 
-	g_object_unref (agent_connection);
+	g_clear_object (&agent_connection);
+	gcr_ssh_agent_stats_client_disconnected (self->stats);
 	g_object_unref (self);
 
 	return TRUE;
 }
 
+static gboolean
+on_stats_incoming (GSocketService *service,
+		   GSocketConnection *connection,
+		   GObject *source_object,
+		   gpointer user_data)
+{
+	GcrSshAgentService *self = GCR_SSH_AGENT_SERVICE (user_data);
+	GOutputStream *stream;
+	GError *error = NULL;
+	GString *output;
+
+	output = g_string_new ("");
+	gcr_ssh_agent_stats_dump (self->stats, output);
+
+	stream = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+	if (!g_output_stream_write_all (stream, output->str, output->len,
+					NULL, self->cancellable, &error)) {
+		if (error->code != G_IO_ERROR_CANCELLED)
+			g_message ("couldn't write stats: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_string_free (output, TRUE);
+	g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+
+	return TRUE;
+}
+
+static void
+start_stats (GcrSshAgentService *self)
+{
+	GError *error = NULL;
+	gchar *path;
+
+	path = g_strdup_printf ("%s/ssh-stats", self->path);
+	g_unlink (path);
+	self->stats_address = g_unix_socket_address_new (path);
+	g_free (path);
+
+	/* The agent is still useful without statistics, so don't fail */
+	if (!g_socket_listener_add_address (G_SOCKET_LISTENER (self->stats_service),
+					    self->stats_address,
+					    G_SOCKET_TYPE_STREAM,
+					    G_SOCKET_PROTOCOL_DEFAULT,
+					    NULL,
+					    NULL,
+					    &error)) {
+		g_message ("couldn't listen on %s: %s",
+			   g_unix_socket_address_get_path (G_UNIX_SOCKET_ADDRESS (self->stats_address)),
+			   error->message);
+		g_error_free (error);
+		g_clear_object (&self->stats_address);
+		return;
+	}
+
+	g_signal_connect (self->stats_service, "incoming", G_CALLBACK (on_stats_incoming), self);
+	g_socket_service_start (self->stats_service);
+}
+
 static void
 on_closed (GcrSshAgentProcess *process,
 	   gpointer user_data)
 {
 	GcrSshAgentService *self = GCR_SSH_AGENT_SERVICE (user_data);
 	clear_keys (self);
+	g_atomic_int_set (&self->relayed, 0);
 }
 
 gboolean
@@ -446,6 +737,8 @@ gcr_ssh_agent_service_start (GcrSshAgentService *self)
 
 	g_socket_service_start (G_SOCKET_SERVICE (self->listener));
 
+	start_stats (self);
+
 	return TRUE;
 }
 
@@ -454,9 +747,12 @@ gcr_ssh_agent_service_stop (GcrSshAgentService *self)
 {
 	if (self->address)
 		g_unlink (g_unix_socket_address_get_path (G_UNIX_SOCKET_ADDRESS (self->address)));
+	if (self->stats_address)
+		g_unlink (g_unix_socket_address_get_path (G_UNIX_SOCKET_ADDRESS (self->stats_address)));
 
 	g_cancellable_cancel (self->cancellable);
 	g_socket_service_stop (G_SOCKET_SERVICE (self->listener));
+	g_socket_service_stop (self->stats_service);
 }
 
 GcrSshAgentService *
@@ -486,6 +782,12 @@ gcr_ssh_agent_service_get_process (GcrSshAgentService *self)
 	return self->process;
 }
 
+GcrSshAgentStats *
+gcr_ssh_agent_service_get_stats (GcrSshAgentService *self)
+{
+	return self->stats;
+}
+
 gboolean
 gcr_ssh_agent_service_lookup_key (GcrSshAgentService *self,
 			  GBytes *key)
@@ -494,6 +796,8 @@ gcr_ssh_agent_service_lookup_key (GcrSshAgentService *self,
 	g_mutex_lock (&self->lock);
 	ret = g_hash_table_contains (self->keys, key);
 	g_mutex_unlock (&self->lock);
+	if (!ret && self->store)
+		ret = gcr_ssh_agent_key_store_contains (self->store, key);
 	return ret;
 }
 
@@ -516,7 +820,7 @@ op_add_identity (GcrSshAgentService *self,
 	/* If parsing the request fails, just pass through */
 	ret = egg_buffer_get_byte_array (req, offset, &offset, &blob, &length);
 	if (ret)
-		key = g_bytes_new (blob, length);
+		key = g_bytes_new_static (blob, length);
 	else
 		g_message ("got unparseable add identity request for ssh-agent");
 
@@ -564,6 +868,40 @@ parse_identities_answer (EggBuffer *resp)
 	return answer;
 }
 
+/* Add any preloaded keys not already in answer */
+static guint32
+add_preloaded_identities (GcrSshAgentService *self,
+			  EggBuffer *resp,
+			  GHashTable *answer)
+{
+	GcrSshAgentPreload *preload;
+	gint64 started;
+	guint32 added = 0;
+	gsize length;
+	GList *keys;
+	GList *l;
+
+	preload = gcr_ssh_agent_service_get_preload (self);
+	started = g_get_monotonic_time ();
+	keys = gcr_ssh_agent_preload_get_keys (preload);
+	gcr_ssh_agent_stats_record_timer (self->stats, GCR_SSH_AGENT_STATS_PRELOAD,
+	                                  g_get_monotonic_time () - started);
+	for (l = keys; l != NULL; l = g_list_next (l)) {
+		GcrSshAgentKeyInfo *info = l->data;
+		const guchar *blob;
+		if (answer && g_hash_table_contains (answer, info->public_key))
+			continue;
+		if (self->store && gcr_ssh_agent_key_store_contains (self->store, info->public_key))
+			continue;
+		blob = g_bytes_get_data (info->public_key, &length);
+		egg_buffer_add_byte_array (resp, blob, length);
+		egg_buffer_add_string (resp, info->comment);
+		added++;
+	}
+
+	g_list_free_full (keys, (GDestroyNotify)gcr_ssh_agent_key_info_free);
+	return added;
+}
 
 static gboolean
 op_request_identities (GcrSshAgentService *self,
@@ -575,12 +913,8 @@ op_request_identities (GcrSshAgentService *self,
 {
 	GHashTable *answer;
 	GHashTableIter iter;
-	gsize length;
 	guint32 added;
 	GBytes *key;
-	GList *keys;
-	GList *l;
-	GcrSshAgentPreload *preload;
 
 	if (!relay_request (self, connection, req, resp, cancellable, error))
 		return FALSE;
@@ -595,21 +929,9 @@ op_request_identities (GcrSshAgentService *self,
 		add_key (self, key);
 
 	added = 0;
-
-	/* Add any preloaded keys not already in answer */
-	preload = gcr_ssh_agent_service_get_preload (self);
-	keys = gcr_ssh_agent_preload_get_keys (preload);
-	for (l = keys; l != NULL; l = g_list_next (l)) {
-		GcrSshAgentKeyInfo *info = l->data;
-		if (!g_hash_table_contains (answer, info->public_key)) {
-			const guchar *blob = g_bytes_get_data (info->public_key, &length);
-			egg_buffer_add_byte_array (resp, blob, length);
-			egg_buffer_add_string (resp, info->comment);
-			added++;
-		}
-	}
-
-	g_list_free_full (keys, (GDestroyNotify)gcr_ssh_agent_key_info_free);
+	if (self->store)
+		added += gcr_ssh_agent_key_store_add_identities (self->store, resp, answer);
+	added += add_preloaded_identities (self, resp, answer);
 
 	/* Set the correct amount of keys including the ones we added */
 	egg_buffer_set_uint32 (resp, 5, added + g_hash_table_size (answer));
@@ -634,9 +956,13 @@ op_sign_request (GcrSshAgentService *self,
 	gsize offset = 5;
 	GBytes *key;
 
+	/* In native mode the key has already been loaded if possible */
+	if (self->store)
+		return relay_request (self, connection, req, resp, cancellable, error);
+
 	/* If parsing the request fails, just pass through */
 	if (egg_buffer_get_byte_array (req, offset, &offset, &blob, &length)) {
-		key = g_bytes_new (blob, length);
+		key = g_bytes_new_static (blob, length);
 		ensure_key (self, key);
 		g_bytes_unref (key);
 	} else {
@@ -663,7 +989,7 @@ op_remove_identity (GcrSshAgentService *self,
 	/* If parsing the request fails, just pass through */
 	ret = egg_buffer_get_byte_array (req, offset, &offset, &blob, &length);
 	if (ret)
-		key = g_bytes_new (blob, length);
+		key = g_bytes_new_static (blob, length);
 	else
 		g_message ("got unparseable remove request for ssh-agent");
 
@@ -694,6 +1020,41 @@ op_remove_all_identities (GcrSshAgentService *self,
 	return ret;
 }
 
+static gboolean
+op_lock (GcrSshAgentService *self,
+	 GSocketConnection *connection,
+	 EggBuffer *req,
+	 EggBuffer *resp,
+	 GCancellable *cancellable,
+	 GError **error)
+{
+	gchar *password;
+	gboolean ret;
+	guchar op;
+
+	ret = relay_request (self, connection, req, resp, cancellable, error);
+	if (!ret || !self->store || !is_success (resp))
+		return ret;
+
+	/* The native store follows only once ssh-agent has agreed */
+	egg_buffer_get_byte (req, 4, NULL, &op);
+	if (!egg_buffer_get_string (req, 5, NULL, &password, egg_secure_realloc))
+		return ret;
+
+	if (op == GCR_SSH_OP_LOCK)
+		ret = gcr_ssh_agent_key_store_lock (self->store, password);
+	else
+		ret = gcr_ssh_agent_key_store_unlock (self->store, password);
+	egg_secure_strfree (password);
+
+	if (!ret) {
+		egg_buffer_resize (resp, 4);
+		egg_buffer_add_byte (resp, GCR_SSH_RES_FAILURE);
+	}
+
+	return TRUE;
+}
+
 static const GcrSshAgentOperation operations[GCR_SSH_OP_MAX] = {
 	NULL,                                 /* 0 */
 	NULL,                                 /* GCR_SSH_OP_REQUEST_RSA_IDENTITIES */
@@ -717,9 +1078,215 @@ static const GcrSshAgentOperation operations[GCR_SSH_OP_MAX] = {
 	op_remove_all_identities,             /* GCR_SSH_OP_REMOVE_ALL_IDENTITIES */
 	NULL,                                 /* GCR_SSH_OP_ADD_SMARTCARD_KEY */
 	NULL,                                 /* GCR_SSH_OP_REMOVE_SMARTCARD_KEY */
-	NULL,                                 /* GCR_SSH_OP_LOCK */
-	NULL,                                 /* GCR_SSH_OP_UNLOCK */
+	op_lock,                              /* GCR_SSH_OP_LOCK */
+	op_lock,                              /* GCR_SSH_OP_UNLOCK */
 	NULL,                                 /* GCR_SSH_OP_ADD_RSA_ID_CONSTRAINED */
 	op_add_identity,                      /* GCR_SSH_OP_ADD_ID_CONSTRAINED */
 	NULL,                                 /* GCR_SSH_OP_ADD_SMARTCARD_KEY_CONSTRAINED */
 };
+
+/* ---------------------------------------------------------------------------- */
+
+static gboolean
+native_result (EggBuffer *resp,
+	       gboolean success)
+{
+	egg_buffer_add_byte (resp, success ? GCR_SSH_RES_SUCCESS : GCR_SSH_RES_FAILURE);
+	return TRUE;
+}
+
+static gboolean
+native_add_identity (GcrSshAgentService *self,
+		     EggBuffer *req,
+		     EggBuffer *resp)
+{
+	GcrSshAgentKeyStoreResult result;
+	guchar op;
+
+	/* Nothing is added while locked, as with ssh-agent */
+	if (gcr_ssh_agent_key_store_is_locked (self->store))
+		return native_result (resp, FALSE);
+
+	egg_buffer_get_byte (req, 4, NULL, &op);
+	result = gcr_ssh_agent_key_store_add (self->store, req,
+					      op == GCR_SSH_OP_ADD_ID_CONSTRAINED,
+					      NULL);
+
+	switch (result) {
+	case GCR_SSH_AGENT_KEY_STORE_ADDED:
+		return native_result (resp, TRUE);
+	case GCR_SSH_AGENT_KEY_STORE_INVALID:
+		g_message ("got unparseable add identity request for ssh-agent");
+		return native_result (resp, FALSE);
+	default:
+		/* Let ssh-agent deal with other key types and constraints */
+		return FALSE;
+	}
+}
+
+static gboolean
+native_request_identities (GcrSshAgentService *self,
+			   EggBuffer *req,
+			   EggBuffer *resp)
+{
+	guint32 added;
+
+	/* Keys in ssh-agent need to be listed as well */
+	if (g_atomic_int_get (&self->relayed))
+		return FALSE;
+
+	egg_buffer_add_byte (resp, GCR_SSH_RES_IDENTITIES_ANSWER);
+	egg_buffer_add_uint32 (resp, 0);
+
+	added = gcr_ssh_agent_key_store_add_identities (self->store, resp, NULL);
+	added += add_preloaded_identities (self, resp, NULL);
+	egg_buffer_set_uint32 (resp, 5, added);
+
+	return TRUE;
+}
+
+static gboolean
+native_sign_request (GcrSshAgentService *self,
+		     EggBuffer *req,
+		     EggBuffer *resp)
+{
+	const guchar *blob;
+	const guchar *data;
+	gsize n_blob;
+	gsize n_data;
+	gsize offset = 5;
+	guint32 flags;
+	GBytes *key;
+	gboolean ret = FALSE;
+
+	if (!egg_buffer_get_byte_array (req, offset, &offset, &blob, &n_blob) ||
+	    !egg_buffer_get_byte_array (req, offset, &offset, &data, &n_data) ||
+	    !egg_buffer_get_uint32 (req, offset, &offset, &flags)) {
+		g_message ("got unparseable sign request for ssh-agent");
+		return native_result (resp, FALSE);
+	}
+
+	key = g_bytes_new_static (blob, n_blob);
+
+	/* The preloaded key gets added back to us by ssh-add */
+	ensure_key (self, key);
+
+	if (gcr_ssh_agent_key_store_contains (self->store, key)) {
+		ret = gcr_ssh_agent_key_store_sign (self->store, key, data, n_data, flags, resp);
+		if (!ret) {
+			egg_buffer_resize (resp, 4);
+			native_result (resp, FALSE);
+		}
+		ret = TRUE;
+	} else if (!g_atomic_int_get (&self->relayed)) {
+		ret = native_result (resp, FALSE);
+	}
+
+	g_bytes_unref (key);
+	return ret;
+}
+
+static gboolean
+native_remove_identity (GcrSshAgentService *self,
+			EggBuffer *req,
+			EggBuffer *resp)
+{
+	const guchar *blob;
+	gsize length;
+	GBytes *key;
+	gboolean ret;
+
+	if (!egg_buffer_get_byte_array (req, 5, NULL, &blob, &length)) {
+		g_message ("got unparseable remove request for ssh-agent");
+		return native_result (resp, FALSE);
+	}
+
+	if (gcr_ssh_agent_key_store_is_locked (self->store))
+		return native_result (resp, FALSE);
+
+	key = g_bytes_new_static (blob, length);
+	ret = gcr_ssh_agent_key_store_remove (self->store, key);
+	if (ret)
+		remove_key (self, key);
+	g_bytes_unref (key);
+
+	if (ret || !g_atomic_int_get (&self->relayed))
+		return native_result (resp, ret);
+
+	return FALSE;
+}
+
+static gboolean
+native_remove_all_identities (GcrSshAgentService *self,
+			      EggBuffer *req,
+			      EggBuffer *resp)
+{
+	if (gcr_ssh_agent_key_store_is_locked (self->store))
+		return native_result (resp, FALSE);
+
+	gcr_ssh_agent_key_store_clear (self->store);
+	clear_keys (self);
+
+	if (g_atomic_int_get (&self->relayed))
+		return FALSE;
+
+	return native_result (resp, TRUE);
+}
+
+static gboolean
+native_lock (GcrSshAgentService *self,
+	     EggBuffer *req,
+	     EggBuffer *resp)
+{
+	gchar *password;
+	gboolean ret;
+	guchar op;
+
+	/* ssh-agent has the final say, see op_lock() */
+	if (g_atomic_int_get (&self->relayed))
+		return FALSE;
+
+	egg_buffer_get_byte (req, 4, NULL, &op);
+	if (!egg_buffer_get_string (req, 5, NULL, &password, egg_secure_realloc)) {
+		g_message ("got unparseable lock request for ssh-agent");
+		return native_result (resp, FALSE);
+	}
+
+	if (op == GCR_SSH_OP_LOCK)
+		ret = gcr_ssh_agent_key_store_lock (self->store, password);
+	else
+		ret = gcr_ssh_agent_key_store_unlock (self->store, password);
+	egg_secure_strfree (password);
+
+	return native_result (resp, ret);
+}
+
+static const GcrSshAgentNativeOperation native_operations[GCR_SSH_OP_MAX] = {
+	NULL,                                 /* 0 */
+	NULL,                                 /* GCR_SSH_OP_REQUEST_RSA_IDENTITIES */
+	NULL,                                 /* 2 */
+	NULL,                                 /* GCR_SSH_OP_RSA_CHALLENGE */
+	NULL,                                 /* 4 */
+	NULL,                                 /* 5 */
+	NULL,                                 /* 6 */
+	NULL,                                 /* GCR_SSH_OP_ADD_RSA_IDENTITY */
+	NULL,                                 /* GCR_SSH_OP_REMOVE_RSA_IDENTITY */
+	NULL,                                 /* GCR_SSH_OP_REMOVE_ALL_RSA_IDENTITIES */
+	NULL,                                 /* 10 */
+	native_request_identities,            /* GCR_SSH_OP_REQUEST_IDENTITIES */
+	NULL,                                 /* 12 */
+	native_sign_request,                  /* GCR_SSH_OP_SIGN_REQUEST */
+	NULL,                                 /* 14 */
+	NULL,                                 /* 15 */
+	NULL,                                 /* 16 */
+	native_add_identity,                  /* GCR_SSH_OP_ADD_IDENTITY */
+	native_remove_identity,               /* GCR_SSH_OP_REMOVE_IDENTITY */
+	native_remove_all_identities,         /* GCR_SSH_OP_REMOVE_ALL_IDENTITIES */
+	NULL,                                 /* GCR_SSH_OP_ADD_SMARTCARD_KEY */
+	NULL,                                 /* GCR_SSH_OP_REMOVE_SMARTCARD_KEY */
+	native_lock,                          /* GCR_SSH_OP_LOCK */
+	native_lock,                          /* GCR_SSH_OP_UNLOCK */
+	NULL,                                 /* GCR_SSH_OP_ADD_RSA_ID_CONSTRAINED */
+	native_add_identity,                  /* GCR_SSH_OP_ADD_ID_CONSTRAINED */
+	NULL,                                 /* GCR_SSH_OP_ADD_SMARTCARD_KEY_CONSTRAINED */
+};
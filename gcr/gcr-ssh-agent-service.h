@@ -27,6 +27,7 @@
 #include <gio/gio.h>
 #include "gcr-ssh-agent-preload.h"
 #include "gcr-ssh-agent-process.h"
+#include "gcr-ssh-agent-stats.h"
 #include "egg/egg-buffer.h"
 
 #define GCR_TYPE_SSH_AGENT_SERVICE gcr_ssh_agent_service_get_type ()
@@ -47,6 +48,9 @@ GcrSshAgentPreload *gcr_ssh_agent_service_get_preload
 GcrSshAgentProcess *gcr_ssh_agent_service_get_process
                                                (GcrSshAgentService *self);
 
+GcrSshAgentStats   *gcr_ssh_agent_service_get_stats
+                                               (GcrSshAgentService *self);
+
 gboolean            gcr_ssh_agent_service_lookup_key
                                                (GcrSshAgentService *self,
                                                 GBytes             *key);
@@ -0,0 +1,420 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gcr-ssh-agent-stats.h"
+#include "gcr-ssh-agent-private.h"
+
+/*
+ * Each thread counts into its own shard, and the shards are only summed
+ * when the numbers are read. A shard has its own lock, which only a
+ * reader ever contends on, so the client threads don't share any cache
+ * lines while serving requests. When a thread exits its shard is folded
+ * into the retired counters.
+ */
+
+typedef struct {
+	guint64 count;
+	guint64 total_usec;
+	guint64 buckets[GCR_SSH_AGENT_STATS_BUCKETS];
+} Histogram;
+
+typedef struct {
+	/* Unknown operations are all counted in the last slot */
+	Histogram ops[GCR_SSH_OP_MAX + 1];
+	Histogram timers[GCR_SSH_AGENT_STATS_N_TIMERS];
+	guint64 reconnects;
+	guint64 clients_connected;
+	guint64 clients_disconnected;
+} Counters;
+
+typedef struct {
+	GMutex mutex;
+	GcrSshAgentStats *stats;
+	Counters counters;
+} Shard;
+
+struct _GcrSshAgentStats {
+	GMutex mutex;
+	GList *shards;
+	Counters retired;
+};
+
+static void thread_shards_free (gpointer data);
+
+/* The shards of the current thread, one for each stats it has counted into */
+static GPrivate thread_shards = G_PRIVATE_INIT (thread_shards_free);
+
+static const gchar *OP_NAMES[GCR_SSH_OP_MAX + 1] = {
+	[GCR_SSH_OP_REQUEST_RSA_IDENTITIES] = "REQUEST_RSA_IDENTITIES",
+	[GCR_SSH_OP_RSA_CHALLENGE] = "RSA_CHALLENGE",
+	[GCR_SSH_OP_ADD_RSA_IDENTITY] = "ADD_RSA_IDENTITY",
+	[GCR_SSH_OP_REMOVE_RSA_IDENTITY] = "REMOVE_RSA_IDENTITY",
+	[GCR_SSH_OP_REMOVE_ALL_RSA_IDENTITIES] = "REMOVE_ALL_RSA_IDENTITIES",
+	[GCR_SSH_OP_REQUEST_IDENTITIES] = "REQUEST_IDENTITIES",
+	[GCR_SSH_OP_SIGN_REQUEST] = "SIGN_REQUEST",
+	[GCR_SSH_OP_ADD_IDENTITY] = "ADD_IDENTITY",
+	[GCR_SSH_OP_REMOVE_IDENTITY] = "REMOVE_IDENTITY",
+	[GCR_SSH_OP_REMOVE_ALL_IDENTITIES] = "REMOVE_ALL_IDENTITIES",
+	[GCR_SSH_OP_ADD_SMARTCARD_KEY] = "ADD_SMARTCARD_KEY",
+	[GCR_SSH_OP_REMOVE_SMARTCARD_KEY] = "REMOVE_SMARTCARD_KEY",
+	[GCR_SSH_OP_LOCK] = "LOCK",
+	[GCR_SSH_OP_UNLOCK] = "UNLOCK",
+	[GCR_SSH_OP_ADD_RSA_ID_CONSTRAINED] = "ADD_RSA_ID_CONSTRAINED",
+	[GCR_SSH_OP_ADD_ID_CONSTRAINED] = "ADD_ID_CONSTRAINED",
+	[GCR_SSH_OP_ADD_SMARTCARD_KEY_CONSTRAINED] = "ADD_SMARTCARD_KEY_CONSTRAINED",
+	[GCR_SSH_OP_MAX] = "OTHER",
+};
+
+static const gchar *TIMER_NAMES[GCR_SSH_AGENT_STATS_N_TIMERS] = {
+	[GCR_SSH_AGENT_STATS_ENSURE_KEY] = "ensure_key",
+	[GCR_SSH_AGENT_STATS_PRELOAD] = "preload",
+};
+
+GcrSshAgentStats *
+gcr_ssh_agent_stats_new (void)
+{
+	GcrSshAgentStats *stats;
+
+	stats = g_atomic_rc_box_new0 (GcrSshAgentStats);
+	g_mutex_init (&stats->mutex);
+	return stats;
+}
+
+static void
+stats_clear (gpointer data)
+{
+	GcrSshAgentStats *stats = data;
+
+	g_assert (stats->shards == NULL);
+	g_mutex_clear (&stats->mutex);
+}
+
+/* Threads that counted into the stats keep them alive until they exit */
+void
+gcr_ssh_agent_stats_free (GcrSshAgentStats *stats)
+{
+	g_atomic_rc_box_release_full (stats, stats_clear);
+}
+
+static void
+histogram_add (Histogram *to,
+               const Histogram *from)
+{
+	guint i;
+
+	to->count += from->count;
+	to->total_usec += from->total_usec;
+	for (i = 0; i < GCR_SSH_AGENT_STATS_BUCKETS; i++)
+		to->buckets[i] += from->buckets[i];
+}
+
+static void
+counters_add (Counters *to,
+              const Counters *from)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (to->ops); i++)
+		histogram_add (&to->ops[i], &from->ops[i]);
+	for (i = 0; i < G_N_ELEMENTS (to->timers); i++)
+		histogram_add (&to->timers[i], &from->timers[i]);
+	to->reconnects += from->reconnects;
+	to->clients_connected += from->clients_connected;
+	to->clients_disconnected += from->clients_disconnected;
+}
+
+static void
+shard_retire (gpointer data)
+{
+	Shard *shard = data;
+	GcrSshAgentStats *stats = shard->stats;
+
+	g_mutex_lock (&stats->mutex);
+	g_mutex_lock (&shard->mutex);
+	counters_add (&stats->retired, &shard->counters);
+	stats->shards = g_list_remove (stats->shards, shard);
+	g_mutex_unlock (&shard->mutex);
+	g_mutex_unlock (&stats->mutex);
+
+	g_mutex_clear (&shard->mutex);
+	g_free (shard);
+
+	g_atomic_rc_box_release_full (stats, stats_clear);
+}
+
+static void
+thread_shards_free (gpointer data)
+{
+	g_slist_free_full (data, shard_retire);
+}
+
+/* Only ever called from the thread that owns the shard */
+static Shard *
+stats_lock_shard (GcrSshAgentStats *stats)
+{
+	GSList *shards, *l;
+	Shard *shard = NULL;
+
+	shards = g_private_get (&thread_shards);
+	for (l = shards; l != NULL; l = g_slist_next (l)) {
+		if (((Shard *)l->data)->stats == stats) {
+			shard = l->data;
+			break;
+		}
+	}
+
+	if (shard == NULL) {
+		shard = g_new0 (Shard, 1);
+		g_mutex_init (&shard->mutex);
+		shard->stats = g_atomic_rc_box_acquire (stats);
+
+		g_mutex_lock (&stats->mutex);
+		stats->shards = g_list_prepend (stats->shards, shard);
+		g_mutex_unlock (&stats->mutex);
+
+		g_private_set (&thread_shards, g_slist_prepend (shards, shard));
+	}
+
+	g_mutex_lock (&shard->mutex);
+	return shard;
+}
+
+/* Sums up all the shards, the result is not a consistent snapshot */
+static void
+stats_collect (GcrSshAgentStats *stats,
+               Counters *counters)
+{
+	Shard *shard;
+	GList *l;
+
+	g_mutex_lock (&stats->mutex);
+	*counters = stats->retired;
+	for (l = stats->shards; l != NULL; l = g_list_next (l)) {
+		shard = l->data;
+		g_mutex_lock (&shard->mutex);
+		counters_add (counters, &shard->counters);
+		g_mutex_unlock (&shard->mutex);
+	}
+	g_mutex_unlock (&stats->mutex);
+}
+
+static void
+histogram_record (Histogram *histogram,
+                  gint64 usec)
+{
+	guint bucket;
+
+	if (usec < 0)
+		usec = 0;
+
+	bucket = g_bit_storage ((gulong)usec) - 1;
+	if (bucket >= GCR_SSH_AGENT_STATS_BUCKETS)
+		bucket = GCR_SSH_AGENT_STATS_BUCKETS - 1;
+
+	histogram->buckets[bucket]++;
+	histogram->total_usec += usec;
+	histogram->count++;
+}
+
+static guint
+op_slot (guchar op)
+{
+	if (op < GCR_SSH_OP_MAX && OP_NAMES[op] != NULL)
+		return op;
+	return GCR_SSH_OP_MAX;
+}
+
+void
+gcr_ssh_agent_stats_record_op (GcrSshAgentStats *stats,
+                               guchar op,
+                               gint64 usec)
+{
+	Shard *shard;
+
+	g_return_if_fail (stats != NULL);
+
+	shard = stats_lock_shard (stats);
+	histogram_record (&shard->counters.ops[op_slot (op)], usec);
+	g_mutex_unlock (&shard->mutex);
+}
+
+void
+gcr_ssh_agent_stats_record_timer (GcrSshAgentStats *stats,
+                                  GcrSshAgentStatsTimer timer,
+                                  gint64 usec)
+{
+	Shard *shard;
+
+	g_return_if_fail (stats != NULL);
+	g_return_if_fail (timer < GCR_SSH_AGENT_STATS_N_TIMERS);
+
+	shard = stats_lock_shard (stats);
+	histogram_record (&shard->counters.timers[timer], usec);
+	g_mutex_unlock (&shard->mutex);
+}
+
+void
+gcr_ssh_agent_stats_record_reconnect (GcrSshAgentStats *stats)
+{
+	Shard *shard;
+
+	g_return_if_fail (stats != NULL);
+
+	shard = stats_lock_shard (stats);
+	shard->counters.reconnects++;
+	g_mutex_unlock (&shard->mutex);
+}
+
+void
+gcr_ssh_agent_stats_client_connected (GcrSshAgentStats *stats)
+{
+	Shard *shard;
+
+	g_return_if_fail (stats != NULL);
+
+	shard = stats_lock_shard (stats);
+	shard->counters.clients_connected++;
+	g_mutex_unlock (&shard->mutex);
+}
+
+void
+gcr_ssh_agent_stats_client_disconnected (GcrSshAgentStats *stats)
+{
+	Shard *shard;
+
+	g_return_if_fail (stats != NULL);
+
+	shard = stats_lock_shard (stats);
+	shard->counters.clients_disconnected++;
+	g_mutex_unlock (&shard->mutex);
+}
+
+guint
+gcr_ssh_agent_stats_get_op_count (GcrSshAgentStats *stats,
+                                  guchar op)
+{
+	Counters counters;
+
+	g_return_val_if_fail (stats != NULL, 0);
+
+	stats_collect (stats, &counters);
+	return counters.ops[op_slot (op)].count;
+}
+
+guint
+gcr_ssh_agent_stats_get_timer_count (GcrSshAgentStats *stats,
+                                     GcrSshAgentStatsTimer timer)
+{
+	Counters counters;
+
+	g_return_val_if_fail (stats != NULL, 0);
+	g_return_val_if_fail (timer < GCR_SSH_AGENT_STATS_N_TIMERS, 0);
+
+	stats_collect (stats, &counters);
+	return counters.timers[timer].count;
+}
+
+guint
+gcr_ssh_agent_stats_get_reconnects (GcrSshAgentStats *stats)
+{
+	Counters counters;
+
+	g_return_val_if_fail (stats != NULL, 0);
+
+	stats_collect (stats, &counters);
+	return counters.reconnects;
+}
+
+static guint
+counters_active_clients (const Counters *counters)
+{
+	/* A client can connect on one thread and disconnect on another */
+	if (counters->clients_disconnected > counters->clients_connected)
+		return 0;
+	return counters->clients_connected - counters->clients_disconnected;
+}
+
+guint
+gcr_ssh_agent_stats_get_active_clients (GcrSshAgentStats *stats)
+{
+	Counters counters;
+
+	g_return_val_if_fail (stats != NULL, 0);
+
+	stats_collect (stats, &counters);
+	return counters_active_clients (&counters);
+}
+
+static void
+histogram_dump (const Histogram *histogram,
+                const gchar *metric,
+                const gchar *label,
+                const gchar *name,
+                GString *output)
+{
+	guint64 cumulative = 0;
+	guint i;
+
+	for (i = 0; i < GCR_SSH_AGENT_STATS_BUCKETS; i++) {
+		cumulative += histogram->buckets[i];
+		if (i == GCR_SSH_AGENT_STATS_BUCKETS - 1)
+			g_string_append_printf (output, "%s_usec_bucket{%s=\"%s\",le=\"+Inf\"} %" G_GUINT64_FORMAT "\n",
+			                        metric, label, name, cumulative);
+		else
+			g_string_append_printf (output, "%s_usec_bucket{%s=\"%s\",le=\"%lu\"} %" G_GUINT64_FORMAT "\n",
+			                        metric, label, name, (1UL << (i + 1)) - 1, cumulative);
+	}
+
+	g_string_append_printf (output, "%s_usec_sum{%s=\"%s\"} %" G_GUINT64_FORMAT "\n",
+	                        metric, label, name, histogram->total_usec);
+	g_string_append_printf (output, "%s_usec_count{%s=\"%s\"} %" G_GUINT64_FORMAT "\n",
+	                        metric, label, name, histogram->count);
+}
+
+/*
+ * The output is in the Prometheus text exposition format, so that it can
+ * be read by people as well as scraped by the usual tools.
+ */
+void
+gcr_ssh_agent_stats_dump (GcrSshAgentStats *stats,
+                          GString *output)
+{
+	Counters counters;
+	guint i;
+
+	g_return_if_fail (stats != NULL);
+	g_return_if_fail (output != NULL);
+
+	stats_collect (stats, &counters);
+
+	g_string_append_printf (output, "gcr_ssh_agent_active_clients %u\n",
+	                        counters_active_clients (&counters));
+	g_string_append_printf (output, "gcr_ssh_agent_upstream_reconnects_total %" G_GUINT64_FORMAT "\n",
+	                        counters.reconnects);
+
+	for (i = 0; i < G_N_ELEMENTS (counters.ops); i++) {
+		if (OP_NAMES[i] == NULL || counters.ops[i].count == 0)
+			continue;
+		histogram_dump (&counters.ops[i], "gcr_ssh_agent_op", "op", OP_NAMES[i], output);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (counters.timers); i++)
+		histogram_dump (&counters.timers[i], "gcr_ssh_agent_timer", "timer", TIMER_NAMES[i], output);
+}
@@ -0,0 +1,67 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see
+ * <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GCR_SSH_AGENT_STATS_H
+#define GCR_SSH_AGENT_STATS_H
+
+#include <glib.h>
+
+/* Latency buckets are powers of two in microseconds, the last one is open */
+#define GCR_SSH_AGENT_STATS_BUCKETS 24
+
+typedef struct _GcrSshAgentStats GcrSshAgentStats;
+
+typedef enum {
+	GCR_SSH_AGENT_STATS_ENSURE_KEY,
+	GCR_SSH_AGENT_STATS_PRELOAD,
+	GCR_SSH_AGENT_STATS_N_TIMERS
+} GcrSshAgentStatsTimer;
+
+GcrSshAgentStats *gcr_ssh_agent_stats_new                (void);
+
+void              gcr_ssh_agent_stats_free               (GcrSshAgentStats *stats);
+
+void              gcr_ssh_agent_stats_record_op          (GcrSshAgentStats *stats,
+                                                          guchar op,
+                                                          gint64 usec);
+
+void              gcr_ssh_agent_stats_record_timer       (GcrSshAgentStats *stats,
+                                                          GcrSshAgentStatsTimer timer,
+                                                          gint64 usec);
+
+void              gcr_ssh_agent_stats_record_reconnect   (GcrSshAgentStats *stats);
+
+void              gcr_ssh_agent_stats_client_connected   (GcrSshAgentStats *stats);
+
+void              gcr_ssh_agent_stats_client_disconnected
+                                                         (GcrSshAgentStats *stats);
+
+guint             gcr_ssh_agent_stats_get_op_count       (GcrSshAgentStats *stats,
+                                                          guchar op);
+
+guint             gcr_ssh_agent_stats_get_timer_count    (GcrSshAgentStats *stats,
+                                                          GcrSshAgentStatsTimer timer);
+
+guint             gcr_ssh_agent_stats_get_reconnects     (GcrSshAgentStats *stats);
+
+guint             gcr_ssh_agent_stats_get_active_clients (GcrSshAgentStats *stats);
+
+void              gcr_ssh_agent_stats_dump               (GcrSshAgentStats *stats,
+                                                          GString *output);
+
+#endif /* GCR_SSH_AGENT_STATS_H */
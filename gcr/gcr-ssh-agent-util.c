@@ -26,46 +26,111 @@
 #include <string.h>
 
 #include "gcr-ssh-agent-util.h"
+#include "gcr-ssh-agent-private.h"
 
-gboolean
-_gcr_ssh_agent_read_packet (GSocketConnection *connection,
-			    EggBuffer *buffer,
-			    GCancellable *cancellable,
-			    GError **error)
+static gboolean
+is_sensitive_op (guchar op)
 {
-	GInputStream *stream;
-	guint32 packet_size;
-	gsize bytes_read;
-
-	stream = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+	switch (op) {
+	case GCR_SSH_OP_ADD_RSA_IDENTITY:
+	case GCR_SSH_OP_ADD_IDENTITY:
+	case GCR_SSH_OP_ADD_RSA_ID_CONSTRAINED:
+	case GCR_SSH_OP_ADD_ID_CONSTRAINED:
+	case GCR_SSH_OP_LOCK:
+	case GCR_SSH_OP_UNLOCK:
+		return TRUE;
+	default:
+		return FALSE;
+	}
+}
 
-	egg_buffer_reset (buffer);
-	egg_buffer_resize (buffer, 4);
+static gboolean
+read_exactly (GInputStream *stream,
+	      guchar *data,
+	      gsize length,
+	      GCancellable *cancellable,
+	      GError **error)
+{
+	gsize bytes_read;
 
-	if (!g_input_stream_read_all (stream, buffer->buf, 4, &bytes_read, cancellable, error))
+	if (!g_input_stream_read_all (stream, data, length, &bytes_read, cancellable, error))
 		return FALSE;
 
-	if (bytes_read < 4) {
+	if (bytes_read < length) {
 		g_set_error (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED,
 			     "connection closed by peer");
 		return FALSE;
 	}
 
-	if (!egg_buffer_get_uint32 (buffer, 0, NULL, &packet_size) ||
-	    packet_size < 1) {
+	return TRUE;
+}
+
+/*
+ * Reads a packet into @buffer. If @secure is set, packets which carry
+ * private keys or passphrases are read into it instead, and @packet is
+ * set to whichever buffer was used. Reading from a buffered stream lets
+ * pipelined requests be pulled in with a single read.
+ */
+gboolean
+_gcr_ssh_agent_read_packet_full (GInputStream *stream,
+				 EggBuffer *buffer,
+				 EggBuffer *secure,
+				 EggBuffer **packet,
+				 GCancellable *cancellable,
+				 GError **error)
+{
+	guchar header[5];
+	guint32 packet_size;
+	EggBuffer *target;
+
+	if (!read_exactly (stream, header, 4, cancellable, error))
+		return FALSE;
+
+	packet_size = egg_buffer_decode_uint32 (header);
+	if (packet_size < 1 || packet_size > GCR_SSH_MAX_PACKET_SIZE) {
+		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+			     "invalid packet size %u",
+			     packet_size);
+		return FALSE;
+	}
+
+	/* The operation decides where the rest goes */
+	if (!read_exactly (stream, header + 4, 1, cancellable, error))
+		return FALSE;
+
+	target = buffer;
+	if (secure && is_sensitive_op (header[4]))
+		target = secure;
+
+	egg_buffer_reset (target);
+	if (!egg_buffer_resize (target, (gsize)packet_size + 4)) {
 		g_set_error (error, G_IO_ERROR, G_IO_ERROR_FAILED,
 			     "invalid packet size %u",
 			     packet_size);
 		return FALSE;
 	}
 
-	egg_buffer_resize (buffer, packet_size + 4);
-	if (!g_input_stream_read_all (stream, buffer->buf + 4, packet_size, &bytes_read, cancellable, error))
+	memcpy (target->buf, header, sizeof (header));
+	if (!read_exactly (stream, target->buf + sizeof (header), packet_size - 1, cancellable, error))
 		return FALSE;
 
+	if (packet)
+		*packet = target;
 	return TRUE;
 }
 
+gboolean
+_gcr_ssh_agent_read_packet (GSocketConnection *connection,
+			    EggBuffer *buffer,
+			    GCancellable *cancellable,
+			    GError **error)
+{
+	GInputStream *stream;
+
+	stream = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+	return _gcr_ssh_agent_read_packet_full (stream, buffer, NULL, NULL, cancellable, error);
+}
+
 gboolean
 _gcr_ssh_agent_write_packet (GSocketConnection *connection,
 			     EggBuffer *buffer,
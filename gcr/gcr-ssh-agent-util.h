@@ -26,6 +26,13 @@
 #ifndef GCR_SSH_AGENT_UTIL_H
 #define GCR_SSH_AGENT_UTIL_H
 
+gboolean _gcr_ssh_agent_read_packet_full (GInputStream       *stream,
+                                          EggBuffer          *buffer,
+                                          EggBuffer          *secure,
+                                          EggBuffer         **packet,
+                                          GCancellable       *cancellable,
+                                          GError            **error);
+
 gboolean _gcr_ssh_agent_read_packet      (GSocketConnection  *connection,
                                           EggBuffer          *buffer,
                                           GCancellable       *cancellable,
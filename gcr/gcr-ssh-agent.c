@@ -22,12 +22,15 @@
 
 static gchar *base_dir;
 static gchar **ssh_agent_args = NULL;
+static gboolean native = FALSE;
 
 /* gcr-ssh-agent --base-dir <base_dir> -- [ssh-agent options]
  * gcr-ssh-agent --base-dir /home/user/test/ -- -c -d */
 
 static GOptionEntry opt_entries[] = {
         { "base-dir", 'd', 0, G_OPTION_ARG_FILENAME, &base_dir, "Base directory", NULL },
+        { "native", 'n', 0, G_OPTION_ARG_NONE, &native,
+          "Hold supported keys without ssh-agent", NULL },
         { G_OPTION_REMAINING, 0, 0, G_OPTION_ARG_STRING_ARRAY, &ssh_agent_args,
           "ssh-agent options", NULL },
         { NULL }
@@ -71,7 +74,12 @@ main (int argc,
 	}
 
 	preload = gcr_ssh_agent_preload_new ("~/.ssh");
-	service = gcr_ssh_agent_service_new (base_dir, ssh_agent_args, preload);
+	service = g_object_new (GCR_TYPE_SSH_AGENT_SERVICE,
+	                        "path", base_dir,
+	                        "ssh-agent-args", ssh_agent_args,
+	                        "preload", preload,
+	                        "native", native,
+	                        NULL);
         g_free (ssh_agent_args);
 	g_object_unref (preload);
 
@@ -409,6 +409,9 @@ gcr_system_prompt_constructed (GObject *obj)
 
 	if (self->pv->prompter_bus_name == NULL)
 		self->pv->prompter_bus_name = g_strdup (GCR_DBUS_PROMPTER_SYSTEM_BUS_NAME);
+
+	/* So opening the prompt doesn't have to wait for key generation */
+	_gcr_secret_exchange_prepare_keys ();
 }
 
 static void
@@ -255,6 +255,8 @@ gcr_system_prompter_init (GcrSystemPrompter *self)
 	self->pv = gcr_system_prompter_get_instance_private (self);
 	self->pv->callbacks = g_hash_table_new_full (callback_hash, callback_equal, callback_free, unwatch_name);
 	self->pv->active = g_hash_table_new_full (callback_hash, callback_equal, NULL, active_prompt_unref);
+
+	_gcr_secret_exchange_prepare_keys ();
 }
 
 static void
@@ -239,6 +239,82 @@ test_fingerprint_hex (Test *test, gconstpointer unused)
 	g_free (print);
 }
 
+static void
+check_fingerprints (GcrCertificate *certificate,
+                    const GChecksumType *types,
+                    guint n_types,
+                    const guchar *fingerprints)
+{
+	guchar *print;
+	gsize n_print;
+	guint i;
+
+	for (i = 0; i < n_types; i++) {
+		print = gcr_certificate_get_fingerprint (certificate, types[i], &n_print);
+		g_assert (memcmp (print, fingerprints, n_print) == 0);
+		fingerprints += n_print;
+		g_free (print);
+	}
+}
+
+static void
+test_fingerprints (Test *test, gconstpointer unused)
+{
+	const GChecksumType types[] = { G_CHECKSUM_SHA1, G_CHECKSUM_SHA256, G_CHECKSUM_MD5 };
+	GcrCertificate *certificates[] = { test->certificate, test->dsa_cert, test->dhansak_cert };
+	guchar prints[3 * (20 + 32 + 16)];
+
+	g_assert (gcr_certificate_get_fingerprints (test->certificate, types, 3, prints, sizeof (prints)));
+	g_assert (memcmp (prints + 20 + 32, "\xa2\x6f\x53\xb7\xee\x40\xdb\x4a\x68\xe7\xfa\x18\xd9\x10\x4b\x72", 16) == 0);
+	check_fingerprints (test->certificate, types, 3, prints);
+
+	g_assert (gcr_fingerprints_from_certificates (certificates, 3, types, 3, prints, sizeof (prints)));
+	check_fingerprints (test->certificate, types, 3, prints);
+	check_fingerprints (test->dsa_cert, types, 3, prints + 68);
+	check_fingerprints (test->dhansak_cert, types, 3, prints + 136);
+}
+
+static void
+test_key_fingerprint (Test *test, gconstpointer unused)
+{
+	const GChecksumType types[] = { G_CHECKSUM_SHA1, G_CHECKSUM_SHA256 };
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GckAttributes *attrs;
+	const guchar *der;
+	guchar *expected;
+	guchar *print;
+	gsize n_expected;
+	gsize n_print;
+	gsize n_der;
+	guint i;
+
+	der = gcr_certificate_get_der_data (test->certificate, &n_der);
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_CERTIFICATE);
+	gck_builder_add_data (&builder, CKA_VALUE, der, n_der);
+	attrs = gck_builder_end (&builder);
+
+	for (i = 0; i < G_N_ELEMENTS (types); i++) {
+		expected = gcr_fingerprint_from_attributes (attrs, types[i], &n_expected);
+		g_assert (expected);
+
+		/* The second call comes from the memoized value */
+		print = gcr_certificate_get_key_fingerprint (test->certificate, types[i], &n_print);
+		egg_assert_cmpmem (print, n_print, ==, expected, n_expected);
+		g_free (print);
+		print = gcr_certificate_get_key_fingerprint (test->certificate, types[i], &n_print);
+		egg_assert_cmpmem (print, n_print, ==, expected, n_expected);
+		g_free (print);
+
+		g_free (expected);
+	}
+
+	print = gcr_certificate_get_key_fingerprint (test->certificate, G_CHECKSUM_MD5, &n_print);
+	g_assert (print == NULL);
+	g_assert_cmpuint (n_print, ==, 0);
+
+	gck_attributes_unref (attrs);
+}
+
 static void
 test_certificate_key_size (Test *test, gconstpointer unused)
 {
@@ -271,6 +347,18 @@ test_basic_constraints (Test *test,
 
 	g_assert (is_ca == FALSE);
 	g_assert (path_len == -1);
+
+	/* Answered again from the decoded extension */
+	is_ca = TRUE;
+	path_len = 0;
+	if (!gcr_certificate_get_basic_constraints (test->dsa_cert, &is_ca, &path_len))
+		g_assert_not_reached ();
+	g_assert (is_ca == FALSE);
+	g_assert (path_len == -1);
+
+	/* A version 1 certificate without any extensions */
+	g_assert (!gcr_certificate_get_basic_constraints (test->certificate, NULL, NULL));
+	g_assert (!gcr_certificate_get_basic_constraints (test->certificate, NULL, NULL));
 }
 
 
@@ -383,6 +471,8 @@ main (int argc, char **argv)
 	g_test_add ("/gcr/certificate/serial_number", Test, NULL, setup, test_serial_number, teardown);
 	g_test_add ("/gcr/certificate/fingerprint", Test, NULL, setup, test_fingerprint, teardown);
 	g_test_add ("/gcr/certificate/fingerprint_hex", Test, NULL, setup, test_fingerprint_hex, teardown);
+	g_test_add ("/gcr/certificate/fingerprints", Test, NULL, setup, test_fingerprints, teardown);
+	g_test_add ("/gcr/certificate/key_fingerprint", Test, NULL, setup, test_key_fingerprint, teardown);
 	g_test_add ("/gcr/certificate/key_size", Test, NULL, setup, test_certificate_key_size, teardown);
 	g_test_add ("/gcr/certificate/is_issuer", Test, NULL, setup, test_certificate_is_issuer, teardown);
 	g_test_add ("/gcr/certificate/basic_constraints", Test, NULL, setup, test_basic_constraints, teardown);
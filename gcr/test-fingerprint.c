@@ -37,6 +37,10 @@
 
 #include <errno.h>
 
+#ifndef CKA_PUBLIC_KEY_INFO
+#define CKA_PUBLIC_KEY_INFO 0x129UL
+#endif
+
 typedef struct {
 	GBytes *cert_rsa;
 	GBytes *key_rsa;
@@ -194,6 +198,37 @@ test_dsa (Test *test, gconstpointer unused)
 	gck_attributes_unref (cert);
 }
 
+static void
+test_public_key_info (Test *test, gconstpointer unused)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	GckAttributes *attrs;
+	GBytes *info;
+	guchar *fingerprint1, *fingerprint2;
+	gsize n_fingerprint1, n_fingerprint2;
+
+	info = parse_subject_public_key_info_for_cert (test->cert_rsa);
+
+	/* Not enough to build the key, so the info is used as is */
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_PUBLIC_KEY);
+	gck_builder_add_data (&builder, CKA_PUBLIC_KEY_INFO, g_bytes_get_data (info, NULL),
+	                      g_bytes_get_size (info));
+	attrs = gck_builder_end (&builder);
+
+	fingerprint1 = gcr_fingerprint_from_subject_public_key_info (g_bytes_get_data (info, NULL),
+	                                                             g_bytes_get_size (info),
+	                                                             G_CHECKSUM_SHA256, &n_fingerprint1);
+	fingerprint2 = gcr_fingerprint_from_attributes (attrs, G_CHECKSUM_SHA256, &n_fingerprint2);
+
+	egg_assert_cmpmem (fingerprint1, n_fingerprint1, ==, fingerprint2, n_fingerprint2);
+
+	g_free (fingerprint1);
+	g_free (fingerprint2);
+
+	g_bytes_unref (info);
+	gck_attributes_unref (attrs);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -201,6 +236,7 @@ main (int argc, char **argv)
 
 	g_test_add ("/gcr/fingerprint/rsa", Test, NULL, setup, test_rsa, teardown);
 	g_test_add ("/gcr/fingerprint/dsa", Test, NULL, setup, test_dsa, teardown);
+	g_test_add ("/gcr/fingerprint/public_key_info", Test, NULL, setup, test_public_key_info, teardown);
 
 	return g_test_run ();
 }
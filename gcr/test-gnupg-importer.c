@@ -0,0 +1,352 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gcr/gcr.h"
+#include "gcr/gcr-gnupg-importer.h"
+
+#include "egg/egg-testing.h"
+
+#include <glib.h>
+
+#define WAIT 10000
+
+typedef struct {
+	gchar *directory;
+	GPtrArray *parsed;
+	GPtrArray *importers;
+	GCancellable *cancellable;
+	guint pending;
+	guint failed;
+	guint cancelled;
+} Test;
+
+static void
+on_parser_parsed (GcrParser *parser,
+                  gpointer user_data)
+{
+	Test *test = user_data;
+	g_ptr_array_add (test->parsed, gcr_parsed_ref (gcr_parser_get_parsed (parser)));
+}
+
+static void
+setup (Test *test,
+       gconstpointer data)
+{
+	test->directory = egg_tests_create_scratch_directory (NULL, NULL);
+	test->parsed = g_ptr_array_new_with_free_func ((GDestroyNotify)gcr_parsed_unref);
+	test->importers = g_ptr_array_new_with_free_func (g_object_unref);
+	test->cancellable = g_cancellable_new ();
+
+	/* Importers from gcr_importer_create_for_parsed() use the default home */
+	g_setenv ("GNUPGHOME", test->directory, TRUE);
+}
+
+static void
+load_parsed (Test *test)
+{
+	GError *error = NULL;
+	GcrParser *parser;
+	gchar *contents;
+	gsize length;
+
+	g_file_get_contents (SRCDIR "/gcr/fixtures/pubring.gpg", &contents, &length, &error);
+	g_assert_no_error (error);
+
+	parser = gcr_parser_new ();
+	g_signal_connect (parser, "parsed", G_CALLBACK (on_parser_parsed), test);
+	gcr_parser_parse_data (parser, (const guchar *)contents, length, &error);
+	g_assert_no_error (error);
+	g_object_unref (parser);
+	g_free (contents);
+}
+
+static void
+teardown (Test *test,
+          gconstpointer data)
+{
+	g_unsetenv ("GNUPGHOME");
+	g_object_unref (test->cancellable);
+	g_ptr_array_unref (test->importers);
+	g_ptr_array_unref (test->parsed);
+	egg_tests_remove_scratch_directory (test->directory);
+	g_free (test->directory);
+}
+
+static gboolean
+skip_without_gnupg (void)
+{
+#ifdef WITH_GNUTLS
+#if GNUTLS_VERSION_NUMBER < 0x030805
+	g_test_skip ("GnuTLS 3.8.5 is required");
+	return TRUE;
+#endif
+#endif
+	if (!g_file_test (GPG_EXECUTABLE, G_FILE_TEST_IS_EXECUTABLE)) {
+		g_test_skip ("gpg is not available");
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+static void
+on_import_complete (GObject *source,
+                    GAsyncResult *result,
+                    gpointer user_data)
+{
+	Test *test = user_data;
+	GError *error = NULL;
+
+	if (!gcr_importer_import_finish (GCR_IMPORTER (source), result, &error)) {
+		if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			test->cancelled++;
+		else
+			test->failed++;
+		g_error_free (error);
+	}
+
+	g_assert_cmpuint (test->pending, >, 0);
+	if (--test->pending == 0)
+		egg_test_wait_stop ();
+}
+
+static void
+start_import (Test *test,
+              guint index,
+              GCancellable *cancellable)
+{
+	GcrImporter *importer;
+	GList *importers;
+	gboolean batch;
+
+	importers = gcr_importer_create_for_parsed (test->parsed->pdata[index]);
+	g_assert_cmpuint (g_list_length (importers), ==, 1);
+	g_assert (GCR_IS_GNUPG_IMPORTER (importers->data));
+	importer = importers->data;
+	g_list_free (importers);
+
+	g_object_get (importer, "batch", &batch, NULL);
+	g_assert (batch);
+
+	gcr_importer_import_async (importer, cancellable, on_import_complete, test);
+	g_ptr_array_add (test->importers, importer);
+	test->pending++;
+}
+
+static void
+start_imports (Test *test,
+               guint from,
+               guint to)
+{
+	guint i;
+
+	for (i = from; i < to; i++)
+		start_import (test, i, NULL);
+}
+
+static void
+check_imported (Test *test)
+{
+	const gchar **imported;
+	guint i;
+
+	g_assert_cmpuint (test->failed, ==, 0);
+	g_assert_cmpuint (test->importers->len, ==, test->parsed->len);
+
+	/* Each importer only gets the results for its own key */
+	for (i = 0; i < test->importers->len; i++) {
+		imported = _gcr_gnupg_importer_get_imported (test->importers->pdata[i]);
+		g_assert_cmpuint (g_strv_length ((gchar **)imported), ==, 1);
+	}
+
+	imported = _gcr_gnupg_importer_get_imported (test->importers->pdata[0]);
+	g_assert_cmpstr (imported[0], ==, "61A6EA3E0115080227A32EC94842D952AFC000FD");
+	imported = _gcr_gnupg_importer_get_imported (test->importers->pdata[7]);
+	g_assert_cmpstr (imported[0], ==, "7B96D396E6471601754BE4DB53B620D01CE0C630");
+}
+
+static guint
+count_keys (Test *test)
+{
+	const gchar *argv[] = { GPG_EXECUTABLE, "--homedir", test->directory, "--batch",
+	                        "--with-colons", "--list-keys", NULL };
+	GError *error = NULL;
+	gchar **lines;
+	gchar *output;
+	guint count = 0;
+	guint i;
+
+	g_spawn_sync (NULL, (gchar **)argv, NULL, G_SPAWN_STDERR_TO_DEV_NULL,
+	              NULL, NULL, &output, NULL, NULL, &error);
+	g_assert_no_error (error);
+
+	lines = g_strsplit (output, "\n", -1);
+	for (i = 0; lines[i] != NULL; i++) {
+		if (g_str_has_prefix (lines[i], "pub:"))
+			count++;
+	}
+
+	g_strfreev (lines);
+	g_free (output);
+	return count;
+}
+
+static void
+test_batch (Test *test,
+            gconstpointer data)
+{
+	if (skip_without_gnupg ())
+		return;
+
+	load_parsed (test);
+	g_assert_cmpuint (test->parsed->len, ==, 8);
+
+	start_imports (test, 0, test->parsed->len);
+	egg_test_wait_until (WAIT);
+	g_assert_cmpuint (test->pending, ==, 0);
+
+	check_imported (test);
+}
+
+static void
+test_batch_while_running (Test *test,
+                          gconstpointer data)
+{
+	if (skip_without_gnupg ())
+		return;
+
+	load_parsed (test);
+	g_assert_cmpuint (test->parsed->len, ==, 8);
+
+	/* The second lot waits for the first gpg to finish */
+	start_imports (test, 0, 4);
+	g_main_context_iteration (NULL, FALSE);
+	start_imports (test, 4, test->parsed->len);
+
+	egg_test_wait_until (WAIT);
+	g_assert_cmpuint (test->pending, ==, 0);
+
+	check_imported (test);
+}
+
+static void
+test_batch_cancel_one (Test *test,
+                       gconstpointer data)
+{
+	const gchar **imported;
+	guint i;
+
+	if (skip_without_gnupg ())
+		return;
+
+	load_parsed (test);
+	g_assert_cmpuint (test->parsed->len, ==, 8);
+
+	for (i = 0; i < test->parsed->len; i++)
+		start_import (test, i, i == 3 ? test->cancellable : NULL);
+	g_cancellable_cancel (test->cancellable);
+
+	egg_test_wait_until (WAIT);
+	g_assert_cmpuint (test->pending, ==, 0);
+	g_assert_cmpuint (test->failed, ==, 0);
+	g_assert_cmpuint (test->cancelled, ==, 1);
+
+	/* The rest of the batch still went through */
+	for (i = 0; i < test->importers->len; i++) {
+		imported = _gcr_gnupg_importer_get_imported (test->importers->pdata[i]);
+		g_assert_cmpuint (g_strv_length ((gchar **)imported), ==, i == 3 ? 0 : 1);
+	}
+
+	/* The cancelled key wasn't passed to gpg at all */
+	g_assert_cmpuint (count_keys (test), ==, test->parsed->len - 1);
+}
+
+static void
+test_batch_other_context (Test *test,
+                          gconstpointer data)
+{
+	GMainContext *context;
+
+	if (skip_without_gnupg ())
+		return;
+
+	load_parsed (test);
+	g_assert_cmpuint (test->parsed->len, ==, 8);
+
+	/* Only this context is run, so the whole batch must live there */
+	context = g_main_context_new ();
+	g_main_context_push_thread_default (context);
+
+	start_imports (test, 0, test->parsed->len);
+	egg_test_wait_until (WAIT);
+	g_assert_cmpuint (test->pending, ==, 0);
+
+	g_main_context_pop_thread_default (context);
+	g_main_context_unref (context);
+
+	check_imported (test);
+}
+
+static void
+test_batch_cancel_running (Test *test,
+                           gconstpointer data)
+{
+	guint i;
+
+	if (skip_without_gnupg ())
+		return;
+
+	load_parsed (test);
+	g_assert_cmpuint (test->parsed->len, ==, 8);
+
+	for (i = 0; i < test->parsed->len; i++)
+		start_import (test, i, test->cancellable);
+
+	/* Start the shared gpg, then cancel every import in it */
+	g_main_context_iteration (NULL, FALSE);
+	g_cancellable_cancel (test->cancellable);
+
+	egg_test_wait_until (WAIT);
+	g_assert_cmpuint (test->pending, ==, 0);
+	g_assert_cmpuint (test->failed, ==, 0);
+	g_assert_cmpuint (test->cancelled, ==, test->parsed->len);
+
+	/* A new import isn't held up by the cancelled batch */
+	g_ptr_array_set_size (test->importers, 0);
+	start_imports (test, 0, test->parsed->len);
+	egg_test_wait_until (WAIT);
+	g_assert_cmpuint (test->pending, ==, 0);
+
+	check_imported (test);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_set_prgname ("test-gnupg-importer");
+
+	g_test_add ("/gcr/gnupg-importer/batch", Test, NULL, setup, test_batch, teardown);
+	g_test_add ("/gcr/gnupg-importer/batch_while_running", Test, NULL, setup, test_batch_while_running, teardown);
+	g_test_add ("/gcr/gnupg-importer/batch_cancel_one", Test, NULL, setup, test_batch_cancel_one, teardown);
+	g_test_add ("/gcr/gnupg-importer/batch_cancel_running", Test, NULL, setup, test_batch_cancel_running, teardown);
+	g_test_add ("/gcr/gnupg-importer/batch_other_context", Test, NULL, setup, test_batch_other_context, teardown);
+
+	return egg_tests_run_with_loop ();
+}
@@ -197,6 +197,58 @@ test_run_simple_output (Test *test, gconstpointer unused)
 	g_assert_cmpstr ("simple-output\n", ==, test->output_buf->str);
 }
 
+static void
+on_process_output_record (GcrGnupgProcess *process, GcrRecord *record, gpointer user_data)
+{
+	GPtrArray *records = user_data;
+	g_ptr_array_add (records, _gcr_record_copy (record));
+}
+
+static void
+test_run_output_records (Test *test, gconstpointer unused)
+{
+	const gchar *argv[] = { NULL };
+	GOutputStream *output;
+	GError *error = NULL;
+	GPtrArray *records;
+	gboolean ret;
+	gchar *script;
+
+	script = build_script_path ("mock-colon-output");
+	test->process = _gcr_gnupg_process_new (NULL, script);
+	g_object_add_weak_pointer (G_OBJECT (test->process), (gpointer *)&test->process);
+	g_free (script);
+
+	output = _gcr_callback_output_stream_new (on_process_output_data, test, NULL);
+	_gcr_gnupg_process_set_output_stream (test->process, output);
+	g_object_unref (output);
+
+	records = g_ptr_array_new_with_free_func (_gcr_record_free);
+	g_signal_connect (test->process, "output-record", G_CALLBACK (on_process_output_record), records);
+
+	_gcr_gnupg_process_run_async (test->process, argv, NULL, GCR_GNUPG_PROCESS_OUTPUT_RECORDS,
+	                              NULL, on_async_ready, test);
+	egg_test_wait_until (WAIT);
+
+	g_assert (test->result);
+	ret = _gcr_gnupg_process_run_finish (test->process, test->result, &error);
+	g_assert_no_error (error);
+	g_assert (ret == TRUE);
+
+	/* The output stream still gets the data as is */
+	g_assert (g_str_has_prefix (test->output_buf->str, "pub:u:2048:1:6C7EE1B8621CC013:1305813041::::::\n"));
+	g_assert (g_str_has_suffix (test->output_buf->str, "Test Key:\nsub:u:2048"));
+
+	g_assert_cmpuint (records->len, ==, 3);
+	g_assert (_gcr_record_get_schema (records->pdata[0]) == GCR_RECORD_SCHEMA_PUB);
+	g_assert_cmpstr (_gcr_record_get_raw (records->pdata[0], 4), ==, "6C7EE1B8621CC013");
+	g_assert (_gcr_record_get_schema (records->pdata[1]) == GCR_RECORD_SCHEMA_UID);
+	g_assert_cmpstr (_gcr_record_get_raw (records->pdata[1], 9), ==, "Test Key");
+	g_assert (_gcr_record_get_schema (records->pdata[2]) == GCR_RECORD_SCHEMA_SUB);
+
+	g_ptr_array_unref (records);
+}
+
 static void
 test_run_simple_error (Test *test, gconstpointer unused)
 {
@@ -574,6 +626,7 @@ main (int argc, char **argv)
 
 	g_test_add ("/gcr/gnupg-process/create", Test, NULL, setup, test_create, teardown);
 	g_test_add ("/gcr/gnupg-process/run_simple_output", Test, NULL, setup, test_run_simple_output, teardown);
+	g_test_add ("/gcr/gnupg-process/run_output_records", Test, NULL, setup, test_run_output_records, teardown);
 	g_test_add ("/gcr/gnupg-process/run_simple_error", Test, NULL, setup, test_run_simple_error, teardown);
 	g_test_add ("/gcr/gnupg-process/run_status_and_output", Test, NULL, setup, test_run_status_and_output, teardown);
 	g_test_add ("/gcr/gnupg-process/run_status_and_attribute", Test, NULL, setup, test_run_status_and_attribute, teardown);
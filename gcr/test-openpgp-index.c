@@ -0,0 +1,392 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gcr/gcr.h"
+#include "gcr/gcr-openpgp-index.h"
+#include "gcr/gcr-record.h"
+
+#include "egg/egg-testing.h"
+
+#include <glib.h>
+#include <glib/gstdio.h>
+#include <string.h>
+
+typedef struct {
+	gchar *directory;
+	gchar *keyring;
+	gchar *cache;
+	GcrOpenpgpIndex *index;
+} Test;
+
+static void
+setup (Test *test,
+       gconstpointer data)
+{
+	const gchar *fixture = data;
+	gchar *basename;
+
+	test->directory = egg_tests_create_scratch_directory (fixture, NULL);
+	basename = g_path_get_basename (fixture);
+	test->keyring = g_build_filename (test->directory, basename, NULL);
+	test->cache = g_build_filename (test->directory, "index.cache", NULL);
+	test->index = _gcr_openpgp_index_new (test->keyring, test->cache);
+	g_free (basename);
+}
+
+static void
+teardown (Test *test,
+          gconstpointer data)
+{
+	_gcr_openpgp_index_free (test->index);
+	egg_tests_remove_scratch_directory (test->directory);
+	g_free (test->directory);
+	g_free (test->keyring);
+	g_free (test->cache);
+}
+
+static gboolean
+skip_without_parser (void)
+{
+#ifdef WITH_GNUTLS
+#if GNUTLS_VERSION_NUMBER < 0x030805
+	g_test_skip ("GnuTLS 3.8.5 is required");
+	return TRUE;
+#endif
+#endif
+	return FALSE;
+}
+
+static void
+check_pubring_entries (GcrOpenpgpIndex *index)
+{
+	const GcrOpenpgpIndexEntry *entry;
+	GPtrArray *entries;
+
+	entries = _gcr_openpgp_index_get_entries (index);
+	g_assert_cmpuint (entries->len, ==, 8);
+
+	entry = _gcr_openpgp_index_lookup (index, "61A6EA3E0115080227A32EC94842D952AFC000FD");
+	g_assert (entry != NULL);
+	g_assert (entry == entries->pdata[0]);
+	g_assert_cmpstr (entry->keyid, ==, "4842D952AFC000FD");
+	g_assert_cmpint (entry->validity, ==, 'o');
+	g_assert_cmpint (_gcr_openpgp_index_get_validity (entry), ==, 'o');
+	g_assert (!entry->secret);
+	g_assert_cmpuint (g_strv_length (entry->user_ids), ==, 2);
+	g_assert (g_strv_contains ((const gchar **)entry->user_ids, "Test Number 1 (unlimited) <test-number-1@example.com>"));
+	g_assert (g_strv_contains ((const gchar **)entry->user_ids, "Dr. Strangelove <lovingbomb@example.com>"));
+
+	/* Key ids, subkeys, short ids, and case */
+	g_assert (_gcr_openpgp_index_lookup (index, "4842D952AFC000FD") == entry);
+	g_assert (_gcr_openpgp_index_lookup (index, "0x4842d952afc000fd") == entry);
+	g_assert (_gcr_openpgp_index_lookup (index, "AFC000FD") == entry);
+	g_assert (_gcr_openpgp_index_lookup (index, "4852132BBED15014") == entry);
+	g_assert (_gcr_openpgp_index_lookup (index, "bed15014") == entry);
+
+	entry = _gcr_openpgp_index_lookup (index, "268FEE686262C395");
+	g_assert (entry != NULL);
+	g_assert_cmpint (entry->validity, ==, 'e');
+	g_assert_cmpuint (entry->expires, ==, 1305276028);
+	g_assert_cmpint (_gcr_openpgp_index_get_validity (entry), ==, 'e');
+	g_assert_cmpstr (entry->fingerprint, ==, "A4853C22EA82C8ADC6692751268FEE686262C395");
+
+	g_assert (_gcr_openpgp_index_lookup (index, "0000000000000000") == NULL);
+	g_assert (_gcr_openpgp_index_lookup (index, "00000000") == NULL);
+}
+
+static void
+test_index (Test *test,
+            gconstpointer data)
+{
+	GError *error = NULL;
+
+	if (skip_without_parser ())
+		return;
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+
+	check_pubring_entries (test->index);
+}
+
+static void
+test_load_records (Test *test,
+                   gconstpointer data)
+{
+	const GcrOpenpgpIndexEntry *entry;
+	GError *error = NULL;
+	GPtrArray *records;
+	gchar *line;
+
+	if (skip_without_parser ())
+		return;
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+
+	entry = _gcr_openpgp_index_lookup (test->index, "268FEE686262C395");
+	g_assert (entry != NULL);
+
+	records = _gcr_openpgp_index_load_records (test->index, entry, GCR_OPENPGP_PARSE_NONE, &error);
+	g_assert_no_error (error);
+	g_assert (records != NULL);
+	g_assert_cmpuint (records->len, ==, 4);
+
+	line = _gcr_record_format (records->pdata[0]);
+	g_assert_cmpstr (line, ==, "pub:e:1024:1:268FEE686262C395:1305189628:1305276028::o:::sc:");
+	g_free (line);
+
+	g_ptr_array_unref (records);
+}
+
+static void
+test_cache (Test *test,
+            gconstpointer data)
+{
+	GcrOpenpgpIndex *index;
+	GError *error = NULL;
+
+	if (skip_without_parser ())
+		return;
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+	g_assert (g_file_test (test->cache, G_FILE_TEST_IS_REGULAR));
+
+	/* Loaded from the cache, the keyring hasn't changed */
+	index = _gcr_openpgp_index_new (test->keyring, test->cache);
+	_gcr_openpgp_index_update (index, &error);
+	g_assert_no_error (error);
+	check_pubring_entries (index);
+	_gcr_openpgp_index_free (index);
+
+	/* A bad cache is ignored */
+	g_file_set_contents (test->cache, "garbage", -1, &error);
+	g_assert_no_error (error);
+	index = _gcr_openpgp_index_new (test->keyring, test->cache);
+	_gcr_openpgp_index_update (index, &error);
+	g_assert_no_error (error);
+	check_pubring_entries (index);
+	_gcr_openpgp_index_free (index);
+}
+
+static void
+test_append (Test *test,
+             gconstpointer data)
+{
+	const GcrOpenpgpIndexEntry *entry;
+	GcrOpenpgpIndex *index;
+	GError *error = NULL;
+	gchar *contents;
+	gsize length;
+	guint64 split;
+	guint64 offset;
+	FILE *file;
+
+	if (skip_without_parser ())
+		return;
+
+	/* Find where the fourth key starts */
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+	entry = _gcr_openpgp_index_get_entries (test->index)->pdata[3];
+	split = entry->offset;
+	offset = ((GcrOpenpgpIndexEntry *)_gcr_openpgp_index_get_entries (test->index)->pdata[7])->offset;
+
+	g_file_get_contents (test->keyring, &contents, &length, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (split, <, length);
+
+	g_file_set_contents (test->keyring, contents, split, &error);
+	g_assert_no_error (error);
+	g_unlink (test->cache);
+
+	index = _gcr_openpgp_index_new (test->keyring, test->cache);
+	_gcr_openpgp_index_update (index, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (_gcr_openpgp_index_get_entries (index)->len, ==, 3);
+	g_assert (_gcr_openpgp_index_lookup (index, "268FEE686262C395") != NULL);
+	g_assert (_gcr_openpgp_index_lookup (index, "53B620D01CE0C630") == NULL);
+
+	/* Append the rest to the same file */
+	file = fopen (test->keyring, "ab");
+	g_assert (file != NULL);
+	g_assert_cmpuint (fwrite (contents + split, 1, length - split, file), ==, length - split);
+	fclose (file);
+
+	_gcr_openpgp_index_update (index, &error);
+	g_assert_no_error (error);
+	check_pubring_entries (index);
+
+	entry = _gcr_openpgp_index_lookup (index, "53B620D01CE0C630");
+	g_assert (entry != NULL);
+	g_assert_cmpuint (entry->offset, ==, offset);
+
+	_gcr_openpgp_index_free (index);
+	g_free (contents);
+}
+
+static void
+test_expires_later (Test *test,
+                    gconstpointer data)
+{
+	GcrOpenpgpIndexEntry *entry;
+	GcrOpenpgpIndex *index;
+	GError *error = NULL;
+
+	if (skip_without_parser ())
+		return;
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+
+	/* A key that expires after it was indexed, as if time had passed */
+	entry = (GcrOpenpgpIndexEntry *)_gcr_openpgp_index_lookup (test->index, "4842D952AFC000FD");
+	g_assert (entry != NULL);
+	g_assert_cmpint (_gcr_openpgp_index_get_validity (entry), ==, 'o');
+	entry->expires = g_get_real_time () / G_USEC_PER_SEC - 60;
+	g_assert_cmpint (entry->validity, ==, 'o');
+	g_assert_cmpint (_gcr_openpgp_index_get_validity (entry), ==, 'e');
+
+	/* The cache stores the expiry, loaded here as the keyring is unchanged */
+	index = _gcr_openpgp_index_new (test->keyring, test->cache);
+	_gcr_openpgp_index_update (index, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (_gcr_openpgp_index_lookup (index, "268FEE686262C395")->expires, ==, 1305276028);
+	g_assert_cmpuint (_gcr_openpgp_index_lookup (index, "4842D952AFC000FD")->expires, ==, 0);
+	_gcr_openpgp_index_free (index);
+}
+
+static void
+test_deleted_then_appended (Test *test,
+                            gconstpointer data)
+{
+	const GcrOpenpgpIndexEntry *entry;
+	GError *error = NULL;
+	gchar *contents;
+	gsize length;
+	guint64 offset;
+	guint32 blob;
+	FILE *file;
+
+	if (skip_without_parser ())
+		return;
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+
+	entry = _gcr_openpgp_index_get_entries (test->index)->pdata[0];
+	offset = entry->offset;
+	entry = _gcr_openpgp_index_get_entries (test->index)->pdata[7];
+	blob = entry->length;
+
+	g_file_get_contents (test->keyring, &contents, &length, &error);
+	g_assert_no_error (error);
+
+	/* gpg deletes a key by marking its blob as empty, in place */
+	file = fopen (test->keyring, "r+b");
+	g_assert (file != NULL);
+	g_assert_cmpint (fseek (file, offset + 4, SEEK_SET), ==, 0);
+	g_assert_cmpint (fputc (0, file), ==, 0);
+
+	/* And then appends another one */
+	g_assert_cmpint (fseek (file, 0, SEEK_END), ==, 0);
+	g_assert_cmpuint (fwrite (contents + entry->offset, 1, blob, file), ==, blob);
+	fclose (file);
+	g_free (contents);
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+
+	g_assert_cmpuint (_gcr_openpgp_index_get_entries (test->index)->len, ==, 8);
+	g_assert (_gcr_openpgp_index_lookup (test->index, "4842D952AFC000FD") == NULL);
+	g_assert (_gcr_openpgp_index_lookup (test->index, "53B620D01CE0C630") != NULL);
+}
+
+static void
+test_rewritten (Test *test,
+                gconstpointer data)
+{
+	const GcrOpenpgpIndexEntry *entry;
+	GError *error = NULL;
+	gchar *contents;
+	gsize length;
+
+	if (skip_without_parser ())
+		return;
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+
+	g_file_get_contents (SRCDIR "/gcr/fixtures/secring.gpg", &contents, &length, &error);
+	g_assert_no_error (error);
+	g_file_set_contents (test->keyring, contents, length, &error);
+	g_assert_no_error (error);
+	g_free (contents);
+
+	_gcr_openpgp_index_update (test->index, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (_gcr_openpgp_index_get_entries (test->index)->len, ==, 2);
+
+	entry = _gcr_openpgp_index_lookup (test->index, "4842D952AFC000FD");
+	g_assert (entry != NULL);
+	g_assert (entry->secret);
+	g_assert (_gcr_openpgp_index_lookup (test->index, "53B620D01CE0C630") == NULL);
+}
+
+static void
+test_missing (Test *test,
+              gconstpointer data)
+{
+	GcrOpenpgpIndex *index;
+	GError *error = NULL;
+	gchar *path;
+
+	path = g_build_filename (test->directory, "nonexistent.gpg", NULL);
+	index = _gcr_openpgp_index_new (path, NULL);
+	g_assert (!_gcr_openpgp_index_update (index, &error));
+	g_assert_error (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+	g_error_free (error);
+	_gcr_openpgp_index_free (index);
+	g_free (path);
+}
+
+int
+main (int argc, char **argv)
+{
+	const gchar *pubring = SRCDIR "/gcr/fixtures/pubring.gpg";
+	const gchar *keybox = SRCDIR "/gcr/fixtures/pubring.kbx";
+
+	g_test_init (&argc, &argv, NULL);
+	g_set_prgname ("test-openpgp-index");
+
+	g_test_add ("/gcr/openpgp-index/pubring", Test, pubring, setup, test_index, teardown);
+	g_test_add ("/gcr/openpgp-index/keybox", Test, keybox, setup, test_index, teardown);
+	g_test_add ("/gcr/openpgp-index/load_records", Test, pubring, setup, test_load_records, teardown);
+	g_test_add ("/gcr/openpgp-index/load_records_keybox", Test, keybox, setup, test_load_records, teardown);
+	g_test_add ("/gcr/openpgp-index/cache", Test, pubring, setup, test_cache, teardown);
+	g_test_add ("/gcr/openpgp-index/append", Test, pubring, setup, test_append, teardown);
+	g_test_add ("/gcr/openpgp-index/append_keybox", Test, keybox, setup, test_append, teardown);
+	g_test_add ("/gcr/openpgp-index/expires_later", Test, pubring, setup, test_expires_later, teardown);
+	g_test_add ("/gcr/openpgp-index/deleted_then_appended", Test, keybox, setup, test_deleted_then_appended, teardown);
+	g_test_add ("/gcr/openpgp-index/rewritten", Test, pubring, setup, test_rewritten, teardown);
+	g_test_add ("/gcr/openpgp-index/missing", Test, pubring, setup, test_missing, teardown);
+
+	return g_test_run ();
+}
@@ -343,6 +343,111 @@ test_openpgp_binary (Test *test,
 	g_bytes_unref (bytes);
 }
 
+static void
+test_find_blocks (void)
+{
+	GcrOpenpgpBlock *block;
+	GError *error = NULL;
+	GArray *blocks;
+	GBytes *bytes;
+	gchar *binary;
+	gsize length;
+	gsize offset;
+	guint i;
+
+	g_file_get_contents (SRCDIR "/gcr/fixtures/pubring.gpg", &binary, &length, &error);
+	g_assert_no_error (error);
+	bytes = g_bytes_new_take (binary, length);
+
+	blocks = _gcr_openpgp_find_blocks (bytes, GCR_OPENPGP_PARSE_KEYS);
+	g_assert_cmpuint (blocks->len, ==, 8);
+
+	/* The key blocks cover the whole keyring */
+	for (i = 0, offset = 0; i < blocks->len; i++) {
+		block = &g_array_index (blocks, GcrOpenpgpBlock, i);
+		g_assert_cmpuint (block->offset, ==, offset);
+		offset += block->length;
+	}
+	g_assert_cmpuint (offset, ==, length);
+	g_array_unref (blocks);
+
+	/* Otherwise every packet is a block */
+	blocks = _gcr_openpgp_find_blocks (bytes, GCR_OPENPGP_PARSE_NONE);
+	g_assert_cmpuint (blocks->len, >, 8);
+	g_array_unref (blocks);
+
+	g_bytes_unref (bytes);
+}
+
+static void
+on_parallel_block (GPtrArray *records,
+                   GBytes *outer,
+                   gpointer user_data)
+{
+	GPtrArray *formatted = user_data;
+	GString *string;
+	gchar *line;
+	guint i;
+
+	string = g_string_new ("");
+	for (i = 0; i < records->len; i++) {
+		line = _gcr_record_format (records->pdata[i]);
+		g_string_append_printf (string, "%s\n", line);
+		g_free (line);
+	}
+	g_string_append_printf (string, "%" G_GSIZE_FORMAT, g_bytes_get_size (outer));
+	g_ptr_array_add (formatted, g_string_free (string, FALSE));
+}
+
+static void
+test_parse_parallel (void)
+{
+	GPtrArray *serial;
+	GPtrArray *parallel;
+	GError *error = NULL;
+	GByteArray *data;
+	GBytes *bytes;
+	gchar *binary;
+	gsize length;
+	guint seen;
+	guint i;
+
+#ifdef WITH_GNUTLS
+#if GNUTLS_VERSION_NUMBER < 0x030805
+	g_test_skip ("GnuTLS 3.8.5 is required");
+	return;
+#endif
+#endif
+
+	g_file_get_contents (SRCDIR "/gcr/fixtures/pubring.gpg", &binary, &length, &error);
+	g_assert_no_error (error);
+
+	/* Big enough to be parsed on threads */
+	data = g_byte_array_new ();
+	while (data->len < 1024 * 1024)
+		g_byte_array_append (data, (guchar *)binary, length);
+	bytes = g_byte_array_free_to_bytes (data);
+	g_free (binary);
+
+	serial = g_ptr_array_new_with_free_func (g_free);
+	seen = _gcr_openpgp_parse (bytes, GCR_OPENPGP_PARSE_KEYS, on_parallel_block, serial);
+	g_assert_cmpuint (seen, ==, serial->len);
+
+	parallel = g_ptr_array_new_with_free_func (g_free);
+	seen = _gcr_openpgp_parse (bytes, GCR_OPENPGP_PARSE_KEYS | GCR_OPENPGP_PARSE_PARALLEL,
+	                           on_parallel_block, parallel);
+	g_assert_cmpuint (seen, ==, parallel->len);
+
+	/* Same blocks, in the same order */
+	g_assert_cmpuint (serial->len, ==, parallel->len);
+	for (i = 0; i < serial->len; i++)
+		g_assert_cmpstr (serial->pdata[i], ==, parallel->pdata[i]);
+
+	g_ptr_array_unref (serial);
+	g_ptr_array_unref (parallel);
+	g_bytes_unref (bytes);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -361,5 +466,8 @@ main (int argc, char **argv)
 		g_free (test_path);
 	}
 
+	g_test_add_func ("/gcr/openpgp/find_blocks", test_find_blocks);
+	g_test_add_func ("/gcr/openpgp/parse_parallel", test_parse_parallel);
+
 	return g_test_run ();
 }
@@ -0,0 +1,220 @@
+/*
+ * gcr
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1 of
+ * the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+
+#include "gcr/gcr.h"
+#include "gcr/gcr-internal.h"
+#include "gcr/gcr-pkcs11-importer.h"
+
+#include "egg/egg-testing.h"
+#include "egg/mock-interaction.h"
+
+#include "gck/gck-mock.h"
+#include "gck/gck-test.h"
+
+#include <glib.h>
+#include <string.h>
+
+static const gchar *certificates[] = {
+	"der-certificate.crt",
+	"der-certificate-dsa.cer",
+	"cacert.org.cer",
+	"collabora-ca.cer",
+	"startcom-ca.cer",
+};
+
+typedef struct {
+	CK_FUNCTION_LIST funcs;
+	GcrImporter *importer;
+	GAsyncResult *result;
+	GArray *progress;
+} Test;
+
+static GckAttributes *
+certificate_attributes (const gchar *filename)
+{
+	GckBuilder builder = GCK_BUILDER_INIT;
+	gchar *contents;
+	gchar *path;
+	gsize length;
+
+	path = g_build_filename (SRCDIR "/gcr/fixtures", filename, NULL);
+	if (!g_file_get_contents (path, &contents, &length, NULL))
+		g_assert_not_reached ();
+
+	gck_builder_add_ulong (&builder, CKA_CLASS, CKO_CERTIFICATE);
+	gck_builder_add_ulong (&builder, CKA_CERTIFICATE_TYPE, CKC_X_509);
+	gck_builder_add_data (&builder, CKA_VALUE, (const guchar *)contents, length);
+
+	g_free (contents);
+	g_free (path);
+
+	return gck_builder_end (&builder);
+}
+
+static void
+on_progress (GcrPkcs11Importer *importer,
+             guint created,
+             guint total,
+             gpointer user_data)
+{
+	Test *test = user_data;
+
+	g_array_append_val (test->progress, created);
+	g_assert_cmpuint (created, <=, total);
+}
+
+static void
+setup (Test *test,
+       gconstpointer unused)
+{
+	GTlsInteraction *interaction;
+	GList *modules = NULL;
+	CK_FUNCTION_LIST_PTR f;
+	GckAttributes *attrs;
+	GckModule *module;
+	GList *slots;
+	CK_RV rv;
+
+	rv = gck_mock_C_GetFunctionList (&f);
+	gck_assert_cmprv (rv, ==, CKR_OK);
+	memcpy (&test->funcs, f, sizeof (test->funcs));
+
+	rv = (test->funcs.C_Initialize) (NULL);
+	gck_assert_cmprv (rv, ==, CKR_OK);
+
+	module = gck_module_new (&test->funcs);
+	modules = g_list_prepend (modules, module);
+	gcr_pkcs11_set_modules (modules);
+
+	/* The first certificate is already on the token */
+	attrs = certificate_attributes (certificates[0]);
+	gck_mock_module_add_object (attrs);
+
+	slots = gck_module_get_slots (module, TRUE);
+	g_assert (slots != NULL);
+	test->importer = _gcr_pkcs11_importer_new (slots->data);
+	g_clear_list (&slots, g_object_unref);
+	g_clear_list (&modules, g_object_unref);
+
+	interaction = mock_interaction_new ("booo");
+	g_object_set (test->importer, "interaction", interaction, NULL);
+	g_object_unref (interaction);
+
+	test->progress = g_array_new (FALSE, FALSE, sizeof (guint));
+	g_signal_connect (test->importer, "progress", G_CALLBACK (on_progress), test);
+}
+
+static void
+teardown (Test *test,
+          gconstpointer unused)
+{
+	CK_RV rv;
+
+	g_clear_object (&test->result);
+	g_object_unref (test->importer);
+	g_array_free (test->progress, TRUE);
+
+	rv = (test->funcs.C_Finalize) (NULL);
+	gck_assert_cmprv (rv, ==, CKR_OK);
+
+	_gcr_uninitialize_library ();
+}
+
+static void
+on_import_complete (GObject *source,
+                    GAsyncResult *result,
+                    gpointer user_data)
+{
+	Test *test = user_data;
+
+	g_assert (test->result == NULL);
+	test->result = g_object_ref (result);
+	egg_test_wait_stop ();
+}
+
+static void
+import_and_wait (Test *test)
+{
+	GError *error = NULL;
+
+	gcr_importer_import_async (test->importer, NULL, on_import_complete, test);
+	egg_test_wait_until (5000);
+	g_assert (test->result != NULL);
+
+	gcr_importer_import_finish (test->importer, test->result, &error);
+	g_assert_no_error (error);
+}
+
+static void
+test_import (Test *test,
+             gconstpointer unused)
+{
+	GckAttributes *attrs;
+	GList *imported;
+	guint i;
+
+	g_object_set (test->importer, "window", 3, NULL);
+
+	for (i = 0; i < G_N_ELEMENTS (certificates); i++) {
+		attrs = certificate_attributes (certificates[i]);
+		_gcr_pkcs11_importer_queue (GCR_PKCS11_IMPORTER (test->importer), NULL, attrs);
+		gck_attributes_unref (attrs);
+	}
+
+	import_and_wait (test);
+
+	/* The certificate already there was skipped, the rest went in two batches */
+	imported = _gcr_pkcs11_importer_get_imported (GCR_PKCS11_IMPORTER (test->importer));
+	g_assert_cmpuint (g_list_length (imported), ==, G_N_ELEMENTS (certificates) - 1);
+	g_list_free (imported);
+
+	g_assert_cmpuint (test->progress->len, ==, 2);
+	g_assert_cmpuint (g_array_index (test->progress, guint, 0), ==, 3);
+	g_assert_cmpuint (g_array_index (test->progress, guint, 1), ==, 4);
+}
+
+static void
+test_import_existing (Test *test,
+                      gconstpointer unused)
+{
+	GckAttributes *attrs;
+	GList *imported;
+
+	attrs = certificate_attributes (certificates[0]);
+	_gcr_pkcs11_importer_queue (GCR_PKCS11_IMPORTER (test->importer), NULL, attrs);
+	gck_attributes_unref (attrs);
+
+	import_and_wait (test);
+
+	imported = _gcr_pkcs11_importer_get_imported (GCR_PKCS11_IMPORTER (test->importer));
+	g_assert (imported == NULL);
+	g_assert_cmpuint (test->progress->len, ==, 0);
+}
+
+int
+main (int argc, char **argv)
+{
+	g_test_init (&argc, &argv, NULL);
+	g_set_prgname ("test-pkcs11-importer");
+
+	g_test_add ("/gcr/pkcs11-importer/import", Test, NULL, setup, test_import, teardown);
+	g_test_add ("/gcr/pkcs11-importer/import_existing", Test, NULL, setup, test_import_existing, teardown);
+
+	return egg_tests_run_with_loop ();
+}
@@ -27,6 +27,8 @@
 
 #include <glib.h>
 
+#include <string.h>
+
 typedef struct {
 	GcrRecord *record;
 } Test;
@@ -112,6 +114,210 @@ test_parse_too_long (void)
 	g_assert (record == NULL);
 }
 
+static void
+reader_write (GcrRecordReader *reader,
+              const gchar *data)
+{
+	gsize n_space;
+	gchar *space;
+	gsize length;
+
+	length = strlen (data);
+	space = _gcr_record_reader_begin_write (reader, &n_space);
+	g_assert_cmpuint (n_space, >=, length);
+	memcpy (space, data, length);
+	_gcr_record_reader_end_write (reader, length);
+}
+
+static void
+test_reader (void)
+{
+	GcrRecordReader *reader;
+	GcrRecord *one, *two, *three;
+
+	reader = _gcr_record_reader_new (':');
+
+	/* Lines split across writes */
+	reader_write (reader, "pub:one:t");
+	g_assert (_gcr_record_reader_next (reader, FALSE) == NULL);
+	reader_write (reader, "wo\r\nuid:three\n");
+	reader_write (reader, "sub:four");
+
+	one = _gcr_record_reader_next (reader, FALSE);
+	g_assert (one != NULL);
+	g_assert_cmpuint (_gcr_record_get_count (one), ==, 3);
+	g_assert_cmpstr (_gcr_record_get_raw (one, 2), ==, "two");
+
+	two = _gcr_record_reader_next (reader, FALSE);
+	g_assert (two != NULL);
+	g_assert_cmpstr (_gcr_record_get_raw (two, 1), ==, "three");
+
+	/* The partial line is only returned at the end */
+	g_assert (_gcr_record_reader_next (reader, FALSE) == NULL);
+	three = _gcr_record_reader_next (reader, TRUE);
+	g_assert (three != NULL);
+	g_assert_cmpstr (_gcr_record_get_raw (three, 1), ==, "four");
+	g_assert (_gcr_record_reader_next (reader, TRUE) == NULL);
+
+	/* Records outlive the reader */
+	_gcr_record_reader_free (reader);
+	g_assert_cmpstr (_gcr_record_get_raw (one, 0), ==, "pub");
+	g_assert_cmpstr (_gcr_record_get_raw (two, 0), ==, "uid");
+
+	_gcr_record_free (one);
+	_gcr_record_free (two);
+	_gcr_record_free (three);
+}
+
+static void
+test_reader_grows (void)
+{
+	GcrRecordReader *reader;
+	GPtrArray *records;
+	GcrRecord *record;
+	gchar *line;
+	guint i;
+
+	reader = _gcr_record_reader_new (':');
+	records = g_ptr_array_new_with_free_func (_gcr_record_free);
+
+	/* Keep the records so the buffer can't be reused */
+	for (i = 0; i < 10000; i++) {
+		line = g_strdup_printf ("uid:%u:%0200u\n", i, i);
+		reader_write (reader, line);
+		g_free (line);
+
+		while ((record = _gcr_record_reader_next (reader, FALSE)) != NULL)
+			g_ptr_array_add (records, record);
+	}
+
+	g_assert_cmpuint (records->len, ==, 10000);
+	for (i = 0; i < records->len; i++) {
+		record = records->pdata[i];
+		g_assert_cmpuint (_gcr_record_get_count (record), ==, 3);
+		line = g_strdup_printf ("%u", i);
+		g_assert_cmpstr (_gcr_record_get_raw (record, 1), ==, line);
+		g_free (line);
+	}
+
+	g_ptr_array_unref (records);
+	_gcr_record_reader_free (reader);
+}
+
+static void
+test_reader_spaces (void)
+{
+	GcrRecordReader *reader;
+	GcrRecord *record;
+	gchar *line;
+	gsize n_line;
+
+	reader = _gcr_record_reader_new (' ');
+	reader_write (reader, "[GNUPG:] IMPORT_OK 1 AAAA\nsecond line\n");
+
+	g_assert (_gcr_record_reader_next_line (reader, FALSE, &line, &n_line));
+	g_assert_cmpstr (line, ==, "[GNUPG:] IMPORT_OK 1 AAAA");
+	g_assert_cmpuint (n_line, ==, 25);
+
+	record = _gcr_record_reader_parse_line (reader, line + 9, n_line - 9);
+	g_assert (record != NULL);
+	g_assert_cmpuint (_gcr_record_get_count (record), ==, 3);
+	g_assert_cmpstr (_gcr_record_get_raw (record, 0), ==, "IMPORT_OK");
+	g_assert_cmpstr (_gcr_record_get_raw (record, 2), ==, "AAAA");
+	_gcr_record_free (record);
+
+	g_assert (_gcr_record_reader_next_line (reader, TRUE, &line, &n_line));
+	g_assert_cmpstr (line, ==, "second line");
+	g_assert (!_gcr_record_reader_next_line (reader, TRUE, &line, &n_line));
+
+	_gcr_record_reader_free (reader);
+}
+
+static void
+test_arena (void)
+{
+	GcrRecordArena *arena;
+	GcrRecord *record, *copy;
+	GPtrArray *records;
+	gchar *string;
+	guint i;
+
+	arena = _gcr_record_arena_new ();
+	records = g_ptr_array_new_with_free_func (_gcr_record_free);
+	for (i = 0; i < 1000; i++) {
+		record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_UID, GCR_RECORD_UID_MAX, ':');
+		_gcr_record_set_uint (record, GCR_RECORD_UID_TIMESTAMP, i);
+		_gcr_record_set_string (record, GCR_RECORD_UID_USERID, "Name: with colon");
+		_gcr_record_set_base64 (record, GCR_RECORD_UID_FINGERPRINT, "data", 4);
+		_gcr_record_take_raw (record, GCR_RECORD_TRUST, g_strdup ("u"));
+		g_ptr_array_add (records, record);
+	}
+
+	/* Records keep the arena alive */
+	_gcr_record_arena_unref (arena);
+
+	record = records->pdata[999];
+	string = _gcr_record_format (record);
+	g_assert_cmpstr (string, ==, "uid:u::::999::ZGF0YQ==::Name\\x3a with colon:");
+	g_free (string);
+
+	/* Copies don't reference the arena */
+	copy = _gcr_record_copy (record);
+	g_ptr_array_remove_range (records, 1, records->len - 1);
+	record = g_ptr_array_steal_index (records, 0);
+	g_ptr_array_unref (records);
+
+	g_assert_cmpstr (_gcr_record_get_raw (record, GCR_RECORD_UID_TIMESTAMP), ==, "0");
+	g_assert_cmpstr (_gcr_record_get_raw (copy, GCR_RECORD_UID_TIMESTAMP), ==, "999");
+	_gcr_record_free (record);
+
+	string = _gcr_record_get_string (copy, GCR_RECORD_UID_USERID);
+	g_assert_cmpstr (string, ==, "Name: with colon");
+	g_free (string);
+	_gcr_record_free (copy);
+}
+
+static void
+test_arena_big (void)
+{
+	GcrRecordArena *arena;
+	GcrRecord *record;
+	gchar *data;
+
+	/* A value much larger than an arena chunk */
+	data = g_malloc0 (200 * 1024);
+	arena = _gcr_record_arena_new ();
+	record = _gcr_record_new_in (arena, GCR_RECORD_SCHEMA_XA1, GCR_RECORD_XA1_MAX, ':');
+	_gcr_record_set_base64 (record, GCR_RECORD_XA1_DATA, data, 200 * 1024);
+	_gcr_record_set_uint (record, GCR_RECORD_XA1_LENGTH, 200 * 1024);
+	_gcr_record_arena_unref (arena);
+
+	g_assert_cmpuint (strlen (_gcr_record_get_raw (record, GCR_RECORD_XA1_DATA)), ==, 200 * 1024 / 3 * 4 + 4);
+	g_assert_cmpstr (_gcr_record_get_raw (record, GCR_RECORD_XA1_LENGTH), ==, "204800");
+
+	_gcr_record_free (record);
+	g_free (data);
+}
+
+static void
+test_parse_colons_set (void)
+{
+	GPtrArray *records;
+	GcrRecord *record;
+
+	records = _gcr_records_parse_colons ("pub:one\nuid:two:three", -1);
+	g_assert (records != NULL);
+	g_assert_cmpuint (records->len, ==, 2);
+	g_assert_cmpuint (_gcr_record_get_count (records->pdata[1]), ==, 3);
+	g_assert_cmpstr (_gcr_record_get_raw (records->pdata[1], 2), ==, "three");
+
+	/* Records outlive the array they were parsed into */
+	record = g_ptr_array_steal_index (records, 0);
+	g_ptr_array_unref (records);
+	g_assert_cmpstr (_gcr_record_get_raw (record, 1), ==, "one");
+	_gcr_record_free (record);
+}
+
 static void
 test_find (void)
 {
@@ -276,6 +482,12 @@ main (int argc, char **argv)
 	g_test_add_func ("/gcr/record/parse_too_long", test_parse_too_long);
 	g_test_add_func ("/gcr/record/free_null", test_free_null);
 	g_test_add_func ("/gcr/record/find", test_find);
+	g_test_add_func ("/gcr/record/arena", test_arena);
+	g_test_add_func ("/gcr/record/arena_big", test_arena_big);
+	g_test_add_func ("/gcr/record/parse_colons_set", test_parse_colons_set);
+	g_test_add_func ("/gcr/record/reader", test_reader);
+	g_test_add_func ("/gcr/record/reader_grows", test_reader_grows);
+	g_test_add_func ("/gcr/record/reader_spaces", test_reader_spaces);
 	g_test_add ("/gcr/record/count", Test, NULL, setup, test_count, teardown);
 	g_test_add ("/gcr/record/copy", Test, NULL, setup, test_copy, teardown);
 	g_test_add ("/gcr/record/boxed", Test, NULL, setup, test_boxed, teardown);
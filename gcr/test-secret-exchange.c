@@ -22,6 +22,7 @@
 #include "config.h"
 
 #include "gcr/gcr.h"
+#include "gcr/gcr-internal.h"
 
 #include "egg/egg-testing.h"
 
@@ -152,6 +153,131 @@ test_perform_multiple (Test *test,
 	g_assert_cmpstr (gcr_secret_exchange_get_secret (test->caller, NULL), ==, "second secret");
 }
 
+static gboolean
+exchange_secret (GcrSecretExchange *caller,
+                 GcrSecretExchange *callee)
+{
+	gchar *exchange;
+	gboolean ret;
+
+	exchange = gcr_secret_exchange_begin (caller);
+	g_assert (exchange);
+
+	ret = gcr_secret_exchange_receive (callee, exchange);
+	g_free (exchange);
+	if (!ret)
+		return FALSE;
+
+	exchange = gcr_secret_exchange_send (callee, "the secret", -1);
+	g_assert (exchange);
+
+	ret = gcr_secret_exchange_receive (caller, exchange);
+	g_free (exchange);
+	if (!ret)
+		return FALSE;
+
+	g_assert_cmpstr (gcr_secret_exchange_get_secret (caller, NULL), ==, "the secret");
+	return TRUE;
+}
+
+static void
+test_protocol_negotiated (Test *test,
+                          gconstpointer unused)
+{
+	g_assert (gcr_secret_exchange_get_protocol (test->caller) == NULL);
+
+	if (!exchange_secret (test->caller, test->callee))
+		g_assert_not_reached ();
+
+	/* Both sides pick the newest protocol they share */
+	g_assert_cmpstr (gcr_secret_exchange_get_protocol (test->caller), ==,
+	                 gcr_secret_exchange_get_protocol (test->callee));
+	g_assert (gcr_secret_exchange_get_protocol (test->caller) != NULL);
+}
+
+static void
+test_protocol_old_peer (Test *test,
+                        gconstpointer unused)
+{
+	GcrSecretExchange *callee;
+
+	/* A peer that only knows the first protocol */
+	callee = gcr_secret_exchange_new (GCR_SECRET_EXCHANGE_PROTOCOL_1);
+
+	if (!exchange_secret (test->caller, callee))
+		g_assert_not_reached ();
+
+	g_assert_cmpstr (gcr_secret_exchange_get_protocol (test->caller), ==, GCR_SECRET_EXCHANGE_PROTOCOL_1);
+	g_assert_cmpstr (gcr_secret_exchange_get_protocol (callee), ==, GCR_SECRET_EXCHANGE_PROTOCOL_1);
+
+	g_object_unref (callee);
+}
+
+static void
+test_protocol_explicit (Test *test,
+                        gconstpointer data)
+{
+	const gchar *protocol = data;
+	GcrSecretExchange *caller;
+	gchar *exchange;
+
+	caller = gcr_secret_exchange_new (protocol);
+	g_assert_cmpstr (gcr_secret_exchange_get_protocol (caller), ==, protocol);
+
+	exchange = gcr_secret_exchange_begin (caller);
+	if (exchange == NULL) {
+		g_test_skip ("protocol is not supported by the crypto backend");
+		g_object_unref (caller);
+		return;
+	}
+
+	/* Only the one protocol is offered */
+	g_assert (g_str_has_prefix (exchange + 1, protocol));
+	g_free (exchange);
+
+	if (!exchange_secret (caller, test->callee))
+		g_assert_not_reached ();
+
+	g_assert_cmpstr (gcr_secret_exchange_get_protocol (test->callee), ==, protocol);
+
+	g_object_unref (caller);
+}
+
+static void
+test_pooled_keys (Test *test,
+                  gconstpointer unused)
+{
+	GcrSecretExchange *exchanges[6];
+	GHashTable *seen;
+	gchar *begin;
+	guint i;
+
+	seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+	/* Keys come from the pool once it has some, but are never handed out twice */
+	_gcr_secret_exchange_prepare_keys ();
+
+	for (i = 0; i < G_N_ELEMENTS (exchanges); i++) {
+		exchanges[i] = gcr_secret_exchange_new (NULL);
+		begin = gcr_secret_exchange_begin (exchanges[i]);
+		g_assert (begin != NULL);
+		g_assert (!g_hash_table_contains (seen, begin));
+		g_hash_table_add (seen, begin);
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (exchanges); i++) {
+		if (!exchange_secret (exchanges[i], test->callee))
+			g_assert_not_reached ();
+		g_object_unref (exchanges[i]);
+
+		g_object_unref (test->callee);
+		test->callee = gcr_secret_exchange_new (NULL);
+		g_object_add_weak_pointer (G_OBJECT (test->callee), (gpointer *)&test->callee);
+	}
+
+	g_hash_table_unref (seen);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -161,6 +287,11 @@ main (int argc, char **argv)
 	g_test_add ("/gcr/secret-exchange/perform-exchange", Test, NULL, setup, test_perform_exchange, teardown);
 	g_test_add ("/gcr/secret-exchange/perform-reverse", Test, NULL, setup, test_perform_reverse, teardown);
 	g_test_add ("/gcr/secret-exchange/perform-multiple", Test, NULL, setup, test_perform_multiple, teardown);
+	g_test_add ("/gcr/secret-exchange/protocol-negotiated", Test, NULL, setup, test_protocol_negotiated, teardown);
+	g_test_add ("/gcr/secret-exchange/protocol-old-peer", Test, NULL, setup, test_protocol_old_peer, teardown);
+	g_test_add ("/gcr/secret-exchange/protocol-1", Test, GCR_SECRET_EXCHANGE_PROTOCOL_1, setup, test_protocol_explicit, teardown);
+	g_test_add ("/gcr/secret-exchange/protocol-2", Test, GCR_SECRET_EXCHANGE_PROTOCOL_2, setup, test_protocol_explicit, teardown);
+	g_test_add ("/gcr/secret-exchange/pooled-keys", Test, NULL, setup, test_pooled_keys, teardown);
 
 	return g_test_run ();
 }
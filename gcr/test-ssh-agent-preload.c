@@ -23,6 +23,7 @@
 #include "config.h"
 
 #include "gcr-ssh-agent-preload.h"
+#include "egg/egg-buffer.h"
 #include "egg/egg-testing.h"
 
 #include <glib/gstdio.h>
@@ -152,6 +153,87 @@ test_changed (Test *test, gconstpointer unused)
 #undef COMMENT
 }
 
+#define N_MANY_KEYS 100
+
+static GBytes *
+write_generated_key (const gchar *directory,
+                     guint index)
+{
+	EggBuffer buffer;
+	guchar key[32] = { 0, };
+	gchar *encoded;
+	gchar *contents;
+	gchar *path;
+	GBytes *public_key;
+	gboolean ret;
+
+	/* Only the public part is parsed, the private one just has to exist */
+	key[0] = index & 0xff;
+	key[1] = (index >> 8) & 0xff;
+
+	egg_buffer_init_full (&buffer, 64, (EggBufferAllocator)g_realloc);
+	egg_buffer_add_string (&buffer, "ssh-ed25519");
+	egg_buffer_add_byte_array (&buffer, key, sizeof (key));
+	public_key = g_bytes_new (buffer.buf, buffer.len);
+
+	encoded = g_base64_encode (buffer.buf, buffer.len);
+	contents = g_strdup_printf ("ssh-ed25519 %s key%u\n", encoded, index);
+	path = g_strdup_printf ("%s/key%u.pub", directory, index);
+	ret = g_file_set_contents (path, contents, -1, NULL);
+	g_assert_true (ret);
+	g_free (path);
+
+	path = g_strdup_printf ("%s/key%u", directory, index);
+	ret = g_file_set_contents (path, "private", -1, NULL);
+	g_assert_true (ret);
+	g_free (path);
+
+	g_free (contents);
+	g_free (encoded);
+	egg_buffer_uninit (&buffer);
+
+	return public_key;
+}
+
+static void
+test_many (void)
+{
+	GcrSshAgentPreload *preload;
+	GcrSshAgentKeyInfo *info;
+	GBytes *keys[N_MANY_KEYS];
+	gchar *directory;
+	gchar *comment;
+	GList *list;
+	guint i;
+
+	directory = egg_tests_create_scratch_directory (NULL, NULL);
+	for (i = 0; i < N_MANY_KEYS; i++)
+		keys[i] = write_generated_key (directory, i);
+
+	/* These are loaded in the background */
+	preload = gcr_ssh_agent_preload_new (directory);
+
+	/* Looking up a key waits until it is loaded */
+	for (i = 0; i < N_MANY_KEYS; i++) {
+		info = gcr_ssh_agent_preload_lookup_by_public_key (preload, keys[i]);
+		g_assert_nonnull (info);
+		comment = g_strdup_printf ("key%u", i);
+		g_assert_cmpstr (info->comment, ==, comment);
+		g_free (comment);
+		gcr_ssh_agent_key_info_free (info);
+	}
+
+	list = gcr_ssh_agent_preload_get_keys (preload);
+	g_assert_cmpint (N_MANY_KEYS, ==, g_list_length (list));
+	g_list_free_full (list, (GDestroyNotify)gcr_ssh_agent_key_info_free);
+
+	g_object_unref (preload);
+	for (i = 0; i < N_MANY_KEYS; i++)
+		g_bytes_unref (keys[i]);
+	egg_tests_remove_scratch_directory (directory);
+	g_free (directory);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -161,6 +243,7 @@ main (int argc, char **argv)
 	g_test_add ("/ssh-agent/preload/added", Test, NULL, setup, test_added, teardown);
 	g_test_add ("/ssh-agent/preload/removed", Test, NULL, setup, test_removed, teardown);
 	g_test_add ("/ssh-agent/preload/changed", Test, NULL, setup, test_changed, teardown);
+	g_test_add_func ("/ssh-agent/preload/many", test_many);
 
 	return g_test_run ();
 }
@@ -33,6 +33,8 @@
 #include <glib/gstdio.h>
 #include <gio/gunixsocketaddress.h>
 
+#include <string.h>
+
 typedef struct {
 	gchar *directory;
 	EggBuffer req;
@@ -69,9 +71,10 @@ server_thread (gpointer data)
 	return NULL;
 }
 
-static void
-connect_to_server (Test *test)
+static GSocketConnection *
+open_connection (void)
 {
+	GSocketConnection *connection;
 	const gchar *envvar;
 	GSocketClient *client;
 	GSocketAddress *address;
@@ -84,19 +87,27 @@ connect_to_server (Test *test)
 	client = g_socket_client_new ();
 
 	error = NULL;
-	test->connection = g_socket_client_connect (client,
-						    G_SOCKET_CONNECTABLE (address),
-						    NULL,
-						    &error);
-	g_assert_nonnull (test->connection);
+	connection = g_socket_client_connect (client,
+					      G_SOCKET_CONNECTABLE (address),
+					      NULL,
+					      &error);
+	g_assert_nonnull (connection);
 	g_assert_no_error (error);
 
 	g_object_unref (address);
 	g_object_unref (client);
+
+	return connection;
 }
 
 static void
-setup (Test *test, gconstpointer unused)
+connect_to_server (Test *test)
+{
+	test->connection = open_connection ();
+}
+
+static void
+setup (Test *test, gconstpointer data)
 {
 	GTlsInteraction *interaction;
 	GcrSshAgentPreload *preload;
@@ -126,7 +137,12 @@ setup (Test *test, gconstpointer unused)
 	preload = gcr_ssh_agent_preload_new (preload_path);
 	g_free (preload_path);
 
-	test->service = gcr_ssh_agent_service_new (sockets_path, ssh_agent_args, preload);
+	test->service = g_object_new (GCR_TYPE_SSH_AGENT_SERVICE,
+				      "path", sockets_path,
+				      "ssh-agent-args", ssh_agent_args,
+				      "preload", preload,
+				      "native", GPOINTER_TO_INT (data),
+				      NULL);
 	g_free (sockets_path);
 
 	interaction = mock_interaction_new ("password");
@@ -342,6 +358,73 @@ call_unknown (Test *test)
 	check_failure (&test->resp);
 }
 
+static void
+call_extension (Test *test)
+{
+	gboolean ret;
+
+	egg_buffer_reset (&test->req);
+	egg_buffer_reset (&test->resp);
+
+	ret = egg_buffer_add_uint32 (&test->req, 0);
+	g_assert_true (ret);
+
+	ret = egg_buffer_add_byte (&test->req, GCR_SSH_OP_EXTENSION);
+	g_assert_true (ret);
+
+	ret = egg_buffer_add_string (&test->req, "session-bind@openssh.com");
+	g_assert_true (ret);
+
+	ret = egg_buffer_set_uint32 (&test->req, 0, test->req.len - 4);
+	g_assert_true (ret);
+
+	call (test);
+
+	check_failure (&test->resp);
+}
+
+/* A confirmation constraint is only supported by ssh-agent */
+static void
+call_add_identity_confirm (Test *test)
+{
+	gboolean ret;
+
+	egg_buffer_reset (&test->req);
+	egg_buffer_reset (&test->resp);
+
+	prepare_add_identity (&test->req);
+	test->req.buf[4] = GCR_SSH_OP_ADD_ID_CONSTRAINED;
+
+	ret = egg_buffer_add_byte (&test->req, GCR_SSH_FLAG_CONSTRAIN_CONFIRM);
+	g_assert_true (ret);
+
+	ret = egg_buffer_set_uint32 (&test->req, 0, test->req.len - 4);
+	g_assert_true (ret);
+
+	call (test);
+
+	check_success (&test->resp);
+}
+
+static void
+call_refused_while_locked (Test *test)
+{
+	egg_buffer_reset (&test->resp);
+	prepare_add_identity (&test->req);
+	call (test);
+	check_failure (&test->resp);
+
+	egg_buffer_reset (&test->resp);
+	prepare_remove_identity (&test->req);
+	call (test);
+	check_failure (&test->resp);
+
+	egg_buffer_reset (&test->resp);
+	prepare_remove_all_identities (&test->req);
+	call (test);
+	check_failure (&test->resp);
+}
+
 static void
 call_lock (Test *test)
 {
@@ -499,6 +582,52 @@ test_sign (Test *test, gconstpointer unused)
 	call_sign (test);
 }
 
+#define N_SIGN_THREADS 16
+
+static gpointer
+sign_thread (gpointer data)
+{
+	GSocketConnection *connection;
+	EggBuffer req;
+	EggBuffer resp;
+	GError *error = NULL;
+	gboolean ret;
+
+	connection = open_connection ();
+	egg_buffer_init_full (&req, 128, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&resp, 128, (EggBufferAllocator)g_realloc);
+
+	prepare_sign_request (&req);
+	ret = _gcr_ssh_agent_call (connection, &req, &resp, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	check_sign_response (&resp);
+
+	egg_buffer_uninit (&req);
+	egg_buffer_uninit (&resp);
+	g_object_unref (connection);
+
+	return NULL;
+}
+
+static void
+test_sign_concurrent (Test *test, gconstpointer unused)
+{
+	GThread *threads[N_SIGN_THREADS];
+	GcrSshAgentStats *stats;
+	guint i;
+
+	for (i = 0; i < N_SIGN_THREADS; i++)
+		threads[i] = g_thread_new ("sign", sign_thread, test);
+	for (i = 0; i < N_SIGN_THREADS; i++)
+		g_thread_join (threads[i]);
+
+	/* The preloaded key was only loaded once */
+	stats = gcr_ssh_agent_service_get_stats (test->service);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_op_count (stats, GCR_SSH_OP_SIGN_REQUEST), ==, N_SIGN_THREADS);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_timer_count (stats, GCR_SSH_AGENT_STATS_ENSURE_KEY), ==, 1);
+}
+
 static void
 test_sign_unknown (Test *test, gconstpointer unused)
 {
@@ -595,6 +724,160 @@ test_lock (Test *test, gconstpointer unused)
 	call_unlock (test);
 }
 
+static void
+test_native (Test *test, gconstpointer unused)
+{
+	GcrSshAgentProcess *process;
+	GBytes *public_key;
+	gchar *comment;
+
+	connect_to_server (test);
+
+	public_key = public_key_from_file (SRCDIR "/gcr/fixtures/ssh-agent/id_rsa_plain.pub", &comment);
+	g_free (comment);
+
+	call_add_identity (test);
+	call_request_identities (test, 1);
+	g_assert_true (gcr_ssh_agent_service_lookup_key (test->service, public_key));
+
+	call_sign (test);
+
+	/* Signing is refused while locked */
+	call_lock (test);
+	egg_buffer_reset (&test->resp);
+	prepare_sign_request (&test->req);
+	call (test);
+	check_failure (&test->resp);
+	call_refused_while_locked (test);
+	call_unlock (test);
+	call_sign (test);
+
+	call_remove_identity (test);
+	g_assert_false (gcr_ssh_agent_service_lookup_key (test->service, public_key));
+
+	/* None of the above needed ssh-agent */
+	process = gcr_ssh_agent_service_get_process (test->service);
+	g_assert_cmpint (gcr_ssh_agent_process_get_pid (process), ==, 0);
+
+	g_bytes_unref (public_key);
+}
+
+static void
+test_native_remove_sign (Test *test, gconstpointer unused)
+{
+	GcrSshAgentStats *stats;
+	GBytes *public_key;
+	gchar *comment;
+
+	connect_to_server (test);
+
+	public_key = public_key_from_file (SRCDIR "/gcr/fixtures/ssh-agent/id_rsa_plain.pub", &comment);
+	g_free (comment);
+
+	/* The preloaded key is loaded into the native store */
+	call_sign (test);
+	g_assert_true (gcr_ssh_agent_service_lookup_key (test->service, public_key));
+
+	/* Once removed, it's loaded again for the next signature */
+	call_remove_identity (test);
+	g_assert_false (gcr_ssh_agent_service_lookup_key (test->service, public_key));
+	call_sign (test);
+	g_assert_true (gcr_ssh_agent_service_lookup_key (test->service, public_key));
+
+	call_remove_all_identities (test);
+	g_assert_false (gcr_ssh_agent_service_lookup_key (test->service, public_key));
+	call_sign (test);
+	g_assert_true (gcr_ssh_agent_service_lookup_key (test->service, public_key));
+
+	stats = gcr_ssh_agent_service_get_stats (test->service);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_timer_count (stats, GCR_SSH_AGENT_STATS_ENSURE_KEY), ==, 3);
+
+	g_bytes_unref (public_key);
+}
+
+static void
+test_native_relay (Test *test, gconstpointer unused)
+{
+	GcrSshAgentProcess *process;
+
+	connect_to_server (test);
+	process = gcr_ssh_agent_service_get_process (test->service);
+
+	/* While ssh-agent holds no keys, these are refused without it */
+	call_unknown (test);
+	call_extension (test);
+	call_sign_unknown (test);
+	call_request_identities (test, 1);
+	g_assert_cmpint (gcr_ssh_agent_process_get_pid (process), ==, 0);
+
+	/* A key the native store can't hold goes to ssh-agent */
+	call_add_identity_confirm (test);
+	g_assert_cmpint (gcr_ssh_agent_process_get_pid (process), !=, 0);
+	call_request_identities (test, 1);
+
+	/* Locking now goes through ssh-agent, and the store follows */
+	call_lock (test);
+	call_refused_while_locked (test);
+	call_unlock (test);
+	call_request_identities (test, 1);
+}
+
+static void
+test_stats (Test *test, gconstpointer unused)
+{
+	GcrSshAgentStats *stats;
+	GSocketClient *client;
+	GSocketAddress *address;
+	GSocketConnection *connection;
+	GInputStream *input;
+	GError *error = NULL;
+	gchar *contents;
+	gsize n_contents;
+	gchar *path;
+
+	stats = gcr_ssh_agent_service_get_stats (test->service);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_active_clients (stats), ==, 0);
+
+	connect_to_server (test);
+
+	call_request_identities (test, 1);
+	call_request_identities (test, 1);
+	call_sign (test);
+
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_op_count (stats, GCR_SSH_OP_REQUEST_IDENTITIES), ==, 2);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_op_count (stats, GCR_SSH_OP_SIGN_REQUEST), ==, 1);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_op_count (stats, GCR_SSH_OP_ADD_IDENTITY), ==, 0);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_timer_count (stats, GCR_SSH_AGENT_STATS_ENSURE_KEY), ==, 1);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_active_clients (stats), ==, 1);
+	g_assert_cmpuint (gcr_ssh_agent_stats_get_reconnects (stats), ==, 0);
+
+	/* The stats socket lives next to the agent socket */
+	path = g_build_filename (test->directory, "sockets", "ssh-stats", NULL);
+	address = g_unix_socket_address_new (path);
+	g_free (path);
+
+	client = g_socket_client_new ();
+	connection = g_socket_client_connect (client, G_SOCKET_CONNECTABLE (address), NULL, &error);
+	g_assert_no_error (error);
+	g_assert_nonnull (connection);
+
+	/* The whole dump is written before the connection is closed */
+	input = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+	contents = g_malloc0 (65536);
+	g_input_stream_read_all (input, contents, 65535, &n_contents, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_cmpuint (n_contents, >, 0);
+
+	g_assert_nonnull (strstr (contents, "gcr_ssh_agent_active_clients 1\n"));
+	g_assert_nonnull (strstr (contents, "gcr_ssh_agent_op_usec_count{op=\"REQUEST_IDENTITIES\"} 2\n"));
+	g_assert_nonnull (strstr (contents, "gcr_ssh_agent_op_usec_count{op=\"SIGN_REQUEST\"} 1\n"));
+
+	g_free (contents);
+	g_object_unref (connection);
+	g_object_unref (client);
+	g_object_unref (address);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -607,6 +890,7 @@ main (int argc, char **argv)
 	g_test_add ("/ssh-agent/service/remove_all", Test, NULL, setup, test_remove_all, teardown);
 	g_test_add ("/ssh-agent/service/sign_loaded", Test, NULL, setup, test_sign_loaded, teardown);
 	g_test_add ("/ssh-agent/service/sign", Test, NULL, setup, test_sign, teardown);
+	g_test_add ("/ssh-agent/service/sign_concurrent", Test, NULL, setup, test_sign_concurrent, teardown);
 	g_test_add ("/ssh-agent/service/sign_unknown", Test, NULL, setup, test_sign_unknown, teardown);
 	g_test_add ("/ssh-agent/service/empty", Test, NULL, setup, test_empty, teardown);
 	g_test_add ("/ssh-agent/service/unknown", Test, NULL, setup, test_unknown, teardown);
@@ -615,6 +899,10 @@ main (int argc, char **argv)
 	g_test_add ("/ssh-agent/service/unparseable_sign", Test, NULL, setup, test_unparseable_sign, teardown);
 	g_test_add ("/ssh-agent/service/restart", Test, NULL, setup, test_restart, teardown);
 	g_test_add ("/ssh-agent/service/lock", Test, NULL, setup, test_lock, teardown);
+	g_test_add ("/ssh-agent/service/stats", Test, NULL, setup, test_stats, teardown);
+	g_test_add ("/ssh-agent/service/native", Test, GINT_TO_POINTER (TRUE), setup, test_native, teardown);
+	g_test_add ("/ssh-agent/service/native_remove_sign", Test, GINT_TO_POINTER (TRUE), setup, test_native_remove_sign, teardown);
+	g_test_add ("/ssh-agent/service/native_relay", Test, GINT_TO_POINTER (TRUE), setup, test_native_relay, teardown);
 
 	return g_test_run ();
 }
@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include "gcr-ssh-agent-private.h"
 #include "gcr-ssh-agent-util.h"
 
 #include <glib.h>
@@ -107,6 +108,76 @@ test_canon_error (void)
 	g_free (p);
 }
 
+static void
+test_read_pipelined (void)
+{
+	static const guchar input[] = {
+		0x00, 0x00, 0x00, 0x01, GCR_SSH_OP_REQUEST_IDENTITIES,
+		0x00, 0x00, 0x00, 0x05, GCR_SSH_OP_LOCK, 0x00, 0x00, 0x00, 0x00,
+		0x00, 0x00, 0x00, 0x02, GCR_SSH_OP_REMOVE_ALL_IDENTITIES,
+	};
+	GInputStream *stream;
+	EggBuffer buffer;
+	EggBuffer secure;
+	EggBuffer *packet;
+	GError *error = NULL;
+	gboolean ret;
+
+	egg_buffer_init_full (&buffer, 16, (EggBufferAllocator)g_realloc);
+	egg_buffer_init_full (&secure, 16, (EggBufferAllocator)g_realloc);
+	stream = g_memory_input_stream_new_from_data (input, sizeof (input), NULL);
+
+	ret = _gcr_ssh_agent_read_packet_full (stream, &buffer, &secure, &packet, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_true (packet == &buffer);
+	g_assert_cmpuint (buffer.len, ==, 5);
+
+	/* Passphrases go to the secure buffer */
+	ret = _gcr_ssh_agent_read_packet_full (stream, &buffer, &secure, &packet, NULL, &error);
+	g_assert_no_error (error);
+	g_assert_true (ret);
+	g_assert_true (packet == &secure);
+	g_assert_cmpuint (secure.len, ==, 9);
+	g_assert_cmpuint (secure.buf[4], ==, GCR_SSH_OP_LOCK);
+
+	/* The last packet is truncated */
+	ret = _gcr_ssh_agent_read_packet_full (stream, &buffer, &secure, &packet, NULL, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CONNECTION_CLOSED);
+	g_assert_false (ret);
+	g_clear_error (&error);
+
+	g_object_unref (stream);
+	egg_buffer_uninit (&buffer);
+	egg_buffer_uninit (&secure);
+}
+
+static void
+test_read_oversized (void)
+{
+	static const guchar input[] = {
+		0xff, 0xff, 0xff, 0xf0, GCR_SSH_OP_ADD_IDENTITY,
+		0x00, 0x00, 0x00, 0x00,
+	};
+	GInputStream *stream;
+	EggBuffer buffer;
+	GError *error = NULL;
+	gboolean ret;
+
+	egg_buffer_init_full (&buffer, 16, (EggBufferAllocator)g_realloc);
+	stream = g_memory_input_stream_new_from_data (input, sizeof (input), NULL);
+
+	/* Rejected from the length alone, without allocating for it */
+	ret = _gcr_ssh_agent_read_packet_full (stream, &buffer, NULL, NULL, NULL, &error);
+	g_assert_error (error, G_IO_ERROR, G_IO_ERROR_FAILED);
+	g_assert_false (ret);
+	g_assert_cmpuint (buffer.allocated_len, <, GCR_SSH_MAX_PACKET_SIZE);
+	g_clear_error (&error);
+
+	g_object_unref (stream);
+	egg_buffer_uninit (&buffer);
+}
+
 int
 main (int argc, char **argv)
 {
@@ -114,6 +185,8 @@ main (int argc, char **argv)
 
 	g_test_add_func ("/ssh-agent/util/parse_public", test_parse_public);
 	g_test_add_func ("/ssh-agent/util/canon_error", test_canon_error);
+	g_test_add_func ("/ssh-agent/util/read_pipelined", test_read_pipelined);
+	g_test_add_func ("/ssh-agent/util/read_oversized", test_read_oversized);
 
 	return g_test_run ();
 }